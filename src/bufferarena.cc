@@ -0,0 +1,303 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "bufferarena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include <iostream>
+
+
+#define BUFFERARENA_MAGIC       0x4e504d41   // "NPMA"
+#define BUFFERARENA_LARGE_CLASS 0xffffffff
+
+
+__thread BufferArena::ThreadCache* BufferArena::MyThreadCache = NULL;
+
+
+// ###### Get the process-wide arena ########################################
+BufferArena* BufferArena::getBufferArena()
+{
+   // NOTE: The arena is never destroyed, since static objects (e.g. the
+   //       FlowManager singleton) may still release buffers at exit.
+   static BufferArena* arena = new BufferArena;
+   return(arena);
+}
+
+
+// ###### Constructor #######################################################
+BufferArena::BufferArena()
+{
+   for(unsigned int i = 0;i < BUFFERARENA_CLASSES;i++) {
+      FreeList[i] = NULL;
+   }
+   RegionPointer   = NULL;
+   RegionBytesLeft = 0;
+   Prefault        = false;
+   memset(&Stats, 0, sizeof(Stats));
+   const int result = pthread_key_create(&ThreadCacheKey, destroyThreadCache);
+   assert(result == 0);
+}
+
+
+// ###### Destructor ########################################################
+BufferArena::~BufferArena()
+{
+   pthread_key_delete(ThreadCacheKey);
+}
+
+
+// ###### Map a new region ##################################################
+bool BufferArena::mapRegion()
+{
+   const int populate = (Prefault == true) ? MAP_POPULATE : 0;
+   void*     region   = MAP_FAILED;
+
+   // ====== Try explicit huge pages ========================================
+#ifdef MAP_HUGETLB
+   region = mmap(NULL, BUFFERARENA_REGION_SIZE, PROT_READ|PROT_WRITE,
+                 MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|populate, -1, 0);
+   if(region != MAP_FAILED) {
+      Stats.HugeTLBBytes += BUFFERARENA_REGION_SIZE;
+   }
+#endif
+
+   // ====== Fall back to transparent huge pages ============================
+   if(region == MAP_FAILED) {
+      // Map twice the size, in order to get a huge-page aligned region.
+      char* area = (char*)mmap(NULL, 2 * BUFFERARENA_REGION_SIZE, PROT_READ|PROT_WRITE,
+                               MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+      if(area == (char*)MAP_FAILED) {
+         std::cerr << "ERROR: Unable to map buffer arena region - "
+                   << strerror(errno) << "!" << std::endl;
+         return(false);
+      }
+      char* aligned = (char*)(((uintptr_t)area + BUFFERARENA_REGION_SIZE - 1) &
+                              ~((uintptr_t)BUFFERARENA_REGION_SIZE - 1));
+      if(aligned > area) {
+         munmap(area, aligned - area);
+      }
+      const size_t tail = (area + 2 * BUFFERARENA_REGION_SIZE) - (aligned + BUFFERARENA_REGION_SIZE);
+      if(tail > 0) {
+         munmap(aligned + BUFFERARENA_REGION_SIZE, tail);
+      }
+      region = aligned;
+#ifdef MADV_HUGEPAGE
+      if(madvise(region, BUFFERARENA_REGION_SIZE, MADV_HUGEPAGE) == 0) {
+         Stats.TransparentBytes += BUFFERARENA_REGION_SIZE;
+      }
+#endif
+      if(Prefault) {
+         memset(region, 0, BUFFERARENA_REGION_SIZE);
+      }
+   }
+
+   Stats.MappedBytes += BUFFERARENA_REGION_SIZE;
+   RegionPointer   = (char*)region;
+   RegionBytesLeft = BUFFERARENA_REGION_SIZE;
+   return(true);
+}
+
+
+// ###### Get (or create) the calling thread's cache ########################
+BufferArena::ThreadCache* BufferArena::getThreadCache()
+{
+   if(MyThreadCache == NULL) {
+      MyThreadCache = new ThreadCache;
+      memset(MyThreadCache, 0, sizeof(ThreadCache));
+      pthread_setspecific(ThreadCacheKey, MyThreadCache);
+   }
+   return(MyThreadCache);
+}
+
+
+// ###### Return a terminating thread's cache to the global free lists ######
+void BufferArena::destroyThreadCache(void* cache)
+{
+   BufferArena* arena       = getBufferArena();
+   ThreadCache* threadCache = (ThreadCache*)cache;
+   for(unsigned int i = 0;i < BUFFERARENA_CLASSES;i++) {
+      arena->flush(threadCache, i, 0);
+   }
+   delete threadCache;
+   MyThreadCache = NULL;
+}
+
+
+// ###### Get chunks from the global free list or a region ##################
+BufferArena::FreeChunk* BufferArena::refill(const unsigned int sizeClass)
+{
+   const size_t chunkSize = sizeof(ChunkHeader) + getClassSize(sizeClass);
+   FreeChunk*   chunk     = NULL;
+
+   lock();
+   if( (FreeList[sizeClass] == NULL) && (RegionBytesLeft < chunkSize) ) {
+      // The region is exhausted for this class => keep the rest usable.
+      recycleRegionTail();
+   }
+   if(FreeList[sizeClass] != NULL) {
+      chunk               = FreeList[sizeClass];
+      FreeList[sizeClass] = chunk->Next;
+   }
+   else {
+      if( (RegionBytesLeft >= chunkSize) || (mapRegion()) ) {
+         ChunkHeader* header = (ChunkHeader*)RegionPointer;
+         header->SizeClass   = sizeClass;
+         header->Magic       = BUFFERARENA_MAGIC;
+         chunk               = (FreeChunk*)&header[1];
+         RegionPointer      += chunkSize;
+         RegionBytesLeft    -= chunkSize;
+      }
+   }
+   unlock();
+
+   return(chunk);
+}
+
+
+// ###### Put the unused tail of the current region on the free lists #######
+// Called with the arena locked, before a new region is mapped. The tail is
+// split into chunks of the largest classes fitting into it.
+void BufferArena::recycleRegionTail()
+{
+   for(int sizeClass = BUFFERARENA_CLASSES - 1;sizeClass >= 0;sizeClass--) {
+      const size_t chunkSize = sizeof(ChunkHeader) + getClassSize(sizeClass);
+      while(RegionBytesLeft >= chunkSize) {
+         ChunkHeader* header = (ChunkHeader*)RegionPointer;
+         header->SizeClass   = sizeClass;
+         header->Magic       = BUFFERARENA_MAGIC;
+         FreeChunk* chunk    = (FreeChunk*)&header[1];
+         chunk->Next         = FreeList[sizeClass];
+         FreeList[sizeClass] = chunk;
+         RegionPointer      += chunkSize;
+         RegionBytesLeft    -= chunkSize;
+      }
+   }
+}
+
+
+// ###### Move cached chunks to the global free list ########################
+void BufferArena::flush(ThreadCache* cache, const unsigned int sizeClass, const size_t keep)
+{
+   lock();
+   while(cache->FreeCount[sizeClass] > keep) {
+      FreeChunk* chunk               = cache->FreeList[sizeClass];
+      cache->FreeList[sizeClass]     = chunk->Next;
+      cache->FreeCount[sizeClass]--;
+      chunk->Next                    = FreeList[sizeClass];
+      FreeList[sizeClass]            = chunk;
+   }
+   unlock();
+}
+
+
+// ###### Allocate buffer ###################################################
+void* BufferArena::allocate(const size_t size)
+{
+   // ====== Find size class ================================================
+   unsigned int sizeClass = 0;
+   while( (sizeClass < BUFFERARENA_CLASSES) && (getClassSize(sizeClass) < size) ) {
+      sizeClass++;
+   }
+
+   // ====== Large buffer: not handled by the arena =========================
+   if(sizeClass >= BUFFERARENA_CLASSES) {
+      ChunkHeader* header = (ChunkHeader*)malloc(sizeof(ChunkHeader) + size);
+      if(header == NULL) {
+         return(NULL);
+      }
+      header->SizeClass = BUFFERARENA_LARGE_CLASS;
+      header->Magic     = BUFFERARENA_MAGIC;
+      __sync_fetch_and_add(&Stats.LargeAllocations, 1);
+      return(&header[1]);
+   }
+
+   // ====== Take buffer from thread cache or refill it =====================
+   ThreadCache* cache = getThreadCache();
+   FreeChunk*   chunk = cache->FreeList[sizeClass];
+   if(chunk != NULL) {
+      cache->FreeList[sizeClass] = chunk->Next;
+      cache->FreeCount[sizeClass]--;
+   }
+   else {
+      chunk = refill(sizeClass);
+      if(chunk == NULL) {
+         return(NULL);
+      }
+   }
+
+   // ====== Update statistics ==============================================
+   const unsigned long long bytesInUse =
+      __sync_add_and_fetch(&Stats.BytesInUse, getClassSize(sizeClass));
+   __sync_fetch_and_add(&Stats.BuffersInUse, 1);
+   __sync_fetch_and_add(&Stats.Allocations, 1);
+   unsigned long long peakBytesInUse = Stats.PeakBytesInUse;
+   while( (bytesInUse > peakBytesInUse) &&
+          (!__sync_bool_compare_and_swap(&Stats.PeakBytesInUse, peakBytesInUse, bytesInUse)) ) {
+      peakBytesInUse = Stats.PeakBytesInUse;
+   }
+   return(chunk);
+}
+
+
+// ###### Release buffer ####################################################
+void BufferArena::release(void* buffer)
+{
+   if(buffer == NULL) {
+      return;
+   }
+   ChunkHeader* header = &((ChunkHeader*)buffer)[-1];
+   assert(header->Magic == BUFFERARENA_MAGIC);
+
+   if(header->SizeClass == BUFFERARENA_LARGE_CLASS) {
+      free(header);
+      return;
+   }
+
+   const unsigned int sizeClass = header->SizeClass;
+   assert(sizeClass < BUFFERARENA_CLASSES);
+   __sync_fetch_and_sub(&Stats.BytesInUse, getClassSize(sizeClass));
+   __sync_fetch_and_sub(&Stats.BuffersInUse, 1);
+
+   ThreadCache* cache = getThreadCache();
+   FreeChunk*   chunk = (FreeChunk*)buffer;
+   chunk->Next                = cache->FreeList[sizeClass];
+   cache->FreeList[sizeClass] = chunk;
+   cache->FreeCount[sizeClass]++;
+   if(cache->FreeCount[sizeClass] > getCacheLimit(sizeClass)) {
+      flush(cache, sizeClass, getCacheLimit(sizeClass) / 2);
+   }
+}
+
+
+// ###### Get usage statistics ##############################################
+void BufferArena::getStatistics(Statistics& statistics)
+{
+   lock();
+   statistics = Stats;
+   unlock();
+}
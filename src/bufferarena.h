@@ -0,0 +1,173 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#ifndef BUFFERARENA_H
+#define BUFFERARENA_H
+
+#include "mutex.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <new>
+#include <limits>
+
+
+// The arena maps memory in regions of 2 MiB, preferably as explicit huge
+// pages (MAP_HUGETLB) with a fallback to transparent huge pages.
+#define BUFFERARENA_REGION_SIZE     (2 * 1024 * 1024)
+#define BUFFERARENA_MIN_CLASS_SHIFT 6                   // 64 B
+#define BUFFERARENA_MAX_CLASS_SHIFT 16                  // 64 KiB
+#define BUFFERARENA_CLASSES         (BUFFERARENA_MAX_CLASS_SHIFT - BUFFERARENA_MIN_CLASS_SHIFT + 1)
+
+
+class BufferArena : public Mutex
+{
+   // ====== Public Methods =================================================
+   public:
+   struct Statistics {
+      unsigned long long MappedBytes;          // All mapped regions
+      unsigned long long HugeTLBBytes;         // Regions with MAP_HUGETLB
+      unsigned long long TransparentBytes;     // Regions with THP advice
+      unsigned long long BuffersInUse;
+      unsigned long long BytesInUse;
+      unsigned long long PeakBytesInUse;
+      unsigned long long Allocations;
+      unsigned long long LargeAllocations;     // Not served by the arena
+   };
+
+   static BufferArena* getBufferArena();
+
+   void* allocate(const size_t size);
+   void release(void* buffer);
+   void getStatistics(Statistics& statistics);
+
+   inline void setPrefault(const bool prefault) {
+      lock();
+      Prefault = prefault;
+      unlock();
+   }
+
+
+   // ====== Private Methods ================================================
+   private:
+   BufferArena();
+   ~BufferArena();
+
+   struct ChunkHeader {
+      uint32_t SizeClass;
+      uint32_t Magic;
+      uint64_t Padding;   // Keeps the buffer 16-byte aligned
+   };
+   struct FreeChunk {
+      FreeChunk* Next;
+   };
+   struct ThreadCache {
+      FreeChunk* FreeList[BUFFERARENA_CLASSES];
+      size_t     FreeCount[BUFFERARENA_CLASSES];
+   };
+
+   static inline size_t getClassSize(const unsigned int sizeClass) {
+      return((size_t)1 << (sizeClass + BUFFERARENA_MIN_CLASS_SHIFT));
+   }
+   static inline size_t getCacheLimit(const unsigned int sizeClass) {
+      // Keep at most 256 KiB (but at least 4 buffers) per class and thread
+      const size_t limit = (256 * 1024) / getClassSize(sizeClass);
+      return((limit < 4) ? 4 : limit);
+   }
+   static void destroyThreadCache(void* cache);
+
+   ThreadCache* getThreadCache();
+   FreeChunk* refill(const unsigned int sizeClass);
+   void recycleRegionTail();
+   void flush(ThreadCache* cache, const unsigned int sizeClass, const size_t keep);
+   bool mapRegion();
+
+
+   // ====== Private Data ===================================================
+   static __thread ThreadCache* MyThreadCache;
+
+   pthread_key_t ThreadCacheKey;
+   FreeChunk*    FreeList[BUFFERARENA_CLASSES];   // Global free lists
+   char*         RegionPointer;                   // Current region's free space
+   size_t        RegionBytesLeft;
+   bool          Prefault;
+   Statistics    Stats;
+};
+
+
+// ###### STL allocator for containers in the data path #####################
+template<class T> class ArenaAllocator
+{
+   public:
+   typedef T              value_type;
+   typedef T*             pointer;
+   typedef const T*       const_pointer;
+   typedef T&             reference;
+   typedef const T&       const_reference;
+   typedef size_t         size_type;
+   typedef ptrdiff_t      difference_type;
+   template<class U> struct rebind {
+      typedef ArenaAllocator<U> other;
+   };
+
+   inline ArenaAllocator() { }
+   inline ArenaAllocator(const ArenaAllocator&) { }
+   template<class U> inline ArenaAllocator(const ArenaAllocator<U>&) { }
+
+   inline pointer address(reference x) const {
+      return(&x);
+   }
+   inline const_pointer address(const_reference x) const {
+      return(&x);
+   }
+   inline pointer allocate(size_type n, const void* = 0) {
+      void* buffer = BufferArena::getBufferArena()->allocate(n * sizeof(T));
+      if(buffer == NULL) {
+         throw std::bad_alloc();
+      }
+      return((pointer)buffer);
+   }
+   inline void deallocate(pointer p, size_type) {
+      BufferArena::getBufferArena()->release(p);
+   }
+   inline size_type max_size() const {
+      return(std::numeric_limits<size_type>::max() / sizeof(T));
+   }
+   inline void construct(pointer p, const T& value) {
+      new((void*)p) T(value);
+   }
+   inline void destroy(pointer p) {
+      p->~T();
+   }
+};
+
+template<class T, class U> inline bool operator==(const ArenaAllocator<T>&, const ArenaAllocator<U>&) {
+   return(true);
+}
+template<class T, class U> inline bool operator!=(const ArenaAllocator<T>&, const ArenaAllocator<U>&) {
+   return(false);
+}
+
+#endif
@@ -23,6 +23,8 @@
 
 #include "control.h"
 #include "tools.h"
+#include "frametrace.h"
+#include "empiricaldistribution.h"
 
 #include <string.h>
 #include <math.h>
@@ -30,6 +32,8 @@
 #include <assert.h>
 
 #include <iostream>
+#include <map>
+#include <set>
 
 
 unsigned int         gOutputVerbosity = 9;
@@ -50,9 +54,8 @@ static bool downloadOutputFile(MessageReader* messageReader,
                                const int      controlSocket,
                                const char*    fileName)
 {
-   char                 messageBuffer[sizeof(NetPerfMeterResults) +
-                                      NETPERFMETER_RESULTS_MAX_DATA_LENGTH];
-   NetPerfMeterResults* resultsMsg = (NetPerfMeterResults*)&messageBuffer;
+   const char*                message;
+   const NetPerfMeterResults* resultsMsg;
 
    FILE* fh = fopen(fileName, "w");
    if(fh == NULL) {
@@ -61,9 +64,10 @@ static bool downloadOutputFile(MessageReader* messageReader,
       return(false);
    }
    bool success = false;
-   ssize_t received = gMessageReader.receiveMessage(controlSocket, resultsMsg, sizeof(messageBuffer));
+   ssize_t received = gMessageReader.receiveMessageView(controlSocket, &message);
    while( (received == MRRM_PARTIAL_READ) || (received >= (ssize_t)sizeof(NetPerfMeterResults)) ) {
       if(received > 0) {
+         resultsMsg = (const NetPerfMeterResults*)message;
          const size_t bytes = ntohs(resultsMsg->Header.Length);
          if(resultsMsg->Header.Type != NETPERFMETER_RESULTS) {
             std::cerr << "ERROR: Received unexpected message type "
@@ -80,7 +84,7 @@ static bool downloadOutputFile(MessageReader* messageReader,
          }
 
          if(bytes > sizeof(NetPerfMeterResults)) {
-            if(fwrite((char*)&resultsMsg->Data, bytes - sizeof(NetPerfMeterResults), 1, fh) != 1) {
+            if(fwrite((const char*)&resultsMsg->Data, bytes - sizeof(NetPerfMeterResults), 1, fh) != 1) {
                std::cerr << "ERROR: Unable to write results to file " << fileName
                          << " - " << strerror(errno) << "!" << std::endl;
                exit(1);
@@ -99,7 +103,7 @@ static bool downloadOutputFile(MessageReader* messageReader,
             break;
          }
       }
-      received = gMessageReader.receiveMessage(controlSocket, resultsMsg, sizeof(messageBuffer));
+      received = gMessageReader.receiveMessageView(controlSocket, &message);
    }
    if(!success) {
       std::cerr << std::endl
@@ -149,9 +153,96 @@ bool performNetPerfMeterAddFlow(MessageReader* messageReader,
                                 int            controlSocket,
                                 const Flow*    flow)
 {
+   // ====== Prepare inbound trace extension ================================
+   std::string extensions;
+   if(flow->getTrafficSpec().InboundTrace != "") {
+      FrameTrace  trace;
+      std::string traceData;
+      if(!trace.initialize(flow->getTrafficSpec().InboundTrace.c_str(), 1.0, false)) {
+         return(false);
+      }
+      // Small traces are sent inline, larger ones by reference.
+      const bool inlineTrace =
+         trace.encode(traceData, NETPERFMETER_TRACE_INLINE_MAX);
+      if(!inlineTrace) {
+         traceData = flow->getTrafficSpec().InboundTrace;
+         if(gOutputVerbosity >= NPFOV_CONNECTIONS) {
+            std::cout << "<trace by reference> "; std::cout.flush();
+         }
+      }
+      NetPerfMeterTraceExtension traceExtension;
+      traceExtension.Header.Type   = (inlineTrace) ? NPMAFE_TRACE_DATA : NPMAFE_TRACE_FILE;
+      traceExtension.Header.Flags  = (flow->getTrafficSpec().TraceLoop) ? NPMAFEF_TRACE_LOOP : 0x00;
+      traceExtension.Header.Length = htons(sizeof(traceExtension) + traceData.size());
+      traceExtension.TimeScale     = htonl((uint32_t)rint(flow->getTrafficSpec().TraceScale * 1000000.0));
+      extensions.append((const char*)&traceExtension, sizeof(traceExtension));
+      extensions.append(traceData);
+   }
+
+   // ====== Prepare empirical distribution extensions ======================
+   std::set<unsigned int> distributions;
+   if(flow->getTrafficSpec().InboundFrameRateRng == RANDOM_EMPIRICAL) {
+      distributions.insert((unsigned int)flow->getTrafficSpec().InboundFrameRate[1]);
+   }
+   if(flow->getTrafficSpec().InboundFrameSizeRng == RANDOM_EMPIRICAL) {
+      distributions.insert((unsigned int)flow->getTrafficSpec().InboundFrameSize[1]);
+   }
+   for(std::vector<OnOffEvent>::const_iterator iterator = flow->getTrafficSpec().OnOffEvents.begin();
+       iterator != flow->getTrafficSpec().OnOffEvents.end();iterator++) {
+      if((*iterator).RandNumGen == RANDOM_EMPIRICAL) {
+         distributions.insert((unsigned int)(*iterator).ValueArray[1]);
+      }
+   }
+   for(std::set<unsigned int>::const_iterator iterator = distributions.begin();
+       iterator != distributions.end(); iterator++) {
+      const EmpiricalDistribution* distribution =
+         EmpiricalDistribution::getDistribution(*iterator);
+      assert(distribution != NULL);
+      const size_t extensionLength = sizeof(NetPerfMeterDistributionExtension) +
+                                        distribution->getEntries() * sizeof(NetPerfMeterDistributionEntry);
+      if(extensionLength > 65535) {
+         std::cerr << "ERROR: Distribution " << distribution->getName()
+                   << " has too many entries!" << std::endl;
+         return(false);
+      }
+      NetPerfMeterDistributionExtension distributionExtension;
+      distributionExtension.Header.Type   = NPMAFE_DISTRIBUTION;
+      distributionExtension.Header.Flags  = 0x00;
+      distributionExtension.Header.Length = htons(extensionLength);
+      distributionExtension.Identifier    = htonl(*iterator);
+      extensions.append((const char*)&distributionExtension, sizeof(distributionExtension));
+      for(size_t i = 0;i < distribution->getEntries();i++) {
+         NetPerfMeterDistributionEntry entry;
+         entry.Value  = doubleToNetwork(distribution->getValue(i));
+         entry.Weight = doubleToNetwork(distribution->getWeight(i));
+         extensions.append((const char*)&entry, sizeof(entry));
+      }
+   }
+
+   // ====== Prepare ABR ladder extension ===================================
+   if(flow->getTrafficSpec().ABRLadder.size() > 0) {
+      const std::vector<unsigned int>& ladder = flow->getTrafficSpec().ABRLadder;
+      NetPerfMeterABRExtension abrExtension;
+      abrExtension.Header.Type     = NPMAFE_ABR_LADDER;
+      abrExtension.Header.Flags    = 0x00;
+      abrExtension.Header.Length   = htons(sizeof(abrExtension) + ladder.size() * sizeof(uint32_t));
+      abrExtension.SegmentDuration = htonl((uint32_t)rint(flow->getTrafficSpec().SegmentDuration * 1000000.0));
+      extensions.append((const char*)&abrExtension, sizeof(abrExtension));
+      for(size_t i = 0;i < ladder.size();i++) {
+         const uint32_t bitrate = htonl(ladder[i]);
+         extensions.append((const char*)&bitrate, sizeof(bitrate));
+      }
+   }
+
    // ====== Sent NETPERFMETER_ADD_FLOW to remote node ======================
    const size_t                addFlowMsgSize = sizeof(NetPerfMeterAddFlowMessage) +
-                                                   (sizeof(NetPerfMeterOnOffEvent) * flow->getTrafficSpec().OnOffEvents.size());
+                                                   (sizeof(NetPerfMeterOnOffEvent) * flow->getTrafficSpec().OnOffEvents.size()) +
+                                                   extensions.size();
+   if(addFlowMsgSize > 65535) {
+      std::cerr << "ERROR: NETPERFMETER_ADD_FLOW message for flow #" << flow->getFlowID()
+                << " is too large!" << std::endl;
+      return(false);
+   }
    char                        addFlowMsgBuffer[addFlowMsgSize];
    NetPerfMeterAddFlowMessage* addFlowMsg = (NetPerfMeterAddFlowMessage*)&addFlowMsgBuffer;
    addFlowMsg->Header.Type   = NETPERFMETER_ADD_FLOW;
@@ -165,6 +256,12 @@ bool performNetPerfMeterAddFlow(MessageReader* messageReader,
    if(flow->getTrafficSpec().RepeatOnOff == true) {
       addFlowMsg->Header.Flags |= NPMAFF_REPEATONOFF;
    }
+   if(flow->getTrafficSpec().RPC == true) {
+      addFlowMsg->Header.Flags |= NPMAFF_RPC;
+   }
+   if(flow->getTrafficSpec().Probe == true) {
+      addFlowMsg->Header.Flags |= NPMAFF_PROBE;
+   }
 
    addFlowMsg->Header.Length = htons(addFlowMsgSize);
    addFlowMsg->MeasurementID = hton64(flow->getMeasurementID());
@@ -220,6 +317,8 @@ bool performNetPerfMeterAddFlow(MessageReader* messageReader,
            std::min(sizeof(addFlowMsg->Scheduler), flow->getTrafficSpec().Scheduler.size()));
 
    addFlowMsg->NDiffPorts = htons(flow->getTrafficSpec().NDiffPorts);
+   memcpy(&addFlowMsgBuffer[addFlowMsgSize - extensions.size()],
+          extensions.data(), extensions.size());
 
    sctp_sndrcvinfo sinfo;
    memset(&sinfo, 0, sizeof(sinfo));
@@ -258,7 +357,8 @@ bool performNetPerfMeterIdentifyFlow(MessageReader* messageReader,
    unsigned int maxTrials = 1;
    if( (flow->getTrafficSpec().Protocol != IPPROTO_SCTP) &&
        (flow->getTrafficSpec().Protocol != IPPROTO_TCP) &&
-       (flow->getTrafficSpec().Protocol != IPPROTO_MPTCP) ) {
+       (flow->getTrafficSpec().Protocol != IPPROTO_MPTCP) &&
+       (!isLocalProtocol(flow->getTrafficSpec().Protocol)) ) {
       // SCTP and TCP are reliable transport protocols => no retransmissions
       maxTrials = IDENTIFY_MAX_TRIALS;
    }
@@ -290,6 +390,12 @@ bool performNetPerfMeterIdentifyFlow(MessageReader* messageReader,
             return(false);
          }
       }
+      else if(flow->getTrafficSpec().Protocol == IPPROTO_SHM) {
+         if(flow->getShmRing()->send(flow->getSocketDescriptor(),
+                                     &identifyMsg, sizeof(identifyMsg)) <= 0) {
+            return(false);
+         }
+      }
       else {
          if(ext_send(flow->getSocketDescriptor(), &identifyMsg, sizeof(identifyMsg), 0) <= 0) {
             return(false);
@@ -309,17 +415,60 @@ bool performNetPerfMeterIdentifyFlow(MessageReader* messageReader,
 }
 
 
+// ###### Append flow schedule extension ####################################
+static void appendScheduleExtension(std::string&       extensions,
+                                    const std::string& schedules)
+{
+   NetPerfMeterScheduleExtension scheduleExtension;
+   scheduleExtension.Header.Type   = NPMSE_SCHEDULE;
+   scheduleExtension.Header.Flags  = 0x00;
+   scheduleExtension.Header.Length = htons(sizeof(scheduleExtension) + schedules.size());
+   extensions.append((const char*)&scheduleExtension, sizeof(scheduleExtension));
+   extensions.append(schedules);
+}
+
+
+// ###### Send NETPERFMETER_START message ###################################
+static bool sendNetPerfMeterStart(int                controlSocket,
+                                  const uint64_t     measurementID,
+                                  const uint8_t      flags,
+                                  const std::string& extensions)
+{
+   const size_t startMsgSize = sizeof(NetPerfMeterStartMessage) + extensions.size();
+   if(startMsgSize > 65535) {
+      std::cerr << "ERROR: NETPERFMETER_START message is too large!" << std::endl;
+      return(false);
+   }
+   NetPerfMeterStartMessage startMsg;
+   startMsg.Header.Type   = NETPERFMETER_START;
+   startMsg.Header.Flags  = flags;
+   startMsg.Header.Length = htons(startMsgSize);
+   startMsg.Padding       = 0x00000000;
+   startMsg.MeasurementID = hton64(measurementID);
+   std::string startMsgBuffer((const char*)&startMsg, sizeof(startMsg));
+   startMsgBuffer.append(extensions);
+
+   sctp_sndrcvinfo sinfo;
+   memset(&sinfo, 0, sizeof(sinfo));
+   sinfo.sinfo_ppid = htonl(PPID_NETPERFMETER_CONTROL);
+   return(sctp_send(controlSocket, startMsgBuffer.data(), startMsgBuffer.size(), &sinfo, 0) >= 0);
+}
+
+
 // ###### Start measurement #################################################
-bool performNetPerfMeterStart(MessageReader*         messageReader,
-                              int                    controlSocket,
-                              const uint64_t         measurementID,
-                              const char*            activeNodeName,
-                              const char*            passiveNodeName,
-                              const char*            configName,
-                              const char*            vectorNamePattern,
-                              const OutputFileFormat vectorFileFormat,
-                              const char*            scalarNamePattern,
-                              const OutputFileFormat scalarFileFormat)
+bool performNetPerfMeterStart(MessageReader*           messageReader,
+                              int                      controlSocket,
+                              const uint64_t           measurementID,
+                              const char*              activeNodeName,
+                              const char*              passiveNodeName,
+                              const char*              configName,
+                              const char*              vectorNamePattern,
+                              const OutputFileFormat   vectorFileFormat,
+                              const char*              scalarNamePattern,
+                              const OutputFileFormat   scalarFileFormat,
+                              const unsigned long long warmUp,
+                              const unsigned long long coolDownOffset,
+                              const unsigned long long startTime)
 {
    // ====== Write config file ==============================================
    FILE* configFile = NULL;
@@ -395,36 +544,93 @@ bool performNetPerfMeterStart(MessageReader*         messageReader,
                            measurementID, getMicroTime(),
                            vectorNamePattern, vectorFileFormat,
                            scalarNamePattern, scalarFileFormat,
+                           warmUp, coolDownOffset, startTime,
                            (gOutputVerbosity >= NPFOV_FLOWS));
    if(success) {
-      // ====== Tell passive node to start measurement ======================
-      NetPerfMeterStartMessage startMsg;
-      startMsg.Header.Type   = NETPERFMETER_START;
-      startMsg.Header.Length = htons(sizeof(startMsg));
-      startMsg.Padding       = 0x00000000;
-      startMsg.MeasurementID = hton64(measurementID);
-      startMsg.Header.Flags  = 0x00;
+      // ====== Prepare flow schedule =======================================
+      std::string schedules;
+      FlowManager::getFlowManager()->lock();
+      for(std::vector<Flow*>::iterator iterator = FlowManager::getFlowManager()->getFlowSet().begin();
+          iterator != FlowManager::getFlowManager()->getFlowSet().end(); iterator++) {
+         const Flow* flow = *iterator;
+         if( (flow->getMeasurementID() == measurementID) &&
+             ((flow->getStartOffset() > 0) || (flow->getStopOffset() > 0)) ) {
+            NetPerfMeterFlowSchedule schedule;
+            schedule.FlowID      = htonl(flow->getFlowID());
+            schedule.StreamID    = htons(flow->getStreamID());
+            schedule.Padding     = 0x0000;
+            schedule.StartOffset = hton64(flow->getStartOffset());
+            schedule.StopOffset  = hton64(flow->getStopOffset());
+            schedules.append((const char*)&schedule, sizeof(schedule));
+         }
+      }
+      FlowManager::getFlowManager()->unlock();
+
+      uint8_t flags = 0x00;
       if(scalarNamePattern[0] == 0x00) {
-         startMsg.Header.Flags |= NPMSF_NO_SCALARS;
+         flags |= NPMSF_NO_SCALARS;
       }
       if(hasSuffix(scalarNamePattern, ".bz2")) {
-         startMsg.Header.Flags |= NPMSF_COMPRESS_SCALARS;
+         flags |= NPMSF_COMPRESS_SCALARS;
       }
       if(vectorNamePattern[0] == 0x00) {
-         startMsg.Header.Flags |= NPMSF_NO_VECTORS;
+         flags |= NPMSF_NO_VECTORS;
       }
       if(hasSuffix(vectorNamePattern, ".bz2")) {
-         startMsg.Header.Flags |= NPMSF_COMPRESS_VECTORS;
+         flags |= NPMSF_COMPRESS_VECTORS;
       }
 
-      sctp_sndrcvinfo sinfo;
-      memset(&sinfo, 0, sizeof(sinfo));
-      sinfo.sinfo_ppid = htonl(PPID_NETPERFMETER_CONTROL);
-
       if(gOutputVerbosity >= NPFOV_STATUS) {
          std::cout << "Starting measurement ... <S1> "; std::cout.flush();
       }
-      if(sctp_send(controlSocket, &startMsg, sizeof(startMsg), &sinfo, 0) < 0) {
+
+      // ====== Send schedule in parts, if necessary ========================
+      // The NETPERFMETER_START message length is limited to 64 KiB.
+      const size_t maxScheduleSize = NETPERFMETER_SCHEDULE_MAX_ENTRIES * sizeof(NetPerfMeterFlowSchedule);
+      size_t       scheduleOffset  = 0;
+      while(schedules.size() - scheduleOffset > maxScheduleSize) {
+         std::string extensions;
+         appendScheduleExtension(extensions, schedules.substr(scheduleOffset, maxScheduleSize));
+         scheduleOffset += maxScheduleSize;
+         if( (sendNetPerfMeterStart(controlSocket, measurementID,
+                                    flags | NPMSF_CONTINUED, extensions) == false) ||
+             (awaitNetPerfMeterAcknowledge(messageReader, controlSocket,
+                                           measurementID, 0, 0) == false) ) {
+            return(false);
+         }
+      }
+
+      // ====== Prepare remaining flow schedule extension ===================
+      std::string extensions;
+      if(schedules.size() > scheduleOffset) {
+         appendScheduleExtension(extensions, schedules.substr(scheduleOffset));
+      }
+
+      // ====== Prepare statistics window extension =========================
+      if( (warmUp > 0) || (coolDownOffset > 0) ) {
+         NetPerfMeterStatisticsWindowExtension windowExtension;
+         windowExtension.Header.Type    = NPMSE_STATISTICS_WINDOW;
+         windowExtension.Header.Flags   = 0x00;
+         windowExtension.Header.Length  = htons(sizeof(windowExtension));
+         windowExtension.Padding        = 0x00000000;
+         windowExtension.WarmUp         = hton64(warmUp);
+         windowExtension.CoolDownOffset = hton64(coolDownOffset);
+         extensions.append((const char*)&windowExtension, sizeof(windowExtension));
+      }
+
+      // ====== Prepare start time extension ================================
+      if(startTime > 0) {
+         NetPerfMeterStartTimeExtension startTimeExtension;
+         startTimeExtension.Header.Type   = NPMSE_START_TIME;
+         startTimeExtension.Header.Flags  = 0x00;
+         startTimeExtension.Header.Length = htons(sizeof(startTimeExtension));
+         startTimeExtension.Padding       = 0x00000000;
+         startTimeExtension.StartTime     = hton64(startTime);
+         extensions.append((const char*)&startTimeExtension, sizeof(startTimeExtension));
+      }
+
+      // ====== Tell passive node to start measurement ======================
+      if(sendNetPerfMeterStart(controlSocket, measurementID, flags, extensions) == false) {
          return(false);
       }
       if(gOutputVerbosity >= NPFOV_STATUS) {
@@ -608,30 +814,32 @@ bool awaitNetPerfMeterAcknowledge(MessageReader* messageReader,
    }
 
    // ====== Read NETPERFMETER_ACKNOWLEDGE message ==========================
-   NetPerfMeterAcknowledgeMessage ackMsg;
-   ssize_t                        received;
+   const char* message;
+   ssize_t     received;
    do {
-      received = gMessageReader.receiveMessage(controlSocket, &ackMsg, sizeof(ackMsg));
+      received = gMessageReader.receiveMessageView(controlSocket, &message);
    } while(received == MRRM_PARTIAL_READ);
-   if(received < (ssize_t)sizeof(ackMsg)) {
+   if(received < (ssize_t)sizeof(NetPerfMeterAcknowledgeMessage)) {
       return(false);
    }
-   if(ackMsg.Header.Type != NETPERFMETER_ACKNOWLEDGE) {
-      std::cerr << "ERROR: Received message type " << (unsigned int)ackMsg.Header.Type
+   const NetPerfMeterAcknowledgeMessage* ackMsg =
+      (const NetPerfMeterAcknowledgeMessage*)message;
+   if(ackMsg->Header.Type != NETPERFMETER_ACKNOWLEDGE) {
+      std::cerr << "ERROR: Received message type " << (unsigned int)ackMsg->Header.Type
                 << " instead of NETPERFMETER_ACKNOWLEDGE!" << std::endl;
       return(false);
    }
 
    // ====== Check whether NETPERFMETER_ACKNOWLEDGE is okay =================
-   if( (ntoh64(ackMsg.MeasurementID) != measurementID) ||
-       (ntohl(ackMsg.FlowID) != flowID) ||
-       (ntohs(ackMsg.StreamID) != streamID) ) {
+   if( (ntoh64(ackMsg->MeasurementID) != measurementID) ||
+       (ntohl(ackMsg->FlowID) != flowID) ||
+       (ntohs(ackMsg->StreamID) != streamID) ) {
       std::cerr << "ERROR: Received NETPERFMETER_ACKNOWLEDGE for wrong measurement/flow/stream!"
                 << std::endl;
       return(false);
    }
 
-   const uint32_t status = ntohl(ackMsg.Status);
+   const uint32_t status = ntohl(ackMsg->Status);
    if(gOutputVerbosity >= NPFOV_CONNECTIONS) {
       std::cout << "<status=" << status << "> ";
       std::cout.flush();
@@ -731,6 +939,33 @@ static bool uploadResults(const int controlSocket,
 }
 
 
+// ###### Replace remote distribution identifier by local one ###############
+static bool mapDistribution(const std::map<unsigned int, unsigned int>& distributions,
+                            double*                                     valueArray,
+                            const uint8_t                               rng)
+{
+   if(rng == RANDOM_EMPIRICAL) {
+      std::map<unsigned int, unsigned int>::const_iterator found =
+         distributions.find((unsigned int)valueArray[1]);
+      if( (found == distributions.end()) || (found->second == 0) ) {
+         return(false);
+      }
+      valueArray[1] = found->second;
+   }
+   return(true);
+}
+
+
+// ###### Release references to received distributions ######################
+static void releaseDistributions(const std::map<unsigned int, unsigned int>& distributions)
+{
+   for(std::map<unsigned int, unsigned int>::const_iterator iterator = distributions.begin();
+       iterator != distributions.end(); iterator++) {
+      EmpiricalDistribution::releaseDistribution(iterator->second);
+   }
+}
+
+
 // ###### Handle NETPERFMETER_ADD_FLOW ######################################
 static bool handleNetPerfMeterAddFlow(MessageReader*                    messageReader,
                                       const int                         controlSocket,
@@ -783,6 +1018,8 @@ static bool handleNetPerfMeterAddFlow(MessageReader*                    messageR
       trafficSpec.NoDelay                  = (addFlowMsg->Header.Flags & NPMAFF_NODELAY);
       trafficSpec.Debug                    = (addFlowMsg->Header.Flags & NPMAFF_DEBUG);
       trafficSpec.RepeatOnOff              = (addFlowMsg->Header.Flags & NPMAFF_REPEATONOFF);
+      trafficSpec.RPC                      = (addFlowMsg->Header.Flags & NPMAFF_RPC);
+      trafficSpec.Probe                    = (addFlowMsg->Header.Flags & NPMAFF_PROBE);
       trafficSpec.RetransmissionTrials     = ntohl(addFlowMsg->RetransmissionTrials) & ~NPMAF_RTX_TRIALS_IN_MILLISECONDS;
       trafficSpec.RetransmissionTrialsInMS = (ntohl(addFlowMsg->RetransmissionTrials) & NPMAF_RTX_TRIALS_IN_MILLISECONDS);
       if( (trafficSpec.RetransmissionTrialsInMS) && (trafficSpec.RetransmissionTrials == 0x7fffffff) ) {
@@ -817,9 +1054,102 @@ static bool handleNetPerfMeterAddFlow(MessageReader*                    messageR
 
       trafficSpec.NDiffPorts = ntohs(addFlowMsg->NDiffPorts);
 
-      Flow* flow = new Flow(ntoh64(addFlowMsg->MeasurementID), ntohl(addFlowMsg->FlowID),
-                            ntohs(addFlowMsg->StreamID), trafficSpec,
-                            controlSocket);
+      // ====== Handle extensions ===========================================
+      std::map<unsigned int, unsigned int> distributions;
+      size_t offset = sizeof(NetPerfMeterAddFlowMessage) +
+                         (startStopEvents * sizeof(NetPerfMeterOnOffEvent));
+      while(offset + sizeof(NetPerfMeterHeader) <= received) {
+         const NetPerfMeterHeader* extension =
+            (const NetPerfMeterHeader*)&((const char*)addFlowMsg)[offset];
+         const size_t length = ntohs(extension->Length);
+         if( (length < sizeof(NetPerfMeterHeader)) || (offset + length > received) ) {
+            std::cerr << "ERROR: Received malformed NETPERFMETER_ADD_FLOW control message "
+                         "(bad extension)!" << std::endl;
+            releaseDistributions(distributions);
+            return(false);
+         }
+         if( ((extension->Type == NPMAFE_TRACE_DATA) || (extension->Type == NPMAFE_TRACE_FILE)) &&
+             (length >= sizeof(NetPerfMeterTraceExtension)) ) {
+            const NetPerfMeterTraceExtension* traceExtension =
+               (const NetPerfMeterTraceExtension*)extension;
+            const std::string traceData((const char*)&traceExtension->Data,
+                                        length - sizeof(NetPerfMeterTraceExtension));
+            if(extension->Type == NPMAFE_TRACE_DATA) {
+               trafficSpec.OutboundTraceData = traceData;
+               trafficSpec.OutboundTrace     = "(inline)";
+            }
+            else {
+               trafficSpec.OutboundTrace = traceData;
+            }
+            trafficSpec.TraceScale = ntohl(traceExtension->TimeScale) / 1000000.0;
+            trafficSpec.TraceLoop  = (extension->Flags & NPMAFEF_TRACE_LOOP);
+         }
+         else if( (extension->Type == NPMAFE_DISTRIBUTION) &&
+                  (length >= sizeof(NetPerfMeterDistributionExtension)) ) {
+            const NetPerfMeterDistributionExtension* distributionExtension =
+               (const NetPerfMeterDistributionExtension*)extension;
+            const size_t entries = (length - sizeof(NetPerfMeterDistributionExtension)) /
+                                      sizeof(NetPerfMeterDistributionEntry);
+            std::vector<double> values(entries);
+            std::vector<double> weights(entries);
+            for(size_t i = 0;i < entries;i++) {
+               values[i]  = networkToDouble(distributionExtension->Entry[i].Value);
+               weights[i] = networkToDouble(distributionExtension->Entry[i].Weight);
+            }
+            EmpiricalDistribution* distribution = new EmpiricalDistribution;
+            if(distribution->initialize(values, weights)) {
+               unsigned int& identifier = distributions[ntohl(distributionExtension->Identifier)];
+               EmpiricalDistribution::releaseDistribution(identifier);
+               identifier = EmpiricalDistribution::registerDistribution(distribution);
+            }
+            else {
+               delete distribution;
+            }
+         }
+         else if( (extension->Type == NPMAFE_ABR_LADDER) &&
+                  (length >= sizeof(NetPerfMeterABRExtension)) ) {
+            const NetPerfMeterABRExtension* abrExtension =
+               (const NetPerfMeterABRExtension*)extension;
+            const size_t entries = (length - sizeof(NetPerfMeterABRExtension)) / sizeof(uint32_t);
+            trafficSpec.ABRLadder.clear();
+            for(size_t i = 0;i < std::min(entries, (size_t)NETPERFMETER_ABR_LADDER_MAX);i++) {
+               trafficSpec.ABRLadder.push_back(ntohl(abrExtension->Bitrate[i]));
+            }
+            trafficSpec.SegmentDuration = ntohl(abrExtension->SegmentDuration) / 1000000.0;
+         }
+         // Unknown extensions are ignored.
+         offset += length;
+      }
+
+      // ====== Map distribution identifiers to local ones ==================
+      bool success = mapDistribution(distributions, trafficSpec.OutboundFrameRate,
+                                     trafficSpec.OutboundFrameRateRng) &&
+                     mapDistribution(distributions, trafficSpec.OutboundFrameSize,
+                                     trafficSpec.OutboundFrameSizeRng);
+      for(std::vector<OnOffEvent>::iterator iterator = trafficSpec.OnOffEvents.begin();
+          iterator != trafficSpec.OnOffEvents.end(); iterator++) {
+         success = success && mapDistribution(distributions, (*iterator).ValueArray,
+                                              (*iterator).RandNumGen);
+      }
+      Flow* flow = NULL;
+      if(success) {
+         flow = new Flow(ntoh64(addFlowMsg->MeasurementID), ntohl(addFlowMsg->FlowID),
+                         ntohs(addFlowMsg->StreamID), trafficSpec,
+                         controlSocket);
+      }
+      // The flow holds its own references to the distributions it uses.
+      releaseDistributions(distributions);
+      if(!success) {
+         std::cerr << "ERROR: NETPERFMETER_ADD_FLOW refers to unknown distribution!"
+                   << std::endl;
+         return(sendNetPerfMeterAcknowledge(controlSocket,
+                                            measurementID, flowID, streamID,
+                                            NETPERFMETER_STATUS_ERROR));
+      }
+      if( (flow != NULL) && (!flow->loadTrace()) ) {
+         delete flow;
+         flow = NULL;
+      }
       return(sendNetPerfMeterAcknowledge(controlSocket,
                                          measurementID, flowID, streamID,
                                          (flow != NULL) ? NETPERFMETER_STATUS_OKAY :
@@ -877,7 +1207,8 @@ static bool handleNetPerfMeterStart(MessageReader*                  messageReade
    }
    const uint64_t measurementID = ntoh64(startMsg->MeasurementID);
 
-   if(gOutputVerbosity >= NPFOV_STATUS) {
+   if( (gOutputVerbosity >= NPFOV_STATUS) &&
+       (!(startMsg->Header.Flags & NPMSF_CONTINUED)) ) {
       std::cout << std::endl << "Starting measurement "
                 << format("$%llx", (unsigned long long)measurementID) << " ..." << std::endl;
    }
@@ -897,11 +1228,72 @@ static bool handleNetPerfMeterStart(MessageReader*                  messageReade
       vectorFileFormat = OFF_None;
    }
 
+   // ====== Handle extensions ==============================================
+   unsigned long long warmUp         = 0;
+   unsigned long long coolDownOffset = 0;
+   unsigned long long startTime      = 0;
+   size_t offset = sizeof(NetPerfMeterStartMessage);
+   while(offset + sizeof(NetPerfMeterHeader) <= received) {
+      const NetPerfMeterHeader* extension =
+         (const NetPerfMeterHeader*)&((const char*)startMsg)[offset];
+      const size_t length = ntohs(extension->Length);
+      if( (length < sizeof(NetPerfMeterHeader)) || (offset + length > received) ) {
+         std::cerr << "ERROR: Received malformed NETPERFMETER_START control message "
+                      "(bad extension)!" << std::endl;
+         return(false);
+      }
+      if( (extension->Type == NPMSE_SCHEDULE) &&
+          (length >= sizeof(NetPerfMeterScheduleExtension)) ) {
+         // Delayed starts and ramp-down of the flows.
+         const NetPerfMeterScheduleExtension* scheduleExtension =
+            (const NetPerfMeterScheduleExtension*)extension;
+         const size_t entries = (length - sizeof(NetPerfMeterScheduleExtension)) /
+                                   sizeof(NetPerfMeterFlowSchedule);
+         for(size_t i = 0;i < entries;i++) {
+            const NetPerfMeterFlowSchedule& schedule = scheduleExtension->Schedule[i];
+            Flow* flow = FlowManager::getFlowManager()->findFlow(measurementID,
+                                                                 ntohl(schedule.FlowID),
+                                                                 ntohs(schedule.StreamID));
+            if(flow != NULL) {
+               flow->setSchedule(ntoh64(schedule.StartOffset), ntoh64(schedule.StopOffset));
+            }
+         }
+      }
+      else if( (extension->Type == NPMSE_STATISTICS_WINDOW) &&
+               (length >= sizeof(NetPerfMeterStatisticsWindowExtension)) ) {
+         // Warm-up and cool-down excluded from the scalar statistics.
+         const NetPerfMeterStatisticsWindowExtension* windowExtension =
+            (const NetPerfMeterStatisticsWindowExtension*)extension;
+         warmUp         = ntoh64(windowExtension->WarmUp);
+         coolDownOffset = ntoh64(windowExtension->CoolDownOffset);
+      }
+      else if( (extension->Type == NPMSE_START_TIME) &&
+               (length >= sizeof(NetPerfMeterStartTimeExtension)) ) {
+         // Coordinated start at an absolute time (needs synchronized clocks).
+         const NetPerfMeterStartTimeExtension* startTimeExtension =
+            (const NetPerfMeterStartTimeExtension*)extension;
+         startTime = ntoh64(startTimeExtension->StartTime);
+      }
+      // Unknown extensions are ignored.
+      offset += length;
+   }
+   if(startMsg->Header.Flags & NPMSF_CONTINUED) {
+      // Only a part of the schedule; the measurement starts with the last one.
+      return(sendNetPerfMeterAcknowledge(controlSocket,
+                                         measurementID, 0, 0,
+                                         NETPERFMETER_STATUS_OKAY));
+   }
+
    const unsigned long long now = getMicroTime();
+   if( (startTime > 0) && (startTime < now) ) {
+      std::cerr << "WARNING: Start time has passed " << (now - startTime) / 1000.0
+                << "ms ago, starting immediately! Check clock synchronization!" << std::endl;
+   }
    bool success = FlowManager::getFlowManager()->startMeasurement(
       measurementID, now,
       NULL, vectorFileFormat,
       NULL, scalarFileFormat,
+      warmUp, coolDownOffset, startTime,
       (gOutputVerbosity >= NPFOV_FLOWS));
 
    return(sendNetPerfMeterAcknowledge(controlSocket,
@@ -1005,16 +1397,17 @@ static void handleControlAssocShutdown(int controlSocket)
 bool handleNetPerfMeterControlMessage(MessageReader* messageReader,
                                       int            controlSocket)
 {
-   char            inputBuffer[65536];
+   const char*     inputBuffer;
    sockaddr_union  from;
    socklen_t       fromlen = sizeof(from);
    int             flags   = 0;
    sctp_sndrcvinfo sinfo;
 
    // ====== Read message (or fragment) =====================================
+   // The message is a view into the MessageReader's buffer of the socket.
    const ssize_t received =
-      messageReader->receiveMessage(controlSocket, &inputBuffer, sizeof(inputBuffer),
-                                    &from.sa, &fromlen, &sinfo, &flags);
+      messageReader->receiveMessageView(controlSocket, &inputBuffer,
+                                        &from.sa, &fromlen, &sinfo, &flags);
    if(received == MRRM_PARTIAL_READ) {
       return(true);   // Partial read -> wait for next fragment.
    }
@@ -1028,7 +1421,7 @@ bool handleNetPerfMeterControlMessage(MessageReader* messageReader,
 
    // ====== Received a SCTP notification ===================================
    if(flags & MSG_NOTIFICATION) {
-      const sctp_notification* notification = (const sctp_notification*)&inputBuffer;
+      const sctp_notification* notification = (const sctp_notification*)inputBuffer;
       if( (notification->sn_header.sn_type == SCTP_ASSOC_CHANGE) &&
           ((notification->sn_assoc_change.sac_state == SCTP_COMM_LOST) ||
            (notification->sn_assoc_change.sac_state == SCTP_SHUTDOWN_COMP)) ) {
@@ -1038,7 +1431,7 @@ bool handleNetPerfMeterControlMessage(MessageReader* messageReader,
 
    // ====== Received a real control message ================================
    else {
-      const NetPerfMeterHeader* header = (const NetPerfMeterHeader*)&inputBuffer;
+      const NetPerfMeterHeader* header = (const NetPerfMeterHeader*)inputBuffer;
       if(ntohs(header->Length) != received) {
          std::cerr << "ERROR: Received malformed control message!" << std::endl
             << "       expected=" << ntohs(header->Length)
@@ -1050,19 +1443,19 @@ bool handleNetPerfMeterControlMessage(MessageReader* messageReader,
          case NETPERFMETER_ADD_FLOW:
             return(handleNetPerfMeterAddFlow(
                       messageReader, controlSocket,
-                      (const NetPerfMeterAddFlowMessage*)&inputBuffer, received));
+                      (const NetPerfMeterAddFlowMessage*)inputBuffer, received));
          case NETPERFMETER_REMOVE_FLOW:
             return(handleNetPerfMeterRemoveFlow(
                       messageReader, controlSocket,
-                      (const NetPerfMeterRemoveFlowMessage*)&inputBuffer, received));
+                      (const NetPerfMeterRemoveFlowMessage*)inputBuffer, received));
          case NETPERFMETER_START:
             return(handleNetPerfMeterStart(
                       messageReader, controlSocket,
-                      (const NetPerfMeterStartMessage*)&inputBuffer, received));
+                      (const NetPerfMeterStartMessage*)inputBuffer, received));
          case NETPERFMETER_STOP:
             return(handleNetPerfMeterStop(
                       messageReader, controlSocket,
-                      (const NetPerfMeterStopMessage*)&inputBuffer, received));
+                      (const NetPerfMeterStopMessage*)inputBuffer, received));
          default:
             std::cerr << "ERROR: Received invalid control message of type "
                      << (unsigned int)header->Type << "!" << std::endl;
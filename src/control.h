@@ -50,16 +50,19 @@ bool performNetPerfMeterAddFlow(MessageReader* messageReader,
 bool performNetPerfMeterIdentifyFlow(MessageReader* messageReader,
                                      int            controlSocket,
                                      const Flow*    flow);
-bool performNetPerfMeterStart(MessageReader*         messageReader,
-                              int                    controlSocket,
-                              const uint64_t         measurementID,
-                              const char*            activeNodeName,
-                              const char*            passiveNodeName,
-                              const char*            configName,
-                              const char*            vectorNamePattern,
-                              const OutputFileFormat vectorFileFormat,
-                              const char*            scalarNamePattern,
-                              const OutputFileFormat scalarFileFormat);
+bool performNetPerfMeterStart(MessageReader*           messageReader,
+                              int                      controlSocket,
+                              const uint64_t           measurementID,
+                              const char*              activeNodeName,
+                              const char*              passiveNodeName,
+                              const char*              configName,
+                              const char*              vectorNamePattern,
+                              const OutputFileFormat   vectorFileFormat,
+                              const char*              scalarNamePattern,
+                              const OutputFileFormat   scalarFileFormat,
+                              const unsigned long long warmUp,
+                              const unsigned long long coolDownOffset,
+                              const unsigned long long startTime);
 bool performNetPerfMeterStop(MessageReader* messageReader,
                              int            controlSocket,
                              const uint64_t measurementID);
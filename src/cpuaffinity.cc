@@ -0,0 +1,245 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "cpuaffinity.h"
+#include "tools.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ifaddrs.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+
+
+// ###### Parse CPU list (e.g. "0-3,8,10-11") ###############################
+// Ranges are clamped to the number of configured CPUs.
+bool parseCPUList(const char* list, std::vector<unsigned int>& cpus)
+{
+   cpus.clear();
+   const long         configured = sysconf(_SC_NPROCESSORS_CONF);
+   const unsigned int cpuCount   = (configured > 0) ? (unsigned int)configured : 1;
+   std::vector<bool>  used(cpuCount, false);
+   const char* p = list;
+   while( (*p != 0x00) && (*p != '\n') ) {
+      unsigned int first;
+      unsigned int last;
+      int          n = 0;
+      if(sscanf(p, "%u-%u%n", &first, &last, &n) == 2) {
+         if(last < first) {
+            return(false);
+         }
+      }
+      else if(sscanf(p, "%u%n", &first, &n) == 1) {
+         last = first;
+      }
+      else {
+         return(false);
+      }
+      if(first >= cpuCount) {
+         return(false);
+      }
+      if(last >= cpuCount) {
+         last = cpuCount - 1;
+      }
+      for(unsigned int cpu = first;cpu <= last;cpu++) {
+         if(!used[cpu]) {
+            used[cpu] = true;
+            cpus.push_back(cpu);
+         }
+      }
+      p = (const char*)&p[n];
+      if(*p == ',') {
+         p++;
+      }
+      else if( (*p != 0x00) && (*p != '\n') ) {
+         return(false);
+      }
+   }
+   return(cpus.size() > 0);
+}
+
+
+// ###### Print CPU list ####################################################
+void printCPUList(std::ostream& os, const std::vector<unsigned int>& cpus)
+{
+   if(cpus.size() == 0) {
+      os << "(any)";
+      return;
+   }
+   for(size_t i = 0;i < cpus.size();i++) {
+      if(i > 0) {
+         os << ",";
+      }
+      os << cpus[i];
+   }
+}
+
+
+// ###### Get CPUs the process may run on ###################################
+bool getAvailableCPUs(std::vector<unsigned int>& cpus)
+{
+   cpus.clear();
+#ifdef __linux__
+   cpu_set_t cpuSet;
+   CPU_ZERO(&cpuSet);
+   if(sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0) {
+      for(unsigned int i = 0;i < CPU_SETSIZE;i++) {
+         if(CPU_ISSET(i, &cpuSet)) {
+            cpus.push_back(i);
+         }
+      }
+   }
+#else
+   const long n = sysconf(_SC_NPROCESSORS_ONLN);
+   for(long i = 0;i < n;i++) {
+      cpus.push_back((unsigned int)i);
+   }
+#endif
+   return(cpus.size() > 0);
+}
+
+
+// ###### Get NUMA node of a network interface ##############################
+int getNUMANodeOfInterface(const char* interfaceName)
+{
+   int node = -1;
+#ifdef __linux__
+   const std::string fileName = format("/sys/class/net/%s/device/numa_node",
+                                       interfaceName);
+   std::ifstream file(fileName.c_str());
+   if(file.good()) {
+      file >> node;
+      if(file.fail()) {
+         node = -1;
+      }
+   }
+#endif
+   return(node);
+}
+
+
+// ###### Get CPUs of a NUMA node ###########################################
+bool getCPUsOfNUMANode(const int node, std::vector<unsigned int>& cpus)
+{
+   cpus.clear();
+#ifdef __linux__
+   if(node >= 0) {
+      const std::string fileName = format("/sys/devices/system/node/node%d/cpulist", node);
+      std::ifstream file(fileName.c_str());
+      std::string   cpuList;
+      if( (file.good()) && (std::getline(file, cpuList)) ) {
+         if(parseCPUList(cpuList.c_str(), cpus)) {
+            // Only use CPUs the process is actually allowed to run on
+            std::vector<unsigned int> available;
+            if(getAvailableCPUs(available)) {
+               std::vector<unsigned int> usable;
+               for(size_t i = 0;i < cpus.size();i++) {
+                  if(std::find(available.begin(), available.end(), cpus[i]) != available.end()) {
+                     usable.push_back(cpus[i]);
+                  }
+               }
+               cpus = usable;
+            }
+         }
+      }
+   }
+#endif
+   return(cpus.size() > 0);
+}
+
+
+// ###### Find the outgoing interface for a given destination ###############
+bool getInterfaceForDestination(const struct sockaddr* destination,
+                                std::string&           interfaceName)
+{
+   bool success = false;
+
+   // ====== Let the kernel choose the local address ========================
+   const int sd = socket(destination->sa_family, SOCK_DGRAM, IPPROTO_UDP);
+   if(sd < 0) {
+      return(false);
+   }
+   sockaddr_union localAddress;
+   socklen_t      localAddressLength = sizeof(localAddress);
+   if( (connect(sd, destination, getSocklen(destination)) == 0) &&
+       (getsockname(sd, &localAddress.sa, &localAddressLength) == 0) ) {
+      // ====== Find the interface having this address ======================
+      struct ifaddrs* ifaddrList;
+      if(getifaddrs(&ifaddrList) == 0) {
+         for(struct ifaddrs* ifaddr = ifaddrList;ifaddr != NULL;ifaddr = ifaddr->ifa_next) {
+            if( (ifaddr->ifa_addr != NULL) &&
+                (ifaddr->ifa_addr->sa_family == localAddress.sa.sa_family) &&
+                (addresscmp(ifaddr->ifa_addr, &localAddress.sa, false) == 0) ) {
+               interfaceName = std::string(ifaddr->ifa_name);
+               success = true;
+               break;
+            }
+         }
+         freeifaddrs(ifaddrList);
+      }
+   }
+   close(sd);
+
+   return(success);
+}
+
+
+// ###### Get CPU set for an affinity policy ################################
+// Policies:
+// - <list>            : the given CPU list (e.g. "0-3,8")
+// - auto[:<interface>]: the CPUs of the NUMA node of the interface; if no
+//                       interface is given, the interface to the destination
+//                       is used. Falls back to all available CPUs.
+bool getCPUsForPolicy(const char*                policy,
+                      const struct sockaddr*     destination,
+                      std::vector<unsigned int>& cpus)
+{
+   if(strncmp(policy, "auto", 4) == 0) {
+      std::string interfaceName;
+      if(policy[4] == ':') {
+         interfaceName = std::string((const char*)&policy[5]);
+      }
+      else if(policy[4] != 0x00) {
+         return(false);
+      }
+      else if(destination != NULL) {
+         getInterfaceForDestination(destination, interfaceName);
+      }
+
+      if(interfaceName != "") {
+         const int node = getNUMANodeOfInterface(interfaceName.c_str());
+         if(getCPUsOfNUMANode(node, cpus)) {
+            return(true);
+         }
+         std::cerr << "NOTE: Unable to find NUMA node for interface "
+                   << interfaceName << "; using all CPUs." << std::endl;
+      }
+      return(getAvailableCPUs(cpus));
+   }
+   return(parseCPUList(policy, cpus));
+}
@@ -0,0 +1,46 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#ifndef CPUAFFINITY_H
+#define CPUAFFINITY_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+
+bool parseCPUList(const char* list, std::vector<unsigned int>& cpus);
+void printCPUList(std::ostream& os, const std::vector<unsigned int>& cpus);
+bool getAvailableCPUs(std::vector<unsigned int>& cpus);
+int getNUMANodeOfInterface(const char* interfaceName);
+bool getCPUsOfNUMANode(const int node, std::vector<unsigned int>& cpus);
+bool getInterfaceForDestination(const struct sockaddr* destination,
+                                std::string&           interfaceName);
+bool getCPUsForPolicy(const char*               policy,
+                      const struct sockaddr*    destination,
+                      std::vector<unsigned int>& cpus);
+
+#endif
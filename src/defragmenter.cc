@@ -25,37 +25,34 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
-#include <map>
 
 
-// ###### Constructor #################b######################################
+// ###### Constructor #######################################################
 Defragmenter::Defragmenter()
 {
+   FragmentWindow      = NULL;
+   FrameWindow         = NULL;
+   ReceivedBitmap      = NULL;
+   WindowSize          = 0;
+   WindowStart         = 0;
+   PurgeHorizon        = 0;
+   StoredFragments     = 0;
    NextFrameID         = 0;
    NextPacketSeqNumber = 0;
    NextByteSeqNumber   = 0;
+   memset(&Pending, 0, sizeof(Pending));
 }
 
 
 // ###### Destructor ########################################################
 Defragmenter::~Defragmenter()
 {
-   std::map<uint32_t, Frame*>::iterator frameIterator = FrameSet.begin();
-   while(frameIterator != FrameSet.end()) {
-      Frame* frame = frameIterator->second;
-
-      std::map<uint64_t, Fragment*>::iterator fragmentIterator = frame->FragmentSet.begin();
-      while(fragmentIterator != frame->FragmentSet.end()) {
-         Fragment* fragment = fragmentIterator->second;
-         frame->FragmentSet.erase(fragmentIterator);
-         delete fragment;
-         fragmentIterator = frame->FragmentSet.begin();
-      }
-
-      FrameSet.erase(frameIterator);
-      delete frame;
-      frameIterator = FrameSet.begin();
+   if(FragmentWindow) {
+      BufferArena::getBufferArena()->release(FragmentWindow);
+      BufferArena::getBufferArena()->release(FrameWindow);
+      BufferArena::getBufferArena()->release(ReceivedBitmap);
    }
 }
 
@@ -63,135 +60,215 @@ Defragmenter::~Defragmenter()
 // ###### Print FragmentSet #################################################
 void Defragmenter::print(std::ostream& os)
 {
-   os << "FragmentSet:" << std::endl;
-   for(std::map<uint32_t, Frame*>::iterator frameIterator = FrameSet.begin();
-         frameIterator != FrameSet.end(); frameIterator++) {
-      Frame* frame = frameIterator->second;
-      os << "   - Frame " << frame->FrameID
-         << ", LastUpdate=" << frame->LastUpdate
-         << ":" << std::endl;
-
-      for(std::map<uint64_t, Fragment*>::iterator fragmentIterator = frame->FragmentSet.begin();
-          fragmentIterator != frame->FragmentSet.end(); fragmentIterator++) {
-         Fragment* fragment = fragmentIterator->second;
-         os << "      + Fragment " << fragment->PacketSeqNumber << ":\t"
-            << "ByteSeq=" << fragment->ByteSeqNumber
-            << ", Length=" << fragment->Length << "   ";
-         if(fragment->Flags & NPMDF_FRAME_BEGIN) {
-            os << "<Begin> ";
-         }
-         if(fragment->Flags & NPMDF_FRAME_END) {
-            os << "<End> ";
-         }
-         os << std::endl;
+   os << "FragmentSet (window " << WindowStart << "+" << WindowSize
+      << ", " << StoredFragments << " fragments):" << std::endl;
+   uint64_t packetSeqNumber = WindowStart;
+   for(size_t i = 0; i < StoredFragments; i++) {
+      packetSeqNumber = findNextFragment(packetSeqNumber);
+      const Fragment& fragment = getFragment(packetSeqNumber);
+      const Frame&    frame    = getFrame(fragment.FrameID);
+      os << "   + Fragment " << packetSeqNumber << ":\t"
+         << "Frame=" << fragment.FrameID
+         << ", LastUpdate=" << frame.LastUpdate
+         << ", ByteSeq=" << fragment.ByteSeqNumber
+         << ", Length=" << fragment.Length << "   ";
+      if(fragment.Flags & NPMDF_FRAME_BEGIN) {
+         os << "<Begin> ";
       }
+      if(fragment.Flags & NPMDF_FRAME_END) {
+         os << "<End> ";
+      }
+      os << std::endl;
+      packetSeqNumber++;
    }
 }
 
 
-// ###### Add fragment to Defragmenter ######################################
-void Defragmenter::addFragment(const unsigned long long       now,
-                               const NetPerfMeterDataMessage* dataMsg)
+// ###### Resize the window #################################################
+// The window storage is allocated from the buffer arena; the fragments and
+// their frames are moved into their slots in the new window.
+bool Defragmenter::resizeWindow(const size_t windowSize)
 {
-   const uint32_t frameID = ntohl(dataMsg->FrameID);
-
-   // ====== Find frame =====================================================
-   Frame*                               frame;
-   std::map<uint32_t, Frame*>::iterator foundFrame = FrameSet.find(frameID);
-   if(foundFrame != FrameSet.end()) {
-      frame = foundFrame->second;
+   BufferArena* bufferArena    = BufferArena::getBufferArena();
+   Fragment*    fragmentWindow = (Fragment*)bufferArena->allocate(windowSize * sizeof(Fragment));
+   Frame*       frameWindow    = (Frame*)bufferArena->allocate(windowSize * sizeof(Frame));
+   uint64_t*    receivedBitmap = (uint64_t*)bufferArena->allocate(windowSize / 8);
+   if( (fragmentWindow == NULL) || (frameWindow == NULL) || (receivedBitmap == NULL) ) {
+      bufferArena->release(fragmentWindow);
+      bufferArena->release(frameWindow);
+      bufferArena->release(receivedBitmap);
+      return(false);
    }
-   else {
-      // ====== Frame has to be created =====================================
-      frame = new Frame;
-      if(frame) {
-         frame->LastUpdate = now;
-         frame->FrameID    = frameID;
-         frame->Completed  = false;
-         FrameSet.insert(std::pair<uint32_t, Frame*>(frame->FrameID, frame));
+   memset(frameWindow, 0, windowSize * sizeof(Frame));
+   memset(receivedBitmap, 0, windowSize / 8);
+
+   if(FragmentWindow) {
+      uint64_t packetSeqNumber = WindowStart;
+      for(size_t i = 0; i < StoredFragments; i++) {
+         packetSeqNumber = findNextFragment(packetSeqNumber);
+         const Fragment& fragment = getFragment(packetSeqNumber);
+         const size_t    slot     = packetSeqNumber & (windowSize - 1);
+         fragmentWindow[slot] = fragment;
+         frameWindow[fragment.FrameID & (windowSize - 1)] = getFrame(fragment.FrameID);
+         receivedBitmap[slot / 64] |= (1ULL << (slot % 64));
+         packetSeqNumber++;
       }
+      bufferArena->release(FragmentWindow);
+      bufferArena->release(FrameWindow);
+      bufferArena->release(ReceivedBitmap);
    }
 
-   // ====== Add fragment ===================================================
-   const uint64_t packetSeqNumber = ntoh64(dataMsg->SeqNumber);
-   std::map<uint64_t, Fragment*>::iterator foundFragment =
-      frame->FragmentSet.find(packetSeqNumber);
-   if(foundFragment == frame->FragmentSet.end()) {
-      Fragment* fragment = new Fragment;
-      if(fragment) {
-         fragment->PacketSeqNumber = packetSeqNumber;
-         fragment->ByteSeqNumber   = ntoh64(dataMsg->ByteSeqNumber);
-         fragment->Length          = ntohs(dataMsg->Header.Length);
-         fragment->Flags           = dataMsg->Header.Flags;
-         frame->FragmentSet.insert(std::pair<uint64_t, Fragment*>(fragment->PacketSeqNumber, fragment));
-      }
+   FragmentWindow = fragmentWindow;
+   FrameWindow    = frameWindow;
+   ReceivedBitmap = receivedBitmap;
+   WindowSize     = windowSize;
+   return(true);
+}
+
+
+// ###### Slide the window to cover a packet sequence number ################
+// The window grows up to its maximum size. Beyond that, the oldest fragments
+// are expired regardless of the defragment timeout; their statistics are
+// reported by the next purge() call. An empty window is just moved, since
+// there is nothing to keep.
+bool Defragmenter::slideWindow(const uint64_t packetSeqNumber)
+{
+   // ====== Grow the window ================================================
+   size_t windowSize = WindowSize;
+   while( (StoredFragments > 0) &&
+          (packetSeqNumber - WindowStart >= windowSize) &&
+          (windowSize < DEFRAGMENTER_MAX_WINDOW_SIZE) ) {
+      windowSize *= 2;
    }
-   else {
-      // puts("Duplicate???");
+   if(windowSize != WindowSize) {
+      resizeWindow(windowSize);
+   }
+   if(packetSeqNumber - WindowStart < WindowSize) {
+      return(true);
+   }
+
+   // ====== Expire the oldest fragments ====================================
+   const uint64_t windowStart = packetSeqNumber - WindowSize + 1;
+   while(StoredFragments > 0) {
+      const uint64_t nextPacketSeqNumber = findNextFragment(WindowStart);
+      if(nextPacketSeqNumber >= windowStart) {
+         break;
+      }
+      expireFragment(nextPacketSeqNumber, Pending);
+      PurgeHorizon = 0;
    }
+   WindowStart = windowStart;
+   return(true);
 }
 
 
-// ====== Get first fragment from storage ===================================
-bool Defragmenter::getFirstFragment(Frame*&    frame,
-                                    Fragment*& fragment)
+// ###### Find the next stored fragment #####################################
+// There must be a stored fragment at or behind the given sequence number.
+uint64_t Defragmenter::findNextFragment(uint64_t packetSeqNumber) const
 {
-   FrameIterator = FrameSet.begin();
-   if(FrameIterator != FrameSet.end()) {
-      frame            = FrameIterator->second;
-      FragmentIterator = frame->FragmentSet.begin();
-      assert(FragmentIterator != frame->FragmentSet.end());
-      fragment = FragmentIterator->second;
-      return(true);
+   assert(StoredFragments > 0);
+   const size_t slot  = packetSeqNumber & (WindowSize - 1);
+   size_t       index = slot / 64;
+   uint64_t     word  = ReceivedBitmap[index] & (~0ULL << (slot % 64));
+   packetSeqNumber -= slot % 64;
+   while(word == 0) {
+      packetSeqNumber += 64;
+      index = (index + 1) & ((WindowSize / 64) - 1);
+      word  = ReceivedBitmap[index];
    }
-   frame    = NULL;
-   fragment = NULL;
-   return(false);
+   return(packetSeqNumber + __builtin_ctzll(word));
 }
 
 
-// ====== Get next fragment from storage ====================================
-bool Defragmenter::getNextFragment(Frame*&    frame,
-                                   Fragment*& fragment,
-                                   const bool eraseCurrentFrame)
+// ###### Add fragment to Defragmenter ######################################
+void Defragmenter::addFragment(const unsigned long long       now,
+                               const NetPerfMeterDataMessage* dataMsg)
 {
-   Frame*                                  lastFrame            = frame;
-   Fragment*                               lastFragment         = fragment;
-   std::map<uint32_t, Frame*>::iterator    lastFrameIterator    = FrameIterator;
-   std::map<uint64_t, Fragment*>::iterator lastFragmentIterator = FragmentIterator;
-
-   FragmentIterator++;
-   if(FragmentIterator == frame->FragmentSet.end()) {
-      FrameIterator++;
-      if(FrameIterator == FrameSet.end()) {
-         frame    = NULL;
-         fragment = NULL;
-      }
-      else {
-         frame            = FrameIterator->second;
-         FragmentIterator = frame->FragmentSet.begin();
-         assert(FragmentIterator != frame->FragmentSet.end());
-         fragment = FragmentIterator->second;
-      }
+   const uint64_t packetSeqNumber = ntoh64(dataMsg->SeqNumber);
+   const uint32_t frameID         = ntohl(dataMsg->FrameID);
+
+   // ====== Find window slot ===============================================
+   if( (FragmentWindow == NULL) &&
+       (!resizeWindow(DEFRAGMENTER_INITIAL_WINDOW_SIZE)) ) {
+      return;
+   }
+   if(packetSeqNumber < WindowStart) {
+      // Its frame has already been purged, i.e. the fragment is too late
+      // to be counted.
+      return;
+   }
+   if( (packetSeqNumber - WindowStart >= WindowSize) &&
+       (!slideWindow(packetSeqNumber)) ) {
+      return;
    }
-   else {
-      fragment = FragmentIterator->second;
+   if(isReceived(packetSeqNumber)) {
+      // puts("Duplicate???");
+      return;
    }
 
-   if(eraseCurrentFrame) {
-      lastFrame->FragmentSet.erase(lastFragmentIterator);
-      delete lastFragment;
-      if(lastFrame->FragmentSet.size() == 0) {
-         FrameSet.erase(lastFrameIterator);
-         delete lastFrame;
-      }
+   // ====== Find frame =====================================================
+   Frame& frame = getFrame(frameID);
+   if(frame.Fragments == 0) {
+      // ====== Frame has to be created =====================================
+      frame.LastUpdate = now;
+      frame.FrameID    = frameID;
    }
+   else if(frame.FrameID != frameID) {
+      // Frame IDs out of sequence with the packet sequence numbers.
+      return;
+   }
+   else if(frame.LastUpdate < PurgeHorizon) {
+      // An older frame may now be in front of the window.
+      PurgeHorizon = frame.LastUpdate;
+   }
+   frame.Fragments++;
 
-   return(fragment != NULL);
+   // ====== Add fragment ===================================================
+   Fragment& fragment = getFragment(packetSeqNumber);
+   fragment.ByteSeqNumber = ntoh64(dataMsg->ByteSeqNumber);
+   fragment.FrameID       = frameID;
+   fragment.Length        = ntohs(dataMsg->Header.Length);
+   fragment.Flags         = dataMsg->Header.Flags;
+   setReceived(packetSeqNumber, true);
+   StoredFragments++;
+}
+
+
+// ###### Expire fragment and update the statistics #########################
+void Defragmenter::expireFragment(const uint64_t   packetSeqNumber,
+                                  PurgeStatistics& statistics)
+{
+   const Fragment& fragment = getFragment(packetSeqNumber);
+   Frame&          frame    = getFrame(fragment.FrameID);
+
+   if(frame.FrameID >= NextFrameID) {
+      statistics.ReceivedFrames++;
+      statistics.LostFrames += ((long long)frame.FrameID - (long long)NextFrameID);
+      NextFrameID = frame.FrameID + 1;
+   }
+   if(fragment.ByteSeqNumber >= NextByteSeqNumber) {
+      statistics.LostBytes += ((long long)fragment.ByteSeqNumber - (long long)NextByteSeqNumber);
+      NextByteSeqNumber = fragment.ByteSeqNumber + fragment.Length;
+   }
+   if(packetSeqNumber >= NextPacketSeqNumber) {
+      statistics.LostPackets += ((long long)packetSeqNumber - (long long)NextPacketSeqNumber);
+      NextPacketSeqNumber = packetSeqNumber + 1;
+   }
+
+   frame.Fragments--;
+   setReceived(packetSeqNumber, false);
+   StoredFragments--;
+   WindowStart = packetSeqNumber + 1;
 }
 
 
 // ###### Purge incomplete frames from Defragmenter #########################
+// Fragments are expired in sequence number order, up to the first one whose
+// frame has not yet reached the defragment timeout. That frame's LastUpdate
+// is kept as PurgeHorizon: nothing can expire before it times out, since a
+// fragment inserted in front of it creates a new frame, or otherwise lowers
+// the horizon. Until then, purge() only reports the fragments expired early
+// by slideWindow(), i.e. calling it per packet costs O(1).
 void Defragmenter::purge(const unsigned long long now,
                          const unsigned long long defragmentTimeout,
                          size_t&                  receivedFrames,
@@ -199,37 +276,24 @@ void Defragmenter::purge(const unsigned long long now,
                          size_t&                  lostPackets,
                          size_t&                  lostBytes)
 {
-   receivedFrames = 0;
-   lostBytes      = 0;
-   lostPackets    = 0;
-   lostFrames     = 0;
-
-   Frame*    frame;
-   Fragment* fragment;
-   if(getFirstFragment(frame, fragment)) {
-      bool eraseCurrentFragment;
-      do {
-         eraseCurrentFragment = false;
-         if(frame->LastUpdate + defragmentTimeout <= now) {
-            eraseCurrentFragment = true;
-
-            if(frame->FrameID >= NextFrameID) {
-               receivedFrames++;
-               lostFrames += ((long long)frame->FrameID - (long long)NextFrameID);
-               NextFrameID = frame->FrameID + 1;
-            }
-            if(fragment->ByteSeqNumber >= NextByteSeqNumber) {
-               lostBytes += ((long long)fragment->ByteSeqNumber - (long long)NextByteSeqNumber);
-               NextByteSeqNumber = fragment->ByteSeqNumber + fragment->Length;
-            }
-            if(fragment->PacketSeqNumber >= NextPacketSeqNumber) {
-               lostPackets += ((long long)fragment->PacketSeqNumber - (long long)NextPacketSeqNumber);
-               NextPacketSeqNumber = fragment->PacketSeqNumber + 1;
-            }
-         }
-         else {
+   PurgeStatistics statistics = Pending;
+   memset(&Pending, 0, sizeof(Pending));
+
+   if(PurgeHorizon + defragmentTimeout <= now) {
+      PurgeHorizon = 0;
+      while(StoredFragments > 0) {
+         const uint64_t packetSeqNumber = findNextFragment(WindowStart);
+         const Frame&   frame           = getFrame(getFragment(packetSeqNumber).FrameID);
+         if(frame.LastUpdate + defragmentTimeout > now) {
+            PurgeHorizon = frame.LastUpdate;
             break;
          }
-      } while(getNextFragment(frame, fragment, eraseCurrentFragment));
+         expireFragment(packetSeqNumber, statistics);
+      }
    }
+
+   receivedFrames = statistics.ReceivedFrames;
+   lostFrames     = statistics.LostFrames;
+   lostPackets    = statistics.LostPackets;
+   lostBytes      = statistics.LostBytes;
 }
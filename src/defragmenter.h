@@ -24,11 +24,18 @@
 #ifndef DEFRAGMENTER_H
 #define DEFRAGMENTER_H
 
-#include <map>
+#include <ostream>
 
 #include "netperfmeterpackets.h"
+#include "bufferarena.h"
 
 
+// The window covers the packet sequence numbers of all fragments not yet
+// purged. It starts small, doubles on demand and never exceeds the maximum
+// size, which bounds the defragmenter's memory usage per flow.
+#define DEFRAGMENTER_INITIAL_WINDOW_SIZE   256
+#define DEFRAGMENTER_MAX_WINDOW_SIZE     65536
+
 class Defragmenter
 {
    // ====== Public Methods =================================================
@@ -50,30 +57,66 @@ class Defragmenter
 
    // ====== Private Data ===================================================
    private:
+   // A fragment is stored in the window slot given by its packet sequence
+   // number; a bitmap tells which slots are in use.
    struct Fragment
    {
-      uint64_t PacketSeqNumber;
       uint64_t ByteSeqNumber;
+      uint32_t FrameID;
       uint16_t Length;
       uint8_t  Flags;
    };
+   // A frame is stored in the slot given by its frame ID. Since frame IDs
+   // grow with the packet sequence numbers, the frames of the fragments
+   // within the window cannot collide.
    struct Frame
    {
-      uint32_t                      FrameID;
-      unsigned long long            LastUpdate;
-      std::map<uint64_t, Fragment*> FragmentSet;
-      bool                          Completed;
+      unsigned long long LastUpdate;
+      uint32_t           FrameID;
+      uint32_t           Fragments;
+   };
+   struct PurgeStatistics
+   {
+      size_t ReceivedFrames;
+      size_t LostFrames;
+      size_t LostPackets;
+      size_t LostBytes;
    };
 
-   bool getFirstFragment(Frame*&    frame,
-                         Fragment*& fragment);
-   bool getNextFragment(Frame*&    frame,
-                        Fragment*& fragment,
-                        const bool eraseCurrentFrame);
+   inline Fragment& getFragment(const uint64_t packetSeqNumber) {
+      return(FragmentWindow[packetSeqNumber & (WindowSize - 1)]);
+   }
+   inline Frame& getFrame(const uint32_t frameID) {
+      return(FrameWindow[frameID & (WindowSize - 1)]);
+   }
+   inline bool isReceived(const uint64_t packetSeqNumber) const {
+      const size_t slot = packetSeqNumber & (WindowSize - 1);
+      return((ReceivedBitmap[slot / 64] & (1ULL << (slot % 64))) != 0);
+   }
+   inline void setReceived(const uint64_t packetSeqNumber, const bool received) {
+      const size_t slot = packetSeqNumber & (WindowSize - 1);
+      if(received) {
+         ReceivedBitmap[slot / 64] |= (1ULL << (slot % 64));
+      }
+      else {
+         ReceivedBitmap[slot / 64] &= ~(1ULL << (slot % 64));
+      }
+   }
+
+   bool resizeWindow(const size_t windowSize);
+   bool slideWindow(const uint64_t packetSeqNumber);
+   uint64_t findNextFragment(uint64_t packetSeqNumber) const;
+   void expireFragment(const uint64_t   packetSeqNumber,
+                       PurgeStatistics& statistics);
 
-   std::map<uint32_t, Frame*>              FrameSet;
-   std::map<uint32_t, Frame*>::iterator    FrameIterator;
-   std::map<uint64_t, Fragment*>::iterator FragmentIterator;
+   Fragment*                               FragmentWindow;
+   Frame*                                  FrameWindow;
+   uint64_t*                               ReceivedBitmap;
+   size_t                                  WindowSize;
+   size_t                                  StoredFragments;
+   uint64_t                                WindowStart;
+   unsigned long long                      PurgeHorizon;
+   PurgeStatistics                         Pending;
    uint64_t                                NextPacketSeqNumber;
    uint64_t                                NextByteSeqNumber;
    uint32_t                                NextFrameID;
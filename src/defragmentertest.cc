@@ -0,0 +1,210 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "defragmenter.h"
+#include "referencedefragmenter.h"
+#include "tools.h"
+
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+
+// Checks that Defragmenter computes the same statistics as the map-based
+// ReferenceDefragmenter for randomized streams with loss, duplicates and
+// reordering. With -benchmark, the time per packet of both is measured.
+
+#define TEST_SCENARIOS         200
+#define TEST_PACKETS         20000
+#define BENCHMARK_PACKETS  2000000
+
+
+struct Scenario
+{
+   size_t             Packets;
+   unsigned int       MaxFragments;    // Fragments per frame
+   double             Loss;            // Packet loss probability
+   double             Duplicates;      // Packet duplication probability
+   double             Outages;         // Probability of an outage per frame
+   unsigned int       Reordering;      // Maximum reordering distance
+   unsigned long long Timeout;         // Defragment timeout
+};
+
+
+// ###### Generate received data messages ###################################
+static void generateStream(std::mt19937&                         rng,
+                           const Scenario&                       scenario,
+                           std::vector<NetPerfMeterDataMessage>& messages)
+{
+   std::uniform_real_distribution<double> uniform(0.0, 1.0);
+   uint64_t packetSeqNumber = rng() % 3;
+   uint64_t byteSeqNumber   = 0;
+   uint32_t frameID         = 0;
+
+   messages.clear();
+   while(messages.size() < scenario.Packets) {
+      const unsigned int fragments = 1 + (rng() % scenario.MaxFragments);
+      for(unsigned int i = 0;i < fragments;i++) {
+         const uint16_t length = 100 + (rng() % 1000);
+         NetPerfMeterDataMessage dataMsg;
+         memset(&dataMsg, 0, sizeof(dataMsg));
+         dataMsg.Header.Type   = NETPERFMETER_DATA;
+         dataMsg.Header.Flags  = ((i == 0) ? NPMDF_FRAME_BEGIN : 0) |
+                                 ((i == fragments - 1) ? NPMDF_FRAME_END : 0);
+         dataMsg.Header.Length = htons(length);
+         dataMsg.FrameID       = htonl(frameID);
+         dataMsg.SeqNumber     = hton64(packetSeqNumber++);
+         dataMsg.ByteSeqNumber = hton64(byteSeqNumber);
+         byteSeqNumber += length;
+         if(uniform(rng) >= scenario.Loss) {
+            messages.push_back(dataMsg);
+            if(uniform(rng) < scenario.Duplicates) {
+               messages.push_back(dataMsg);
+            }
+         }
+      }
+      frameID++;
+      if(uniform(rng) < scenario.Outages) {
+         // An outage loses more packets than the initial window covers.
+         packetSeqNumber += 4 * DEFRAGMENTER_INITIAL_WINDOW_SIZE;
+         byteSeqNumber   += 4 * DEFRAGMENTER_INITIAL_WINDOW_SIZE * 1000;
+         frameID         += DEFRAGMENTER_INITIAL_WINDOW_SIZE;
+      }
+   }
+
+   if(scenario.Reordering > 0) {
+      for(size_t i = 0;i + 1 < messages.size();i++) {
+         if(rng() % 10 == 0) {
+            const size_t j = std::min(messages.size() - 1,
+                                      i + 1 + (rng() % scenario.Reordering));
+            std::swap(messages[i], messages[j]);
+         }
+      }
+   }
+}
+
+
+// ###### Feed data messages to defragmenter ################################
+// Like the flows, purge() is called after each packet. Returns the time per
+// packet in ns.
+template<class T> double runDefragmenter(T&                                          defragmenter,
+                                         const Scenario&                             scenario,
+                                         const std::vector<NetPerfMeterDataMessage>& messages,
+                                         size_t*                                     statistics)
+{
+   size_t             receivedFrames, lostFrames, lostPackets, lostBytes;
+   unsigned long long now = 0;
+   for(unsigned int i = 0;i < 4;i++) {
+      statistics[i] = 0;
+   }
+
+   const unsigned long long t1 = getMicroTime();
+   for(size_t i = 0;i < messages.size();i++) {
+      now += 1 + (i % 3);
+      defragmenter.addFragment(now, &messages[i]);
+      defragmenter.purge(now, scenario.Timeout,
+                         receivedFrames, lostFrames, lostPackets, lostBytes);
+      statistics[0] += receivedFrames;
+      statistics[1] += lostFrames;
+      statistics[2] += lostPackets;
+      statistics[3] += lostBytes;
+   }
+   const unsigned long long t2 = getMicroTime();
+
+   defragmenter.purge(now + 10 * scenario.Timeout, scenario.Timeout,
+                      receivedFrames, lostFrames, lostPackets, lostBytes);
+   statistics[0] += receivedFrames;
+   statistics[1] += lostFrames;
+   statistics[2] += lostPackets;
+   statistics[3] += lostBytes;
+   return(1000.0 * (double)(t2 - t1) / messages.size());
+}
+
+
+// ###### Get scenario ######################################################
+static Scenario getScenario(const unsigned int number, const size_t packets)
+{
+   Scenario scenario;
+   scenario.Packets      = packets;
+   scenario.MaxFragments = (number % 3 == 0) ? 1 : 8;
+   scenario.Loss         = (number % 5) * 0.02;
+   scenario.Duplicates   = 0.005;
+   scenario.Outages      = (number % 8 == 5) ? 0.001 : 0.0;
+   scenario.Reordering   = (number % 4) * 7;
+   scenario.Timeout      = 1000 + (number % 3) * 500;
+   return(scenario);
+}
+
+
+// ###### Main program ######################################################
+int main(int argc, char** argv)
+{
+   const bool benchmark = ((argc > 1) && (strcmp(argv[1], "-benchmark") == 0));
+   if( (argc > 2) || ((argc == 2) && (!benchmark)) ) {
+      std::cerr << "Usage: " << argv[0] << " [-benchmark]" << std::endl;
+      exit(1);
+   }
+
+   std::mt19937                         rng(42);
+   std::vector<NetPerfMeterDataMessage> messages;
+   const unsigned int                   scenarios = (benchmark) ? 5 : TEST_SCENARIOS;
+   unsigned int                         failed    = 0;
+   for(unsigned int number = 0;number < scenarios;number++) {
+      const Scenario scenario =
+         getScenario(number, (benchmark) ? BENCHMARK_PACKETS : TEST_PACKETS);
+      generateStream(rng, scenario, messages);
+
+      size_t                 statistics[4];
+      size_t                 referenceStatistics[4];
+      Defragmenter*          defragmenter          = new Defragmenter;
+      ReferenceDefragmenter* referenceDefragmenter = new ReferenceDefragmenter;
+      const double time          = runDefragmenter(*defragmenter, scenario, messages, statistics);
+      const double referenceTime = runDefragmenter(*referenceDefragmenter, scenario, messages,
+                                                   referenceStatistics);
+      delete defragmenter;
+      delete referenceDefragmenter;
+
+      if(memcmp(statistics, referenceStatistics, sizeof(statistics)) != 0) {
+         std::cerr << "ERROR: Scenario " << number << ": frames "
+                   << statistics[0] << "/" << referenceStatistics[0]
+                   << ", lost frames " << statistics[1] << "/" << referenceStatistics[1]
+                   << ", lost packets " << statistics[2] << "/" << referenceStatistics[2]
+                   << ", lost bytes " << statistics[3] << "/" << referenceStatistics[3]
+                   << " (Defragmenter/ReferenceDefragmenter)!" << std::endl;
+         failed++;
+      }
+      if(benchmark) {
+         std::cout << format("Scenario %u: loss %1.0f%%, reordering %2u, up to %u fragments: "
+                             "%6.1f ns/packet (reference: %6.1f ns/packet)",
+                             number, 100.0 * scenario.Loss, scenario.Reordering,
+                             scenario.MaxFragments, time, referenceTime)
+                   << std::endl;
+      }
+   }
+
+   std::cout << (scenarios - failed) << " of " << scenarios
+             << " scenarios have identical statistics." << std::endl;
+   return((failed == 0) ? 0 : 1);
+}
@@ -0,0 +1,291 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "empiricaldistribution.h"
+#include "mutex.h"
+#include "tools.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <errno.h>
+#include <iostream>
+
+
+// Registered distributions are reference-counted: each registration and
+// each flow using a distribution holds a reference, the last release frees
+// its slot. Identifier 0 is invalid.
+static Mutex                  RegistryMutex;
+static EmpiricalDistribution* Registry[EMPIRICALDISTRIBUTION_MAX + 1];
+static unsigned int           RegistryReferences[EMPIRICALDISTRIBUTION_MAX + 1];
+
+
+// ###### Constructor #######################################################
+EmpiricalDistribution::EmpiricalDistribution()
+{
+   Mean = 0.0;
+}
+
+
+// ###### Destructor ########################################################
+EmpiricalDistribution::~EmpiricalDistribution()
+{
+}
+
+
+// ###### Load distribution from histogram or CDF file ######################
+// Each line contains "<value> <weight>" (histogram) or
+// "<value> <cumulative probability>" (CDF, non-decreasing), separated by
+// comma, semicolon or whitespace; '#' starts a comment.
+bool EmpiricalDistribution::load(const char* fileName, const bool cdf)
+{
+   FILE* fh = fopen(fileName, "r");
+   if(fh == NULL) {
+      std::cerr << "ERROR: Unable to open distribution file " << fileName
+                << " - " << strerror(errno) << "!" << std::endl;
+      return(false);
+   }
+
+   std::vector<double> values;
+   std::vector<double> weights;
+   double              lastCumulative = 0.0;
+   size_t              lineNumber     = 0;
+   char                line[1024];
+   while(fgets((char*)&line, sizeof(line), fh) != NULL) {
+      lineNumber++;
+      char* comment = strchr((char*)&line, '#');
+      if(comment != NULL) {
+         *comment = 0x00;
+      }
+      for(char* c = (char*)&line; *c != 0x00; c++) {
+         if( (*c == ',') || (*c == ';') ) {
+            *c = ' ';
+         }
+      }
+      double value;
+      double weight;
+      const int items = sscanf((const char*)&line, "%lf %lf", &value, &weight);
+      if(items <= 0) {
+         continue;   // Empty line
+      }
+      if( (items != 2) || (weight < 0.0) ||
+          ((cdf) && ((weight < lastCumulative) || (weight > 1.0 + 1e-9))) ) {
+         std::cerr << "ERROR: Bad entry in distribution file " << fileName
+                   << ", line " << lineNumber << "!" << std::endl;
+         fclose(fh);
+         return(false);
+      }
+      if(cdf) {
+         // The CDF steps become the probability masses.
+         const double mass = weight - lastCumulative;
+         lastCumulative = weight;
+         weight         = mass;
+      }
+      values.push_back(value);
+      weights.push_back(weight);
+   }
+   fclose(fh);
+
+   if(!initialize(values, weights)) {
+      std::cerr << "ERROR: Distribution file " << fileName
+                << " contains no usable entries!" << std::endl;
+      return(false);
+   }
+   Name = fileName;
+   return(true);
+}
+
+
+// ###### Build alias table #################################################
+bool EmpiricalDistribution::initialize(const std::vector<double>& values,
+                                       const std::vector<double>& weights)
+{
+   const size_t n = values.size();
+   if( (n == 0) || (n > EMPIRICALDISTRIBUTION_ENTRIES) || (weights.size() != n) ) {
+      return(false);
+   }
+   double total = 0.0;
+   for(size_t i = 0;i < n;i++) {
+      if(!(weights[i] >= 0.0)) {
+         return(false);
+      }
+      total += weights[i];
+   }
+   if(!(total > 0.0)) {
+      return(false);
+   }
+
+   Values = values;
+   Weights.resize(n);
+   Probability.resize(n);
+   Alias.resize(n);
+   Mean = 0.0;
+
+   // ====== Vose's algorithm ===============================================
+   std::vector<uint32_t> small;
+   std::vector<uint32_t> large;
+   for(size_t i = 0;i < n;i++) {
+      Weights[i]     = weights[i] / total;
+      Mean          += Weights[i] * Values[i];
+      Probability[i] = Weights[i] * n;
+      Alias[i]       = i;
+      if(Probability[i] < 1.0) {
+         small.push_back(i);
+      }
+      else {
+         large.push_back(i);
+      }
+   }
+   while( (!small.empty()) && (!large.empty()) ) {
+      const uint32_t s = small.back();
+      small.pop_back();
+      const uint32_t l = large.back();
+      Alias[s]        = l;
+      Probability[l] -= 1.0 - Probability[s];
+      if(Probability[l] < 1.0) {
+         large.pop_back();
+         small.push_back(l);
+      }
+   }
+   // Remaining columns are full, up to rounding errors.
+   for(size_t i = 0;i < small.size();i++) {
+      Probability[small[i]] = 1.0;
+   }
+   for(size_t i = 0;i < large.size();i++) {
+      Probability[large[i]] = 1.0;
+   }
+   return(true);
+}
+
+
+// ###### Draw value ########################################################
+double EmpiricalDistribution::sample() const
+{
+   // One random number selects both the column and the side of the column.
+   const size_t n      = Values.size();
+   const double u      = randomDouble() * n;
+   size_t       column = (size_t)u;
+   if(column >= n) {
+      column = n - 1;
+   }
+   if(u - column < Probability[column]) {
+      return(Values[column]);
+   }
+   return(Values[Alias[column]]);
+}
+
+
+// ###### Register distribution (takes ownership) ###########################
+// The caller holds a reference to the returned identifier, which has to be
+// released by releaseDistribution().
+unsigned int EmpiricalDistribution::registerDistribution(EmpiricalDistribution* distribution)
+{
+   unsigned int identifier = 0;
+   unsigned int freeSlot   = 0;
+   RegistryMutex.lock();
+   // Identical distributions (e.g. of repeated flows) share one entry.
+   for(unsigned int i = 1;i <= EMPIRICALDISTRIBUTION_MAX;i++) {
+      if(Registry[i] == NULL) {
+         if(freeSlot == 0) {
+            freeSlot = i;
+         }
+      }
+      else if( (Registry[i]->Values == distribution->Values) &&
+               (Registry[i]->Weights == distribution->Weights) ) {
+         identifier = i;
+         break;
+      }
+   }
+   if(identifier != 0) {
+      RegistryReferences[identifier]++;
+      delete distribution;
+   }
+   else if(freeSlot != 0) {
+      identifier = freeSlot;
+      Registry[identifier]           = distribution;
+      RegistryReferences[identifier] = 1;
+   }
+   else {
+      std::cerr << "ERROR: Too many empirical distributions!" << std::endl;
+      delete distribution;
+   }
+   RegistryMutex.unlock();
+   return(identifier);
+}
+
+
+// ###### Add reference to registered distribution ##########################
+void EmpiricalDistribution::retainDistribution(const unsigned int identifier)
+{
+   if( (identifier == 0) || (identifier > EMPIRICALDISTRIBUTION_MAX) ) {
+      return;
+   }
+   RegistryMutex.lock();
+   if(Registry[identifier] != NULL) {
+      RegistryReferences[identifier]++;
+   }
+   RegistryMutex.unlock();
+}
+
+
+// ###### Release reference to registered distribution ######################
+void EmpiricalDistribution::releaseDistribution(const unsigned int identifier)
+{
+   if( (identifier == 0) || (identifier > EMPIRICALDISTRIBUTION_MAX) ) {
+      return;
+   }
+   EmpiricalDistribution* distribution = NULL;
+   RegistryMutex.lock();
+   if( (Registry[identifier] != NULL) && (--RegistryReferences[identifier] == 0) ) {
+      distribution         = Registry[identifier];
+      Registry[identifier] = NULL;
+   }
+   RegistryMutex.unlock();
+   delete distribution;
+}
+
+
+// ###### Get registered distribution #######################################
+// The returned distribution remains valid as long as the caller holds a
+// reference to it.
+const EmpiricalDistribution* EmpiricalDistribution::getDistribution(const unsigned int identifier)
+{
+   if( (identifier == 0) || (identifier > EMPIRICALDISTRIBUTION_MAX) ) {
+      return(NULL);
+   }
+   RegistryMutex.lock();
+   const EmpiricalDistribution* distribution = Registry[identifier];
+   RegistryMutex.unlock();
+   return(distribution);
+}
+
+
+// ###### Draw value from registered distribution ###########################
+double EmpiricalDistribution::sample(const unsigned int identifier)
+{
+   const EmpiricalDistribution* distribution = getDistribution(identifier);
+   if(distribution == NULL) {
+      return(0.0);
+   }
+   return(distribution->sample());
+}
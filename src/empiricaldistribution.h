@@ -0,0 +1,86 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#ifndef EMPIRICALDISTRIBUTION_H
+#define EMPIRICALDISTRIBUTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+// Discrete empirical distribution, sampled in O(1) by Walker's alias method
+// (table construction by Vose's algorithm). Distributions are registered in
+// a process-wide table; the random number generator RANDOM_EMPIRICAL refers
+// to them by identifier (ValueArray[1]), ValueArray[0] holds the mean.
+#define EMPIRICALDISTRIBUTION_MAX     256
+#define EMPIRICALDISTRIBUTION_ENTRIES 65536
+
+class EmpiricalDistribution
+{
+   // ====== Methods ========================================================
+   public:
+   EmpiricalDistribution();
+   ~EmpiricalDistribution();
+
+   bool load(const char* fileName, const bool cdf);
+   bool initialize(const std::vector<double>& values,
+                   const std::vector<double>& weights);
+   double sample() const;
+
+   inline size_t getEntries() const {
+      return(Values.size());
+   }
+   inline double getValue(const size_t index) const {
+      return(Values[index]);
+   }
+   inline double getWeight(const size_t index) const {
+      return(Weights[index]);
+   }
+   inline double getMean() const {
+      return(Mean);
+   }
+   inline const std::string& getName() const {
+      return(Name);
+   }
+
+   static unsigned int registerDistribution(EmpiricalDistribution* distribution);
+   static void retainDistribution(const unsigned int identifier);
+   static void releaseDistribution(const unsigned int identifier);
+   static const EmpiricalDistribution* getDistribution(const unsigned int identifier);
+   static double sample(const unsigned int identifier);
+
+
+   // ====== Private Data ===================================================
+   private:
+   std::string            Name;
+   std::vector<double>    Values;
+   std::vector<double>    Weights;       // Normalised, for encoding
+   std::vector<double>    Probability;   // Alias table: threshold ...
+   std::vector<uint32_t>  Alias;         // ... and alias of each column
+   double                 Mean;
+};
+
+#endif
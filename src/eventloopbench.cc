@@ -0,0 +1,274 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "flow.h"
+#include "tools.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <iostream>
+#include <vector>
+
+
+// Measures the FlowManager's event loop for 10 to 50,000 flows: each flow
+// has its own UDP socket in the poll interest set, like an outgoing flow
+// of the active node. The flows' threads are not started. In each round, a
+// few random flows get a NETPERFMETER_DATA message; the time until the
+// FlowManager thread has woken up, received the messages and updated the
+// flows' statistics is the wake-up cost. For comparison, a poll() call over
+// all sockets is measured, which the former pollfd based loop needed per
+// wake-up. The MessageReader registration of the sockets, setting and
+// resetting the flows' sockets, i.e. watchSocket() and unwatchSocket()
+// (including the flow lookup indexes), and the removal of the flows are
+// timed as well.
+//
+// Usage: eventloopbench [flows ...]
+// Each socket needs a descriptor, i.e. flow counts beyond RLIMIT_NOFILE
+// are skipped.
+
+#define ROUNDS                 2000
+#define READY_SOCKETS          4     // Sockets made readable per round
+#define POLL_CALLS             200
+#define RESERVED_DESCRIPTORS   64
+#define BENCHMARK_MEASUREMENT  0x1234567890abcdefULL
+
+MessageReader gMessageReader;
+extern unsigned int gOutputVerbosity;
+
+
+// ###### Create UDP socket bound to the loopback address ###################
+static int createLoopbackSocket(sockaddr_union& address)
+{
+   const int sd = ext_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+   if(sd < 0) {
+      std::cerr << "ERROR: Unable to create UDP socket - "
+                << strerror(errno) << "!" << std::endl;
+      exit(1);
+   }
+   memset(&address, 0, sizeof(address));
+   address.in.sin_family      = AF_INET;
+   address.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   socklen_t addressLength = sizeof(address.in);
+   if( (ext_bind(sd, &address.sa, addressLength) < 0) ||
+       (ext_getsockname(sd, &address.sa, &addressLength) < 0) ) {
+      std::cerr << "ERROR: Unable to bind UDP socket - "
+                << strerror(errno) << "!" << std::endl;
+      exit(1);
+   }
+   return(sd);
+}
+
+
+// ###### Ensure that enough socket descriptors are available ###############
+static bool reserveDescriptors(const unsigned int flows)
+{
+   const rlim_t needed = (rlim_t)flows + RESERVED_DESCRIPTORS;
+   rlimit       limit;
+   if(getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+      return(false);
+   }
+   if(limit.rlim_cur < needed) {
+      if(limit.rlim_max < needed) {
+         limit.rlim_max = needed;   // Only possible with CAP_SYS_RESOURCE
+      }
+      limit.rlim_cur = needed;
+      if(setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+         return(false);
+      }
+   }
+   return(true);
+}
+
+
+// ###### Get number of messages received by a flow #########################
+static unsigned long long getReceivedPackets(Flow* flow)
+{
+   flow->lock();
+   const unsigned long long receivedPackets =
+      flow->getCurrentBandwidthStats().ReceivedPackets;
+   flow->unlock();
+   return(receivedPackets);
+}
+
+
+// ###### Measure the event loop ############################################
+static void runBenchmark(const unsigned int flows, const int senderSD)
+{
+   if(!reserveDescriptors(flows)) {
+      std::cout << format("%6u flows: skipped, not enough socket descriptors"
+                          " (RLIMIT_NOFILE)", flows)
+                << std::endl;
+      return;
+   }
+
+   // ====== Create sockets =================================================
+   std::vector<int>            socketSet(flows);
+   std::vector<sockaddr_union> addressSet(flows);
+   for(unsigned int i = 0;i < flows;i++) {
+      socketSet[i] = createLoopbackSocket(addressSet[i]);
+   }
+
+   // ====== Former loop: poll() over all sockets ===========================
+   std::vector<pollfd> pollFDs(flows);
+   for(unsigned int i = 0;i < flows;i++) {
+      pollFDs[i].fd      = socketSet[i];
+      pollFDs[i].events  = POLLIN;
+      pollFDs[i].revents = 0;
+   }
+   NetPerfMeterDataMessage dataMsg;
+   memset(&dataMsg, 0, sizeof(dataMsg));
+   dataMsg.Header.Type   = NETPERFMETER_DATA;
+   dataMsg.Header.Flags  = NPMDF_FRAME_BEGIN|NPMDF_FRAME_END;
+   dataMsg.Header.Length = htons(sizeof(dataMsg));
+   dataMsg.MeasurementID = hton64(BENCHMARK_MEASUREMENT);
+   for(unsigned int j = 0;j < READY_SOCKETS;j++) {
+      const unsigned int i = (unsigned int)(random64() % flows);
+      ext_sendto(senderSD, &dataMsg, sizeof(dataMsg), 0,
+                 &addressSet[i].sa, sizeof(addressSet[i].in));
+   }
+   const unsigned long long p1 = getMicroTime();
+   for(unsigned int j = 0;j < POLL_CALLS;j++) {
+      ext_poll(pollFDs.data(), pollFDs.size(), 0);
+   }
+   const unsigned long long p2 = getMicroTime();
+   for(unsigned int i = 0;i < flows;i++) {   // Drain the sockets again
+      char buffer[sizeof(dataMsg)];
+      while(ext_recv(socketSet[i], &buffer, sizeof(buffer), MSG_DONTWAIT) > 0) { }
+   }
+
+   // ====== Create flows and watch their sockets ===========================
+   // The sockets are registered at the MessageReader first, so that the
+   // watch time does not include the allocation of their message buffers.
+   MessageReader*     messageReader = FlowManager::getFlowManager()->getMessageReader();
+   FlowTrafficSpec    trafficSpec;
+   trafficSpec.Protocol = IPPROTO_UDP;
+   std::vector<Flow*> flowSet(flows);
+   for(unsigned int i = 0;i < flows;i++) {
+      flowSet[i] = new Flow(BENCHMARK_MEASUREMENT, i, 0, trafficSpec, -1);
+   }
+   const unsigned long long m1 = getMicroTime();
+   for(unsigned int i = 0;i < flows;i++) {
+      messageReader->registerSocket(IPPROTO_UDP, socketSet[i]);
+   }
+   const unsigned long long w1 = getMicroTime();
+   for(unsigned int i = 0;i < flows;i++) {
+      flowSet[i]->setSocketDescriptor(socketSet[i], true, true);
+   }
+   const unsigned long long w2 = getMicroTime();
+
+   // ====== Make some sockets ready, wait for the FlowManager ==============
+   unsigned long long wakeUpTime = 0;
+   for(unsigned int round = 0;round < ROUNDS;round++) {
+      unsigned int       ready[READY_SOCKETS];
+      unsigned long long received[READY_SOCKETS];
+      for(unsigned int j = 0;j < READY_SOCKETS;j++) {
+         ready[j]    = (unsigned int)(random64() % flows);
+         received[j] = getReceivedPackets(flowSet[ready[j]]);
+      }
+
+      const unsigned long long t1 = getMicroTime();
+      for(unsigned int j = 0;j < READY_SOCKETS;j++) {
+         dataMsg.SeqNumber = hton64((uint64_t)round);
+         dataMsg.TimeStamp = hton64(getMicroTime());
+         if(ext_sendto(senderSD, &dataMsg, sizeof(dataMsg), 0,
+                       &addressSet[ready[j]].sa, sizeof(addressSet[ready[j]].in)) < 0) {
+            std::cerr << "ERROR: Unable to send message - "
+                      << strerror(errno) << "!" << std::endl;
+            exit(1);
+         }
+      }
+      for(unsigned int j = 0;j < READY_SOCKETS;j++) {
+         // The same flow may have been chosen several times.
+         while(getReceivedPackets(flowSet[ready[j]]) <= received[j]) {
+            sched_yield();
+         }
+      }
+      wakeUpTime += getMicroTime() - t1;
+   }
+
+   // ====== Unwatch the sockets, then remove the flows =====================
+   const unsigned long long u1 = getMicroTime();
+   for(unsigned int i = 0;i < flows;i++) {
+      flowSet[i]->setSocketDescriptor(-1, false, false);
+   }
+   const unsigned long long u2 = getMicroTime();
+   for(unsigned int i = 0;i < flows;i++) {
+      messageReader->deregisterSocket(socketSet[i]);   // The flow's registration
+      messageReader->deregisterSocket(socketSet[i]);   // The benchmark's one
+      ext_close(socketSet[i]);
+   }
+   const unsigned long long r1 = getMicroTime();
+   for(unsigned int i = 0;i < flows;i++) {
+      delete flowSet[i];
+   }
+   const unsigned long long r2 = getMicroTime();
+
+   std::cout << format("%6u flows: wake-up %6.2f us per round with %u ready sockets"
+                       " (poll() over all sockets: %8.2f us);"
+                       " per socket: register %5.2f us, watch %5.2f us,"
+                       " unwatch %5.2f us; remove flow %5.2f us",
+                       flows,
+                       (double)wakeUpTime / ROUNDS, READY_SOCKETS,
+                       (double)(p2 - p1) / POLL_CALLS,
+                       (double)(w1 - m1) / flows,
+                       (double)(w2 - w1) / flows,
+                       (double)(u2 - u1) / flows,
+                       (double)(r2 - r1) / flows)
+             << std::endl;
+}
+
+
+// ###### Main program ######################################################
+int main(int argc, char** argv)
+{
+   std::vector<unsigned int> flowCounts;
+   for(int i = 1;i < argc;i++) {
+      const int flows = atoi(argv[i]);
+      if(flows <= 0) {
+         std::cerr << "Usage: " << argv[0] << " [flows ...]" << std::endl;
+         exit(1);
+      }
+      flowCounts.push_back((unsigned int)flows);
+   }
+   if(flowCounts.empty()) {
+      const unsigned int defaultFlowCounts[] = { 10, 100, 1000, 10000, 50000 };
+      flowCounts.assign(defaultFlowCounts,
+                        defaultFlowCounts + sizeof(defaultFlowCounts) / sizeof(defaultFlowCounts[0]));
+   }
+
+   gOutputVerbosity = 0;
+   sockaddr_union senderAddress;
+   const int      senderSD = createLoopbackSocket(senderAddress);
+   FlowManager::getFlowManager();   // Starts the FlowManager thread
+
+   std::cout << "FlowManager event loop, " << ROUNDS << " rounds:" << std::endl;
+   for(std::vector<unsigned int>::const_iterator iterator = flowCounts.begin();
+       iterator != flowCounts.end(); iterator++) {
+      runBenchmark(*iterator, senderSD);
+   }
+   ext_close(senderSD);
+   return(0);
+}
@@ -24,6 +24,10 @@
 #include "flow.h"
 #include "control.h"
 #include "transfer.h"
+#include "bufferarena.h"
+#include "mptcpinfo.h"
+#include "udpreceiveworker.h"
+#include "receiveworker.h"
 
 #include <string.h>
 #include <signal.h>
@@ -31,11 +35,19 @@
 #include <assert.h>
 #include <math.h>
 #include <netinet/tcp.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include <algorithm>
 #include <set>
 
 #include <set>
 
 
+// Maximum number of ready sockets handled per epoll_wait() call
+#define FLOWMANAGER_MAX_EVENTS 256
+
 // Flow Manager Singleton object
 FlowManager FlowManager::FlowManagerSingleton;
 
@@ -49,6 +61,39 @@ FlowManager::FlowManager()
    FirstDisplayEvent = 0;
    LastDisplayEvent  = 0;
    NextDisplayEvent  = 0;
+   NextCPUIndex      = 0;
+   MainLoopCPU       = -1;
+   MainLoopThreadID  = 0;
+   FlowSchedulingPolicy   = SCHED_OTHER;
+   FlowSchedulingPriority = 0;
+   Prefault               = false;
+   ReceiveWorkerPolicy    = RECEIVEWORKER_POLICY_LEASTLOADED;
+   NextReceiveWorker      = 0;
+   Reader.setStreamBulkRead(true);
+   if(ext_pipe((int*)&WakeUpPipe) == 0) {
+      ext_fcntl(WakeUpPipe[0], F_SETFL, O_NONBLOCK);
+      ext_fcntl(WakeUpPipe[1], F_SETFL, O_NONBLOCK);
+   }
+   else {
+      WakeUpPipe[0] = WakeUpPipe[1] = -1;
+   }
+#ifdef __linux__
+   EpollFD = epoll_create1(EPOLL_CLOEXEC);
+   if(EpollFD < 0) {
+      std::cerr << "ERROR: Unable to create epoll instance - "
+                << strerror(errno) << "!" << std::endl;
+      exit(1);
+   }
+   if(WakeUpPipe[0] >= 0) {
+      epoll_event event;
+      memset(&event, 0, sizeof(event));
+      event.events  = EPOLLIN;
+      event.data.fd = WakeUpPipe[0];
+      epoll_ctl(EpollFD, EPOLL_CTL_ADD, WakeUpPipe[0], &event);
+   }
+#else
+   UpdatedPollSet = true;
+#endif
    start();
 }
 
@@ -57,7 +102,141 @@ FlowManager::FlowManager()
 FlowManager::~FlowManager()
 {
    stop();
+   wakeUp();
    waitForFinish();
+   if(WakeUpPipe[0] >= 0) {
+      ext_close(WakeUpPipe[0]);
+      ext_close(WakeUpPipe[1]);
+   }
+#ifdef __linux__
+   close(EpollFD);
+#endif
+}
+
+
+// ###### Interrupt the reception thread's poll() ###########################
+void FlowManager::wakeUp()
+{
+   if(WakeUpPipe[1] >= 0) {
+      const char c = 0x00;
+      if(ext_write(WakeUpPipe[1], &c, 1) < 0) {
+         // The pipe is full, i.e. there is already a pending wake-up.
+      }
+   }
+}
+
+
+// ###### Append flow to the flows of an index key ########################
+template<class Index, class Key> static void insertIntoIndex(Index&     index,
+                                                             const Key& key,
+                                                             Flow*      flow)
+{
+   index[key].push_back(flow);
+}
+
+
+// ###### Remove flow from the flows of an index key ########################
+template<class Index, class Key> static void removeFromIndex(Index&     index,
+                                                             const Key& key,
+                                                             Flow*      flow)
+{
+   typename Index::iterator found = index.find(key);
+   if(found != index.end()) {
+      std::vector<Flow*>& flows = found->second;
+      std::vector<Flow*>::iterator position = std::find(flows.begin(), flows.end(), flow);
+      if(position != flows.end()) {
+         flows.erase(position);
+      }
+      if(flows.empty()) {
+         index.erase(found);
+      }
+   }
+}
+
+
+// ###### Get first flow of an index key ####################################
+template<class Index, class Key> static Flow* lookupIndex(const Index& index,
+                                                          const Key&   key)
+{
+   typename Index::const_iterator found = index.find(key);
+   if(found != index.end()) {
+      return(found->second.front());
+   }
+   return(NULL);
+}
+
+
+// ###### Get normalized address key ########################################
+bool FlowManager::getAddressKey(const sockaddr* address, AddressKey& key)
+{
+   if(address->sa_family == AF_INET6) {
+      memcpy(&key.Address, &((const sockaddr_in6*)address)->sin6_addr, 16);
+   }
+   else if(address->sa_family == AF_INET) {
+      key.Address[0] = 0;
+      key.Address[1] = 0;
+      key.Address[2] = htonl(0xffff);
+      memcpy(&key.Address[3], &((const sockaddr_in*)address)->sin_addr, 4);
+   }
+   else {
+      return(false);
+   }
+   key.Port = getPort(address);
+   return(true);
+}
+
+
+// ###### Add flow to socket index ##########################################
+void FlowManager::indexFlowSocket(Flow* flow)
+{
+   if(flow->SocketDescriptor >= 0) {
+      const SocketKey key = { flow->SocketDescriptor, flow->StreamID };
+      insertIntoIndex(SocketIndex, key, flow);
+   }
+}
+
+
+// ###### Remove flow from socket index #####################################
+void FlowManager::unindexFlowSocket(Flow* flow)
+{
+   if(flow->SocketDescriptor >= 0) {
+      const SocketKey key = { flow->SocketDescriptor, flow->StreamID };
+      removeFromIndex(SocketIndex, key, flow);
+      for(std::vector<ReceiveWorker*>::iterator iterator = ReceiveWorkers.begin();
+          iterator != ReceiveWorkers.end();iterator++) {
+         (*iterator)->forgetFlow(key, flow);
+      }
+   }
+}
+
+
+// ###### Add flow to address index #########################################
+// Only UDP flows are identified by source address; a TCP connection
+// may use the same port number.
+void FlowManager::indexFlowAddress(Flow* flow)
+{
+   AddressKey key;
+   if( (flow->RemoteAddressIsValid) &&
+       (flow->TrafficSpec.Protocol == IPPROTO_UDP) &&
+       (getAddressKey(&flow->RemoteAddress.sa, key)) ) {
+      insertIntoIndex(AddressIndex, key, flow);
+   }
+}
+
+
+// ###### Remove flow from address index ####################################
+void FlowManager::unindexFlowAddress(Flow* flow)
+{
+   AddressKey key;
+   if( (flow->RemoteAddressIsValid) &&
+       (flow->TrafficSpec.Protocol == IPPROTO_UDP) &&
+       (getAddressKey(&flow->RemoteAddress.sa, key)) ) {
+      removeFromIndex(AddressIndex, key, flow);
+      for(std::vector<UDPReceiveWorker*>::iterator iterator = UDPWorkers.begin();
+          iterator != UDPWorkers.end();iterator++) {
+         (*iterator)->forgetFlow(key, flow);
+      }
+   }
 }
 
 
@@ -65,8 +244,11 @@ FlowManager::~FlowManager()
 void FlowManager::addFlow(Flow* flow)
 {
    lock();
-   flow->PollFDEntry = NULL;
+   flow->PollSocketDescriptor = -1;
    FlowSet.push_back(flow);
+   const FlowIDKey key = { flow->MeasurementID, flow->FlowID, flow->StreamID };
+   insertIntoIndex(FlowIDIndex, key, flow);
+   indexFlowSocket(flow);
    unlock();
 }
 
@@ -78,7 +260,11 @@ void FlowManager::removeFlow(Flow* flow)
    flow->deactivate();
 
    // ====== Remove flow from flow set ======================================
-   flow->PollFDEntry = NULL;
+   unwatchFlow(flow);
+   const FlowIDKey key = { flow->MeasurementID, flow->FlowID, flow->StreamID };
+   removeFromIndex(FlowIDIndex, key, flow);
+   unindexFlowSocket(flow);
+   unindexFlowAddress(flow);
    for(std::vector<Flow*>::iterator iterator = FlowSet.begin();
        iterator != FlowSet.end();iterator++) {
        if(*iterator == flow) {
@@ -101,6 +287,357 @@ void FlowManager::removeFlow(Flow* flow)
 }
 
 
+// ###### Apply thread settings to a receive worker ########################
+// The worker thread gets the CPU affinity and scheduling settings of the
+// flow threads; it has to be started afterwards.
+void FlowManager::prepareWorkerThread(Thread* thread)
+{
+   lock();
+   if(CPUSet.size() > 0) {
+      const size_t first = (CPUSet.size() > 1) ? 1 : 0;
+      const std::vector<unsigned int> cpus(
+         1, CPUSet[first + (NextCPUIndex % (CPUSet.size() - first))]);
+      NextCPUIndex++;
+      thread->setCPUAffinity(cpus);
+   }
+   thread->setScheduling(FlowSchedulingPolicy, FlowSchedulingPriority);
+   thread->setStackPrefault((Prefault == true) ? NETPERFMETER_STACK_PREFAULT : 0);
+   unlock();
+}
+
+
+// ###### Add UDP receive worker ############################################
+void FlowManager::addUDPWorker(UDPReceiveWorker* worker)
+{
+   lock();
+   prepareWorkerThread(worker);
+   UDPWorkers.push_back(worker);
+   unlock();
+}
+
+
+// ###### Remove UDP receive worker #########################################
+void FlowManager::removeUDPWorker(UDPReceiveWorker* worker)
+{
+   lock();
+   for(std::vector<UDPReceiveWorker*>::iterator iterator = UDPWorkers.begin();
+       iterator != UDPWorkers.end();iterator++) {
+      if(*iterator == worker) {
+         UDPWorkers.erase(iterator);
+         break;
+      }
+   }
+   unlock();
+}
+
+
+// ###### Add receive worker ################################################
+void FlowManager::addReceiveWorker(ReceiveWorker* worker)
+{
+   lock();
+   prepareWorkerThread(worker);
+   ReceiveWorkers.push_back(worker);
+   unlock();
+}
+
+
+// ###### Remove receive worker #############################################
+// The worker's sockets are handed back to the FlowManager thread.
+void FlowManager::removeReceiveWorker(ReceiveWorker* worker)
+{
+   lock();
+   for(std::map<int, PollEntry>::iterator iterator = PollSet.begin();
+       iterator != PollSet.end(); iterator++) {
+      PollEntry& entry = iterator->second;
+      if(entry.Worker == worker) {
+         if(!entry.Migrating) {
+            worker->unwatchSocket(iterator->first);
+#ifdef __linux__
+            epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events  = EPOLLIN;
+            event.data.fd = iterator->first;
+            epoll_ctl(EpollFD, EPOLL_CTL_ADD, iterator->first, &event);
+#else
+            UpdatedPollSet = true;
+#endif
+         }
+         entry.Worker    = NULL;
+         entry.Migrating = false;
+      }
+   }
+   worker->ShardSockets = 0;
+   for(std::vector<ReceiveWorker*>::iterator iterator = ReceiveWorkers.begin();
+       iterator != ReceiveWorkers.end();iterator++) {
+      if(*iterator == worker) {
+         ReceiveWorkers.erase(iterator);
+         break;
+      }
+   }
+   unlock();
+}
+
+
+// ###### Set policy for assigning sockets to receive workers ###############
+void FlowManager::setReceiveWorkerPolicy(const int policy)
+{
+   lock();
+   ReceiveWorkerPolicy = policy;
+   unlock();
+}
+
+
+// ###### Assign identified socket to a receive worker ######################
+// The FlowManager thread may still be reading from the socket (the
+// identification is handled within handleNetPerfMeterData()). So, the
+// socket is only migrating here; migrateSocket() completes the hand-over.
+void FlowManager::assignReceiveWorker(const int socketDescriptor)
+{
+   std::map<int, PollEntry>::iterator found = PollSet.find(socketDescriptor);
+   if( (ReceiveWorkers.size() == 0) || (found == PollSet.end()) ||
+       (found->second.Unidentified) || (found->second.Worker != NULL) ) {
+      return;
+   }
+   const int protocol = found->second.Protocol;
+   if( (protocol != IPPROTO_TCP) && (protocol != IPPROTO_MPTCP) &&
+       (protocol != IPPROTO_SCTP) && (protocol != IPPROTO_DCCP) ) {
+      return;
+   }
+
+   // ====== Choose worker ==================================================
+   ReceiveWorker* worker;
+   if(ReceiveWorkerPolicy == RECEIVEWORKER_POLICY_ROUNDROBIN) {
+      worker = ReceiveWorkers[NextReceiveWorker % ReceiveWorkers.size()];
+      NextReceiveWorker++;
+   }
+   else {
+      worker = ReceiveWorkers[0];
+      for(std::vector<ReceiveWorker*>::const_iterator iterator = ReceiveWorkers.begin();
+          iterator != ReceiveWorkers.end();iterator++) {
+         if((*iterator)->ShardSockets < worker->ShardSockets) {
+            worker = *iterator;
+         }
+      }
+   }
+   worker->ShardSockets++;
+   found->second.Worker    = worker;
+   found->second.Migrating = true;
+}
+
+
+// ###### Hand over migrating socket to its receive worker ##################
+void FlowManager::migrateSocket(const int socketDescriptor)
+{
+   std::map<int, PollEntry>::iterator found = PollSet.find(socketDescriptor);
+   if( (found != PollSet.end()) && (found->second.Migrating) ) {
+      found->second.Migrating = false;
+#ifdef __linux__
+      epoll_ctl(EpollFD, EPOLL_CTL_DEL, socketDescriptor, NULL);
+#else
+      UpdatedPollSet = true;
+#endif
+      found->second.Worker->watchSocket(socketDescriptor, found->second.Protocol);
+   }
+}
+
+
+// ###### Add socket to poll interest set ##################################
+void FlowManager::watchSocket(const int  socketDescriptor,
+                              const int  protocol,
+                              const bool unidentified)
+{
+   lock();
+   std::map<int, PollEntry>::iterator found = PollSet.find(socketDescriptor);
+   if(found == PollSet.end()) {
+      PollEntry entry;
+      entry.Protocol       = protocol;
+      entry.FlowReferences = 0;
+      entry.Unidentified   = false;
+      entry.Worker         = NULL;
+      entry.Migrating      = false;
+      found = PollSet.insert(std::pair<int, PollEntry>(socketDescriptor, entry)).first;
+#ifdef __linux__
+      epoll_event event;
+      memset(&event, 0, sizeof(event));
+      event.events  = EPOLLIN;
+      event.data.fd = socketDescriptor;
+      if(epoll_ctl(EpollFD, EPOLL_CTL_ADD, socketDescriptor, &event) < 0) {
+         std::cerr << "WARNING: Unable to add socket " << socketDescriptor
+                   << " to epoll set - " << strerror(errno) << "!" << std::endl;
+      }
+#else
+      UpdatedPollSet = true;
+#endif
+   }
+   if(unidentified) {
+      found->second.Unidentified = true;
+   }
+   else {
+      found->second.FlowReferences++;
+   }
+   unlock();
+}
+
+
+// ###### Remove socket from poll interest set ##############################
+void FlowManager::unwatchSocket(const int  socketDescriptor,
+                                const bool unidentified)
+{
+   lock();
+   std::map<int, PollEntry>::iterator found = PollSet.find(socketDescriptor);
+   if(found != PollSet.end()) {
+      if(unidentified) {
+         found->second.Unidentified = false;
+      }
+      else if(found->second.FlowReferences > 0) {
+         found->second.FlowReferences--;
+      }
+      if( (found->second.FlowReferences == 0) && (!found->second.Unidentified) ) {
+         ReceiveWorker* worker = found->second.Worker;
+         if(worker != NULL) {
+            worker->ShardSockets--;
+         }
+         if( (worker != NULL) && (!found->second.Migrating) ) {
+            worker->unwatchSocket(socketDescriptor);
+         }
+         else {
+#ifdef __linux__
+            // A closed socket has already left the epoll set.
+            epoll_ctl(EpollFD, EPOLL_CTL_DEL, socketDescriptor, NULL);
+#else
+            UpdatedPollSet = true;
+#endif
+         }
+         PollSet.erase(found);
+      }
+   }
+   unlock();
+}
+
+
+// ###### Add flow's socket to poll interest set ############################
+void FlowManager::watchFlow(Flow* flow)
+{
+   lock();
+   flow->lock();
+   if( (flow->PollSocketDescriptor < 0) &&
+       (flow->InputStatus != Flow::Off) &&
+       (flow->SocketDescriptor >= 0) &&
+       (!((flow->TrafficSpec.Protocol == IPPROTO_UDP) &&   // Global UDP socket is handled by main loop!
+          (flow->RemoteControlSocketDescriptor >= 0))) ) { // Incoming UDP association has RemoteControlSocketDescriptor >= 0.
+      flow->PollSocketDescriptor = flow->SocketDescriptor;
+      watchSocket(flow->PollSocketDescriptor, flow->TrafficSpec.Protocol, false);
+   }
+   flow->unlock();
+   unlock();
+}
+
+
+// ###### Remove flow's socket from poll interest set #######################
+// A receive worker locks the flow while holding its own lock. Therefore, the
+// flow must not be locked while unwatchSocket() locks the worker.
+void FlowManager::unwatchFlow(Flow* flow)
+{
+   lock();
+   flow->lock();
+   const int pollSocketDescriptor = flow->PollSocketDescriptor;
+   flow->PollSocketDescriptor = -1;
+   flow->unlock();
+   if(pollSocketDescriptor >= 0) {
+      unwatchSocket(pollSocketDescriptor, false);
+   }
+   unlock();
+}
+
+
+// ###### Set CPUs for FlowManager and flow threads #########################
+void FlowManager::setCPUSet(const std::vector<unsigned int>& cpus)
+{
+   lock();
+   CPUSet       = cpus;
+   NextCPUIndex = 0;
+   // The first CPU of the set is used for the FlowManager's receive thread.
+   std::vector<unsigned int> managerCPUs;
+   if(CPUSet.size() > 0) {
+      managerCPUs.push_back(CPUSet[0]);
+   }
+   setCPUAffinity(managerCPUs);
+   unlock();
+}
+
+
+// ###### Remember thread and CPU of the main loop ##########################
+// Called by the main loop itself, since the scalar statistics are not
+// necessarily written by the main loop's thread.
+void FlowManager::updateMainLoopStatus()
+{
+   const int cpu = Thread::getCPUOfCaller();
+   lock();
+   MainLoopCPU = cpu;
+   if(MainLoopThreadID == 0) {
+      MainLoopThreadID = Thread::getThreadIDOfCaller();
+   }
+   unlock();
+}
+
+
+// ###### Set scheduling class for FlowManager and flow threads ############
+void FlowManager::setFlowScheduling(const int policy, const int priority)
+{
+   lock();
+   FlowSchedulingPolicy   = policy;
+   FlowSchedulingPriority = priority;
+   if(!setScheduling(policy, priority)) {
+      // Already warned. Flows would fail the same way => use default class.
+      FlowSchedulingPolicy   = SCHED_OTHER;
+      FlowSchedulingPriority = 0;
+      setScheduling(SCHED_OTHER, 0);
+   }
+   unlock();
+}
+
+
+// ###### Turn on prefaulting of per-flow buffers ###########################
+void FlowManager::setPrefault(const bool prefault)
+{
+   lock();
+   Prefault = prefault;
+   Reader.setPrefault(prefault);
+   BufferArena::getBufferArena()->setPrefault(prefault);
+   setStackPrefault((prefault == true) ? NETPERFMETER_STACK_PREFAULT : 0);
+   unlock();
+}
+
+
+// ###### Prepare the settings of a flow's sender thread ####################
+void FlowManager::prepareFlowThread(Flow* flow)
+{
+   std::vector<unsigned int> cpus;
+
+   lock();
+   // ====== CPU affinity ===================================================
+   if(flow->TrafficSpec.CPU >= 0) {
+      cpus.push_back((unsigned int)flow->TrafficSpec.CPU);
+   }
+   else if(CPUSet.size() > 0) {
+      if(flow->AssignedCPU < 0) {
+         // Spread the flows round-robin over the CPU set. The first CPU is
+         // left to the FlowManager thread, unless it is the only one.
+         const size_t first = (CPUSet.size() > 1) ? 1 : 0;
+         flow->AssignedCPU = (int)CPUSet[first + (NextCPUIndex % (CPUSet.size() - first))];
+         NextCPUIndex++;
+      }
+      cpus.push_back((unsigned int)flow->AssignedCPU);
+   }
+   flow->setCPUAffinity(cpus);
+
+   // ====== Scheduling class and prefaulting ===============================
+   flow->setScheduling(FlowSchedulingPolicy, FlowSchedulingPriority);
+   flow->setStackPrefault((Prefault == true) ? NETPERFMETER_STACK_PREFAULT : 0);
+   unlock();
+}
+
+
 // ###### Print all flows ###################################################
 void FlowManager::printFlows(std::ostream& os,
                              const bool    printStatistics)
@@ -120,19 +657,10 @@ Flow* FlowManager::findFlow(const uint64_t measurementID,
                             const uint32_t flowID,
                             const uint16_t streamID)
 {
-   Flow* found = NULL;
+   const FlowIDKey key = { measurementID, flowID, streamID };
 
    lock();
-   for(std::vector<Flow*>::iterator iterator = FlowSet.begin();
-       iterator != FlowSet.end();iterator++) {
-      Flow* flow = *iterator;
-      if( (flow->MeasurementID == measurementID) &&
-          (flow->FlowID == flowID) &&
-          (flow->StreamID == streamID) ) {
-         found = flow;
-         break;
-      }
-   }
+   Flow* found = lookupIndex(FlowIDIndex, key);
    unlock();
 
    return(found);
@@ -143,19 +671,10 @@ Flow* FlowManager::findFlow(const uint64_t measurementID,
 Flow* FlowManager::findFlow(const int      socketDescriptor,
                             const uint16_t streamID)
 {
-   Flow* found = NULL;
+   const SocketKey key = { socketDescriptor, streamID };
 
    lock();
-   for(std::vector<Flow*>::iterator iterator = FlowSet.begin();
-       iterator != FlowSet.end();iterator++) {
-      Flow* flow = *iterator;
-      if(flow->SocketDescriptor == socketDescriptor) {
-         if(flow->StreamID == streamID) {
-            found = flow;
-            break;
-         }
-      }
-   }
+   Flow* found = lookupIndex(SocketIndex, key);
    unlock();
 
    return(found);
@@ -165,18 +684,13 @@ Flow* FlowManager::findFlow(const int      socketDescriptor,
 // ###### Find Flow by source address #######################################
 Flow* FlowManager::findFlow(const struct sockaddr* from)
 {
-   Flow* found = NULL;
+   AddressKey key;
+   if(!getAddressKey(from, key)) {
+      return(NULL);
+   }
 
    lock();
-   for(std::vector<Flow*>::iterator iterator = FlowSet.begin();
-       iterator != FlowSet.end();iterator++) {
-      Flow* flow = *iterator;
-      if( (flow->RemoteAddressIsValid) &&
-          (addresscmp(from, &flow->RemoteAddress.sa, true) == 0) ) {
-         found = flow;
-         break;
-      }
-   }
+   Flow* found = lookupIndex(AddressIndex, key);
    unlock();
 
    return(found);
@@ -190,6 +704,9 @@ bool FlowManager::startMeasurement(const uint64_t           measurementID,
                                    const OutputFileFormat   vectorFileFormat,
                                    const char*              scalarNamePattern,
                                    const OutputFileFormat   scalarFileFormat,
+                                   const unsigned long long warmUp,
+                                   const unsigned long long coolDownOffset,
+                                   const unsigned long long startTime,
                                    const bool               printFlows)
 {
    bool success = false;
@@ -201,16 +718,31 @@ bool FlowManager::startMeasurement(const uint64_t           measurementID,
                                  vectorNamePattern, vectorFileFormat,
                                  scalarNamePattern, scalarFileFormat)) {
          success = true;
+         // An absolute start time arms the flows to begin at that instant,
+         // instead of immediately.
+         const unsigned long long startAt = std::max(now, startTime);
+         if( (warmUp > 0) || (coolDownOffset > 0) ) {
+            measurement->setStatisticsWindow(startAt + warmUp,
+                                             (coolDownOffset > 0) ? startAt + coolDownOffset : 0);
+         }
          for(std::vector<Flow*>::iterator iterator = FlowSet.begin();
             iterator != FlowSet.end();iterator++) {
             Flow* flow = *iterator;
             if(flow->MeasurementID == measurementID) {
                flow->setMeasurement(measurement);
                if(flow->SocketDescriptor >= 0) {
-                  flow->TimeBase     = now;
-                  flow->TimeOffset    = 0;
+                  // A delayed start shifts the on/off schedule as well.
+                  flow->TimeBase     = startAt + flow->StartOffset;
+                  flow->TimeOffset   = 0;
+                  flow->StopTime     = (flow->StopOffset > 0) ? startAt + flow->StopOffset : 0;
+                  flow->StartPending = (flow->TimeBase > now) &&
+                                       (flow->TrafficSpec.OnOffEvents.size() == 0);
+                  flow->PlannedStart = 0;
+                  flow->ActualStart  = 0;
                   flow->InputStatus  = Flow::On;
-                  flow->OutputStatus = (flow->TrafficSpec.OnOffEvents.size() > 0) ? Flow::Off : Flow::On;
+                  flow->OutputStatus = ((flow->TrafficSpec.OnOffEvents.size() > 0) || (flow->StartPending)) ?
+                                          Flow::Off : Flow::On;
+                  watchFlow(flow);
                   if(printFlows) {
                      flow->print(std::cout);
                   }
@@ -230,28 +762,95 @@ bool FlowManager::startMeasurement(const uint64_t           measurementID,
 }
 
 
-// ###### Stop measurement ##################################################
-void FlowManager::stopMeasurement(const uint64_t           measurementID,
-                                  const bool               printFlows,
-                                  const unsigned long long now)
+// ###### Get offset of a flow within a ramp-up or ramp-down window ########
+static unsigned long long getScheduleOffset(const unsigned int       mode,
+                                            const unsigned long long window,
+                                            const size_t             index,
+                                            const size_t             flows)
+{
+   switch(mode) {
+      case FLOWSCHEDULE_LINEAR:
+         return(window * index / flows);
+      case FLOWSCHEDULE_RANDOM:
+         return((unsigned long long)rint(randomDouble() * window));
+   }
+   return(window);
+}
+
+
+// ###### Compute start and stop offsets of the measurement's flows ########
+// The flows are started by their own sender threads at the given offsets
+// after startMeasurement(), and ramped down (i.e. turned off) before the
+// end of the runtime. A flow's own start= option overrides the ramp-up.
+void FlowManager::scheduleFlows(const uint64_t           measurementID,
+                                const unsigned int       rampUpMode,
+                                const unsigned long long rampUp,
+                                const unsigned int       rampDownMode,
+                                const unsigned long long rampDown,
+                                const unsigned long long runtime)
 {
-   CPULoadStats.update();
    lock();
-   // We make a two-staged stopping process here:
-   // In stage 0, the flows' sender threads are told to stop.
-   //   => all threads can perform shutdown simultaneously
-   //   => much faster if there are many flows
-   // In stage 1, we wait until the threads have stopped.
-   for(unsigned int stage = 0;stage < 2;stage++) {
-      for(std::vector<Flow*>::iterator iterator = FlowSet.begin();
-         iterator != FlowSet.end();iterator++) {
-         Flow* flow = *iterator;
-         if(flow->MeasurementID == measurementID) {
-            // ====== Stop flow ================================================
-            if(stage == 0) {
-               flow->deactivate(true);
-            }
-            else {
+   size_t flows = 0;
+   for(std::vector<Flow*>::iterator iterator = FlowSet.begin();
+       iterator != FlowSet.end();iterator++) {
+      if((*iterator)->MeasurementID == measurementID) {
+         flows++;
+      }
+   }
+   size_t index = 0;
+   for(std::vector<Flow*>::iterator iterator = FlowSet.begin();
+       iterator != FlowSet.end();iterator++) {
+      Flow* flow = *iterator;
+      if(flow->MeasurementID == measurementID) {
+         unsigned long long startOffset = 0;
+         if(flow->TrafficSpec.StartOffset >= 0.0) {
+            const unsigned long long window =
+               (unsigned long long)rint(flow->TrafficSpec.StartOffset * 1000000.0);
+            startOffset = getScheduleOffset((flow->TrafficSpec.StartRandom) ? FLOWSCHEDULE_RANDOM :
+                                                                             FLOWSCHEDULE_FIXED,
+                                            window, index, flows);
+         }
+         else if(rampUp > 0) {
+            startOffset = getScheduleOffset(rampUpMode, rampUp, index, flows);
+         }
+
+         unsigned long long stopOffset = 0;
+         if( (rampDown > 0) && (runtime > rampDown) ) {
+            stopOffset = runtime - rampDown;
+            if(rampDownMode != FLOWSCHEDULE_FIXED) {
+               stopOffset += getScheduleOffset(rampDownMode, rampDown, index, flows);
+            }
+         }
+         flow->setSchedule(startOffset, stopOffset);
+         index++;
+      }
+   }
+   unlock();
+}
+
+
+// ###### Stop measurement ##################################################
+void FlowManager::stopMeasurement(const uint64_t           measurementID,
+                                  const bool               printFlows,
+                                  const unsigned long long now)
+{
+   CPULoadStats.update();
+   lock();
+   // We make a two-staged stopping process here:
+   // In stage 0, the flows' sender threads are told to stop.
+   //   => all threads can perform shutdown simultaneously
+   //   => much faster if there are many flows
+   // In stage 1, we wait until the threads have stopped.
+   for(unsigned int stage = 0;stage < 2;stage++) {
+      for(std::vector<Flow*>::iterator iterator = FlowSet.begin();
+         iterator != FlowSet.end();iterator++) {
+         Flow* flow = *iterator;
+         if(flow->MeasurementID == measurementID) {
+            // ====== Stop flow ================================================
+            if(stage == 0) {
+               flow->deactivate(true);
+            }
+            else {
                flow->deactivate(false);
                if(printFlows) {
                   flow->print(std::cout, true);
@@ -316,13 +915,19 @@ void FlowManager::removeMeasurement(Measurement* measurement)
 
 
 // ###### Add socket to flow manager ########################################
-void FlowManager::addSocket(const int protocol, const int socketDescriptor)
+void FlowManager::addSocket(const int protocol, const int socketDescriptor,
+                            ShmRing* ring)
 {
    lock();
    FlowManager::getFlowManager()->getMessageReader()->registerSocket(protocol, socketDescriptor);
-   UnidentifiedSockets.insert(std::pair<int, int>(socketDescriptor, protocol));
-   UpdatedUnidentifiedSockets = true;
+   if(ring != NULL) {
+      FlowManager::getFlowManager()->getMessageReader()->attachShmRing(socketDescriptor, ring);
+   }
+   watchSocket(socketDescriptor, protocol, true);
    unlock();
+#ifndef __linux__
+   wakeUp();   // Poll the new socket without waiting for the poll() timeout
+#endif
 }
 
 
@@ -341,15 +946,19 @@ Flow* FlowManager::identifySocket(const uint64_t         measurementID,
    lock();
    Flow* flow = findFlow(measurementID, flowID, streamID);
    if( (flow != NULL) && (flow->RemoteAddressIsValid == false) ) {
-      flow->lock();
+      // setSocketDescriptor() locks the receive workers, i.e. it has to be
+      // called before locking the flow.
       flow->setSocketDescriptor(socketDescriptor, false,
                                 (flow->getTrafficSpec().Protocol != IPPROTO_UDP));
+      flow->lock();
       flow->RemoteAddress        = *from;
       flow->RemoteAddressIsValid = true;
+      indexFlowAddress(flow);
       controlSocketDescriptor    = flow->RemoteControlSocketDescriptor;
       success = flow->initializeVectorFile(NULL, vectorFileFormat);
       flow->unlock();
       removeSocket(socketDescriptor, false);   // Socket is now managed as flow!
+      assignReceiveWorker(socketDescriptor);
    }
    unlock();
 
@@ -366,13 +975,11 @@ void FlowManager::removeSocket(const int  socketDescriptor,
                                const bool closeSocket)
 {
    lock();
-   std::map<int, int>::iterator found = UnidentifiedSockets.find(socketDescriptor);
-   if(found != UnidentifiedSockets.end()) {
-      UnidentifiedSockets.erase(found);
-      UpdatedUnidentifiedSockets = true;
-   }
+   unwatchSocket(socketDescriptor, true);
    if(closeSocket) {
-      FlowManager::getFlowManager()->getMessageReader()->deregisterSocket(socketDescriptor);
+      if(FlowManager::getFlowManager()->getMessageReader()->deregisterSocket(socketDescriptor)) {
+         ext_close(socketDescriptor);
+      }
    }
    unlock();
 }
@@ -388,6 +995,7 @@ unsigned long long FlowManager::getNextEvent()
        iterator != MeasurementSet.end(); iterator++) {
        const Measurement* measurement = iterator->second;
        nextEvent = std::min(nextEvent, measurement->NextStatisticsEvent);
+       nextEvent = std::min(nextEvent, measurement->getNextWindowEvent());
    }
    unlock();
 
@@ -404,6 +1012,9 @@ void FlowManager::handleEvents(const unsigned long long now)
    for(std::map<uint64_t, Measurement*>::iterator iterator = MeasurementSet.begin();
        iterator != MeasurementSet.end(); iterator++) {
        Measurement* measurement = iterator->second;
+       if(measurement->getNextWindowEvent() <= now) {
+          measurement->handleWindowEvent(now);
+       }
        if(measurement->NextStatisticsEvent <= now) {
           measurement->writeVectorStatistics(now, GlobalStats, RelGlobalStats);
        }
@@ -494,11 +1105,50 @@ void FlowManager::handleEvents(const unsigned long long now)
 }
 
 
+// ###### Take snapshot of the flows' statistics ###########################
+void FlowManager::snapshotStatistics(const uint64_t measurementID,
+                                     const bool     windowEnd)
+{
+   lock();
+   for(std::vector<Flow*>::iterator iterator = FlowSet.begin();
+      iterator != FlowSet.end();iterator++) {
+      Flow* flow = *iterator;
+      flow->lock();
+      if(flow->MeasurementID == measurementID) {
+         if(windowEnd) {
+            flow->WindowEndStats = flow->CurrentBandwidthStats;
+         }
+         else {
+            flow->WindowStartStats = flow->CurrentBandwidthStats;
+         }
+      }
+      flow->unlock();
+   }
+   unlock();
+}
+
+
+// ###### Get active duration of a flow within the statistics window #######
+static double getWindowDuration(unsigned long long       first,
+                                unsigned long long       last,
+                                const unsigned long long windowStart,
+                                const unsigned long long windowEnd)
+{
+   if(windowEnd > 0) {
+      first = std::max(first, windowStart);
+      last  = std::min(last, windowEnd);
+   }
+   return((last > first) ? (last - first) / 1000000.0 : 0.0);
+}
+
+
 // ###### Write scalars #####################################################
 void FlowManager::writeScalarStatistics(const uint64_t           measurementID,
                                         const unsigned long long now,
                                         OutputFile&              scalarFile,
-                                        const unsigned long long firstStatisticsEvent)
+                                        const unsigned long long firstStatisticsEvent,
+                                        const unsigned long long windowStart,
+                                        const unsigned long long windowEnd)
 {
    std::string objectName =
       std::string("netPerfMeter.") +
@@ -511,8 +1161,19 @@ void FlowManager::writeScalarStatistics(const uint64_t           measurementID,
       Flow* flow = *iterator;
       flow->lock();
       if(flow->MeasurementID == measurementID) {
-         const double transmissionDuration = (flow->LastTransmission - flow->FirstTransmission) / 1000000.0;
-         const double receptionDuration    = (flow->LastReception - flow->FirstReception) / 1000000.0;
+         // With a steady-state window, only the difference of the snapshots
+         // taken at its boundaries is reported.
+         const FlowBandwidthStats stats = (windowEnd > 0) ?
+            flow->WindowEndStats - flow->WindowStartStats : flow->CurrentBandwidthStats;
+         const double transmissionDuration =
+            getWindowDuration(flow->FirstTransmission, flow->LastTransmission,
+                              windowStart, windowEnd);
+         const double receptionDuration =
+            getWindowDuration(flow->FirstReception, flow->LastReception,
+                              windowStart, windowEnd);
+         unsigned long long voluntaryContextSwitches;
+         unsigned long long involuntaryContextSwitches;
+         flow->getContextSwitches(voluntaryContextSwitches, involuntaryContextSwitches);
          scalarFile.printf(
             "scalar \"%s.flow[%u]\" \"Transmitted Bytes\"       %llu\n"
             "scalar \"%s.flow[%u]\" \"Transmitted Packets\"     %llu\n"
@@ -528,29 +1189,165 @@ void FlowManager::writeScalarStatistics(const uint64_t           measurementID,
             "scalar \"%s.flow[%u]\" \"Received Byte Rate\"      %1.6f\n"
             "scalar \"%s.flow[%u]\" \"Received Packet Rate\"    %1.6f\n"
             "scalar \"%s.flow[%u]\" \"Received Frame Rate\"     %1.6f\n"
+            "scalar \"%s.flow[%u]\" \"Mean Delay\"              %1.6f\n"
+            "scalar \"%s.flow[%u]\" \"Mean Jitter\"             %1.6f\n"
+            "scalar \"%s.flow[%u]\" \"Sender CPU\"              %d\n"
+            "scalar \"%s.flow[%u]\" \"Voluntary Context Switches\"   %llu\n"
+            "scalar \"%s.flow[%u]\" \"Involuntary Context Switches\" %llu\n"
             ,
-            objectName.c_str(), flow->FlowID, flow->CurrentBandwidthStats.TransmittedBytes,
-            objectName.c_str(), flow->FlowID, flow->CurrentBandwidthStats.TransmittedPackets,
-            objectName.c_str(), flow->FlowID, flow->CurrentBandwidthStats.TransmittedFrames,
-            objectName.c_str(), flow->FlowID, (transmissionDuration > 0.0) ? 8ULL * flow->CurrentBandwidthStats.TransmittedBytes / transmissionDuration : 0.0,
-            objectName.c_str(), flow->FlowID, (transmissionDuration > 0.0) ? flow->CurrentBandwidthStats.TransmittedBytes   / transmissionDuration : 0.0,
-            objectName.c_str(), flow->FlowID, (transmissionDuration > 0.0) ? flow->CurrentBandwidthStats.TransmittedPackets / transmissionDuration : 0.0,
-            objectName.c_str(), flow->FlowID, (transmissionDuration > 0.0) ? flow->CurrentBandwidthStats.TransmittedFrames  / transmissionDuration : 0.0,
-            objectName.c_str(), flow->FlowID, flow->CurrentBandwidthStats.ReceivedBytes,
-            objectName.c_str(), flow->FlowID, flow->CurrentBandwidthStats.ReceivedPackets,
-            objectName.c_str(), flow->FlowID, flow->CurrentBandwidthStats.ReceivedFrames,
-            objectName.c_str(), flow->FlowID, (receptionDuration > 0.0) ? 8ULL * flow->CurrentBandwidthStats.ReceivedBytes / receptionDuration : 0.0,
-            objectName.c_str(), flow->FlowID, (receptionDuration > 0.0) ? flow->CurrentBandwidthStats.ReceivedBytes   / receptionDuration : 0.0,
-            objectName.c_str(), flow->FlowID, (receptionDuration > 0.0) ? flow->CurrentBandwidthStats.ReceivedPackets / receptionDuration : 0.0,
-            objectName.c_str(), flow->FlowID, (receptionDuration > 0.0) ? flow->CurrentBandwidthStats.ReceivedFrames  / receptionDuration : 0.0
+            objectName.c_str(), flow->FlowID, stats.TransmittedBytes,
+            objectName.c_str(), flow->FlowID, stats.TransmittedPackets,
+            objectName.c_str(), flow->FlowID, stats.TransmittedFrames,
+            objectName.c_str(), flow->FlowID, (transmissionDuration > 0.0) ? 8ULL * stats.TransmittedBytes / transmissionDuration : 0.0,
+            objectName.c_str(), flow->FlowID, (transmissionDuration > 0.0) ? stats.TransmittedBytes   / transmissionDuration : 0.0,
+            objectName.c_str(), flow->FlowID, (transmissionDuration > 0.0) ? stats.TransmittedPackets / transmissionDuration : 0.0,
+            objectName.c_str(), flow->FlowID, (transmissionDuration > 0.0) ? stats.TransmittedFrames  / transmissionDuration : 0.0,
+            objectName.c_str(), flow->FlowID, stats.ReceivedBytes,
+            objectName.c_str(), flow->FlowID, stats.ReceivedPackets,
+            objectName.c_str(), flow->FlowID, stats.ReceivedFrames,
+            objectName.c_str(), flow->FlowID, (receptionDuration > 0.0) ? 8ULL * stats.ReceivedBytes / receptionDuration : 0.0,
+            objectName.c_str(), flow->FlowID, (receptionDuration > 0.0) ? stats.ReceivedBytes   / receptionDuration : 0.0,
+            objectName.c_str(), flow->FlowID, (receptionDuration > 0.0) ? stats.ReceivedPackets / receptionDuration : 0.0,
+            objectName.c_str(), flow->FlowID, (receptionDuration > 0.0) ? stats.ReceivedFrames  / receptionDuration : 0.0,
+            objectName.c_str(), flow->FlowID, (stats.ReceivedPackets > 0) ? stats.DelaySum  / stats.ReceivedPackets : 0.0,
+            objectName.c_str(), flow->FlowID, (stats.ReceivedPackets > 0) ? stats.JitterSum / stats.ReceivedPackets : 0.0,
+            objectName.c_str(), flow->FlowID, flow->getCurrentCPU(),
+            objectName.c_str(), flow->FlowID, voluntaryContextSwitches,
+            objectName.c_str(), flow->FlowID, involuntaryContextSwitches
             );
-         totalBandwidthStats = totalBandwidthStats + flow->CurrentBandwidthStats;
+         if(flow->ActualStart > 0) {
+            scalarFile.printf(
+               "scalar \"%s.flow[%u]\" \"Start Deviation\"         %1.6f\n",
+               objectName.c_str(), flow->FlowID,
+               ((double)flow->ActualStart - (double)flow->PlannedStart) / 1000000.0);
+         }
+         if(flow->MyImpairment != NULL) {
+            // Ground truth for the receiver's loss and reordering statistics.
+            const Impairment* impairment = flow->MyImpairment;
+            scalarFile.printf(
+               "scalar \"%s.flow[%u]\" \"Impairment Dropped Packets\"    %llu\n"
+               "scalar \"%s.flow[%u]\" \"Impairment Duplicated Packets\" %llu\n"
+               "scalar \"%s.flow[%u]\" \"Impairment Delayed Packets\"    %llu\n"
+               "scalar \"%s.flow[%u]\" \"Impairment Reordered Packets\"  %llu\n"
+               "scalar \"%s.flow[%u]\" \"Impairment Discarded Packets\"  %llu\n"
+               ,
+               objectName.c_str(), flow->FlowID, impairment->Dropped,
+               objectName.c_str(), flow->FlowID, impairment->Duplicated,
+               objectName.c_str(), flow->FlowID, impairment->Delayed,
+               objectName.c_str(), flow->FlowID, impairment->Reordered,
+               objectName.c_str(), flow->FlowID, impairment->Discarded
+               );
+         }
+         if(flow->TrafficSpec.Churn) {
+            const double churnDuration = (flow->LastChurnAttempt - flow->FirstChurnAttempt) / 1000000.0;
+            const LatencyHistogram& latency = flow->ConnectLatency;
+            scalarFile.printf(
+               "scalar \"%s.flow[%u]\" \"Connection Attempts\"     %llu\n"
+               "scalar \"%s.flow[%u]\" \"Connections\"             %llu\n"
+               "scalar \"%s.flow[%u]\" \"Failed Connections\"      %llu\n"
+               "scalar \"%s.flow[%u]\" \"Connection Rate\"         %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Connect Latency Mean\"    %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Connect Latency Min\"     %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Connect Latency P50\"     %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Connect Latency P90\"     %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Connect Latency P99\"     %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Connect Latency P99.9\"   %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Connect Latency Max\"     %1.6f\n"
+               ,
+               objectName.c_str(), flow->FlowID, flow->ChurnAttempts,
+               objectName.c_str(), flow->FlowID, flow->ChurnConnections,
+               objectName.c_str(), flow->FlowID, flow->ChurnFailures,
+               objectName.c_str(), flow->FlowID, (churnDuration > 0.0) ? flow->ChurnConnections / churnDuration : 0.0,
+               objectName.c_str(), flow->FlowID, latency.getMean() / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getMinimum() / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getPercentile(50.0) / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getPercentile(90.0) / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getPercentile(99.0) / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getPercentile(99.9) / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getMaximum() / 1000.0
+               );
+         }
+         if( (flow->TrafficSpec.Probe) && (flow->RemoteControlSocketDescriptor >= 0) ) {
+            std::vector<double> capacities = flow->TrainCapacities;
+            double              median     = 0.0;
+            double              mean       = 0.0;
+            if(capacities.size() > 0) {
+               std::nth_element(capacities.begin(),
+                                capacities.begin() + capacities.size() / 2,
+                                capacities.end());
+               median = capacities[capacities.size() / 2];
+               for(size_t j = 0;j < capacities.size();j++) {
+                  mean += capacities[j];
+               }
+               mean /= capacities.size();
+            }
+            scalarFile.printf(
+               "scalar \"%s.flow[%u]\" \"Trains\"                       %llu\n"
+               "scalar \"%s.flow[%u]\" \"Trains with Increasing Delay\" %llu\n"
+               "scalar \"%s.flow[%u]\" \"Capacity Median\"              %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Capacity Mean\"                %1.6f\n"
+               ,
+               objectName.c_str(), flow->FlowID, (unsigned long long)flow->TrainCapacities.size(),
+               objectName.c_str(), flow->FlowID, flow->TrainsWithIncreasingDelay,
+               objectName.c_str(), flow->FlowID, median,
+               objectName.c_str(), flow->FlowID, mean
+               );
+         }
+         if(flow->isRPCClient()) {
+            const double rpcDuration = (flow->LastRPCTransaction > flow->FirstRPCRequest) ?
+                                          (flow->LastRPCTransaction - flow->FirstRPCRequest) / 1000000.0 : 0.0;
+            const LatencyHistogram& latency = flow->TransactionLatency;
+            scalarFile.printf(
+               "scalar \"%s.flow[%u]\" \"Requests\"                    %llu\n"
+               "scalar \"%s.flow[%u]\" \"Transactions\"                %llu\n"
+               "scalar \"%s.flow[%u]\" \"Timed-Out Requests\"          %llu\n"
+               "scalar \"%s.flow[%u]\" \"Transaction Rate\"            %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Transaction Latency Mean\"    %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Transaction Latency Min\"     %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Transaction Latency P50\"     %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Transaction Latency P90\"     %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Transaction Latency P99\"     %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Transaction Latency P99.9\"   %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Transaction Latency Max\"     %1.6f\n"
+               ,
+               objectName.c_str(), flow->FlowID, flow->RPCRequests,
+               objectName.c_str(), flow->FlowID, flow->RPCTransactions,
+               objectName.c_str(), flow->FlowID, flow->RPCTimeouts,
+               objectName.c_str(), flow->FlowID, (rpcDuration > 0.0) ? flow->RPCTransactions / rpcDuration : 0.0,
+               objectName.c_str(), flow->FlowID, latency.getMean() / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getMinimum() / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getPercentile(50.0) / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getPercentile(90.0) / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getPercentile(99.0) / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getPercentile(99.9) / 1000.0,
+               objectName.c_str(), flow->FlowID, latency.getMaximum() / 1000.0
+               );
+         }
+         if(flow->isABRClient()) {
+            scalarFile.printf(
+               "scalar \"%s.flow[%u]\" \"Segments\"                    %llu\n"
+               "scalar \"%s.flow[%u]\" \"Mean Bitrate\"                %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Bitrate Switches\"            %llu\n"
+               "scalar \"%s.flow[%u]\" \"Rebuffer Events\"             %llu\n"
+               "scalar \"%s.flow[%u]\" \"Rebuffer Time\"               %1.6f\n"
+               "scalar \"%s.flow[%u]\" \"Startup Delay\"               %1.6f\n"
+               ,
+               objectName.c_str(), flow->FlowID, flow->ABRSegments,
+               objectName.c_str(), flow->FlowID, (flow->ABRSegments > 0) ? flow->ABRBitrateSum / flow->ABRSegments : 0.0,
+               objectName.c_str(), flow->FlowID, flow->ABRSwitches,
+               objectName.c_str(), flow->FlowID, flow->ABRRebuffers,
+               objectName.c_str(), flow->FlowID, flow->ABRRebufferTime / 1000000.0,
+               objectName.c_str(), flow->FlowID, flow->ABRStartupDelay / 1000000.0
+               );
+         }
+         totalBandwidthStats = totalBandwidthStats + stats;
       }
       flow->unlock();
    }
 
    // ====== Write total statistics =========================================
-   const double totalDuration = (now - firstStatisticsEvent) / 1000000.0;
+   const double totalDuration = (windowEnd > 0) ?
+      (windowEnd - windowStart) / 1000000.0 : (now - firstStatisticsEvent) / 1000000.0;
    scalarFile.printf(
       "scalar \"%s.total\" \"Transmitted Bytes\"       %llu\n"
       "scalar \"%s.total\" \"Transmitted Packets\"     %llu\n"
@@ -594,6 +1391,125 @@ void FlowManager::writeScalarStatistics(const uint64_t           measurementID,
       );
    unlock();
 
+   // ====== Write thread placement and context switches ====================
+   unsigned long long managerVoluntary;
+   unsigned long long managerInvoluntary;
+   unsigned long long mainLoopVoluntary;
+   unsigned long long mainLoopInvoluntary;
+   getContextSwitches(managerVoluntary, managerInvoluntary);
+   lock();
+   const int   mainLoopCPU      = MainLoopCPU;
+   const pid_t mainLoopThreadID = MainLoopThreadID;
+   unlock();
+   Thread::readContextSwitches(mainLoopThreadID, mainLoopVoluntary, mainLoopInvoluntary);
+   scalarFile.printf(
+      "scalar \"%s.flowManager\" \"CPU\"                          %d\n"
+      "scalar \"%s.flowManager\" \"Voluntary Context Switches\"   %llu\n"
+      "scalar \"%s.flowManager\" \"Involuntary Context Switches\" %llu\n"
+      "scalar \"%s.mainLoop\" \"CPU\"                             %d\n"
+      "scalar \"%s.mainLoop\" \"Voluntary Context Switches\"      %llu\n"
+      "scalar \"%s.mainLoop\" \"Involuntary Context Switches\"    %llu\n",
+      objectName.c_str(), getCurrentCPU(),
+      objectName.c_str(), managerVoluntary,
+      objectName.c_str(), managerInvoluntary,
+      objectName.c_str(), mainLoopCPU,
+      objectName.c_str(), mainLoopVoluntary,
+      objectName.c_str(), mainLoopInvoluntary);
+
+   // ====== Write buffer arena usage =======================================
+   BufferArena::Statistics arenaStats;
+   BufferArena::getBufferArena()->getStatistics(arenaStats);
+   scalarFile.printf(
+      "scalar \"%s.bufferArena\" \"Mapped Bytes\"          %llu\n"
+      "scalar \"%s.bufferArena\" \"HugeTLB Bytes\"         %llu\n"
+      "scalar \"%s.bufferArena\" \"Transparent HP Bytes\"  %llu\n"
+      "scalar \"%s.bufferArena\" \"Buffers In Use\"        %llu\n"
+      "scalar \"%s.bufferArena\" \"Bytes In Use\"          %llu\n"
+      "scalar \"%s.bufferArena\" \"Peak Bytes In Use\"     %llu\n"
+      "scalar \"%s.bufferArena\" \"Allocations\"           %llu\n"
+      "scalar \"%s.bufferArena\" \"Large Allocations\"     %llu\n",
+      objectName.c_str(), arenaStats.MappedBytes,
+      objectName.c_str(), arenaStats.HugeTLBBytes,
+      objectName.c_str(), arenaStats.TransparentBytes,
+      objectName.c_str(), arenaStats.BuffersInUse,
+      objectName.c_str(), arenaStats.BytesInUse,
+      objectName.c_str(), arenaStats.PeakBytesInUse,
+      objectName.c_str(), arenaStats.Allocations,
+      objectName.c_str(), arenaStats.LargeAllocations);
+
+   // ====== Write UDP receive workers ======================================
+   UDPReceiveStatistics udpStats;
+   getUDPReceiveStatistics(udpStats);
+   for(std::vector<UDPReceiveWorker*>::iterator iterator = UDPWorkers.begin();
+       iterator != UDPWorkers.end();iterator++) {
+      UDPReceiveWorker*    worker = *iterator;
+      UDPReceiveStatistics workerStats;
+      worker->getReceiveStatistics(workerStats);
+      scalarFile.printf(
+         "scalar \"%s.udpWorker[%u]\" \"Receive Calls\"          %llu\n"
+         "scalar \"%s.udpWorker[%u]\" \"Received Datagrams\"     %llu\n"
+         "scalar \"%s.udpWorker[%u]\" \"Received Segments\"      %llu\n"
+         "scalar \"%s.udpWorker[%u]\" \"Datagrams per Call\"     %1.3f\n"
+         "scalar \"%s.udpWorker[%u]\" \"CPU\"                    %d\n",
+         objectName.c_str(), worker->getWorkerID(), workerStats.ReceiveCalls,
+         objectName.c_str(), worker->getWorkerID(), workerStats.ReceivedDatagrams,
+         objectName.c_str(), worker->getWorkerID(), workerStats.ReceivedSegments,
+         objectName.c_str(), worker->getWorkerID(), (workerStats.ReceiveCalls > 0) ?
+            (double)workerStats.ReceivedDatagrams / (double)workerStats.ReceiveCalls : 0.0,
+         objectName.c_str(), worker->getWorkerID(), worker->getCurrentCPU());
+      udpStats.ReceiveCalls       += workerStats.ReceiveCalls;
+      udpStats.ReceivedDatagrams  += workerStats.ReceivedDatagrams;
+      udpStats.ReceivedSegments   += workerStats.ReceivedSegments;
+      udpStats.CoalescedDatagrams += workerStats.CoalescedDatagrams;
+   }
+
+   // ====== Write receive workers ==========================================
+   for(std::vector<ReceiveWorker*>::iterator iterator = ReceiveWorkers.begin();
+       iterator != ReceiveWorkers.end();iterator++) {
+      ReceiveWorker*          worker = *iterator;
+      ReceiveWorkerStatistics workerStats;
+      double                  utilization;
+      worker->getReceiveStatistics(workerStats, utilization);
+      scalarFile.printf(
+         "scalar \"%s.receiveWorker[%u]\" \"Sockets\"                %llu\n"
+         "scalar \"%s.receiveWorker[%u]\" \"Assigned Sockets\"       %llu\n"
+         "scalar \"%s.receiveWorker[%u]\" \"Wakeups\"                %llu\n"
+         "scalar \"%s.receiveWorker[%u]\" \"Received Messages\"      %llu\n"
+         "scalar \"%s.receiveWorker[%u]\" \"Received Bytes\"         %llu\n"
+         "scalar \"%s.receiveWorker[%u]\" \"Busy Time\"              %1.6f\n"
+         "scalar \"%s.receiveWorker[%u]\" \"Utilization\"            %1.6f\n"
+         "scalar \"%s.receiveWorker[%u]\" \"CPU\"                    %d\n",
+         objectName.c_str(), worker->getWorkerID(), (unsigned long long)worker->ShardSockets,
+         objectName.c_str(), worker->getWorkerID(), workerStats.AssignedSockets,
+         objectName.c_str(), worker->getWorkerID(), workerStats.Wakeups,
+         objectName.c_str(), worker->getWorkerID(), workerStats.ReceivedMessages,
+         objectName.c_str(), worker->getWorkerID(), workerStats.ReceivedBytes,
+         objectName.c_str(), worker->getWorkerID(), workerStats.BusyTime / 1000000.0,
+         objectName.c_str(), worker->getWorkerID(), utilization,
+         objectName.c_str(), worker->getWorkerID(), worker->getCurrentCPU());
+   }
+
+   // ====== Write UDP receive batching =====================================
+   const unsigned long long udpReceiveCalls       = udpStats.ReceiveCalls;
+   const unsigned long long udpReceivedDatagrams  = udpStats.ReceivedDatagrams;
+   const unsigned long long udpReceivedSegments   = udpStats.ReceivedSegments;
+   const unsigned long long udpCoalescedDatagrams = udpStats.CoalescedDatagrams;
+   scalarFile.printf(
+      "scalar \"%s.udpReceive\" \"Receive Calls\"          %llu\n"
+      "scalar \"%s.udpReceive\" \"Received Datagrams\"     %llu\n"
+      "scalar \"%s.udpReceive\" \"Received Segments\"      %llu\n"
+      "scalar \"%s.udpReceive\" \"Coalesced Datagrams\"    %llu\n"
+      "scalar \"%s.udpReceive\" \"Datagrams per Call\"     %1.3f\n"
+      "scalar \"%s.udpReceive\" \"Segments per Call\"      %1.3f\n",
+      objectName.c_str(), udpReceiveCalls,
+      objectName.c_str(), udpReceivedDatagrams,
+      objectName.c_str(), udpReceivedSegments,
+      objectName.c_str(), udpCoalescedDatagrams,
+      objectName.c_str(), (udpReceiveCalls > 0) ?
+         (double)udpReceivedDatagrams / (double)udpReceiveCalls : 0.0,
+      objectName.c_str(), (udpReceiveCalls > 0) ?
+         (double)udpReceivedSegments / (double)udpReceiveCalls : 0.0);
+
    // ====== Write CPU statistics ===========================================
    for(unsigned int i = 1; i <= CPULoadStats.getNumberOfCPUs(); i++) {
       for(unsigned int j = 0; j < CPULoadStats.getCpuStates(); j++) {
@@ -675,6 +1591,9 @@ void FlowManager::writeVectorStatistics(const uint64_t           measurementID,
 
           flow->LastBandwidthStats = flow->CurrentBandwidthStats;
           flow->unlock();
+
+          // ====== Sample MPTCP subflows (upstream Linux MPTCP only) =======
+          flow->writeSubflowStatistics(now, firstStatisticsEvent);
        }
    }
 
@@ -718,57 +1637,49 @@ void FlowManager::run()
 {
    signal(SIGPIPE, SIG_IGN);
 
+#ifdef __linux__
+   epoll_event         events[FLOWMANAGER_MAX_EVENTS];
+#else
+   std::vector<pollfd> pollFDs;
+#endif
    do {
-      // ====== Collect PollFDs for poll() ==================================
+      // ====== Wait for events =============================================
       lock();
-      std::set<int> socketSet;
-      pollfd        pollFDs[FlowSet.size() + UnidentifiedSockets.size()];
-      size_t        n = 0;
-      for(size_t i = 0;i  < FlowSet.size();i++) {
-         FlowSet[i]->lock();
-         if( (FlowSet[i]->InputStatus != Flow::Off) &&
-             (FlowSet[i]->SocketDescriptor >= 0) ) {
-            if(!((FlowSet[i]->getTrafficSpec().Protocol == IPPROTO_UDP) &&   // Global UDP socket is handled by main loop!
-                 (FlowSet[i]->RemoteControlSocketDescriptor >= 0)) ) {       // Incoming UDP association has RemoteControlSocketDescriptor >= 0.
-               if(socketSet.find(FlowSet[i]->SocketDescriptor) == socketSet.end()) {
-                  pollFDs[n].fd      = FlowSet[i]->SocketDescriptor;
-                  pollFDs[n].events  = POLLIN;
-                  pollFDs[n].revents = 0;
-                  FlowSet[i]->PollFDEntry = &pollFDs[n];
-                  // printf("?pollin-1: %d\n", pollFDs[n].fd);
-                  n++;
-                  socketSet.insert(FlowSet[i]->SocketDescriptor);
-               }
-            }
+#ifndef __linux__
+      // The pollfd array is only rebuilt when the interest set has changed.
+      if(UpdatedPollSet) {
+         UpdatedPollSet = false;
+         pollFDs.clear();
+         pollfd entry;
+         entry.events  = POLLIN;
+         entry.revents = 0;
+         if(WakeUpPipe[0] >= 0) {
+            entry.fd = WakeUpPipe[0];
+            pollFDs.push_back(entry);
          }
-         else {
-            FlowSet[i]->PollFDEntry = NULL;
+         for(std::map<int, PollEntry>::const_iterator iterator = PollSet.begin();
+             iterator != PollSet.end(); iterator++) {
+            if( (iterator->second.Worker == NULL) || (iterator->second.Migrating) ) {
+               entry.fd = iterator->first;
+               pollFDs.push_back(entry);
+            }
          }
-         FlowSet[i]->unlock();
-      }
-      UpdatedUnidentifiedSockets = false;
-      pollfd* unidentifiedSocketsPollFDIndex[UnidentifiedSockets.size()];
-      size_t i = 0;
-      for(std::map<int, int>::iterator iterator = UnidentifiedSockets.begin();
-          iterator != UnidentifiedSockets.end(); iterator++) {
-         pollFDs[n].fd      = iterator->first;
-         pollFDs[n].events  = POLLIN;
-         pollFDs[n].revents = 0;
-         // printf("?pollin-2: %d\n", pollFDs[n].fd);
-         unidentifiedSocketsPollFDIndex[i] = &pollFDs[n];
-         n++; i++;
       }
+#endif
       const unsigned long long nextEvent = getNextEvent();
       unlock();
 
-
-      // ====== Wait for events =============================================
       unsigned long long now = getMicroTime();
       const int timeout = pollTimeout(getMicroTime(), 2,
                                       now + 250000,
                                       nextEvent);
       // printf("timeout=%d\n", timeout);
-      const int result = ext_poll_wrapper((pollfd*)&pollFDs, n, timeout);
+#ifdef __linux__
+      const int result = epoll_wait(EpollFD, (epoll_event*)&events,
+                                    FLOWMANAGER_MAX_EVENTS, timeout);
+#else
+      const int result = ext_poll_wrapper(pollFDs.data(), pollFDs.size(), timeout);
+#endif
       // printf("result=%d\n",result);
 
 
@@ -776,54 +1687,62 @@ void FlowManager::run()
       lock();
 
       now = getMicroTime();
+      updateCurrentCPU();
+      prefaultStack();   // Only does something when prefaulting is requested
       if(result > 0) {
-         // ====== Handle read events of flows ==============================
-         for(i = 0;i  < FlowSet.size();i++) {
-            FlowSet[i]->lock();
-            const pollfd* entry    = FlowSet[i]->PollFDEntry;
-            const int     protocol = FlowSet[i]->getTrafficSpec().Protocol;
-            // FlowSet[i]->unlock(); --- not necessary: FlowManager is locked
-            // NOTE: Release the lock here, because the FlowSet enty may belong
-            //       to another stream of the socket. handleNetPerfMeterData()
-            //       will find and lock the actual FlowSet entry!
-            if(entry) {
-               // printf("***pollin-1: %d REV=%x\n", entry->fd, entry->revents);
-               if(entry->revents & (POLLIN|POLLERR)) {
-                  // NOTE: FlowSet[i] may not be the actual Flow!
-                  //       It may be another stream of the same SCTP assoc!
-                  handleNetPerfMeterData(true, now, protocol, entry->fd);
-               }
+         // Closed connections are collected first, so that all of them
+         // are removed in one pass (connection churn closes many).
+         std::vector<int> closedSockets;
+#ifdef __linux__
+         for(int j = 0;j < result;j++) {
+            const int sd = events[j].data.fd;
+#else
+         for(size_t j = 0;j < pollFDs.size();j++) {
+            if(!(pollFDs[j].revents & (POLLIN|POLLERR|POLLHUP))) {
+               continue;
+            }
+            const int sd = pollFDs[j].fd;
+#endif
+            if(sd == WakeUpPipe[0]) {
+               char buffer[64];
+               while(ext_read(WakeUpPipe[0], (char*)&buffer, sizeof(buffer)) > 0) { }
+               continue;
             }
-            FlowSet[i]->unlock();
-         }
-
 
-         // ====== Handle read events of yet unidentified sockets ===========
-         if(!UpdatedUnidentifiedSockets) {
-            i = 0;
-            for(std::map<int, int>::iterator iterator = UnidentifiedSockets.begin();
-               iterator != UnidentifiedSockets.end(); iterator++) {
-               assert(unidentifiedSocketsPollFDIndex[i]->fd == iterator->first);
-               if(unidentifiedSocketsPollFDIndex[i]->revents & (POLLIN|POLLERR)) {
-                  // printf("***pollin-2: %d REV=%x\n", unidentifiedSocketsPollFDIndex[i]->fd, unidentifiedSocketsPollFDIndex[i]->revents);
-                  if(handleNetPerfMeterData(true, now,
-                                            iterator->second,
-                                            iterator->first) == 0) {
-                     // Incoming connection has already been closed -> remove it!
-                     std::cout << "NOTE: Shutdown of still unidentified incoming connection "
-                               << iterator->first << "!" << std::endl;
-                     removeSocket(iterator->first, true);
-                     break;
-                  }
-                  if(UpdatedUnidentifiedSockets) {
-                     // NOTE: The UnidentifiedSockets set may have changed in
-                     // handleDataMessage -> ... -> FlowManager::identifySocket
-                     // => stop processing if this is the case
-                     break;
-                  }
+            // ====== Handle read event of flow or unidentified socket ======
+            // NOTE: The socket may have been removed by an earlier event of
+            //       this pass. For a flow, handleNetPerfMeterData() finds the
+            //       actual Flow (it may be another stream of the same SCTP
+            //       association).
+            std::map<int, PollEntry>::const_iterator found = PollSet.find(sd);
+            if( (found == PollSet.end()) ||
+                ((found->second.Worker != NULL) && (!found->second.Migrating)) ) {
+               continue;   // Removed, or handled by a receive worker
+            }
+            const ssize_t received = handleNetPerfMeterData(true, now,
+                                                            found->second.Protocol, sd);
+
+            // The socket may have been identified by handleNetPerfMeterData().
+            found = PollSet.find(sd);
+            if( (found != PollSet.end()) && (found->second.Unidentified) &&
+                ( (received == 0) ||
+                  ((received < 0) && (received != MRRM_PARTIAL_READ) &&
+                   (errno != EAGAIN) && (errno != EINTR)) ) ) {
+               // Incoming connection has already been closed -> remove it!
+               if(gOutputVerbosity >= NPFOV_CONNECTIONS) {
+                  std::cout << "NOTE: Shutdown of still unidentified incoming connection "
+                            << sd << "!" << std::endl;
                }
-               i++;
+               closedSockets.push_back(sd);
             }
+            // The socket may have been assigned to a receive worker.
+            else if( (found != PollSet.end()) && (found->second.Migrating) ) {
+               migrateSocket(sd);
+            }
+         }
+         for(std::vector<int>::const_iterator iterator = closedSockets.begin();
+             iterator != closedSockets.end(); iterator++) {
+            removeSocket(*iterator, true);
          }
       }
 
@@ -856,15 +1775,19 @@ Flow::Flow(const uint64_t         measurementID,
    StreamID                      = streamID;
 
    SocketDescriptor              = -1;
+   Ring                          = NULL;
    OriginalSocketDescriptor      = false;
    RemoteControlSocketDescriptor = controlSocketDescriptor;
    RemoteAddressIsValid          = false;
+   AssignedCPU                   = -1;
 
    InputStatus                   = WaitingForStartup;
+   PollSocketDescriptor          = -1;
    OutputStatus                  = WaitingForStartup;
    TimeBase                      = getMicroTime();
 
    TrafficSpec                   = trafficSpec;
+   TrafficSpec.retainDistributions();
 
    MyMeasurement                 = NULL;
    FirstTransmission             = 0;
@@ -876,6 +1799,27 @@ Flow::Flow(const uint64_t         measurementID,
    LastOutboundFrameID           = ~0;
    NextStatusChangeEvent         = ~0ULL;
    OnOffEventPointer             = 0;
+   HasOutboundTrace              = false;
+   StartOffset                   = 0;
+   StopOffset                    = 0;
+   StopTime                      = 0;
+   StartPending                  = false;
+   PlannedStart                  = 0;
+   ActualStart                   = 0;
+   RPCWakeUpPipe[0]              = -1;
+   RPCWakeUpPipe[1]              = -1;
+   if(TrafficSpec.RPC) {
+      if(ext_pipe((int*)&RPCWakeUpPipe) == 0) {
+         ext_fcntl(RPCWakeUpPipe[0], F_SETFL, O_NONBLOCK);
+         ext_fcntl(RPCWakeUpPipe[1], F_SETFL, O_NONBLOCK);
+      }
+      else {
+         RPCWakeUpPipe[0] = RPCWakeUpPipe[1] = -1;
+      }
+   }
+   MyImpairment = (TrafficSpec.Impairment.isEnabled()) ?
+                     new Impairment(TrafficSpec.Impairment) : NULL;
+   SendBuffer   = NULL;
    unlock();
 
    FlowManager::getFlowManager()->addFlow(this);
@@ -887,7 +1831,21 @@ Flow::~Flow()
 {
    FlowManager::getFlowManager()->removeFlow(this);
    deactivate();
+   if(RPCWakeUpPipe[0] >= 0) {
+      ext_close(RPCWakeUpPipe[0]);
+      ext_close(RPCWakeUpPipe[1]);
+   }
+   if(MyImpairment != NULL) {
+      delete MyImpairment;
+      MyImpairment = NULL;
+   }
+   if(SendBuffer != NULL) {
+      BufferArena::getBufferArena()->release(SendBuffer);
+      SendBuffer = NULL;
+   }
+   TrafficSpec.releaseDistributions();
    VectorFile.finish(true);
+   SubflowVectorFile.finish(true);
    if((SocketDescriptor >= 0) && (OriginalSocketDescriptor)) {
       if(DeleteWhenFinished) {
          FlowManager::getFlowManager()->getMessageReader()->deregisterSocket(SocketDescriptor);
@@ -897,6 +1855,19 @@ Flow::~Flow()
 }
 
 
+// ###### Get buffer for outgoing messages ##################################
+// The buffer is allocated on first use and kept for the flow's lifetime.
+// It is only used by the flow's own thread.
+char* Flow::getSendBuffer()
+{
+   if(SendBuffer == NULL) {
+      SendBuffer = (char*)BufferArena::getBufferArena()->allocate(FLOW_SEND_BUFFER_SIZE);
+      assert(SendBuffer != NULL);
+   }
+   return(SendBuffer);
+}
+
+
 // ###### Reset statistics ##################################################
 void Flow::resetStatistics()
 {
@@ -905,6 +1876,27 @@ void Flow::resetStatistics()
    LastBandwidthStats.reset();
    Jitter = 0;
    Delay  = 0;
+   ChurnAttempts     = 0;
+   ChurnConnections  = 0;
+   ChurnFailures     = 0;
+   FirstChurnAttempt = 0;
+   LastChurnAttempt  = 0;
+   ConnectLatency.reset();
+   RPCRequests        = 0;
+   RPCTransactions    = 0;
+   RPCTimeouts        = 0;
+   FirstRPCRequest    = 0;
+   LastRPCTransaction = 0;
+   TransactionLatency.reset();
+   ABRSegments        = 0;
+   ABRSwitches        = 0;
+   ABRRebuffers       = 0;
+   ABRRebufferTime    = 0;
+   ABRStartupDelay    = 0;
+   ABRBitrateSum      = 0.0;
+   TrainActive               = false;
+   TrainsWithIncreasingDelay = 0;
+   TrainCapacities.clear();
    unlock();
 }
 
@@ -933,6 +1925,58 @@ void Flow::print(std::ostream& os, const bool printStatistics)
       CurrentBandwidthStats.print(os,
                                   (LastTransmission - FirstTransmission) / 1000000.0,
                                   (LastReception    - FirstReception)    / 1000000.0);
+      if(ActualStart > 0) {
+         char str[128];
+         snprintf((char*)&str, sizeof(str),
+                  "      - Start:        %1.3fms after the planned start\n",
+                  ((double)ActualStart - (double)PlannedStart) / 1000.0);
+         os << str;
+      }
+      if(MyImpairment != NULL) {
+         char str[256];
+         snprintf((char*)&str, sizeof(str),
+                  "      - Impairment:   %llu dropped, %llu duplicated, %llu delayed, %llu reordered, %llu discarded\n",
+                  MyImpairment->Dropped, MyImpairment->Duplicated, MyImpairment->Delayed,
+                  MyImpairment->Reordered, MyImpairment->Discarded);
+         os << str;
+      }
+      if(TrafficSpec.Churn) {
+         const double churnDuration = (LastChurnAttempt - FirstChurnAttempt) / 1000000.0;
+         char         str[256];
+         snprintf((char*)&str, sizeof(str),
+                  "      - Connections:  %llu of %llu (%llu failed), %1.1f/s\n"
+                  "      - Connect Latency: mean %1.3fms, p50 %1.3fms, p99 %1.3fms, max %1.3fms\n",
+                  ChurnConnections, ChurnAttempts, ChurnFailures,
+                  (churnDuration > 0.0) ? ChurnConnections / churnDuration : 0.0,
+                  ConnectLatency.getMean() / 1000.0,
+                  ConnectLatency.getPercentile(50.0) / 1000.0,
+                  ConnectLatency.getPercentile(99.0) / 1000.0,
+                  ConnectLatency.getMaximum() / 1000.0);
+         os << str;
+      }
+      if(isRPCClient()) {
+         const double rpcDuration = (LastRPCTransaction - FirstRPCRequest) / 1000000.0;
+         char         str[256];
+         snprintf((char*)&str, sizeof(str),
+                  "      - Transactions: %llu of %llu (%llu timed out), %1.1f/s\n"
+                  "      - Transaction Latency: mean %1.3fms, p50 %1.3fms, p99 %1.3fms, max %1.3fms\n",
+                  RPCTransactions, RPCRequests, RPCTimeouts,
+                  ((LastRPCTransaction > FirstRPCRequest) && (rpcDuration > 0.0)) ? RPCTransactions / rpcDuration : 0.0,
+                  TransactionLatency.getMean() / 1000.0,
+                  TransactionLatency.getPercentile(50.0) / 1000.0,
+                  TransactionLatency.getPercentile(99.0) / 1000.0,
+                  TransactionLatency.getMaximum() / 1000.0);
+         os << str;
+      }
+      if(isABRClient()) {
+         char str[256];
+         snprintf((char*)&str, sizeof(str),
+                  "      - Segments: %llu, mean bitrate %1.0f Kbit/s, %llu switches\n"
+                  "      - Rebuffering: %llu events, %1.3fs; startup delay %1.3fs\n",
+                  ABRSegments, (ABRSegments > 0) ? ABRBitrateSum / ABRSegments : 0.0, ABRSwitches,
+                  ABRRebuffers, ABRRebufferTime / 1000000.0, ABRStartupDelay / 1000000.0);
+         os << str;
+      }
    }
    unlock();
 }
@@ -944,16 +1988,52 @@ void Flow::setSocketDescriptor(const int  socketDescriptor,
                                const bool deleteWhenFinished)
 {
    deactivate();
+   FlowManager::getFlowManager()->unwatchFlow(this);
+   FlowManager::getFlowManager()->lock();
+   // The socket descriptor only changes with the FlowManager locked. The
+   // flow is locked afterwards, since unindexing locks the receive workers.
+   FlowManager::getFlowManager()->unindexFlowSocket(this);
    lock();
    SocketDescriptor         = socketDescriptor;
    OriginalSocketDescriptor = originalSocketDescriptor;
    DeleteWhenFinished       = deleteWhenFinished;
 
+   Ring                     = NULL;
+
    if(SocketDescriptor >= 0) {
       FlowManager::getFlowManager()->getMessageReader()->registerSocket(
          TrafficSpec.Protocol, SocketDescriptor);
+      // An incoming SHM flow's ring has already been attached by addSocket().
+      Ring = FlowManager::getFlowManager()->getMessageReader()->getShmRing(SocketDescriptor);
    }
+   FlowManager::getFlowManager()->indexFlowSocket(this);
    unlock();
+   FlowManager::getFlowManager()->unlock();
+   FlowManager::getFlowManager()->watchFlow(this);
+}
+
+
+// ###### Input has ended (e.g. connection has been closed) #################
+void Flow::endOfInput()
+{
+   lock();
+   InputStatus = Off;
+   unlock();
+   FlowManager::getFlowManager()->unwatchFlow(this);
+}
+
+
+// ###### Attach shared-memory ring to the flow's socket ####################
+void Flow::setShmRing(ShmRing* ring)
+{
+   FlowManager::getFlowManager()->lock();
+   lock();
+   assert(SocketDescriptor >= 0);
+   if(FlowManager::getFlowManager()->getMessageReader()->attachShmRing(SocketDescriptor, ring)) {
+      Ring = ring;
+   }
+   unlock();
+   FlowManager::getFlowManager()->unlock();
 }
 
 
@@ -964,8 +2044,20 @@ bool Flow::initializeVectorFile(const char* name, const OutputFileFormat format)
 
    lock();
    if(VectorFile.initialize(name, format)) {
-      success = VectorFile.printf(
-                   "AbsTime RelTime SeqNumber Delay PrevPacketDelayDiff Jitter\n");
+      if(TrafficSpec.Probe) {
+         // Probing flows write one line per received packet train.
+         success = VectorFile.printf(
+                      "AbsTime RelTime TrainID Packets Dispersion Capacity PCT\n");
+      }
+      else if(isABRClient()) {
+         // ABR clients write one line per downloaded segment.
+         success = VectorFile.printf(
+                      "AbsTime RelTime Segment Bitrate DownloadTime Throughput Buffer Switch Rebuffer RebufferTime\n");
+      }
+      else {
+         success = VectorFile.printf(
+                      "AbsTime RelTime SeqNumber Delay PrevPacketDelayDiff Jitter\n");
+      }
       VectorFile.nextLine();
    }
    unlock();
@@ -974,6 +2066,61 @@ bool Flow::initializeVectorFile(const char* name, const OutputFileFormat format)
 }
 
 
+// ###### Initialize flow's MPTCP subflow vector file #######################
+bool Flow::initializeSubflowVectorFile(const char* name, const OutputFileFormat format)
+{
+   bool success = false;
+
+   lock();
+   if(SubflowVectorFile.initialize(name, format)) {
+      success = SubflowVectorFile.printf(
+                   "AbsTime RelTime Subflow LocalAddress RemoteAddress\t"
+                   "BytesSent BytesReceived BytesAcked BytesRetrans\t"
+                   "RTT RTTVar Cwnd Retransmissions\n");
+      SubflowVectorFile.nextLine();
+   }
+   unlock();
+
+   return(success);
+}
+
+
+// ###### Write MPTCP subflow statistics ####################################
+void Flow::writeSubflowStatistics(const unsigned long long now,
+                                  const unsigned long long firstStatisticsEvent)
+{
+   std::vector<MPTCPSubflowInfo> subflows;
+
+   lock();
+   if( (SubflowVectorFile.exists()) && (SocketDescriptor >= 0) &&
+       (getMPTCPSubflowInfo(SocketDescriptor, subflows)) ) {
+      for(size_t i = 0;i < subflows.size();i++) {
+         char localAddress[128];
+         char remoteAddress[128];
+         if(!address2string(&subflows[i].LocalAddress.sa, (char*)&localAddress, sizeof(localAddress), true)) {
+            safestrcpy((char*)&localAddress, "?", sizeof(localAddress));
+         }
+         if(!address2string(&subflows[i].RemoteAddress.sa, (char*)&remoteAddress, sizeof(remoteAddress), true)) {
+            safestrcpy((char*)&remoteAddress, "?", sizeof(remoteAddress));
+         }
+         SubflowVectorFile.printf(
+            "%06llu %llu %1.6f\t%u \"%s\" \"%s\"\t"
+            "%llu %llu %llu %llu\t%1.3f %1.3f %u %u\n",
+            SubflowVectorFile.nextLine(), now,
+            (double)(now - firstStatisticsEvent) / 1000000.0,
+            (unsigned int)i, localAddress, remoteAddress,
+            (unsigned long long)subflows[i].BytesSent,
+            (unsigned long long)subflows[i].BytesReceived,
+            (unsigned long long)subflows[i].BytesAcked,
+            (unsigned long long)subflows[i].BytesRetrans,
+            subflows[i].RTT / 1000.0, subflows[i].RTTVar / 1000.0,
+            subflows[i].Cwnd, subflows[i].TotalRetrans);
+      }
+   }
+   unlock();
+}
+
+
 // ###### Update transmission statistics ####################################
 void Flow::updateTransmissionStatistics(const unsigned long long now,
                                         const size_t             addedFrames,
@@ -1020,11 +2167,14 @@ void Flow::updateReceptionStatistics(const unsigned long long now,
    CurrentBandwidthStats.LostFrames      += lostFrames;
    CurrentBandwidthStats.LostPackets     += lostPackets;
    CurrentBandwidthStats.LostBytes       += lostBytes;
+   CurrentBandwidthStats.DelaySum        += delay;
+   CurrentBandwidthStats.JitterSum       += jitter;
    Delay  = delay;
    Jitter = jitter;
 
    // ====== Write line to flow's vector file ===============================
-   if( (MyMeasurement) && (MyMeasurement->getFirstStatisticsEvent() > 0) ) {
+   if( (!TrafficSpec.Probe) && (!isABRClient()) &&
+       (MyMeasurement) && (MyMeasurement->getFirstStatisticsEvent() > 0) ) {
       VectorFile.printf(
          "%06llu %llu %1.6f\t"
          "%llu %1.3f %1.3f %1.3f\n",
@@ -1037,11 +2187,80 @@ void Flow::updateReceptionStatistics(const unsigned long long now,
 }
 
 
+// ###### Update packet train statistics ###################################
+void Flow::updateTrainStatistics(const unsigned long long       arrivalTime,
+                                 const NetPerfMeterDataMessage* dataMsg,
+                                 const size_t                   receivedBytes)
+{
+   const uint32_t  trainID = ntohl(dataMsg->FrameID);
+   const long long delay   = (long long)arrivalTime - (long long)ntoh64(dataMsg->TimeStamp);
+
+   lock();
+   if( (TrainActive) && (TrainID != trainID) ) {
+      // The last packet of the previous train has been lost.
+      finishTrain();
+   }
+   if(!TrainActive) {
+      TrainActive         = true;
+      TrainID             = trainID;
+      TrainPackets        = 1;
+      TrainBytes          = 0;
+      TrainFirstArrival   = arrivalTime;
+      TrainLastArrival    = arrivalTime;
+      TrainLastDelay      = delay;
+      TrainDelayIncreases = 0;
+   }
+   else {
+      TrainPackets++;
+      TrainBytes       += receivedBytes;
+      TrainLastArrival  = arrivalTime;
+      if(delay > TrainLastDelay) {
+         TrainDelayIncreases++;
+      }
+      TrainLastDelay = delay;
+   }
+   if(dataMsg->Header.Flags & NPMDF_FRAME_END) {
+      finishTrain();
+   }
+   unlock();
+}
+
+
+// ###### Evaluate completely received packet train ########################
+// The dispersion of the train at the receiver gives the bottleneck capacity
+// estimate (packet pair/train dispersion, as in pathrate). The pairwise
+// comparison test (PCT) of the one-way delays tells whether the train rate
+// has exceeded the available bandwidth (as in pathload).
+void Flow::finishTrain()
+{
+   if( (TrainPackets >= 2) && (TrainLastArrival > TrainFirstArrival) ) {
+      const unsigned long long dispersion = TrainLastArrival - TrainFirstArrival;
+      const double             capacity   = (8.0 * TrainBytes) / dispersion;   // bit/us = Mbit/s
+      const double             pct        = TrainDelayIncreases / (double)(TrainPackets - 1);
+      TrainCapacities.push_back(capacity);
+      if(pct > 0.55) {
+         TrainsWithIncreasingDelay++;
+      }
+
+      if( (MyMeasurement) && (MyMeasurement->getFirstStatisticsEvent() > 0) ) {
+         VectorFile.printf(
+            "%06llu %llu %1.6f\t"
+            "%u %u %1.3f %1.3f %1.3f\n",
+            VectorFile.nextLine(), TrainLastArrival,
+            (double)(TrainLastArrival - MyMeasurement->getFirstStatisticsEvent()) / 1000000.0,
+            TrainID, TrainPackets, dispersion / 1000.0, capacity, pct);
+      }
+   }
+   TrainActive = false;
+}
+
+
 // ###### Start flow's transmission thread ##################################
 bool Flow::activate()
 {
    deactivate();
    assert(SocketDescriptor >= 0);
+   FlowManager::getFlowManager()->prepareFlowThread(this);
    return(start());
 }
 
@@ -1054,7 +2273,9 @@ void Flow::deactivate(const bool asyncStop)
       InputStatus  = Off;
       OutputStatus = Off;
       unlock();
+      FlowManager::getFlowManager()->unwatchFlow(this);
       stop();
+      wakeUpRPC();
       if(SocketDescriptor >= 0) {
          if(TrafficSpec.Protocol == IPPROTO_UDP) {
             // NOTE: There is only one UDP socket. We cannot close it here!
@@ -1074,7 +2295,6 @@ void Flow::deactivate(const bool asyncStop)
       if(!asyncStop) {
          waitForFinish();
          FlowManager::getFlowManager()->getMessageReader()->deregisterSocket(SocketDescriptor);
-         PollFDEntry = NULL;   // Poll FD entry is now invalid!
       }
    }
 }
@@ -1133,6 +2353,14 @@ unsigned long long Flow::scheduleNextStatusChangeEvent(const unsigned long long
       }
    }
 
+   // ====== Delayed start and ramp-down ====================================
+   if(StartPending) {
+      NextStatusChangeEvent = TimeBase;
+   }
+   if(StopTime > 0) {
+      NextStatusChangeEvent = std::min(NextStatusChangeEvent, StopTime);
+   }
+
    unlock();
    return(NextStatusChangeEvent);
 }
@@ -1143,20 +2371,40 @@ void Flow::handleStatusChangeEvent(const unsigned long long now)
 {
    lock();
    if(NextStatusChangeEvent <= now) {
-      assert(OnOffEventPointer < TrafficSpec.OnOffEvents.size());
-
-      if(OutputStatus == Off) {
-         OutputStatus = On;
+      if( (StopTime > 0) && (StopTime <= now) ) {
+         // Ramped down: off for the rest of the measurement.
+         OutputStatus          = Off;
+         StopTime              = 0;
+         StartPending          = false;
+         NextStatusChangeEvent = ~0ULL;
       }
-      else if(OutputStatus == On) {
-         OutputStatus = Off;
+      else if(StartPending) {
+         PlannedStart = NextStatusChangeEvent;
+         ActualStart  = now;
+         StartPending = false;
+         OutputStatus = On;
+         scheduleNextStatusChangeEvent(now);
       }
       else {
-         assert(false);
-      }
+         assert(OnOffEventPointer < TrafficSpec.OnOffEvents.size());
 
-      OnOffEventPointer++;
-      scheduleNextStatusChangeEvent(now);
+         if(OutputStatus == Off) {
+            if(ActualStart == 0) {
+               PlannedStart = NextStatusChangeEvent;
+               ActualStart  = now;
+            }
+            OutputStatus = On;
+         }
+         else if(OutputStatus == On) {
+            OutputStatus = Off;
+         }
+         else {
+            assert(false);
+         }
+
+         OnOffEventPointer++;
+         scheduleNextStatusChangeEvent(now);
+      }
    }
    unlock();
 }
@@ -1169,12 +2417,37 @@ void Flow::run()
 
    scheduleNextStatusChangeEvent(getMicroTime());
 
+   // ====== Connection churn: separate connection per frame ================
+   if(TrafficSpec.Churn) {
+      runChurn();
+      return;
+   }
+   // ====== Adaptive-bitrate streaming: segment requests ==================
+   if(isABRClient()) {
+      runABR();
+      return;
+   }
+   // ====== Request/response: transactions instead of a frame stream =====
+   if(TrafficSpec.RPC) {
+      runRPC();
+      return;
+   }
+
+   // ====== Trace-driven flow: frames from the trace ======================
+   if(HasOutboundTrace) {
+      runTrace();
+      return;
+   }
+
    bool result = true;
    do {
       // ====== Schedule next status change event ===========================
       unsigned long long       now              = getMicroTime();
       const unsigned long long nextTransmission = scheduleNextTransmissionEvent();
       unsigned long long       nextEvent        = std::min(NextStatusChangeEvent, nextTransmission);
+      if(MyImpairment != NULL) {
+         nextEvent = std::min(nextEvent, MyImpairment->getNextEvent());
+      }
 
       // ====== Wait until there is something to do =========================
       if(nextEvent > now) {
@@ -1185,6 +2458,11 @@ void Flow::run()
          now = getMicroTime();
       }
 
+      // ====== Release delayed datagrams ===================================
+      if(MyImpairment != NULL) {
+         releaseImpairedDatagrams(this, now);
+      }
+
       // ====== Send outgoing data ==========================================
       lock();
       const FlowStatus outputStatus = OutputStatus;
@@ -1222,6 +2500,747 @@ void Flow::run()
          handleStatusChangeEvent(now);
       }
    } while( (result == true) && (!isStopping()) );
+
+   if(MyImpairment != NULL) {
+      MyImpairment->discard();
+   }
+}
+
+
+// ###### Connection churn thread function ##################################
+// Instead of sending frames over the flow's connection, each frame opens a
+// new connection to the same peer, optionally sends the frame as request
+// and closes the connection again. The flow's connection remains open for
+// identification.
+void Flow::runChurn()
+{
+   // ====== Get endpoints from the flow's connection =======================
+   sockaddr_union localAddress;
+   sockaddr_union remoteAddress;
+   socklen_t      localAddressLength  = sizeof(localAddress);
+   socklen_t      remoteAddressLength = sizeof(remoteAddress);
+   if( (ext_getsockname(SocketDescriptor, &localAddress.sa, &localAddressLength) < 0) ||
+       (ext_getpeername(SocketDescriptor, &remoteAddress.sa, &remoteAddressLength) < 0) ) {
+      std::cerr << "ERROR: Unable to obtain endpoints of flow #" << FlowID
+                << " for connection churn - " << strerror(errno) << "!" << std::endl;
+      return;
+   }
+   setPort(&localAddress.sa, 0);
+   if(TrafficSpec.Protocol == IPPROTO_SCTP) {
+      // Do not restrict a possibly multi-homed SCTP endpoint to one address.
+      const sa_family_t family = localAddress.sa.sa_family;
+      memset(&localAddress, 0, sizeof(localAddress));
+      localAddress.sa.sa_family = family;
+   }
+
+   uint16_t           nextPort       = TrafficSpec.PortRangeLow;
+   unsigned long long nextConnection = getMicroTime();
+   do {
+      // ====== Wait until there is something to do =========================
+      unsigned long long now = getMicroTime();
+      lock();
+      const FlowStatus outputStatus = OutputStatus;
+      unlock();
+      unsigned long long nextEvent = NextStatusChangeEvent;
+      if(outputStatus == Flow::On) {
+         nextEvent = std::min(nextEvent, nextConnection);
+      }
+      if(nextEvent > now) {
+         const int timeout = pollTimeout(now, 2,
+                                         now + 1000000,
+                                         nextEvent);
+         ext_poll_wrapper(NULL, 0, timeout);
+         now = getMicroTime();
+      }
+
+      // ====== Open, use and close a connection ============================
+      if( (outputStatus == Flow::On) && (nextConnection <= now) ) {
+         performChurnConnection(localAddress, remoteAddress, nextPort);
+
+         // ------ Schedule next connection (saturated: immediately) --------
+         if(TrafficSpec.OutboundFrameRate[0] > 0.0000001) {
+            const double nextRate = getRandomValue((const double*)&TrafficSpec.OutboundFrameRate,
+                                                   TrafficSpec.OutboundFrameRateRng);
+            nextConnection += (unsigned long long)rint(1000000.0 / nextRate);
+            if(nextConnection + 1000000 < now) {
+               // Time gap of more than 1s -> do not try to correct
+               nextConnection = now;
+            }
+         }
+         else {
+            nextConnection = now;
+         }
+      }
+      else if(outputStatus != Flow::On) {
+         nextConnection = now;
+      }
+
+      // ====== Handle status changes =======================================
+      if(NextStatusChangeEvent <= now) {
+         handleStatusChangeEvent(now);
+      }
+   } while(!isStopping());
+}
+
+
+// ###### Map the flow's outbound trace (if configured) #####################
+bool Flow::loadTrace()
+{
+   lock();
+   if(TrafficSpec.OutboundTraceData.size() > 0) {
+      HasOutboundTrace = OutboundTrace.initialize(TrafficSpec.OutboundTraceData.data(),
+                                                  TrafficSpec.OutboundTraceData.size(),
+                                                  TrafficSpec.TraceScale,
+                                                  TrafficSpec.TraceLoop);
+      TrafficSpec.OutboundTraceData.clear();   // The trace has its own copy
+   }
+   else if(TrafficSpec.OutboundTrace != "") {
+      HasOutboundTrace = OutboundTrace.initialize(TrafficSpec.OutboundTrace.c_str(),
+                                                  TrafficSpec.TraceScale,
+                                                  TrafficSpec.TraceLoop);
+   }
+   else {
+      HasOutboundTrace = false;
+      unlock();
+      return(true);
+   }
+   const bool success = HasOutboundTrace;
+   unlock();
+   return(success);
+}
+
+
+// ###### Trace-driven thread function ######################################
+// The frames are sent at the (scaled) relative times of the trace, starting
+// when the thread is started. Frames falling into an off period are skipped.
+void Flow::runTrace()
+{
+   // The trace is anchored to the flow's scheduled start (TimeBase), i.e.
+   // it is not shifted by a delayed start or by the thread's startup.
+   lock();
+   const unsigned long long traceBase = TimeBase;
+   unlock();
+
+   OutboundTrace.rewind();
+   unsigned long long       relTime;
+   size_t                   frameSize;
+   bool                     haveFrame = OutboundTrace.next(relTime, frameSize);
+   bool                     result    = true;
+   do {
+      // ====== Wait until there is something to do =========================
+      unsigned long long now       = getMicroTime();
+      unsigned long long nextEvent = NextStatusChangeEvent;
+      if(haveFrame) {
+         nextEvent = std::min(nextEvent, traceBase + relTime);
+      }
+      if(MyImpairment != NULL) {
+         nextEvent = std::min(nextEvent, MyImpairment->getNextEvent());
+      }
+      if(nextEvent > now) {
+         const int timeout = pollTimeout(now, 2,
+                                         now + 1000000,
+                                         nextEvent);
+         ext_poll_wrapper(NULL, 0, timeout);
+         now = getMicroTime();
+      }
+
+      // ====== Release delayed datagrams ===================================
+      if(MyImpairment != NULL) {
+         releaseImpairedDatagrams(this, now);
+      }
+
+      // ====== Handle status changes =======================================
+      // Before sending, so that the first frame of a delayed start is sent.
+      if(NextStatusChangeEvent <= now) {
+         handleStatusChangeEvent(now);
+      }
+
+      // ====== Send all frames that are due ================================
+      // A trace far behind its schedule must not keep the thread from
+      // handling status changes and stopping.
+      lock();
+      const FlowStatus outputStatus = OutputStatus;
+      unlock();
+      unsigned int burst = 0;
+      while( (haveFrame) && (traceBase + relTime <= now) &&
+             (burst++ < FLOW_TRACE_MAX_BURST) ) {
+         if(outputStatus == Flow::On) {
+            result = (transmitTraceFrame(this, now, frameSize) > 0);
+            if(TrafficSpec.Protocol == IPPROTO_UDP) {
+               // Keep sending, even if there is a temporary failure.
+               result = true;
+            }
+         }
+         haveFrame = OutboundTrace.next(relTime, frameSize);
+         if( (!result) || (isStopping()) ) {
+            break;
+         }
+      }
+   } while( (result == true) && (!isStopping()) );
+
+   if(MyImpairment != NULL) {
+      MyImpairment->discard();
+   }
+}
+
+
+// ###### Request/response thread function ##################################
+// On the active side, each frame is a request carrying a transaction ID (its
+// frame ID). Up to TrafficSpec.Outstanding requests may be pipelined; a
+// saturated frame rate results in a closed-loop client. On the passive side,
+// each received request is answered by a response frame of the flow's
+// outbound frame size, echoing the transaction ID.
+void Flow::runRPC()
+{
+   const bool         client      = isRPCClient();
+   unsigned long long nextRequest = getMicroTime();
+   bool               result      = true;
+   do {
+      // ====== Wait until there is something to do =========================
+      unsigned long long now = getMicroTime();
+      lock();
+      const FlowStatus outputStatus = OutputStatus;
+      const bool       windowOpen   = (OutstandingRPCRequests.size() < TrafficSpec.Outstanding);
+      const bool       pending      = !PendingRPCResponses.empty();
+      unlock();
+      unsigned long long nextEvent = NextStatusChangeEvent;
+      if( (client) && (outputStatus == Flow::On) && (windowOpen) ) {
+         nextEvent = std::min(nextEvent, nextRequest);
+      }
+      else if( (!client) && (pending) ) {
+         nextEvent = now;
+      }
+      if(nextEvent > now) {
+         waitForRPCEvent(now, nextEvent);
+         now = getMicroTime();
+      }
+
+      // ====== Active side: send requests while the window permits =========
+      if(client) {
+         expireRPCTransactions(now);
+         lock();
+         const FlowStatus currentStatus = OutputStatus;
+         unlock();
+         if(currentStatus == Flow::On) {
+            while(nextRequest <= now) {
+               lock();
+               if(OutstandingRPCRequests.size() >= TrafficSpec.Outstanding) {
+                  unlock();
+                  break;
+               }
+               // Register the transaction first, since the response may
+               // arrive before transmitRPCFrame() returns.
+               const uint32_t transactionID = nextOutboundFrameID();
+               OutstandingRPCRequests.insert(std::pair<uint32_t, unsigned long long>(transactionID, now));
+               RPCRequests++;
+               if(FirstRPCRequest == 0) {
+                  FirstRPCRequest = now;
+               }
+               unlock();
+
+               if(transmitRPCFrame(this, now, transactionID, NPMDF_RPC_REQUEST) <= 0) {
+                  lock();
+                  OutstandingRPCRequests.erase(transactionID);
+                  RPCRequests--;
+                  unlock();
+                  // Keep sending, even if there is a temporary UDP failure.
+                  result = (TrafficSpec.Protocol == IPPROTO_UDP);
+                  break;
+               }
+
+               // ------ Schedule next request (saturated: immediately) ------
+               if(TrafficSpec.OutboundFrameRate[0] > 0.0000001) {
+                  const double nextRate = getRandomValue((const double*)&TrafficSpec.OutboundFrameRate,
+                                                         TrafficSpec.OutboundFrameRateRng);
+                  nextRequest += (unsigned long long)rint(1000000.0 / nextRate);
+                  if(nextRequest + 1000000 < now) {
+                     // Time gap of more than 1s -> do not try to correct
+                     nextRequest = now;
+                  }
+               }
+               else {
+                  nextRequest = now;
+               }
+            }
+         }
+         else {
+            nextRequest = now;
+         }
+      }
+
+      // ====== Passive side: answer received requests ======================
+      else {
+         while(!isStopping()) {
+            lock();
+            if(PendingRPCResponses.empty()) {
+               unlock();
+               break;
+            }
+            const std::pair<uint32_t, uint16_t> request = PendingRPCResponses.front();
+            PendingRPCResponses.pop_front();
+            unlock();
+
+            if( (transmitRPCFrame(this, now, request.first, NPMDF_RPC_RESPONSE, request.second) <= 0) &&
+                (TrafficSpec.Protocol != IPPROTO_UDP) ) {
+               result = false;
+               break;
+            }
+         }
+      }
+
+      // ====== Handle status changes =======================================
+      if(NextStatusChangeEvent <= now) {
+         handleStatusChangeEvent(now);
+      }
+   } while( (result == true) && (!isStopping()) );
+}
+
+
+// ###### Wait for next event or wake-up of request/response thread ########
+void Flow::waitForRPCEvent(const unsigned long long now,
+                           const unsigned long long nextEvent)
+{
+   const int timeout = pollTimeout(now, 2,
+                                   now + 1000000,
+                                   nextEvent);
+   if(RPCWakeUpPipe[0] >= 0) {
+      pollfd pfd;
+      pfd.fd      = RPCWakeUpPipe[0];
+      pfd.events  = POLLIN;
+      pfd.revents = 0;
+      if(ext_poll_wrapper(&pfd, 1, timeout) > 0) {
+         char buffer[64];
+         while(ext_read(RPCWakeUpPipe[0], (char*)&buffer, sizeof(buffer)) > 0) { }
+      }
+   }
+   else {
+      ext_poll_wrapper(NULL, 0, timeout);
+   }
+}
+
+
+// ###### Interrupt the request/response thread's poll() ###################
+void Flow::wakeUpRPC()
+{
+   if(RPCWakeUpPipe[1] >= 0) {
+      const char c = 0x00;
+      if(ext_write(RPCWakeUpPipe[1], &c, 1) < 0) {
+         // The pipe is full, i.e. there is already a pending wake-up.
+      }
+   }
+}
+
+
+// ###### Queue response to received request (passive side) ###############
+void Flow::queueRPCResponse(const uint32_t transactionID,
+                            const uint16_t parameter)
+{
+   if(isRPCClient()) {
+      return;
+   }
+   lock();
+   const bool wasEmpty = PendingRPCResponses.empty();
+   PendingRPCResponses.push_back(std::pair<uint32_t, uint16_t>(transactionID, parameter));
+   unlock();
+   if(wasEmpty) {
+      wakeUpRPC();
+   }
+}
+
+
+// ###### Complete transaction on received response (active side) #########
+void Flow::completeRPCTransaction(const uint32_t           transactionID,
+                                  const unsigned long long now)
+{
+   bool windowWasFull = false;
+
+   lock();
+   std::map<uint32_t, unsigned long long>::iterator found =
+      OutstandingRPCRequests.find(transactionID);
+   if(found != OutstandingRPCRequests.end()) {
+      windowWasFull = (OutstandingRPCRequests.size() >= TrafficSpec.Outstanding);
+      TransactionLatency.record((now > found->second) ? now - found->second : 0);
+      RPCTransactions++;
+      LastRPCTransaction = now;
+      OutstandingRPCRequests.erase(found);
+   }
+   // Otherwise, the transaction has already timed out.
+   unlock();
+
+   if(windowWasFull) {
+      wakeUpRPC();
+   }
+}
+
+
+// ###### Expire unanswered requests (active side) #########################
+// Requests (or responses) may get lost on unreliable transports; after the
+// defragmentation timeout, such a transaction is given up to free its slot.
+void Flow::expireRPCTransactions(const unsigned long long now)
+{
+   lock();
+   std::map<uint32_t, unsigned long long>::iterator iterator = OutstandingRPCRequests.begin();
+   while(iterator != OutstandingRPCRequests.end()) {
+      if(iterator->second + TrafficSpec.DefragmentTimeout < now) {
+         OutstandingRPCRequests.erase(iterator++);
+         RPCTimeouts++;
+      }
+      else {
+         iterator++;
+      }
+   }
+   unlock();
+}
+
+
+// ###### Adaptive-bitrate streaming thread function ########################
+// The client fetches one segment at a time, by a request carrying the index
+// of the selected representation. A simulated playout buffer is filled by
+// each downloaded segment and drained in real time while the flow is on.
+// Playback starts (and resumes after a stall) as soon as a segment is
+// buffered; new segments are requested while the buffer has room for them.
+void Flow::runABR()
+{
+   const unsigned long long segmentDuration =
+      (unsigned long long)rint(TrafficSpec.SegmentDuration * 1000000.0);
+   const unsigned long long bufferSize =
+      std::max(segmentDuration, (unsigned long long)rint(TrafficSpec.ABRBufferSize * 1000000.0));
+   std::deque<double>       throughputs;            // Latest throughputs in Kbit/s
+   unsigned long long       bufferLevel    = 0;     // Buffered playout time in us
+   unsigned long long       lastUpdate     = getMicroTime();
+   unsigned long long       stallBegin     = 0;
+   unsigned long long       requestTime    = 0;
+   unsigned long long       requested      = 0;
+   uint32_t                 requestID      = 0;
+   size_t                   representation = 0;
+   bool                     switched       = false;
+   bool                     downloading    = false;
+   bool                     playing        = false;
+   bool                     result         = true;
+   do {
+      unsigned long long now = getMicroTime();
+      lock();
+      const FlowStatus currentStatus = OutputStatus;
+      unlock();
+
+      // ====== Drain playout buffer ========================================
+      if( (playing) && (currentStatus == Flow::On) ) {
+         const unsigned long long played = now - lastUpdate;
+         if(played >= bufferLevel) {
+            // Buffer underrun -> stall until the next segment is complete.
+            stallBegin  = lastUpdate + bufferLevel;
+            bufferLevel = 0;
+            playing     = false;
+            lock();
+            ABRRebuffers++;
+            unlock();
+         }
+         else {
+            bufferLevel -= played;
+         }
+      }
+      lastUpdate = now;
+
+      // ====== Check for completed segment download ========================
+      if(downloading) {
+         lock();
+         const bool complete =
+            (OutstandingRPCRequests.find(requestID) == OutstandingRPCRequests.end());
+         const unsigned long long completion = LastRPCTransaction;
+         unlock();
+         if(complete) {
+            downloading = false;
+            const unsigned long long downloadTime =
+               (completion > requestTime) ? completion - requestTime : 1;
+            const double throughput =
+               8000.0 * getSegmentSize(representation) / downloadTime;
+            throughputs.push_back(throughput);
+            if(throughputs.size() > 5) {
+               throughputs.pop_front();
+            }
+
+            bufferLevel += segmentDuration;
+            unsigned long long rebufferTime = 0;
+            const bool         rebuffer     = (!playing) && (stallBegin > 0);
+            if(rebuffer) {
+               rebufferTime = now - stallBegin;
+               stallBegin   = 0;
+            }
+            playing = true;
+
+            lock();
+            if(ABRSegments == 0) {
+               ABRStartupDelay = now - FirstRPCRequest;
+            }
+            ABRSegments++;
+            ABRBitrateSum   += TrafficSpec.ABRLadder[representation];
+            ABRRebufferTime += rebufferTime;
+            if( (MyMeasurement) && (MyMeasurement->getFirstStatisticsEvent() > 0) ) {
+               VectorFile.printf(
+                  "%06llu %llu %1.6f\t"
+                  "%llu %u %1.6f %1.3f %1.3f %u %u %1.6f\n",
+                  VectorFile.nextLine(), now,
+                  (double)(now - MyMeasurement->getFirstStatisticsEvent()) / 1000000.0,
+                  ABRSegments, TrafficSpec.ABRLadder[representation],
+                  downloadTime / 1000000.0, throughput, bufferLevel / 1000000.0,
+                  (switched == true) ? 1 : 0, (rebuffer == true) ? 1 : 0,
+                  rebufferTime / 1000000.0);
+            }
+            unlock();
+         }
+      }
+
+      // ====== Request next segment ========================================
+      if( (!downloading) && (currentStatus == Flow::On) &&
+          (bufferLevel + segmentDuration <= bufferSize) ) {
+         const size_t next = selectABRRepresentation(bufferLevel, throughputs, representation);
+         switched       = (requested > 0) && (next != representation);
+         representation = next;
+
+         // Register the transaction first, since the response may arrive
+         // before transmitRPCFrame() returns.
+         lock();
+         requestID = nextOutboundFrameID();
+         OutstandingRPCRequests.insert(std::pair<uint32_t, unsigned long long>(requestID, now));
+         RPCRequests++;
+         if(FirstRPCRequest == 0) {
+            FirstRPCRequest = now;
+         }
+         if(switched) {
+            ABRSwitches++;
+         }
+         unlock();
+         requestTime = now;
+         downloading = true;
+         requested++;
+         result = (transmitRPCFrame(this, now, requestID, NPMDF_RPC_REQUEST,
+                                    (uint16_t)representation) > 0);
+      }
+
+      // ====== Wait for download, buffer underrun or room in buffer ========
+      unsigned long long nextEvent = NextStatusChangeEvent;
+      if( (playing) && (currentStatus == Flow::On) ) {
+         nextEvent = std::min(nextEvent, now + bufferLevel);
+         if( (!downloading) && (bufferLevel + segmentDuration > bufferSize) ) {
+            nextEvent = std::min(nextEvent, now + (bufferLevel + segmentDuration - bufferSize));
+         }
+      }
+      if( (result) && (nextEvent > now) ) {
+         waitForRPCEvent(now, nextEvent);
+      }
+
+      // ====== Handle status changes =======================================
+      now = getMicroTime();
+      if(NextStatusChangeEvent <= now) {
+         handleStatusChangeEvent(now);
+      }
+   } while( (result == true) && (!isStopping()) );
+}
+
+
+// ###### Select representation of next ABR segment ########################
+// Throughput-based: highest bitrate below 90% of the harmonic mean of the
+// latest segment throughputs (the lowest one for the first segment).
+// Buffer-based (BBA-0): the buffer level between a reservoir (25% of the
+// buffer) and the end of the cushion (75%) is mapped linearly onto the
+// bitrate range; the bitrate only changes when the mapped rate passes the
+// next higher or lower bitrate.
+size_t Flow::selectABRRepresentation(const unsigned long long  bufferLevel,
+                                     const std::deque<double>& throughputs,
+                                     const size_t              current) const
+{
+   const std::vector<unsigned int>& ladder = TrafficSpec.ABRLadder;
+   size_t                           next   = current;
+
+   if(TrafficSpec.ABRPolicy == ABR_POLICY_BUFFER) {
+      const double buffer    = bufferLevel / 1000000.0;
+      const double reservoir = 0.25 * TrafficSpec.ABRBufferSize;
+      const double cushion   = 0.50 * TrafficSpec.ABRBufferSize;
+      if(buffer <= reservoir) {
+         next = 0;
+      }
+      else if(buffer >= reservoir + cushion) {
+         next = ladder.size() - 1;
+      }
+      else {
+         const double rate = ladder.front() +
+                                (ladder.back() - ladder.front()) * (buffer - reservoir) / cushion;
+         if( (current + 1 < ladder.size()) && (rate >= ladder[current + 1]) ) {
+            while( (next + 1 < ladder.size()) && (ladder[next + 1] < rate) ) {
+               next++;
+            }
+         }
+         else if( (current > 0) && (rate <= ladder[current - 1]) ) {
+            while( (next > 0) && (ladder[next - 1] > rate) ) {
+               next--;
+            }
+         }
+      }
+   }
+   else {
+      next = 0;
+      if(throughputs.size() > 0) {
+         double sum = 0.0;
+         for(std::deque<double>::const_iterator iterator = throughputs.begin();
+             iterator != throughputs.end(); iterator++) {
+            sum += 1.0 / *iterator;
+         }
+         const double estimate = 0.9 * throughputs.size() / sum;
+         while( (next + 1 < ladder.size()) && (ladder[next + 1] <= estimate) ) {
+            next++;
+         }
+      }
+   }
+   return(next);
+}
+
+
+// ###### Get segment size of ABR representation ############################
+size_t Flow::getSegmentSize(const uint16_t representation) const
+{
+   // An invalid index results in the highest representation.
+   const unsigned int bitrate =
+      TrafficSpec.ABRLadder[std::min((size_t)representation, TrafficSpec.ABRLadder.size() - 1)];
+   return((size_t)rint(bitrate * 1000.0 * TrafficSpec.SegmentDuration / 8.0));
+}
+
+
+// ###### Bind connection churn socket ######################################
+int Flow::bindChurnSocket(const int             socketDescriptor,
+                          const sockaddr_union& localAddress,
+                          uint16_t&             nextPort)
+{
+   const unsigned int localAddresses =
+      (TrafficSpec.Protocol == IPPROTO_SCTP) ? 0 : 1;
+
+   // ====== Ephemeral port =================================================
+   if(TrafficSpec.PortRangeLow == 0) {
+#ifdef IP_BIND_ADDRESS_NO_PORT
+      // Defer port selection to connect(), to allow for reusing the same
+      // local port towards different peers.
+      const int on = 1;
+      ext_setsockopt(socketDescriptor, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof(on));
+#endif
+      return(bindSocket(socketDescriptor, localAddress.sa.sa_family, SOCK_STREAM,
+                        TrafficSpec.Protocol, 0, localAddresses, &localAddress,
+                        false, TrafficSpec.BindV6Only));
+   }
+
+   // ====== Port range: try each port once, round-robin ====================
+   const unsigned int ports = (unsigned int)TrafficSpec.PortRangeHigh -
+                                 (unsigned int)TrafficSpec.PortRangeLow + 1;
+   int result = -3;
+   for(unsigned int i = 0;i < ports;i++) {
+      const uint16_t port = nextPort;
+      nextPort = (nextPort >= TrafficSpec.PortRangeHigh) ? TrafficSpec.PortRangeLow : nextPort + 1;
+      result = bindSocket(socketDescriptor, localAddress.sa.sa_family, SOCK_STREAM,
+                          TrafficSpec.Protocol, port, localAddresses, &localAddress,
+                          false, TrafficSpec.BindV6Only);
+      if( (result >= 0) || (errno != EADDRINUSE) ) {
+         break;
+      }
+   }
+   return(result);
+}
+
+
+// ###### Perform one connection churn attempt ##############################
+void Flow::performChurnConnection(const sockaddr_union& localAddress,
+                                  const sockaddr_union& remoteAddress,
+                                  uint16_t&             nextPort)
+{
+   const unsigned long long start    = getMicroTime();
+   const bool               request  = (TrafficSpec.OutboundFrameSize[0] >= 1.0);
+   const bool               fastOpen = (TrafficSpec.FastOpen) && (request);
+   bool                     success  = false;
+   int                      failure  = 0;   // errno of the failed call
+   unsigned long long       latency  = 0;
+
+   // ====== Create and configure socket ====================================
+   const int sd = createSocket(remoteAddress.sa.sa_family, SOCK_STREAM,
+                               TrafficSpec.Protocol, 0, NULL);
+   if(sd >= 0) {
+      bool okay = configureSocket(sd);
+      if(TrafficSpec.ReuseAddress) {
+         const int on = 1;
+         ext_setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      }
+      // On Linux, SO_SNDTIMEO also limits the duration of connect().
+      struct timeval timeout;
+      timeout.tv_sec  = TrafficSpec.ConnectTimeout / 1000;
+      timeout.tv_usec = 1000 * (TrafficSpec.ConnectTimeout % 1000);
+      ext_setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      if(TrafficSpec.Protocol == IPPROTO_SCTP) {
+         sctp_initmsg initmsg;
+         memset((char*)&initmsg, 0 ,sizeof(initmsg));
+         initmsg.sinit_num_ostreams  = 65535;
+         initmsg.sinit_max_instreams = 65535;
+         ext_setsockopt(sd, IPPROTO_SCTP, SCTP_INITMSG, &initmsg, sizeof(initmsg));
+      }
+      if(fastOpen) {
+#ifdef TCP_FASTOPEN_CONNECT
+         // The SYN carries the request; connect() returns immediately.
+         const int on = 1;
+         if(ext_setsockopt(sd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof(on)) < 0) {
+            std::cerr << "WARNING: Failed to enable TCP Fast Open (TCP_FASTOPEN_CONNECT) for flow #"
+                      << FlowID << " - " << strerror(errno) << "!" << std::endl;
+            TrafficSpec.FastOpen = false;
+         }
+#else
+         std::cerr << "WARNING: TCP Fast Open is not supported by this system!" << std::endl;
+         TrafficSpec.FastOpen = false;
+#endif
+      }
+
+      // ====== Bind, connect and send request ==============================
+      if(!okay) {
+         failure = errno;
+      }
+      else if(bindChurnSocket(sd, localAddress, nextPort) < 0) {
+         failure = errno;
+      }
+      else if(ext_connect(sd, &remoteAddress.sa, getSocklen(&remoteAddress.sa)) != 0) {
+         failure = errno;
+      }
+      else {
+         latency = getMicroTime() - start;
+         success = true;
+         if(request) {
+            // With TCP Fast Open, the latency includes sending the request.
+            success = (transmitFrame(this, getMicroTime(), sd) > 0);
+            if(!success) {
+               failure = errno;
+            }
+            if(fastOpen) {
+               latency = getMicroTime() - start;
+            }
+         }
+      }
+      ext_close(sd);
+   }
+   else {
+      failure = errno;
+   }
+
+   // ====== Update statistics ==============================================
+   lock();
+   if(ChurnAttempts == 0) {
+      FirstChurnAttempt = start;
+   }
+   LastChurnAttempt = start;
+   ChurnAttempts++;
+   if(success) {
+      ChurnConnections++;
+      ConnectLatency.record(latency);
+   }
+   else {
+      ChurnFailures++;
+      if(gOutputVerbosity >= NPFOV_CONNECTIONS) {
+         std::cerr << "NOTE: Connection churn attempt of flow #" << FlowID
+                   << " failed - " << strerror(failure) << std::endl;
+      }
+   }
+   unlock();
 }
 
 
@@ -1241,7 +3260,10 @@ bool Flow::configureSocket(const int socketDescriptor)
          return(false);
       }
 
-      if(TrafficSpec.Protocol == IPPROTO_MPTCP) {
+      // Upstream Linux MPTCP is configured system-wide (ip mptcp endpoint,
+      // net.mptcp sysctls), the options below are for out-of-tree MPTCP only.
+      if( (TrafficSpec.Protocol == IPPROTO_MPTCP) &&
+          (!isUpstreamMPTCPSocket(socketDescriptor)) ) {
          // FIXME! Add proper, platform-independent code here!
 #ifndef __linux__
 #warning MPTCP is currently only available on Linux!
@@ -32,19 +32,43 @@
 #include "defragmenter.h"
 #include "measurement.h"
 #include "cpustatus.h"
+#include "latencyhistogram.h"
+#include "frametrace.h"
 #include "tools.h"
 
 #include <poll.h>
+#include <string.h>
 
 #include <vector>
+#include <deque>
 #include <map>
+#include <unordered_map>
 
 
+// Stack space to prefault for sender/receiver threads (covers the message
+// buffer of handleNetPerfMeterData()).
+#define NETPERFMETER_STACK_PREFAULT (256 * 1024)
+
+// Size of a flow's buffer for outgoing messages (maximum message size)
+#define FLOW_SEND_BUFFER_SIZE       65536
+
+// Maximum number of due trace frames sent before checking for stopping
+#define FLOW_TRACE_MAX_BURST        1024
+
+// Distribution of flow start (ramp-up) and stop (ramp-down) times
+#define FLOWSCHEDULE_FIXED  0   // Same offset for all flows
+#define FLOWSCHEDULE_LINEAR 1   // Evenly spread over the window
+#define FLOWSCHEDULE_RANDOM 2   // Uniformly distributed within the window
+
 class Flow;
+class UDPReceiveWorker;
+class ReceiveWorker;
 
 class FlowManager : public Thread
 {
    friend class Flow;
+   friend class UDPReceiveWorker;
+   friend class ReceiveWorker;
 
    // ====== Methods ========================================================
    protected:
@@ -73,7 +97,8 @@ class FlowManager : public Thread
       unlock();
    }
 
-   void addSocket(const int protocol, const int socketDescriptor);
+   void addSocket(const int protocol, const int socketDescriptor,
+                  ShmRing* ring = NULL);
    Flow* identifySocket(const uint64_t         measurementID,
                         const uint32_t         flowID,
                         const uint16_t         streamID,
@@ -86,6 +111,18 @@ class FlowManager : public Thread
 
    void addFlow(Flow* flow);
    void removeFlow(Flow* flow);
+   void addUDPWorker(UDPReceiveWorker* worker);
+   void removeUDPWorker(UDPReceiveWorker* worker);
+   void addReceiveWorker(ReceiveWorker* worker);
+   void removeReceiveWorker(ReceiveWorker* worker);
+   void setReceiveWorkerPolicy(const int policy);
+   void setCPUSet(const std::vector<unsigned int>& cpus);
+   void setFlowScheduling(const int policy, const int priority);
+   void setPrefault(const bool prefault);
+   void updateMainLoopStatus();
+   inline const std::vector<unsigned int>& getCPUSet() const {
+      return(CPUSet);
+   }
    void printFlows(std::ostream& os,
                    const bool    printStatistics);
 
@@ -95,7 +132,16 @@ class FlowManager : public Thread
                          const OutputFileFormat   vectorFileFormat,
                          const char*              scalarNamePattern,
                          const OutputFileFormat   scalarFileFormat,
+                         const unsigned long long warmUp,
+                         const unsigned long long coolDownOffset,
+                         const unsigned long long startTime,
                          const bool               printFlows = false);
+   void scheduleFlows(const uint64_t           measurementID,
+                      const unsigned int       rampUpMode,
+                      const unsigned long long rampUp,
+                      const unsigned int       rampDownMode,
+                      const unsigned long long rampDown,
+                      const unsigned long long runtime);
    void stopMeasurement(const uint64_t            measurementID,
                         const bool                printFlows = false,
                         const unsigned long long  now        = getMicroTime());
@@ -103,7 +149,11 @@ class FlowManager : public Thread
    void writeScalarStatistics(const uint64_t           measurementID,
                               const unsigned long long now,
                               OutputFile&              scalarFile,
-                              const unsigned long long firstStatisticsEvent);
+                              const unsigned long long firstStatisticsEvent,
+                              const unsigned long long windowStart,
+                              const unsigned long long windowEnd);
+   void snapshotStatistics(const uint64_t measurementID,
+                           const bool     windowEnd);
    void writeVectorStatistics(const uint64_t           measurementID,
                               const unsigned long long now,
                               OutputFile&              vectorFile,
@@ -133,7 +183,23 @@ class FlowManager : public Thread
 
    // ====== Private Methods ================================================
    unsigned long long getNextEvent();
+   void prepareFlowThread(Flow* flow);
+   void prepareWorkerThread(Thread* thread);
    void handleEvents(const unsigned long long now);
+   void wakeUp();
+   void watchFlow(Flow* flow);
+   void unwatchFlow(Flow* flow);
+   void watchSocket(const int  socketDescriptor,
+                    const int  protocol,
+                    const bool unidentified);
+   void unwatchSocket(const int  socketDescriptor,
+                      const bool unidentified);
+   void indexFlowSocket(Flow* flow);
+   void unindexFlowSocket(Flow* flow);
+   void indexFlowAddress(Flow* flow);
+   void unindexFlowAddress(Flow* flow);
+   void assignReceiveWorker(const int socketDescriptor);
+   void migrateSocket(const int socketDescriptor);
 
 
    // ====== Private Data ===================================================
@@ -143,12 +209,103 @@ class FlowManager : public Thread
    // ------ Flow Management ------------------------------------------------
    MessageReader      Reader;
    std::vector<Flow*> FlowSet;
-   std::map<int, int> UnidentifiedSockets;
-   bool               UpdatedUnidentifiedSockets;
+   int                WakeUpPipe[2];   // Interrupts poll() on new sockets
    bool               DisplayOn;
    FlowBandwidthStats CurrentGlobalStats;
    FlowBandwidthStats LastGlobalStats;
 
+   // ------ Flow Lookup Indexes --------------------------------------------
+   // Each key maps to its flows in insertion order; a lookup returns the
+   // first one, like the former linear search of FlowSet.
+   struct FlowIDKey {
+      uint64_t MeasurementID;
+      uint32_t FlowID;
+      uint16_t StreamID;
+
+      inline bool operator==(const FlowIDKey& key) const {
+         return( (MeasurementID == key.MeasurementID) &&
+                 (FlowID == key.FlowID) && (StreamID == key.StreamID) );
+      }
+   };
+   struct FlowIDKeyHash {
+      inline size_t operator()(const FlowIDKey& key) const {
+         return(std::hash<uint64_t>()(key.MeasurementID ^
+                                      ((uint64_t)key.FlowID << 16) ^ key.StreamID));
+      }
+   };
+   struct SocketKey {
+      int      SocketDescriptor;
+      uint16_t StreamID;
+
+      inline bool operator==(const SocketKey& key) const {
+         return( (SocketDescriptor == key.SocketDescriptor) &&
+                 (StreamID == key.StreamID) );
+      }
+   };
+   struct SocketKeyHash {
+      inline size_t operator()(const SocketKey& key) const {
+         return(std::hash<uint64_t>()(((uint64_t)key.SocketDescriptor << 16) ^ key.StreamID));
+      }
+   };
+   struct AddressKey {   // IPv4 addresses are mapped to IPv6, as by addresscmp()
+      uint32_t Address[4];
+      uint16_t Port;
+
+      inline bool operator==(const AddressKey& key) const {
+         return( (memcmp(&Address, &key.Address, sizeof(Address)) == 0) &&
+                 (Port == key.Port) );
+      }
+   };
+   struct AddressKeyHash {
+      inline size_t operator()(const AddressKey& key) const {
+         return(std::hash<uint64_t>()(((uint64_t)key.Address[0] << 32) ^ key.Address[1]) ^
+                std::hash<uint64_t>()(((uint64_t)key.Address[2] << 32) ^ key.Address[3]) ^
+                key.Port);
+      }
+   };
+   static bool getAddressKey(const sockaddr* address, AddressKey& key);
+
+   std::unordered_map<FlowIDKey,  std::vector<Flow*>, FlowIDKeyHash>  FlowIDIndex;
+   std::unordered_map<SocketKey,  std::vector<Flow*>, SocketKeyHash>  SocketIndex;
+   std::unordered_map<AddressKey, std::vector<Flow*>, AddressKeyHash> AddressIndex;
+
+   // ------ Receive Workers ------------------------------------------------
+   // Their flow caches have to be updated when a flow is removed.
+   std::vector<UDPReceiveWorker*> UDPWorkers;
+   std::vector<ReceiveWorker*>    ReceiveWorkers;
+   int                            ReceiveWorkerPolicy;
+   size_t                         NextReceiveWorker;   // For round-robin assignment
+
+   // ------ Poll Interest Set ----------------------------------------------
+   // Sockets are added when a flow or unidentified socket starts reading
+   // and removed when it stops, so a wake-up only costs the ready sockets.
+   // An identified socket may be handed over to a receive worker; it is
+   // migrating until the FlowManager thread has finished reading from it.
+   struct PollEntry {
+      int            Protocol;
+      unsigned int   FlowReferences;   // Flows reading from the socket
+      bool           Unidentified;     // Not yet mapped to a flow
+      ReceiveWorker* Worker;           // NULL for the FlowManager thread
+      bool           Migrating;        // Not yet in the worker's poll set
+   };
+   std::map<int, PollEntry> PollSet;
+#ifdef __linux__
+   int                      EpollFD;
+#else
+   bool                     UpdatedPollSet;
+#endif
+
+   // ------ CPU Affinity ---------------------------------------------------
+   std::vector<unsigned int> CPUSet;         // Empty set: no affinity
+   size_t                    NextCPUIndex;   // For round-robin assignment
+   int                       MainLoopCPU;    // CPU last seen by the main loop
+   pid_t                     MainLoopThreadID;
+
+   // ------ Real-Time Settings ---------------------------------------------
+   int                       FlowSchedulingPolicy;
+   int                       FlowSchedulingPriority;
+   bool                      Prefault;
+
    // ------ Measurement Management -----------------------------------------
    std::map<uint64_t, Measurement*> MeasurementSet;
    unsigned long long               DisplayInterval;
@@ -194,9 +351,16 @@ class Flow : public Thread
    inline int getSocketDescriptor() const {
       return(SocketDescriptor);
    }
+   inline ShmRing* getShmRing() const {
+      return(Ring);
+   }
+   char* getSendBuffer();
    inline Defragmenter* getDefragmenter() {
       return(&MyDefragmenter);
    }
+   inline Impairment* getImpairment() {
+      return(MyImpairment);
+   }
    inline int getRemoteControlSocketDescriptor() const {
       return(RemoteControlSocketDescriptor);
    }
@@ -213,9 +377,7 @@ class Flow : public Thread
       return(AcceptedIncomingFlow);
    }
 
-   inline void endOfInput() {
-      InputStatus = Off;
-   }
+   void endOfInput();
 
    inline const FlowBandwidthStats& getCurrentBandwidthStats() const {
       return(CurrentBandwidthStats);
@@ -243,6 +405,22 @@ class Flow : public Thread
       return(++LastOutboundSeqNumber);
    }
 
+   size_t getSegmentSize(const uint16_t representation) const;
+
+   inline unsigned long long getStartOffset() const {
+      return(StartOffset);
+   }
+   inline unsigned long long getStopOffset() const {
+      return(StopOffset);
+   }
+   inline void setSchedule(const unsigned long long startOffset,
+                           const unsigned long long stopOffset) {
+      lock();
+      StartOffset = startOffset;
+      StopOffset  = stopOffset;
+      unlock();
+   }
+
    inline bool isRemoteAddressValid() const {
       return(RemoteAddressIsValid);
    }
@@ -290,6 +468,9 @@ class Flow : public Thread
    }
 
    bool initializeVectorFile(const char* name, const OutputFileFormat format);
+   bool initializeSubflowVectorFile(const char* name, const OutputFileFormat format);
+   void writeSubflowStatistics(const unsigned long long now,
+                               const unsigned long long firstStatisticsEvent);
    void updateTransmissionStatistics(const unsigned long long now,
                                      const size_t             addedFrames,
                                      const size_t             addedPackets,
@@ -306,13 +487,23 @@ class Flow : public Thread
                                   const double             jitter);
 
 
+   void updateTrainStatistics(const unsigned long long       arrivalTime,
+                              const NetPerfMeterDataMessage* dataMsg,
+                              const size_t                   receivedBytes);
+   void queueRPCResponse(const uint32_t transactionID,
+                         const uint16_t parameter);
+   void completeRPCTransaction(const uint32_t           transactionID,
+                               const unsigned long long now);
+
    void print(std::ostream& os, const bool printStatistics = false);
    void resetStatistics();
 
+   bool loadTrace();
    bool configureSocket(const int socketDescriptor);
    void setSocketDescriptor(const int  socketDescriptor,
                             const bool originalSocketDescriptor = true,
                             const bool deleteWhenFinished       = true);
+   void setShmRing(ShmRing* ring);
    bool activate();
    void deactivate(const bool asyncStop = false);
 
@@ -325,6 +516,30 @@ class Flow : public Thread
    unsigned long long scheduleNextTransmissionEvent();
    unsigned long long scheduleNextStatusChangeEvent(const unsigned long long now);
    void handleStatusChangeEvent(const unsigned long long now);
+   void runChurn();
+   int bindChurnSocket(const int             socketDescriptor,
+                       const sockaddr_union& localAddress,
+                       uint16_t&             nextPort);
+   void performChurnConnection(const sockaddr_union& localAddress,
+                               const sockaddr_union& remoteAddress,
+                               uint16_t&             nextPort);
+   inline bool isRPCClient() const {
+      return( (TrafficSpec.RPC) && (RemoteControlSocketDescriptor < 0) );
+   }
+   inline bool isABRClient() const {
+      return( (TrafficSpec.ABRLadder.size() > 0) && (isRPCClient()) );
+   }
+   void runTrace();
+   void finishTrain();
+   void runRPC();
+   void waitForRPCEvent(const unsigned long long now,
+                        const unsigned long long nextEvent);
+   void wakeUpRPC();
+   void expireRPCTransactions(const unsigned long long now);
+   void runABR();
+   size_t selectABRRepresentation(const unsigned long long bufferLevel,
+                                  const std::deque<double>& throughputs,
+                                  const size_t              current) const;
 
 
    // ====== Flow Identification ============================================
@@ -337,11 +552,13 @@ class Flow : public Thread
    bool               AcceptedIncomingFlow;
    bool               OriginalSocketDescriptor;
    bool               DeleteWhenFinished;
-   pollfd*            PollFDEntry;   // For internal usage by FlowManager
+   int                PollSocketDescriptor;   // Watched by FlowManager (or -1)
+   ShmRing*           Ring;          // Owned by the FlowManager's MessageReader
 
    int                RemoteControlSocketDescriptor;
    sockaddr_union     RemoteAddress;
    bool               RemoteAddressIsValid;
+   int                AssignedCPU;   // CPU assigned by FlowManager (or -1)
 
 
    // ====== Timing =========================================================
@@ -356,19 +573,71 @@ class Flow : public Thread
    FlowTrafficSpec    TrafficSpec;
    FlowStatus         InputStatus;
    FlowStatus         OutputStatus;
+   FrameTrace         OutboundTrace;
+   bool               HasOutboundTrace;
    uint32_t           LastOutboundFrameID;     // ID of last outbound frame
    uint64_t           LastOutboundSeqNumber;   // ID of last outbound packet
    unsigned long long NextStatusChangeEvent;
    size_t             OnOffEventPointer;
+   unsigned long long StartOffset;    // Delayed start (in us)
+   unsigned long long StopOffset;     // Ramp-down (in us, 0: none)
+   unsigned long long StopTime;       // Absolute time of ramp-down (0: none)
+   bool               StartPending;   // Waiting for delayed start
+   unsigned long long PlannedStart;   // Scheduled time of the delayed start
+   unsigned long long ActualStart;    // Time the delayed start took place (0: none)
 
    // ====== Statistics =====================================================
    Measurement*       MyMeasurement;
    OutputFile         VectorFile;
+   OutputFile         SubflowVectorFile;   // MPTCP subflows (active side only)
    FlowBandwidthStats CurrentBandwidthStats;
    FlowBandwidthStats LastBandwidthStats;
+   FlowBandwidthStats WindowStartStats;   // Snapshot at the end of warm-up
+   FlowBandwidthStats WindowEndStats;     // Snapshot at the begin of cool-down
    double             Delay;    // Transit time of latest received packet
    double             Jitter;   // Current jitter value
    Defragmenter       MyDefragmenter;
+   Impairment*        MyImpairment;   // Outgoing datagram impairment (NULL: none)
+   char*              SendBuffer;     // Outgoing messages (flow thread only)
+
+   // ====== Connection Churn Statistics ====================================
+   unsigned long long ChurnAttempts;
+   unsigned long long ChurnConnections;
+   unsigned long long ChurnFailures;
+   unsigned long long FirstChurnAttempt;
+   unsigned long long LastChurnAttempt;
+   LatencyHistogram   ConnectLatency;   // in us
+
+   // ====== Request/Response Transactions ==================================
+   int                                    RPCWakeUpPipe[2];      // Interrupts the sender's poll()
+   std::deque< std::pair<uint32_t, uint16_t> > PendingRPCResponses;   // Passive side: transaction ID, parameter
+   std::map<uint32_t, unsigned long long> OutstandingRPCRequests;   // Active side: ID -> send time
+   unsigned long long                     RPCRequests;
+   unsigned long long                     RPCTransactions;
+   unsigned long long                     RPCTimeouts;
+   unsigned long long                     FirstRPCRequest;
+   unsigned long long                     LastRPCTransaction;
+   LatencyHistogram                       TransactionLatency;   // in us
+
+   // ====== Adaptive-Bitrate Streaming (active side) =======================
+   unsigned long long                     ABRSegments;
+   unsigned long long                     ABRSwitches;
+   unsigned long long                     ABRRebuffers;
+   unsigned long long                     ABRRebufferTime;      // in us
+   unsigned long long                     ABRStartupDelay;      // in us
+   double                                 ABRBitrateSum;        // in Kbit/s
+
+   // ====== Packet Train Probing (receiver side) ===========================
+   bool                                   TrainActive;
+   uint32_t                               TrainID;
+   unsigned int                           TrainPackets;
+   unsigned long long                     TrainBytes;          // Without first packet
+   unsigned long long                     TrainFirstArrival;
+   unsigned long long                     TrainLastArrival;
+   long long                              TrainLastDelay;      // in us
+   unsigned int                           TrainDelayIncreases;
+   unsigned long long                     TrainsWithIncreasingDelay;
+   std::vector<double>                    TrainCapacities;     // in Mbit/s
 };
 
 #endif
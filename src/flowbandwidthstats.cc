@@ -54,6 +54,9 @@ FlowBandwidthStats operator+(const FlowBandwidthStats& s1,
    result.LostBytes          = s1.LostBytes + s2.LostBytes;
    result.LostPackets        = s1.LostPackets + s2.LostPackets;
    result.LostFrames         = s1.LostFrames + s2.LostFrames;
+
+   result.DelaySum           = s1.DelaySum + s2.DelaySum;
+   result.JitterSum          = s1.JitterSum + s2.JitterSum;
    return(result);
 }
 
@@ -74,6 +77,9 @@ FlowBandwidthStats operator-(const FlowBandwidthStats& s1,
    result.LostBytes          = s1.LostBytes - s2.LostBytes;
    result.LostPackets        = s1.LostPackets - s2.LostPackets;
    result.LostFrames         = s1.LostFrames - s2.LostFrames;
+
+   result.DelaySum           = s1.DelaySum - s2.DelaySum;
+   result.JitterSum          = s1.JitterSum - s2.JitterSum;
    return(result);
 }
 
@@ -159,4 +165,7 @@ void FlowBandwidthStats::reset()
    LostBytes          = 0;
    LostPackets        = 0;
    LostFrames         = 0;
+
+   DelaySum           = 0.0;
+   JitterSum          = 0.0;
 }
@@ -62,6 +62,9 @@ class FlowBandwidthStats
    unsigned long long LostBytes;
    unsigned long long LostPackets;
    unsigned long long LostFrames;
+
+   double             DelaySum;    // Sum of transit times of received packets (in ms)
+   double             JitterSum;   // Sum of jitter values at received packets (in ms)
 };
 
 
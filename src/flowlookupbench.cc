@@ -0,0 +1,160 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "flow.h"
+#include "tools.h"
+
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+
+// Measures the cost of the three FlowManager::findFlow() lookups, which the
+// passive node performs per received packet, for 10 to 50,000 flows. The
+// flows are identified like incoming UDP flows, sharing one socket
+// descriptor (i.e. they differ by stream ID and source address). No packets
+// are sent, so the flow count is not limited by sockets or threads. For
+// comparison, the former linear search of the flow set is measured as well.
+
+#define LOOKUPS                1000000
+#define LINEAR_SEARCH_STEPS    100000000   // Limits the linear search lookups
+#define BENCHMARK_SOCKET       1000000   // Not opened, only used as key
+#define BENCHMARK_MEASUREMENT  0x1234567890abcdefULL
+
+MessageReader gMessageReader;
+
+
+// ###### Get source address of a flow ######################################
+static void getFlowAddress(const unsigned int flowNumber, sockaddr_union& address)
+{
+   memset(&address, 0, sizeof(address));
+   address.in.sin_family      = AF_INET;
+   address.in.sin_addr.s_addr = htonl(0x0a000000 | flowNumber);   // 10.x.y.z
+   address.in.sin_port        = htons(9000);
+}
+
+
+// ###### Measure lookups ###################################################
+static void runBenchmark(const unsigned int flows)
+{
+   FlowManager*       flowManager = FlowManager::getFlowManager();
+   std::vector<Flow*> flowSet;
+
+   // ====== Create flows ===================================================
+   FlowTrafficSpec trafficSpec;
+   trafficSpec.Protocol = IPPROTO_UDP;
+   for(unsigned int i = 0;i < flows;i++) {
+      // An incoming UDP flow is not polled by the FlowManager thread.
+      Flow* flow = new Flow(BENCHMARK_MEASUREMENT, i, (uint16_t)i, trafficSpec,
+                            STDIN_FILENO);
+      sockaddr_union address;
+      getFlowAddress(i, address);
+      int controlSocketDescriptor;
+      if(flowManager->identifySocket(BENCHMARK_MEASUREMENT, i, (uint16_t)i,
+                                     BENCHMARK_SOCKET, &address, OFF_None,
+                                     controlSocketDescriptor) != flow) {
+         std::cerr << "ERROR: Unable to identify flow " << i << "!" << std::endl;
+         exit(1);
+      }
+      flowSet.push_back(flow);
+   }
+
+   // ====== Random lookup order ============================================
+   std::vector<unsigned int> order(LOOKUPS);
+   for(size_t i = 0;i < LOOKUPS;i++) {
+      order[i] = (unsigned int)(random64() % flows);
+   }
+   std::vector<sockaddr_union> addresses(flows);
+   for(unsigned int i = 0;i < flows;i++) {
+      getFlowAddress(i, addresses[i]);
+   }
+
+   // ====== Look up flows ==================================================
+   size_t found = 0;
+   const unsigned long long t1 = getMicroTime();
+   for(size_t i = 0;i < LOOKUPS;i++) {
+      found += (flowManager->findFlow(BENCHMARK_MEASUREMENT, order[i], (uint16_t)order[i]) != NULL);
+   }
+   const unsigned long long t2 = getMicroTime();
+   for(size_t i = 0;i < LOOKUPS;i++) {
+      found += (flowManager->findFlow(BENCHMARK_SOCKET, (uint16_t)order[i]) != NULL);
+   }
+   const unsigned long long t3 = getMicroTime();
+   for(size_t i = 0;i < LOOKUPS;i++) {
+      found += (flowManager->findFlow(&addresses[order[i]].sa) != NULL);
+   }
+   const unsigned long long t4 = getMicroTime();
+
+   // ====== Linear search, like the former findFlow() by ID ================
+   const size_t linearLookups = std::min((size_t)LOOKUPS,
+                                         (size_t)(LINEAR_SEARCH_STEPS / flows));
+   for(size_t i = 0;i < linearLookups;i++) {
+      flowManager->lock();
+      for(std::vector<Flow*>::const_iterator iterator = flowManager->getFlowSet().begin();
+          iterator != flowManager->getFlowSet().end(); iterator++) {
+         const Flow* flow = *iterator;
+         if( (flow->getMeasurementID() == BENCHMARK_MEASUREMENT) &&
+             (flow->getFlowID() == order[i]) &&
+             (flow->getStreamID() == (uint16_t)order[i]) ) {
+            found++;
+            break;
+         }
+      }
+      flowManager->unlock();
+   }
+   const unsigned long long t5 = getMicroTime();
+   if(found != (3 * LOOKUPS) + linearLookups) {
+      std::cerr << "ERROR: Lookups have failed!" << std::endl;
+      exit(1);
+   }
+
+   std::cout << format("%6u flows: by ID %6.1f ns, by socket %6.1f ns, by address %6.1f ns"
+                       " (linear search: %9.1f ns)",
+                       flows,
+                       1000.0 * (t2 - t1) / LOOKUPS,
+                       1000.0 * (t3 - t2) / LOOKUPS,
+                       1000.0 * (t4 - t3) / LOOKUPS,
+                       1000.0 * (t5 - t4) / linearLookups)
+             << std::endl;
+
+   // ====== Remove flows ===================================================
+   for(std::vector<Flow*>::iterator iterator = flowSet.begin();
+       iterator != flowSet.end(); iterator++) {
+      delete *iterator;
+   }
+}
+
+
+// ###### Main program ######################################################
+int main(int argc, char** argv)
+{
+   const unsigned int flowCounts[] = { 10, 100, 1000, 10000, 50000 };
+
+   std::cout << "Time per findFlow() call, " << LOOKUPS
+             << " lookups of random flows:" << std::endl;
+   for(size_t i = 0;i < sizeof(flowCounts) / sizeof(flowCounts[0]);i++) {
+      runBenchmark(flowCounts[i]);
+   }
+   return(0);
+}
@@ -22,6 +22,7 @@
  */
 
 #include "flowtrafficspec.h"
+#include "empiricaldistribution.h"
 
 
 // ###### Constructor #######################################################
@@ -37,6 +38,48 @@ FlowTrafficSpec::~FlowTrafficSpec()
 }
 
 
+// ###### Apply function to all empirical distributions in use ##############
+static void forEachDistribution(const FlowTrafficSpec& trafficSpec,
+                                void (*function)(const unsigned int identifier))
+{
+   if(trafficSpec.OutboundFrameRateRng == RANDOM_EMPIRICAL) {
+      function((unsigned int)trafficSpec.OutboundFrameRate[1]);
+   }
+   if(trafficSpec.OutboundFrameSizeRng == RANDOM_EMPIRICAL) {
+      function((unsigned int)trafficSpec.OutboundFrameSize[1]);
+   }
+   if(trafficSpec.InboundFrameRateRng == RANDOM_EMPIRICAL) {
+      function((unsigned int)trafficSpec.InboundFrameRate[1]);
+   }
+   if(trafficSpec.InboundFrameSizeRng == RANDOM_EMPIRICAL) {
+      function((unsigned int)trafficSpec.InboundFrameSize[1]);
+   }
+   if(trafficSpec.Impairment.DelayRng == RANDOM_EMPIRICAL) {
+      function((unsigned int)trafficSpec.Impairment.Delay[1]);
+   }
+   for(std::vector<OnOffEvent>::const_iterator iterator = trafficSpec.OnOffEvents.begin();
+       iterator != trafficSpec.OnOffEvents.end(); iterator++) {
+      if((*iterator).RandNumGen == RANDOM_EMPIRICAL) {
+         function((unsigned int)(*iterator).ValueArray[1]);
+      }
+   }
+}
+
+
+// ###### Add references to the empirical distributions in use ##############
+void FlowTrafficSpec::retainDistributions() const
+{
+   forEachDistribution(*this, EmpiricalDistribution::retainDistribution);
+}
+
+
+// ###### Release references to the empirical distributions in use ##########
+void FlowTrafficSpec::releaseDistributions() const
+{
+   forEachDistribution(*this, EmpiricalDistribution::releaseDistribution);
+}
+
+
 // ###### Show configuration entry (value + random number generator) ########
 void FlowTrafficSpec::showEntry(std::ostream& os,
                                 const double* valueArray,
@@ -61,6 +104,14 @@ void FlowTrafficSpec::showEntry(std::ostream& os,
          snprintf((char*)&str, sizeof(str), "m=%1.6lf, k=%1.6lf%% (pareto)",
                   valueArray[0], valueArray[1]);
        break;
+      case RANDOM_EMPIRICAL: {
+         const EmpiricalDistribution* distribution =
+            EmpiricalDistribution::getDistribution((unsigned int)valueArray[1]);
+         snprintf((char*)&str, sizeof(str), "mean %1.6lf (empirical, %u values)",
+                  valueArray[0],
+                  (distribution != NULL) ? (unsigned int)distribution->getEntries() : 0);
+        }
+       break;
       default:
          snprintf((char*)&str, sizeof(str), "unknown?!");
        break;
@@ -158,6 +209,88 @@ void FlowTrafficSpec::print(std::ostream& os) const
    }
    os << std::endl;
    os << "      - CCID:                #" << (unsigned int)CCID << std::endl;
+   os << "      - Sender CPU:          ";
+   if(CPU >= 0) {
+      os << CPU;
+   }
+   else {
+      os << "automatic";
+   }
+   os << std::endl;
+   if(Churn) {
+      os << "      - Connection Churn:    yes" << std::endl
+         << "      - TCP Fast Open:       "
+         << ((FastOpen == true) ? "yes" : "no") << std::endl
+         << "      - Reuse Address:       "
+         << ((ReuseAddress == true) ? "yes" : "no") << std::endl
+         << "      - Local Port Range:    ";
+      if(PortRangeLow > 0) {
+         os << PortRangeLow << "-" << PortRangeHigh;
+      }
+      else {
+         os << "ephemeral";
+      }
+      os << std::endl
+         << "      - Connect Timeout:     " << ConnectTimeout << "ms" << std::endl;
+   }
+   if(RPC) {
+      os << "      - Request/Response:    yes" << std::endl
+         << "      - Outstanding Req.:    " << Outstanding << std::endl;
+   }
+   if(StartOffset >= 0.0) {
+      os << "      - Start Offset:        " << ((StartRandom == true) ? "random up to " : "")
+         << StartOffset << "s" << std::endl;
+   }
+   if(ABRLadder.size() > 0) {
+      os << "      - ABR Ladder:          ";
+      for(size_t i = 0;i < ABRLadder.size();i++) {
+         os << ((i > 0) ? "," : "") << ABRLadder[i];
+      }
+      os << " Kbit/s" << std::endl
+         << "      - Segment Duration:    " << SegmentDuration << "s" << std::endl
+         << "      - ABR Policy:          "
+         << ((ABRPolicy == ABR_POLICY_BUFFER) ? "buffer" : "throughput") << std::endl
+         << "      - Playout Buffer:      " << ABRBufferSize << "s" << std::endl;
+   }
+   if( (OutboundTrace != "") || (InboundTrace != "") ) {
+      if(OutboundTrace != "") {
+         os << "      - Outbound Trace:      " << OutboundTrace << std::endl;
+      }
+      if(InboundTrace != "") {
+         os << "      - Inbound Trace:       " << InboundTrace << std::endl;
+      }
+      os << "      - Trace Time Scale:    " << TraceScale << std::endl
+         << "      - Trace Loop:          " << ((TraceLoop == true) ? "yes" : "no") << std::endl;
+   }
+   if(Probe) {
+      os << "      - Packet Train:        ";
+      if(TrainLength > 0) {
+         os << TrainLength << " packets";
+      }
+      else {
+         os << "yes";
+      }
+      os << std::endl;
+   }
+   if(Impairment.isEnabled()) {
+      char str[256];
+      if(Impairment.GoodToBad > 0.0) {
+         snprintf((char*)&str, sizeof(str),
+                  "Gilbert-Elliott p=%1.4f r=%1.4f, loss %1.2f%%/%1.2f%% (good/bad)",
+                  Impairment.GoodToBad, Impairment.BadToGood,
+                  100.0 * Impairment.LossInGood, 100.0 * Impairment.LossInBad);
+      }
+      else {
+         snprintf((char*)&str, sizeof(str), "%1.2f%%", 100.0 * Impairment.LossInGood);
+      }
+      os << "      - Impairment Loss:     " << str << std::endl;
+      snprintf((char*)&str, sizeof(str), "%1.2f%% duplicated, %1.2f%% reordered",
+               100.0 * Impairment.DuplicateRate, 100.0 * Impairment.ReorderRate);
+      os << "      - Impairment:          " << str << std::endl
+         << "      - Impairment Delay:    ";
+      showEntry(os, (const double*)&Impairment.Delay, Impairment.DelayRng);
+      os << " ms" << std::endl;
+   }
 }
 
 
@@ -183,6 +316,29 @@ void FlowTrafficSpec::reset()
    CongestionControl        = "default";
    CMT                      = 0x00;
    CCID                     = 0x00;
+   CPU                      = -1;
+   StartOffset              = -1.0;
+   StartRandom              = false;
+   Churn                    = false;
+   FastOpen                 = false;
+   ReuseAddress             = false;
+   PortRangeLow             = 0;
+   PortRangeHigh            = 0;
+   ConnectTimeout           = 5000;
+   RPC                      = false;
+   Outstanding              = 1;
+   ABRLadder.clear();
+   SegmentDuration          = 4.0;
+   ABRPolicy                = ABR_POLICY_THROUGHPUT;
+   ABRBufferSize            = 30.0;
+   Probe                    = false;
+   TrainLength              = 0;
+   OutboundTrace            = "";
+   OutboundTraceData        = "";
+   InboundTrace             = "";
+   TraceScale               = 1.0;
+   TraceLoop                = false;
+   Impairment.reset();
    for(size_t i = 0;i < NETPERFMETER_RNG_INPUT_PARAMETERS;i++) {
       OutboundFrameRate[i] = 0.0;
       OutboundFrameSize[i] = 0.0;
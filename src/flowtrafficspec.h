@@ -32,6 +32,13 @@
 #include <string>
 #include <iostream>
 
+#include "impairment.h"
+
+
+#define ABR_POLICY_THROUGHPUT 0   // Highest bitrate below measured throughput
+#define ABR_POLICY_BUFFER     1   // Bitrate from playout buffer level (BBA)
+
+#define TRAIN_MAX_LENGTH      1024   // Maximum packets per train (UIO_MAXIOV)
 
 struct OnOffEvent
 {
@@ -49,6 +56,8 @@ class FlowTrafficSpec
 
    void print(std::ostream& os) const;
    void reset();
+   void retainDistributions() const;
+   void releaseDistributions() const;
 
 
    // ====== Public Data ====================================================
@@ -93,6 +102,43 @@ class FlowTrafficSpec
    bool                    RepeatOnOff;
    bool                    BindV6Only;
 
+   int                     CPU;   // CPU for sender thread (-1: automatic)
+
+   double                  StartOffset;   // in s (< 0: global ramp-up)
+   bool                    StartRandom;   // Random offset up to StartOffset
+
+   // ------ Connection churn (active side only) ----------------------------
+   bool                    Churn;            // Frame = connection
+   bool                    FastOpen;         // TCP Fast Open
+   bool                    ReuseAddress;     // SO_REUSEADDR on churn sockets
+   uint16_t                PortRangeLow;     // Local port range (0: ephemeral)
+   uint16_t                PortRangeHigh;
+   unsigned int            ConnectTimeout;   // in ms
+
+   // ------ Request/response transactions ----------------------------------
+   bool                    RPC;              // Frame = request (active) or response (passive)
+   unsigned int            Outstanding;      // Max. pipelined requests (active side only)
+
+   // ------ Adaptive-bitrate streaming (on top of request/response) --------
+   std::vector<unsigned int> ABRLadder;      // Bitrates in Kbit/s (empty: no ABR)
+   double                  SegmentDuration;  // in s
+   uint8_t                 ABRPolicy;        // ABR_POLICY_*
+   double                  ABRBufferSize;    // Max. playout buffer in s
+
+   // ------ Packet train probing (UDP only) --------------------------------
+   bool                    Probe;            // Frame = packet train
+   unsigned int            TrainLength;      // Packets per train (active side only)
+
+   // ------ Trace-driven traffic -------------------------------------------
+   std::string             OutboundTrace;       // Trace file for sending
+   std::string             OutboundTraceData;   // Inline binary trace (passive side)
+   std::string             InboundTrace;        // Trace file for the remote side
+   double                  TraceScale;          // Time scaling factor
+   bool                    TraceLoop;
+
+   // ------ Impairment of outgoing datagrams (active side only) ------------
+   ImpairmentSpec          Impairment;
+
    std::vector<OnOffEvent> OnOffEvents;
 };
 
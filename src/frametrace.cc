@@ -0,0 +1,305 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "frametrace.h"
+#include "tools.h"
+
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+
+
+// ###### Constructor #######################################################
+FrameTrace::FrameTrace()
+{
+   Data       = NULL;
+   Length     = 0;
+   Mapped     = false;
+   Binary     = false;
+   Position   = 0;
+   LineNumber = 0;
+   TimeScale  = 1.0;
+   Loop       = false;
+   LoopOffset = 0;
+   LastTime   = 0;
+   PrevTime   = 0;
+}
+
+
+// ###### Destructor ########################################################
+FrameTrace::~FrameTrace()
+{
+   finish();
+}
+
+
+// ###### Map trace file ####################################################
+// The file is mapped instead of being loaded: records are parsed when they
+// are needed, so that large traces are streamed from the page cache.
+bool FrameTrace::initialize(const char*  fileName,
+                            const double timeScale,
+                            const bool   loop)
+{
+   finish();
+
+   const int fd = open(fileName, O_RDONLY);
+   if(fd < 0) {
+      std::cerr << "ERROR: Unable to open trace file " << fileName
+                << " - " << strerror(errno) << "!" << std::endl;
+      return(false);
+   }
+   struct stat status;
+   if( (fstat(fd, &status) != 0) || (status.st_size == 0) ) {
+      std::cerr << "ERROR: Trace file " << fileName << " is empty!" << std::endl;
+      close(fd);
+      return(false);
+   }
+   void* data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if(data == MAP_FAILED) {
+      std::cerr << "ERROR: Unable to map trace file " << fileName
+                << " - " << strerror(errno) << "!" << std::endl;
+      return(false);
+   }
+   madvise(data, status.st_size, MADV_SEQUENTIAL);
+
+   FileName  = fileName;
+   Data      = (const char*)data;
+   Length    = status.st_size;
+   Mapped    = true;
+   TimeScale = timeScale;
+   Loop      = loop;
+   return(prepare());
+}
+
+
+// ###### Use trace from memory (e.g. received in NETPERFMETER_ADD_FLOW) ###
+bool FrameTrace::initialize(const void*  data,
+                            const size_t length,
+                            const double timeScale,
+                            const bool   loop)
+{
+   finish();
+
+   char* copy = (char*)malloc(length);
+   if(copy == NULL) {
+      return(false);
+   }
+   memcpy(copy, data, length);
+
+   FileName  = "(inline)";
+   Data      = copy;
+   Length    = length;
+   Mapped    = false;
+   TimeScale = timeScale;
+   Loop      = loop;
+   return(prepare());
+}
+
+
+// ###### Release trace #####################################################
+void FrameTrace::finish()
+{
+   if(Data != NULL) {
+      if(Mapped) {
+         munmap((void*)Data, Length);
+      }
+      else {
+         free((void*)Data);
+      }
+      Data   = NULL;
+      Length = 0;
+   }
+}
+
+
+// ###### Check format and position at first record #########################
+bool FrameTrace::prepare()
+{
+   Binary = ( (Length >= FRAMETRACE_MAGIC_SIZE) &&
+              (memcmp(Data, FRAMETRACE_MAGIC, FRAMETRACE_MAGIC_SIZE) == 0) );
+   if( (Binary) &&
+       ((Length - FRAMETRACE_MAGIC_SIZE) % FRAMETRACE_RECORD_SIZE != 0) ) {
+      std::cerr << "WARNING: Binary trace " << FileName
+                << " ends with an incomplete record!" << std::endl;
+   }
+
+   // ====== Ensure that there is at least one frame ========================
+   rewind();
+   unsigned long long timeStamp;
+   size_t             frameSize;
+   if(!readRecord(timeStamp, frameSize)) {
+      std::cerr << "ERROR: Trace " << FileName << " contains no frames!" << std::endl;
+      finish();
+      return(false);
+   }
+
+   // ====== A looped trace has to advance in time ==========================
+   // Otherwise, all loops would be due at once, i.e. the sender would send
+   // at full speed forever.
+   if(Loop) {
+      bool advancing = false;
+      do {
+         if((unsigned long long)rint(timeStamp * TimeScale) > 0) {
+            advancing = true;
+            break;
+         }
+      } while(readRecord(timeStamp, frameSize));
+      if(!advancing) {
+         std::cerr << "ERROR: Trace " << FileName
+                   << " cannot be looped, since all its frames have time 0!" << std::endl;
+         finish();
+         return(false);
+      }
+   }
+   rewind();
+   return(true);
+}
+
+
+// ###### Restart at first record ###########################################
+void FrameTrace::rewind()
+{
+   Position   = (Binary) ? FRAMETRACE_MAGIC_SIZE : 0;
+   LineNumber = 0;
+   LoopOffset = 0;
+   LastTime   = 0;
+   PrevTime   = 0;
+}
+
+
+// ###### Read next record ##################################################
+bool FrameTrace::readRecord(unsigned long long& timeStamp, size_t& frameSize)
+{
+   // ====== Binary format ==================================================
+   if(Binary) {
+      if(Position + FRAMETRACE_RECORD_SIZE > Length) {
+         return(false);
+      }
+      uint64_t time;
+      uint32_t size;
+      memcpy(&time, &Data[Position], sizeof(time));
+      memcpy(&size, &Data[Position + sizeof(time)], sizeof(size));
+      Position += FRAMETRACE_RECORD_SIZE;
+      timeStamp = ntoh64(time);
+      frameSize = ntohl(size);
+      return(true);
+   }
+
+   // ====== CSV format =====================================================
+   while(Position < Length) {
+      // ------ Get next line ------------------------------------------------
+      const char* end = (const char*)memchr(&Data[Position], '\n', Length - Position);
+      const size_t lineLength = (end != NULL) ? (size_t)(end - &Data[Position]) : Length - Position;
+      char line[256];
+      const size_t n = std::min(lineLength, sizeof(line) - 1);
+      memcpy((char*)&line, &Data[Position], n);
+      line[n] = 0x00;
+      Position += lineLength + 1;
+      LineNumber++;
+
+      // ------ Parse line ---------------------------------------------------
+      char* comment = strchr((char*)&line, '#');
+      if(comment != NULL) {
+         *comment = 0x00;
+      }
+      for(char* c = (char*)&line; *c != 0x00; c++) {
+         if( (*c == ',') || (*c == ';') || (*c == '\t') || (*c == '\r') ) {
+            *c = ' ';
+         }
+      }
+      double       time;
+      unsigned int size;
+      const int    items = sscanf((const char*)&line, "%lf %u", &time, &size);
+      if( (items == 2) && (time >= 0.0) ) {
+         timeStamp = (unsigned long long)rint(time * 1000000.0);
+         frameSize = size;
+         return(true);
+      }
+      else if(items != EOF) {
+         std::cerr << "WARNING: Skipping invalid line " << LineNumber
+                   << " of trace " << FileName << "!" << std::endl;
+      }
+   }
+   return(false);
+}
+
+
+// ###### Get next frame ####################################################
+bool FrameTrace::next(unsigned long long& relTime, size_t& frameSize)
+{
+   unsigned long long timeStamp;
+   if(!readRecord(timeStamp, frameSize)) {
+      if(!Loop) {
+         return(false);
+      }
+      // ====== Loop: continue after the last frame's inter-frame gap ========
+      LoopOffset = LastTime + (LastTime - PrevTime);
+      Position   = (Binary) ? FRAMETRACE_MAGIC_SIZE : 0;
+      LineNumber = 0;
+      if(!readRecord(timeStamp, frameSize)) {
+         return(false);
+      }
+   }
+
+   relTime = LoopOffset + (unsigned long long)rint(timeStamp * TimeScale);
+   if(relTime < LastTime) {
+      relTime = LastTime;   // Time stamps must not decrease
+   }
+   PrevTime = LastTime;
+   LastTime = relTime;
+   return(true);
+}
+
+
+// ###### Encode complete trace in binary format ############################
+// Returns false if the encoded trace would exceed maxLength bytes.
+bool FrameTrace::encode(std::string& data, const size_t maxLength)
+{
+   data.assign(FRAMETRACE_MAGIC, FRAMETRACE_MAGIC_SIZE);
+
+   const size_t       savedPosition = Position;
+   const size_t       savedLine     = LineNumber;
+   unsigned long long timeStamp;
+   size_t             frameSize;
+   bool               success = true;
+   Position   = (Binary) ? FRAMETRACE_MAGIC_SIZE : 0;
+   LineNumber = 0;
+   while(readRecord(timeStamp, frameSize)) {
+      if(data.size() + FRAMETRACE_RECORD_SIZE > maxLength) {
+         success = false;
+         break;
+      }
+      const uint64_t time = hton64(timeStamp);
+      const uint32_t size = htonl((uint32_t)frameSize);
+      data.append((const char*)&time, sizeof(time));
+      data.append((const char*)&size, sizeof(size));
+   }
+   Position   = savedPosition;
+   LineNumber = savedLine;
+   return(success);
+}
@@ -0,0 +1,91 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#ifndef FRAMETRACE_H
+#define FRAMETRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+
+// Binary trace file: magic followed by records of
+// { uint64_t TimeStamp (in us); uint32_t FrameSize; } in network byte order.
+// Otherwise, the file is parsed as CSV: "<time in s>,<frame size>" per line
+// (separated by comma, semicolon or whitespace; '#' starts a comment).
+#define FRAMETRACE_MAGIC       "NPMTRACE"
+#define FRAMETRACE_MAGIC_SIZE  8
+#define FRAMETRACE_RECORD_SIZE 12
+
+class FrameTrace
+{
+   // ====== Methods ========================================================
+   public:
+   FrameTrace();
+   ~FrameTrace();
+
+   bool initialize(const char*  fileName,
+                   const double timeScale,
+                   const bool   loop);
+   bool initialize(const void*  data,
+                   const size_t length,
+                   const double timeScale,
+                   const bool   loop);
+   void finish();
+
+   void rewind();
+   bool next(unsigned long long& relTime, size_t& frameSize);
+   bool encode(std::string& data, const size_t maxLength);
+
+   inline bool isBinary() const {
+      return(Binary);
+   }
+   inline const std::string& getFileName() const {
+      return(FileName);
+   }
+
+
+   // ====== Private Methods ================================================
+   private:
+   bool prepare();
+   bool readRecord(unsigned long long& timeStamp, size_t& frameSize);
+
+
+   // ====== Private Data ===================================================
+   std::string        FileName;
+   const char*        Data;
+   size_t             Length;
+   bool               Mapped;        // Data is mmap()'ed (or a private copy)
+   bool               Binary;
+   size_t             Position;
+   size_t             LineNumber;    // CSV only, for error messages
+
+   double             TimeScale;
+   bool               Loop;
+   unsigned long long LoopOffset;    // in us, added when looping
+   unsigned long long LastTime;      // Scaled time of the latest record
+   unsigned long long PrevTime;      // Scaled time of the record before
+};
+
+#endif
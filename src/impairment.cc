@@ -0,0 +1,198 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+
+#include "impairment.h"
+#include "tools.h"
+
+#include <math.h>
+
+
+// ###### Reset impairment specification ####################################
+void ImpairmentSpec::reset()
+{
+   GoodToBad     = 0.0;
+   BadToGood     = 1.0;
+   LossInGood    = 0.0;
+   LossInBad     = 1.0;
+   DuplicateRate = 0.0;
+   ReorderRate   = 0.0;
+   for(size_t i = 0;i < NETPERFMETER_RNG_INPUT_PARAMETERS;i++) {
+      Delay[i] = 0.0;
+   }
+   DelayRng = RANDOM_CONSTANT;
+}
+
+
+// ###### Check whether any impairment is configured ########################
+bool ImpairmentSpec::isEnabled() const
+{
+   return( (GoodToBad > 0.0) || (LossInGood > 0.0) ||
+           (DuplicateRate > 0.0) || (ReorderRate > 0.0) ||
+           (Delay[0] > 0.0) );
+}
+
+
+// ###### Constructor #######################################################
+Impairment::Impairment(const ImpairmentSpec& spec)
+   : Spec(spec)
+{
+   Dropped    = 0;
+   Duplicated = 0;
+   Delayed    = 0;
+   Reordered  = 0;
+   Discarded  = 0;
+   BadState   = false;
+   HeldSince  = 0;
+}
+
+
+// ###### Destructor ########################################################
+Impairment::~Impairment()
+{
+}
+
+
+// ###### Decide whether to drop the next packet ############################
+bool Impairment::dropPacket()
+{
+   // ====== Gilbert-Elliott state transition ===============================
+   if(BadState) {
+      if(randomDouble() < Spec.BadToGood) {
+         BadState = false;
+      }
+   }
+   else if( (Spec.GoodToBad > 0.0) && (randomDouble() < Spec.GoodToBad) ) {
+      BadState = true;
+   }
+
+   // ====== Loss in the current state ======================================
+   const double lossRate = (BadState) ? Spec.LossInBad : Spec.LossInGood;
+   if( (lossRate > 0.0) && (randomDouble() < lossRate) ) {
+      Dropped++;
+      return(true);
+   }
+   return(false);
+}
+
+
+// ###### Decide whether to duplicate the next packet #######################
+bool Impairment::duplicatePacket()
+{
+   if( (Spec.DuplicateRate > 0.0) && (randomDouble() < Spec.DuplicateRate) ) {
+      Duplicated++;
+      return(true);
+   }
+   return(false);
+}
+
+
+// ###### Decide whether to hold back the next packet #######################
+bool Impairment::reorderPacket()
+{
+   return( (Spec.ReorderRate > 0.0) && (HeldSince == 0) &&
+           (randomDouble() < Spec.ReorderRate) );
+}
+
+
+// ###### Get delay of the next packet ######################################
+unsigned long long Impairment::getDelay()
+{
+   if(Spec.Delay[0] <= 0.0) {
+      return(0);
+   }
+   const double delay = getRandomValue((const double*)&Spec.Delay, Spec.DelayRng);
+   return((delay > 0.0) ? (unsigned long long)rint(1000.0 * delay) : 0);
+}
+
+
+// ###### Add packet to the timer queue #####################################
+void Impairment::enqueue(const unsigned long long releaseTime,
+                         const char*              data,
+                         const size_t             length)
+{
+   if(Queue.size() >= IMPAIRMENT_QUEUE_LIMIT) {
+      Discarded++;
+      return;
+   }
+   // Packets with the same release time keep their order.
+   Queue.insert(std::pair<unsigned long long, std::string>(
+                   releaseTime, std::string(data, length)));
+   Delayed++;
+}
+
+
+// ###### Get next packet to be released ####################################
+bool Impairment::dequeue(const unsigned long long now, std::string& packet)
+{
+   if( (!Queue.empty()) && (Queue.begin()->first <= now) ) {
+      packet.swap(Queue.begin()->second);
+      Queue.erase(Queue.begin());
+      return(true);
+   }
+   if( (HeldSince > 0) && (HeldSince + IMPAIRMENT_REORDER_TIMEOUT <= now) ) {
+      // No successor within the timeout: just a delayed packet.
+      packet.swap(HeldPacket);
+      HeldPacket.clear();
+      HeldSince = 0;
+      Delayed++;
+      return(true);
+   }
+   return(false);
+}
+
+
+// ###### Hold back packet until its successor has been sent ################
+void Impairment::hold(const unsigned long long now,
+                      const char*              data,
+                      const size_t             length)
+{
+   HeldPacket.assign(data, length);
+   HeldSince = now;
+}
+
+
+// ###### Release held packet after its successor ###########################
+bool Impairment::unhold(std::string& packet)
+{
+   if(HeldSince > 0) {
+      packet.swap(HeldPacket);
+      HeldPacket.clear();
+      HeldSince = 0;
+      Reordered++;
+      return(true);
+   }
+   return(false);
+}
+
+
+// ###### Discard all packets not sent yet ##################################
+size_t Impairment::discard()
+{
+   const size_t discarded = Queue.size() + ((HeldSince > 0) ? 1 : 0);
+   Queue.clear();
+   HeldPacket.clear();
+   HeldSince  = 0;
+   Discarded += discarded;
+   return(discarded);
+}
@@ -0,0 +1,114 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+
+#ifndef IMPAIRMENT_H
+#define IMPAIRMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "netperfmeterpackets.h"
+
+
+// Packets held back for reordering are released after the next packet, or
+// after this timeout (in us) if no further packet is sent.
+#define IMPAIRMENT_REORDER_TIMEOUT 100000
+// Maximum number of packets in the timer queue (like netem's limit).
+#define IMPAIRMENT_QUEUE_LIMIT     100000
+
+struct ImpairmentSpec
+{
+   // ------ Loss (Gilbert-Elliott; Bernoulli loss: GoodToBad = 0) ----------
+   double  GoodToBad;       // Transition probability p
+   double  BadToGood;       // Transition probability r
+   double  LossInGood;      // Loss probability in good state
+   double  LossInBad;       // Loss probability in bad state
+
+   double  DuplicateRate;   // Duplication probability
+   double  ReorderRate;     // Probability to swap with the next packet
+
+   double  Delay[NETPERFMETER_RNG_INPUT_PARAMETERS];   // in ms
+   uint8_t DelayRng;
+
+   void reset();
+   bool isEnabled() const;
+};
+
+
+class Impairment
+{
+   // ====== Methods ========================================================
+   public:
+   Impairment(const ImpairmentSpec& spec);
+   ~Impairment();
+
+   bool dropPacket();
+   bool duplicatePacket();
+   bool reorderPacket();
+   unsigned long long getDelay();
+
+   void enqueue(const unsigned long long releaseTime,
+                const char*              data,
+                const size_t             length);
+   bool dequeue(const unsigned long long now, std::string& packet);
+   void hold(const unsigned long long now,
+             const char*              data,
+             const size_t             length);
+   bool unhold(std::string& packet);
+   size_t discard();
+
+   inline bool hasHeldPacket() const {
+      return(HeldSince > 0);
+   }
+   inline unsigned long long getNextEvent() const {
+      unsigned long long nextEvent = (Queue.empty()) ? ~0ULL : Queue.begin()->first;
+      if( (HeldSince > 0) && (HeldSince + IMPAIRMENT_REORDER_TIMEOUT < nextEvent) ) {
+         nextEvent = HeldSince + IMPAIRMENT_REORDER_TIMEOUT;
+      }
+      return(nextEvent);
+   }
+
+
+   // ====== Public Data ====================================================
+   public:
+   unsigned long long Dropped;      // Packets dropped by the loss model
+   unsigned long long Duplicated;   // Additional copies sent
+   unsigned long long Delayed;      // Packets sent through the timer queue
+   unsigned long long Reordered;    // Packets sent after their successor
+   unsigned long long Discarded;    // Packets over the queue limit or left at the end
+
+
+   // ====== Private Data ===================================================
+   private:
+   const ImpairmentSpec                           Spec;
+   bool                                           BadState;
+   std::multimap<unsigned long long, std::string> Queue;   // By release time
+   std::string                                    HeldPacket;
+   unsigned long long                             HeldSince;
+};
+
+#endif
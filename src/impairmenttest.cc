@@ -0,0 +1,98 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "flowtrafficspec.h"
+#include "empiricaldistribution.h"
+#include "impairment.h"
+#include "tools.h"
+
+#include <iostream>
+#include <vector>
+
+
+// Checks the packet impairment of the active side:
+// - A delay given by an empirical distribution (delay=histogram:...) has to
+//   be sampled after the parser has released its reference, i.e. the flow
+//   has to hold its own reference.
+
+#define TEST_SAMPLES 10000
+
+
+// ###### Check delay by an empirical distribution ##########################
+static bool testEmpiricalDelay()
+{
+   // ====== Register distribution, like the FLOWSPEC parser ===============
+   std::vector<double> values;
+   std::vector<double> weights;
+   values.push_back(20.0);   weights.push_back(1.0);
+   values.push_back(40.0);   weights.push_back(1.0);
+   EmpiricalDistribution* distribution = new EmpiricalDistribution;
+   if(!distribution->initialize(values, weights)) {
+      std::cerr << "ERROR: Unable to initialize distribution!" << std::endl;
+      return(false);
+   }
+   const unsigned int identifier = EmpiricalDistribution::registerDistribution(distribution);
+
+   FlowTrafficSpec trafficSpec;
+   trafficSpec.Impairment.Delay[0] = distribution->getMean();
+   trafficSpec.Impairment.Delay[1] = identifier;
+   trafficSpec.Impairment.DelayRng = RANDOM_EMPIRICAL;
+
+   // ====== The flow takes its references, the parser releases its one ====
+   trafficSpec.retainDistributions();
+   trafficSpec.releaseDistributions();
+
+   // ====== Sample the delay ===============================================
+   bool       success = true;
+   Impairment impairment(trafficSpec.Impairment);
+   for(unsigned int i = 0;i < TEST_SAMPLES;i++) {
+      const unsigned long long delay = impairment.getDelay();
+      if( (delay != 20000) && (delay != 40000) ) {
+         std::cerr << "ERROR: Delay " << delay << " us is not from the distribution!"
+                   << std::endl;
+         success = false;
+         break;
+      }
+   }
+
+   // ====== The flow releases its references ===============================
+   trafficSpec.releaseDistributions();
+   if(EmpiricalDistribution::getDistribution(identifier) != NULL) {
+      std::cerr << "ERROR: Distribution has not been freed!" << std::endl;
+      success = false;
+   }
+   return(success);
+}
+
+
+// ###### Main program ######################################################
+int main(int argc, char** argv)
+{
+   unsigned int failed = 0;
+   if(!testEmpiricalDelay()) {
+      failed++;
+   }
+   std::cout << ((failed == 0) ? "All impairment tests have passed." :
+                                 "Impairment tests have failed!") << std::endl;
+   return((failed == 0) ? 0 : 1);
+}
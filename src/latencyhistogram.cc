@@ -0,0 +1,139 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "latencyhistogram.h"
+
+#include <string.h>
+#include <math.h>
+
+
+// ###### Constructor #######################################################
+LatencyHistogram::LatencyHistogram()
+{
+   reset();
+}
+
+
+// ###### Destructor ########################################################
+LatencyHistogram::~LatencyHistogram()
+{
+}
+
+
+// ###### Reset histogram ###################################################
+void LatencyHistogram::reset()
+{
+   Count   = 0;
+   Sum     = 0;
+   Minimum = ~0ULL;
+   Maximum = 0;
+   memset(&Buckets, 0, sizeof(Buckets));
+}
+
+
+// ###### Get bucket index of a value #######################################
+// Values below 2 * LATENCYHISTOGRAM_SUB_BUCKETS are stored exactly. Above,
+// each power of two [2^e, 2^(e+1)) is split into LATENCYHISTOGRAM_SUB_BUCKETS
+// buckets of width 2^(e - LATENCYHISTOGRAM_SUB_BUCKET_BITS).
+size_t LatencyHistogram::getBucket(const unsigned long long value)
+{
+   if(value < 2 * LATENCYHISTOGRAM_SUB_BUCKETS) {
+      return((size_t)value);
+   }
+   const unsigned int exponent = 63 - __builtin_clzll(value);
+   if(exponent >= LATENCYHISTOGRAM_MAX_BITS) {
+      return(LATENCYHISTOGRAM_BUCKETS - 1);
+   }
+   const unsigned int shift = exponent - LATENCYHISTOGRAM_SUB_BUCKET_BITS;
+   return((size_t)((shift + 1) * LATENCYHISTOGRAM_SUB_BUCKETS) +
+          (size_t)((value >> shift) - LATENCYHISTOGRAM_SUB_BUCKETS));
+}
+
+
+// ###### Get highest value represented by a bucket #########################
+unsigned long long LatencyHistogram::getBucketValue(const size_t bucket)
+{
+   if(bucket < 2 * LATENCYHISTOGRAM_SUB_BUCKETS) {
+      return((unsigned long long)bucket);
+   }
+   const unsigned int       shift = (bucket / LATENCYHISTOGRAM_SUB_BUCKETS) - 1;
+   const unsigned long long base  = (bucket % LATENCYHISTOGRAM_SUB_BUCKETS) +
+                                       LATENCYHISTOGRAM_SUB_BUCKETS;
+   return(((base + 1) << shift) - 1);
+}
+
+
+// ###### Record value ######################################################
+void LatencyHistogram::record(const unsigned long long value)
+{
+   Buckets[getBucket(value)]++;
+   Count++;
+   Sum += value;
+   if(value < Minimum) {
+      Minimum = value;
+   }
+   if(value > Maximum) {
+      Maximum = value;
+   }
+}
+
+
+// ###### Add the values of another histogram ###############################
+void LatencyHistogram::merge(const LatencyHistogram& histogram)
+{
+   for(size_t i = 0;i < LATENCYHISTOGRAM_BUCKETS;i++) {
+      Buckets[i] += histogram.Buckets[i];
+   }
+   Count += histogram.Count;
+   Sum   += histogram.Sum;
+   if(histogram.Count > 0) {
+      if(histogram.Minimum < Minimum) {
+         Minimum = histogram.Minimum;
+      }
+      if(histogram.Maximum > Maximum) {
+         Maximum = histogram.Maximum;
+      }
+   }
+}
+
+
+// ###### Get percentile (0.0 to 100.0) #####################################
+unsigned long long LatencyHistogram::getPercentile(const double percentile) const
+{
+   if(Count == 0) {
+      return(0);
+   }
+   unsigned long long rank = (unsigned long long)ceil((percentile / 100.0) * Count);
+   if(rank < 1) {
+      rank = 1;
+   }
+   unsigned long long seen = 0;
+   for(size_t i = 0;i < LATENCYHISTOGRAM_BUCKETS;i++) {
+      seen += Buckets[i];
+      if(seen >= rank) {
+         const unsigned long long value = getBucketValue(i);
+         return((value < Maximum) ? value : Maximum);
+      }
+   }
+   return(Maximum);
+}
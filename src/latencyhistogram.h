@@ -0,0 +1,79 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Log-linear histogram of latencies (in microseconds) with a bounded
+// relative error of 1/64: each power of two is split into 64 sub-buckets.
+// Values up to 2^40us are recorded; larger values are clamped.
+#define LATENCYHISTOGRAM_SUB_BUCKET_BITS 6
+#define LATENCYHISTOGRAM_SUB_BUCKETS     (1 << LATENCYHISTOGRAM_SUB_BUCKET_BITS)
+#define LATENCYHISTOGRAM_MAX_BITS        40
+#define LATENCYHISTOGRAM_BUCKETS         ((LATENCYHISTOGRAM_MAX_BITS - LATENCYHISTOGRAM_SUB_BUCKET_BITS + 1) * LATENCYHISTOGRAM_SUB_BUCKETS)
+
+class LatencyHistogram
+{
+   // ====== Methods ========================================================
+   public:
+   LatencyHistogram();
+   ~LatencyHistogram();
+
+   void reset();
+   void record(const unsigned long long value);
+   void merge(const LatencyHistogram& histogram);
+   unsigned long long getPercentile(const double percentile) const;
+
+   inline unsigned long long getCount() const {
+      return(Count);
+   }
+   inline unsigned long long getMinimum() const {
+      return((Count > 0) ? Minimum : 0);
+   }
+   inline unsigned long long getMaximum() const {
+      return(Maximum);
+   }
+   inline double getMean() const {
+      return((Count > 0) ? (double)Sum / (double)Count : 0.0);
+   }
+
+
+   // ====== Private Methods ================================================
+   private:
+   static size_t getBucket(const unsigned long long value);
+   static unsigned long long getBucketValue(const size_t bucket);
+
+
+   // ====== Private Data ===================================================
+   unsigned long long Count;
+   unsigned long long Sum;
+   unsigned long long Minimum;
+   unsigned long long Maximum;
+   uint32_t           Buckets[LATENCYHISTOGRAM_BUCKETS];
+};
+
+#endif
@@ -38,6 +38,11 @@ Measurement::Measurement()
    FirstStatisticsEvent = 0;
    LastStatisticsEvent  = 0;
    NextStatisticsEvent  = 0;
+
+   WindowStart          = 0;
+   WindowEnd            = 0;
+   WindowStartTaken     = false;
+   WindowEndTaken       = false;
 }
 
 
@@ -60,6 +65,10 @@ bool Measurement::initialize(const unsigned long long now,
    FirstStatisticsEvent = 0;
    LastStatisticsEvent  = 0;
    NextStatisticsEvent  = 0;
+   WindowStart          = 0;
+   WindowEnd            = 0;
+   WindowStartTaken     = false;
+   WindowEndTaken       = false;
 
    if(FlowManager::getFlowManager()->addMeasurement(this)) {
       VectorNamePattern = (vectorNamePattern != NULL) ?
@@ -90,13 +99,56 @@ bool Measurement::finish(const bool closeFiles)
 }
 
 
+// ###### Set steady-state window for the scalar statistics ################
+void Measurement::setStatisticsWindow(const unsigned long long windowStart,
+                                      const unsigned long long windowEnd)
+{
+   lock();
+   WindowStart      = windowStart;
+   WindowEnd        = windowEnd;
+   WindowStartTaken = false;
+   WindowEndTaken   = false;
+   unlock();
+}
+
+
+// ###### Take flow statistics snapshot at a window boundary ################
+void Measurement::handleWindowEvent(const unsigned long long now)
+{
+   lock();
+   if( (WindowStart > 0) && (!WindowStartTaken) && (WindowStart <= now) ) {
+      FlowManager::getFlowManager()->snapshotStatistics(MeasurementID, false);
+      WindowStartTaken = true;
+   }
+   if( (WindowEnd > 0) && (WindowStartTaken) && (!WindowEndTaken) && (WindowEnd <= now) ) {
+      FlowManager::getFlowManager()->snapshotStatistics(MeasurementID, true);
+      WindowEndTaken = true;
+   }
+   unlock();
+}
+
+
 // ###### Write scalars #####################################################
 void Measurement::writeScalarStatistics(const unsigned long long now)
 {
    lock();
+   if(WindowStart > 0) {
+      // ====== Close the window at the end of the measurement ==============
+      // A measurement stopped within the warm-up has an empty window.
+      if(!WindowStartTaken) {
+         WindowStart = now;
+         FlowManager::getFlowManager()->snapshotStatistics(MeasurementID, false);
+         WindowStartTaken = true;
+      }
+      if(!WindowEndTaken) {
+         WindowEnd = now;
+         FlowManager::getFlowManager()->snapshotStatistics(MeasurementID, true);
+         WindowEndTaken = true;
+      }
+   }
    FlowManager::getFlowManager()->writeScalarStatistics(
       MeasurementID, now, ScalarFile,
-      FirstStatisticsEvent);
+      FirstStatisticsEvent, WindowStart, WindowEnd);
    unlock();
 }
 
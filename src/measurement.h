@@ -57,6 +57,18 @@ class Measurement : public Mutex
    inline unsigned long long getFirstStatisticsEvent() const {
       return(FirstStatisticsEvent);
    }
+   inline unsigned long long getNextWindowEvent() const {
+      if(WindowStart == 0) {
+         return(~0ULL);
+      }
+      if(!WindowStartTaken) {
+         return(WindowStart);
+      }
+      if( (WindowEnd > 0) && (!WindowEndTaken) ) {
+         return(WindowEnd);
+      }
+      return(~0ULL);
+   }
 
    bool initialize(const unsigned long long now,
                    const uint64_t           measurementID,
@@ -66,6 +78,10 @@ class Measurement : public Mutex
                    const OutputFileFormat   scalarFileFormat);
    bool finish(const bool closeFiles);
 
+   void setStatisticsWindow(const unsigned long long windowStart,
+                            const unsigned long long windowEnd);
+   void handleWindowEvent(const unsigned long long now);
+
    void writeScalarStatistics(const unsigned long long now);
    void writeVectorStatistics(const unsigned long long now,
                               FlowBandwidthStats&      globalStats,
@@ -80,6 +96,11 @@ class Measurement : public Mutex
    unsigned long long LastStatisticsEvent;
    unsigned long long NextStatisticsEvent;
 
+   unsigned long long WindowStart;        // End of warm-up (0 for whole run)
+   unsigned long long WindowEnd;          // Begin of cool-down (0 for none)
+   bool               WindowStartTaken;
+   bool               WindowEndTaken;
+
    std::string        VectorNamePattern;
    std::string        ScalarNamePattern;
    OutputFile         VectorFile;
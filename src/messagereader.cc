@@ -27,8 +27,10 @@
 #include <assert.h>
 #include <string.h>
 #include <iostream>
+#include <algorithm>
 
 #include "tools.h"
+#include "bufferarena.h"
 
 
 // #define DEBUG_SOCKETS
@@ -39,17 +41,29 @@
 // ###### Constructor #######################################################
 MessageReader::MessageReader()
 {
+   for(size_t page = 0;page < MESSAGEREADER_TABLE_PAGES;page++) {
+      SocketTable[page] = NULL;
+   }
+   TablePages     = 0;
+   Sockets        = 0;
+   Prefault       = false;
+   StreamBulkRead = false;
 }
 
 
 // ###### Destructor ########################################################
 MessageReader::~MessageReader()
 {
-   std::map<int, Socket*>::iterator iterator = SocketMap.begin();
-   while(iterator != SocketMap.end()) {
-      Socket* socket = iterator->second;
-      deregisterSocket(socket->SocketDescriptor);
-      iterator = SocketMap.begin();
+   for(size_t page = 0;page < TablePages;page++) {
+      if(SocketTable[page] != NULL) {
+         for(size_t i = 0;i < MESSAGEREADER_TABLE_PAGE_SIZE;i++) {
+            while(SocketTable[page][i] != NULL) {
+               deregisterSocket((int)((page * MESSAGEREADER_TABLE_PAGE_SIZE) + i));
+            }
+         }
+         delete [] SocketTable[page];
+         SocketTable[page] = NULL;
+      }
    }
 }
 
@@ -59,26 +73,58 @@ bool MessageReader::registerSocket(const int    protocol,
                                    const int    sd,
                                    const size_t maxMessageSize)
 {
-   Socket*                          socket;
-   std::map<int, Socket*>::iterator found = SocketMap.find(sd);
-   if(found == SocketMap.end()) {
+   assert(sd >= 0);
+   Socket* socket = getSocket(sd);
+   if(socket == NULL) {
       assert(maxMessageSize >= sizeof(TLVHeader));
 
+      // ====== Get table page ==============================================
+      const size_t page = (size_t)sd / MESSAGEREADER_TABLE_PAGE_SIZE;
+      if(page >= MESSAGEREADER_TABLE_PAGES) {
+         std::cerr << "ERROR: Socket descriptor " << sd
+                   << " is too large for MessageReader!" << std::endl;
+         return(false);
+      }
+      if(SocketTable[page] == NULL) {
+         Socket** entries = new Socket*[MESSAGEREADER_TABLE_PAGE_SIZE];
+         for(size_t i = 0;i < MESSAGEREADER_TABLE_PAGE_SIZE;i++) {
+            entries[i] = NULL;
+         }
+         SocketTable[page] = entries;
+      }
+      TablePages = std::max(TablePages, page + 1);
+
       socket = new Socket;
       assert(socket != NULL);
-      socket->MessageBuffer = new char[maxMessageSize];
+      socket->BulkRead = (StreamBulkRead) &&
+                         ( (protocol == IPPROTO_TCP)   ||
+                           (protocol == IPPROTO_MPTCP) ||
+                           (protocol == IPPROTO_UNIX_STREAM) );
+      // With prefaulting, the stream buffer gets its full size right now.
+      const size_t bufferSize = ((socket->BulkRead) && (Prefault)) ?
+         std::max(maxMessageSize, (size_t)MESSAGEREADER_STREAM_BUFFER_SIZE) : maxMessageSize;
+      socket->MessageBuffer =
+         (char*)BufferArena::getBufferArena()->allocate(bufferSize);
       assert(socket->MessageBuffer != NULL);
-      socket->MessageBufferSize = maxMessageSize;
+      if(Prefault) {
+         memset(socket->MessageBuffer, 0, bufferSize);
+      }
+      socket->MessageBufferSize = bufferSize;
+      socket->MaxMessageSize    = maxMessageSize;
+      socket->ReadOffset        = 0;
+      // SO_RCVLOWAT is only used for TCP, where poll() takes it into account.
+      socket->ReceiveLowat      = ((socket->BulkRead) && (protocol == IPPROTO_TCP)) ? 1 : -1;
       socket->MessageSize       = 0;
       socket->BytesRead         = 0;
       socket->Status            = Socket::MRS_WaitingForHeader;
       socket->Protocol          = protocol;
       socket->SocketDescriptor  = sd;
       socket->UseCount          = 1;
-      SocketMap.insert(std::pair<int, Socket*>(sd, socket));
+      socket->Ring              = NULL;
+      getSocketEntry((size_t)sd) = socket;
+      Sockets++;
    }
    else {
-      socket = found->second;
       socket->UseCount++;
    }
 #ifdef DEBUG_SOCKETS
@@ -92,10 +138,16 @@ bool MessageReader::registerSocket(const int    protocol,
 // ###### Get all socket descriptors ########################################
 size_t MessageReader::getAllSDs(int* sds, const size_t maxEntries)
 {
-   assert(maxEntries >= SocketMap.size());
+   assert(maxEntries >= Sockets);
    size_t count = 0;
-   for(std::map<int, Socket*>::iterator iterator = SocketMap.begin(); iterator != SocketMap.end(); iterator++) {
-      sds[count++] = iterator->second->SocketDescriptor;
+   for(size_t page = 0;page < TablePages;page++) {
+      if(SocketTable[page] != NULL) {
+         for(size_t i = 0;i < MESSAGEREADER_TABLE_PAGE_SIZE;i++) {
+            if(SocketTable[page][i] != NULL) {
+               sds[count++] = SocketTable[page][i]->SocketDescriptor;
+            }
+         }
+      }
    }
    return(count);
 }
@@ -104,17 +156,20 @@ size_t MessageReader::getAllSDs(int* sds, const size_t maxEntries)
 // ###### Deregister a socket ###############################################
 bool MessageReader::deregisterSocket(const int sd)
 {
-   std::map<int, Socket*>::iterator found = SocketMap.find(sd);
-   if(found != SocketMap.end()) {
-      Socket* socket = found->second;
+   Socket* socket = getSocket(sd);
+   if(socket != NULL) {
       socket->UseCount--;
 #ifdef DEBUG_SOCKETS
       printf("DeregisterSocket: UseCount[sd=%d,proto=%d]=%u\n",
              socket->SocketDescriptor, socket->Protocol, (unsigned int)socket->UseCount);
 #endif
       if(socket->UseCount == 0) {
-         SocketMap.erase(found);
-         delete [] socket->MessageBuffer;
+         getSocketEntry((size_t)sd) = NULL;
+         Sockets--;
+         BufferArena::getBufferArena()->release(socket->MessageBuffer);
+         if(socket->Ring) {
+            delete socket->Ring;
+         }
          delete socket;
          return(true);
       }
@@ -124,7 +179,30 @@ bool MessageReader::deregisterSocket(const int sd)
 }
 
 
-// ###### Receive full message ##############################################
+// ###### Attach shared-memory ring to a registered socket ##################
+bool MessageReader::attachShmRing(const int sd, ShmRing* ring)
+{
+   Socket* socket = getSocket(sd);
+   if( (socket != NULL) && (socket->Ring == NULL) ) {
+      socket->Ring = ring;   // Ring is deleted with the socket entry!
+      return(true);
+   }
+   return(false);
+}
+
+
+// ###### Get shared-memory ring of a socket ################################
+ShmRing* MessageReader::getShmRing(const int sd)
+{
+   Socket* socket = getSocket(sd);
+   if(socket != NULL) {
+      return(socket->Ring);
+   }
+   return(NULL);
+}
+
+
+// ###### Receive full message into the caller's buffer #####################
 ssize_t MessageReader::receiveMessage(const int        sd,
                                       void*            buffer,
                                       size_t           bufferSize,
@@ -132,15 +210,68 @@ ssize_t MessageReader::receiveMessage(const int        sd,
                                       socklen_t*       fromSize,
                                       sctp_sndrcvinfo* sinfo,
                                       int*             msgFlags)
+{
+   const char*   message;
+   const ssize_t received = receiveMessageView(sd, &message, from, fromSize, sinfo, msgFlags);
+   if(received > 0) {
+      if((size_t)received > bufferSize) {
+         std::cerr << "ERROR: Buffer size for MessageReader::receiveMessage() is too small!"
+                   << std::endl;
+         getSocket(sd)->Status = Socket::MRS_StreamError;
+         return(MRRM_STREAM_ERROR);
+      }
+      memcpy(buffer, message, received);
+   }
+   return(received);
+}
+
+
+// ###### Receive full message as view into the message buffer ##############
+// The view remains valid until the next call for the socket or its
+// deregistration.
+ssize_t MessageReader::receiveMessageView(const int        sd,
+                                          const char**     message,
+                                          sockaddr*        from,
+                                          socklen_t*       fromSize,
+                                          sctp_sndrcvinfo* sinfo,
+                                          int*             msgFlags)
 {
    Socket* socket = getSocket(sd);
    if(socket != NULL) {
+      // ====== Shared-memory ring: complete messages only ==================
+      if(socket->Ring != NULL) {
+         const ssize_t received = socket->Ring->receive(sd, socket->MessageBuffer,
+                                                        socket->MessageBufferSize);
+         if(received >= 0) {
+            *message = socket->MessageBuffer;
+            if( (from != NULL) && (fromSize != NULL) ) {
+               memset(from, 0, *fromSize);
+               from->sa_family = AF_UNIX;
+            }
+            return(received);
+         }
+         else if(errno == EAGAIN) {
+            return(MRRM_PARTIAL_READ);
+         }
+         else if(errno == EMSGSIZE) {
+            std::cerr << "ERROR: Message in shared-memory ring does not fit buffer!" << std::endl;
+            return(MRRM_STREAM_ERROR);
+         }
+         return(MRRM_SOCKET_ERROR);
+      }
+
+      // ====== Stream socket in bulk read mode ==============================
+      if(socket->BulkRead) {
+         return(receiveFromStream(socket, message, from, fromSize));
+      }
+
       // ====== Find out the number of bytes to read ========================
       ssize_t received;
       size_t  bytesToRead;
-      if( (socket->Protocol == IPPROTO_SCTP) ||
-          (socket->Protocol == IPPROTO_TCP)  ||
-          (socket->Protocol == IPPROTO_MPTCP) ) {
+      if( (socket->Protocol == IPPROTO_SCTP)  ||
+          (socket->Protocol == IPPROTO_TCP)   ||
+          (socket->Protocol == IPPROTO_MPTCP) ||
+          (socket->Protocol == IPPROTO_UNIX_STREAM) ) {
          // SCTP and TCP can return partial messages upon recv() calls. TCP
          // may event return multiple messages, if the buffer size is large enough!
          if(socket->Status == Socket::MRS_WaitingForHeader) {
@@ -151,7 +282,8 @@ ssize_t MessageReader::receiveMessage(const int        sd,
             bytesToRead = socket->MessageSize - socket->BytesRead;
          }
          else {
-            if(socket->Protocol != IPPROTO_TCP) {
+            if( (socket->Protocol != IPPROTO_TCP) &&
+                (socket->Protocol != IPPROTO_UNIX_STREAM) ) {
                // An error occurred before. Reset and try again ...
                socket->Status    = Socket::MRS_WaitingForHeader;
                socket->BytesRead = 0;
@@ -165,7 +297,8 @@ ssize_t MessageReader::receiveMessage(const int        sd,
          assert(bytesToRead + socket->BytesRead <= socket->MessageBufferSize);
       }
       else {
-         // DCCP and UDP will always return only a single message on recv() calls.
+         // DCCP, UDP and UNIX SeqPacket will always return only a single
+         // message on recv() calls.
          bytesToRead = socket->MessageBufferSize;
       }
 
@@ -271,12 +404,6 @@ ssize_t MessageReader::receiveMessage(const int        sd,
             }
 
             // ====== Completed reading =====================================
-            if(socket->MessageSize > bufferSize) {
-               std::cerr << "ERROR: Buffer size for MessageReader::receiveMessage() is too small!"
-                         << std::endl;
-               socket->Status = Socket::MRS_StreamError;
-               return(MRRM_STREAM_ERROR);
-            }
             if((socket->Protocol == IPPROTO_SCTP) && (!(*msgFlags & MSG_EOR))) {
                std::cerr << "ERROR: TLV message end does not match with SCTP message end!"
                          << std::endl;
@@ -284,7 +411,7 @@ ssize_t MessageReader::receiveMessage(const int        sd,
                return(MRRM_STREAM_ERROR);
             }
             received = socket->MessageSize;
-            memcpy(buffer, socket->MessageBuffer, socket->MessageSize);
+            *message = socket->MessageBuffer;
             socket->Status      = Socket::MRS_WaitingForHeader;
             socket->MessageSize = 0;
             socket->BytesRead   = 0;
@@ -302,7 +429,168 @@ ssize_t MessageReader::receiveMessage(const int        sd,
    }
    else {
       std::cerr << "ERROR: Unknown socket " << sd
-                << " given in call of MessageReader::receiveMessage()!" << std::endl;
+                << " given in call of MessageReader::receiveMessageView()!" << std::endl;
       return(MRRM_BAD_SOCKET);
    }
 }
+
+
+// ###### Get size of complete message in stream buffer #####################
+// Returns 0 if the message at the given offset is incomplete, or
+// MRRM_STREAM_ERROR for an invalid message length.
+ssize_t MessageReader::getBufferedMessageSize(const Socket* socket,
+                                              const size_t  offset)
+{
+   const size_t available = socket->BytesRead - offset;
+   if(available >= sizeof(TLVHeader)) {
+      const TLVHeader* header = (const TLVHeader*)&socket->MessageBuffer[offset];
+      const size_t     length = ntohs(header->Length);
+      if( (length < sizeof(TLVHeader)) || (length > socket->MaxMessageSize) ) {
+         return(MRRM_STREAM_ERROR);
+      }
+      if(available >= length) {
+         return((ssize_t)length);
+      }
+   }
+   return(0);
+}
+
+
+// ###### Adapt SO_RCVLOWAT to the rest of the incomplete message ###########
+// Wake-ups are only useful when at least the rest of the incomplete message
+// (or of its header) can be read.
+void MessageReader::updateReceiveLowat(Socket* socket)
+{
+#ifdef SO_RCVLOWAT
+   if(socket->ReceiveLowat < 0) {
+      return;
+   }
+
+   size_t offset = socket->ReadOffset;
+   ssize_t length;
+   while( (length = getBufferedMessageSize(socket, offset)) > 0 ) {
+      offset += (size_t)length;
+   }
+   if(length < 0) {
+      return;
+   }
+   const size_t available = socket->BytesRead - offset;
+   size_t       missing;
+   if(available < sizeof(TLVHeader)) {
+      missing = sizeof(TLVHeader) - available;
+   }
+   else {
+      missing = ntohs(((const TLVHeader*)&socket->MessageBuffer[offset])->Length) - available;
+   }
+   const int lowat = (int)std::min(missing, (size_t)MESSAGEREADER_MAX_RCVLOWAT);
+   if(lowat != socket->ReceiveLowat) {
+      if(ext_setsockopt(socket->SocketDescriptor, SOL_SOCKET, SO_RCVLOWAT,
+                        &lowat, sizeof(lowat)) == 0) {
+         socket->ReceiveLowat = lowat;
+      }
+      else {
+         socket->ReceiveLowat = -1;   // Not supported -> do not try again
+      }
+   }
+#endif
+}
+
+
+// ###### Double the size of a stream socket's buffer ########################
+void MessageReader::growStreamBuffer(Socket* socket)
+{
+   if(socket->MessageBufferSize >= MESSAGEREADER_STREAM_BUFFER_SIZE) {
+      return;
+   }
+   const size_t bufferSize    = std::min(2 * socket->MessageBufferSize,
+                                         (size_t)MESSAGEREADER_STREAM_BUFFER_SIZE);
+   char*        messageBuffer = (char*)BufferArena::getBufferArena()->allocate(bufferSize);
+   if(messageBuffer != NULL) {
+      memcpy(messageBuffer, socket->MessageBuffer, socket->BytesRead);
+      BufferArena::getBufferArena()->release(socket->MessageBuffer);
+      socket->MessageBuffer     = messageBuffer;
+      socket->MessageBufferSize = bufferSize;
+   }
+}
+
+
+// ###### Receive message from stream socket in bulk read mode ##############
+ssize_t MessageReader::receiveFromStream(Socket*      socket,
+                                         const char** message,
+                                         sockaddr*    from,
+                                         socklen_t*   fromSize)
+{
+   if(socket->Status == Socket::MRS_StreamError) {
+      // Not useful to retry when synchronization has been lost!
+      return(MRRM_STREAM_ERROR);
+   }
+
+   ssize_t length = getBufferedMessageSize(socket, socket->ReadOffset);
+   if(length == 0) {
+      // ====== Move incomplete message to the beginning of the buffer ======
+      const size_t available = socket->BytesRead - socket->ReadOffset;
+      if(socket->ReadOffset > 0) {
+         memmove(socket->MessageBuffer, &socket->MessageBuffer[socket->ReadOffset], available);
+         socket->ReadOffset = 0;
+         socket->BytesRead  = available;
+      }
+
+      // ====== Read as much as possible ====================================
+      const ssize_t received =
+         ext_recvfrom(socket->SocketDescriptor,
+                      &socket->MessageBuffer[socket->BytesRead],
+                      socket->MessageBufferSize - socket->BytesRead,
+                      MSG_DONTWAIT, from, fromSize);
+      if(received < 0) {
+         if( (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) ) {
+            return(MRRM_PARTIAL_READ);
+         }
+         return(MRRM_SOCKET_ERROR);
+      }
+      else if(received == 0) {
+         return(0);
+      }
+      socket->BytesRead += (size_t)received;
+      if(socket->BytesRead == socket->MessageBufferSize) {
+         // More data may be waiting => use a larger buffer for the next read.
+         growStreamBuffer(socket);
+      }
+      updateReceiveLowat(socket);
+      length = getBufferedMessageSize(socket, socket->ReadOffset);
+      if(length == 0) {
+         return(MRRM_PARTIAL_READ);
+      }
+   }
+   if(length < 0) {
+      std::cerr << "ERROR: Invalid message size in stream!" << std::endl;
+      socket->Status = Socket::MRS_StreamError;
+      return(MRRM_STREAM_ERROR);
+   }
+
+   // ====== Return complete message =========================================
+   *message = &socket->MessageBuffer[socket->ReadOffset];
+   socket->ReadOffset += (size_t)length;
+   if(socket->ReadOffset == socket->BytesRead) {
+      socket->ReadOffset = 0;
+      socket->BytesRead  = 0;
+   }
+   return(length);
+}
+
+
+// ###### Check whether a complete message is already buffered ##############
+// In bulk read mode, a single read may return several messages. They have
+// to be fetched before waiting for the socket again.
+// A shared-memory ring has to be drained until its receive() finds it empty:
+// only then, the consumer waits for a doorbell again. Further records
+// written before would otherwise never make the socket readable.
+bool MessageReader::hasBufferedMessage(const int sd)
+{
+   const Socket* socket = getSocket(sd);
+   if( (socket != NULL) && (socket->Ring != NULL) ) {
+      return(true);
+   }
+   return( (socket != NULL) && (socket->BulkRead) &&
+           (socket->Status != Socket::MRS_StreamError) &&
+           (getBufferedMessageSize(socket, socket->ReadOffset) > 0) );
+}
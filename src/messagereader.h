@@ -27,7 +27,9 @@
 #include <ext_socket.h>
 #include <sys/types.h>
 #include <cstddef>
-#include <map>
+#include <vector>
+
+#include "shmring.h"
 
 
 #define MRRM_SOCKET_ERROR (ssize_t)-1
@@ -35,6 +37,20 @@
 #define MRRM_PARTIAL_READ (ssize_t)-3
 #define MRRM_BAD_SOCKET   (ssize_t)-4
 
+// Stream sockets in bulk read mode read as much as fits into their buffer
+// with a single recv() call, and then return the complete messages in it.
+// The buffer starts with the maximum message size, and doubles up to this
+// size whenever a read fills it (i.e. only for sockets with a backlog).
+#define MESSAGEREADER_STREAM_BUFFER_SIZE (256 * 1024)
+// Upper limit of SO_RCVLOWAT while waiting for the rest of a message
+#define MESSAGEREADER_MAX_RCVLOWAT       (32 * 1024)
+// The socket table consists of pages, which are never moved before the
+// MessageReader is destroyed. Therefore, a receive thread may look up its
+// own sockets while another thread registers further ones.
+#define MESSAGEREADER_TABLE_PAGE_SIZE    1024
+#define MESSAGEREADER_TABLE_PAGES        4096   // Descriptors up to 4M - 1
+
+
 class MessageReader
 {
    // ====== Public Methods =================================================
@@ -54,10 +70,27 @@ class MessageReader
                           socklen_t*       fromSize = NULL,
                           sctp_sndrcvinfo* sinfo    = NULL,
                           int*             msgFlags = NULL);
+   ssize_t receiveMessageView(const int        sd,
+                              const char**     message,
+                              sockaddr*        from     = NULL,
+                              socklen_t*       fromSize = NULL,
+                              sctp_sndrcvinfo* sinfo    = NULL,
+                              int*             msgFlags = NULL);
+   bool hasBufferedMessage(const int sd);
    size_t getAllSDs(int* sds, const size_t maxEntries);
-   
+
+   bool attachShmRing(const int sd, ShmRing* ring);
+   ShmRing* getShmRing(const int sd);
+
+   inline void setPrefault(const bool prefault) {
+      Prefault = prefault;
+   }
+   inline void setStreamBulkRead(const bool bulkRead) {
+      StreamBulkRead = bulkRead;   // Applies to sockets registered afterwards
+   }
+
    inline size_t size() {
-      return(SocketMap.size()); 
+      return(Sockets);
    }
 
    // ====== Private Data ===================================================
@@ -82,17 +115,41 @@ class MessageReader
       size_t              MessageBufferSize;
       size_t              MessageSize;
       size_t              BytesRead;
+      ShmRing*            Ring;       // Shared-memory ring (SHM flows only)
+
+      // ------ Bulk read mode (stream sockets) ------------------------------
+      // The buffered data is MessageBuffer[ReadOffset .. BytesRead).
+      bool                BulkRead;
+      size_t              ReadOffset;
+      size_t              MaxMessageSize;
+      int                 ReceiveLowat;   // Current SO_RCVLOWAT (-1: not used)
    };
 
+   ssize_t receiveFromStream(Socket*      socket,
+                             const char** message,
+                             sockaddr*    from,
+                             socklen_t*   fromSize);
+   ssize_t getBufferedMessageSize(const Socket* socket,
+                                  const size_t  offset);
+   void updateReceiveLowat(Socket* socket);
+   void growStreamBuffer(Socket* socket);
+
    inline Socket* getSocket(const int sd) {
-      std::map<int, Socket*>::iterator found = SocketMap.find(sd);
-      if(found != SocketMap.end()) {
-         return(found->second);
+      const size_t page = (size_t)sd / MESSAGEREADER_TABLE_PAGE_SIZE;
+      if( (sd >= 0) && (page < MESSAGEREADER_TABLE_PAGES) && (SocketTable[page] != NULL) ) {
+         return(SocketTable[page][(size_t)sd % MESSAGEREADER_TABLE_PAGE_SIZE]);
       }
       return(NULL);
    }
+   inline Socket*& getSocketEntry(const size_t sd) {   // Page must exist!
+      return(SocketTable[sd / MESSAGEREADER_TABLE_PAGE_SIZE][sd % MESSAGEREADER_TABLE_PAGE_SIZE]);
+   }
 
-   std::map<int, Socket*> SocketMap;
+   Socket**             SocketTable[MESSAGEREADER_TABLE_PAGES];   // Indexed by socket descriptor
+   size_t               TablePages;                               // Highest used page + 1
+   size_t               Sockets;
+   bool                 Prefault;         // Touch new buffers immediately
+   bool                 StreamBulkRead;   // Bulk reads for stream sockets
 };
 
 #endif
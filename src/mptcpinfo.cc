@@ -0,0 +1,206 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "mptcpinfo.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+
+// Upstream Linux MPTCP API (linux/mptcp.h). The definitions are replicated
+// here, since linux/mptcp.h conflicts with the out-of-tree MPTCP_* options
+// in tools.h and may not be available on the build system.
+#define SOL_MPTCP_KERNEL           284
+#define MPTCP_TCPINFO_KERNEL       2
+#define MPTCP_SUBFLOW_ADDRS_KERNEL 3
+
+struct MPTCPSubflowData
+{
+   uint32_t SizeSubflowData;   // Size of this structure
+   uint32_t NumSubflows;       // Set by kernel
+   uint32_t SizeKernel;        // Set by kernel
+   uint32_t SizeUser;          // Size of one array element
+} __attribute__((aligned(8)));
+
+// Prefix of the kernel's struct tcp_info (linux/tcp.h), up to the byte
+// counters. Older kernels fill less; the rest remains zero.
+struct KernelTCPInfo
+{
+   uint8_t  State;
+   uint8_t  CAState;
+   uint8_t  Retransmits;
+   uint8_t  Probes;
+   uint8_t  Backoff;
+   uint8_t  Options;
+   uint8_t  WScale;
+   uint8_t  Flags;
+   uint32_t RTO;
+   uint32_t ATO;
+   uint32_t SndMSS;
+   uint32_t RcvMSS;
+   uint32_t Unacked;
+   uint32_t Sacked;
+   uint32_t Lost;
+   uint32_t Retrans;
+   uint32_t Fackets;
+   uint32_t LastDataSent;
+   uint32_t LastAckSent;
+   uint32_t LastDataRecv;
+   uint32_t LastAckRecv;
+   uint32_t PMTU;
+   uint32_t RcvSSThresh;
+   uint32_t RTT;
+   uint32_t RTTVar;
+   uint32_t SndSSThresh;
+   uint32_t SndCwnd;
+   uint32_t AdvMSS;
+   uint32_t Reordering;
+   uint32_t RcvRTT;
+   uint32_t RcvSpace;
+   uint32_t TotalRetrans;
+   uint64_t PacingRate;
+   uint64_t MaxPacingRate;
+   uint64_t BytesAcked;
+   uint64_t BytesReceived;
+   uint32_t SegsOut;
+   uint32_t SegsIn;
+   uint32_t NotSentBytes;
+   uint32_t MinRTT;
+   uint32_t DataSegsIn;
+   uint32_t DataSegsOut;
+   uint64_t DeliveryRate;
+   uint64_t BusyTime;
+   uint64_t RWndLimited;
+   uint64_t SndBufLimited;
+   uint32_t Delivered;
+   uint32_t DeliveredCE;
+   uint64_t BytesSent;
+   uint64_t BytesRetrans;
+};
+
+union KernelSockAddr
+{
+   sa_family_t      Family;
+   sockaddr         SA;
+   sockaddr_in      In;
+   sockaddr_in6     In6;
+   sockaddr_storage Storage;
+};
+
+struct KernelSubflowAddrs
+{
+   KernelSockAddr Local;
+   KernelSockAddr Remote;
+};
+
+#define MPTCP_MAX_SUBFLOWS 16
+
+
+// ###### Create upstream Linux MPTCP socket ################################
+int createUpstreamMPTCPSocket(const int family, const int type)
+{
+#ifdef __linux__
+   return(ext_socket(family, type, IPPROTO_MPTCP_KERNEL));
+#else
+   errno = EPROTONOSUPPORT;
+   return(-1);
+#endif
+}
+
+
+// ###### Check whether socket is an upstream Linux MPTCP socket ############
+bool isUpstreamMPTCPSocket(const int sd)
+{
+#ifdef SO_PROTOCOL
+   int       protocol;
+   socklen_t protocolLength = sizeof(protocol);
+   if(ext_getsockopt(sd, SOL_SOCKET, SO_PROTOCOL, &protocol, &protocolLength) == 0) {
+      return(protocol == IPPROTO_MPTCP_KERNEL);
+   }
+#endif
+   return(false);
+}
+
+
+// ###### Get subflow statistics of an upstream Linux MPTCP socket ##########
+bool getMPTCPSubflowInfo(const int sd, std::vector<MPTCPSubflowInfo>& subflows)
+{
+   subflows.clear();
+
+   // ====== Get TCP information of all subflows ============================
+   struct {
+      MPTCPSubflowData Header;
+      KernelTCPInfo    Info[MPTCP_MAX_SUBFLOWS];
+   } tcpInfo;
+   memset(&tcpInfo, 0, sizeof(tcpInfo));
+   tcpInfo.Header.SizeSubflowData = sizeof(MPTCPSubflowData);
+   tcpInfo.Header.SizeUser        = sizeof(KernelTCPInfo);
+   socklen_t tcpInfoLength = sizeof(tcpInfo);
+   if(ext_getsockopt(sd, SOL_MPTCP_KERNEL, MPTCP_TCPINFO_KERNEL,
+                     &tcpInfo, &tcpInfoLength) < 0) {
+      return(false);
+   }
+
+   // ====== Get addresses of all subflows ==================================
+   struct {
+      MPTCPSubflowData   Header;
+      KernelSubflowAddrs Addrs[MPTCP_MAX_SUBFLOWS];
+   } addrInfo;
+   memset(&addrInfo, 0, sizeof(addrInfo));
+   addrInfo.Header.SizeSubflowData = sizeof(MPTCPSubflowData);
+   addrInfo.Header.SizeUser        = sizeof(KernelSubflowAddrs);
+   socklen_t addrInfoLength = sizeof(addrInfo);
+   const bool haveAddresses =
+      (ext_getsockopt(sd, SOL_MPTCP_KERNEL, MPTCP_SUBFLOW_ADDRS_KERNEL,
+                      &addrInfo, &addrInfoLength) == 0);
+
+   // ====== Combine results ================================================
+   // NOTE: Subflows may come and go between both calls. The kernel reports
+   //       them in the same order, so the common prefix is used.
+   size_t n = std::min((size_t)tcpInfo.Header.NumSubflows, (size_t)MPTCP_MAX_SUBFLOWS);
+   if(haveAddresses) {
+      n = std::min(n, (size_t)addrInfo.Header.NumSubflows);
+   }
+   for(size_t i = 0;i < n;i++) {
+      const KernelTCPInfo& info = tcpInfo.Info[i];
+      MPTCPSubflowInfo     subflow;
+      memset(&subflow, 0, sizeof(subflow));
+      if(haveAddresses) {
+         memcpy(&subflow.LocalAddress, &addrInfo.Addrs[i].Local,
+                std::min(sizeof(subflow.LocalAddress), sizeof(addrInfo.Addrs[i].Local)));
+         memcpy(&subflow.RemoteAddress, &addrInfo.Addrs[i].Remote,
+                std::min(sizeof(subflow.RemoteAddress), sizeof(addrInfo.Addrs[i].Remote)));
+      }
+      subflow.BytesSent     = info.BytesSent;
+      subflow.BytesReceived = info.BytesReceived;
+      subflow.BytesAcked    = info.BytesAcked;
+      subflow.BytesRetrans  = info.BytesRetrans;
+      subflow.RTT           = info.RTT;
+      subflow.RTTVar        = info.RTTVar;
+      subflow.Cwnd          = info.SndCwnd;
+      subflow.TotalRetrans  = info.TotalRetrans;
+      subflows.push_back(subflow);
+   }
+   return(true);
+}
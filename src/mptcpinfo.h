@@ -0,0 +1,52 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#ifndef MPTCPINFO_H
+#define MPTCPINFO_H
+
+#include "tools.h"
+
+#include <stdint.h>
+#include <vector>
+
+
+// Per-subflow sample of an upstream Linux MPTCP connection
+struct MPTCPSubflowInfo
+{
+   sockaddr_union LocalAddress;
+   sockaddr_union RemoteAddress;
+   uint64_t       BytesSent;
+   uint64_t       BytesReceived;
+   uint64_t       BytesAcked;
+   uint64_t       BytesRetrans;
+   uint32_t       RTT;            // in us
+   uint32_t       RTTVar;         // in us
+   uint32_t       Cwnd;           // in segments
+   uint32_t       TotalRetrans;   // in segments
+};
+
+int createUpstreamMPTCPSocket(const int family, const int type);
+bool isUpstreamMPTCPSocket(const int sd);
+bool getMPTCPSubflowInfo(const int sd, std::vector<MPTCPSubflowInfo>& subflows);
+
+#endif
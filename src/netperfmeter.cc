@@ -29,17 +29,34 @@
 #include <signal.h>
 #include <math.h>
 #include <assert.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <netinet/udp.h>
+#include <linux/filter.h>
+#endif
 
 #include <iostream>
+#include <algorithm>
 
 #include "flow.h"
 #include "control.h"
 #include "transfer.h"
+#include "cpuaffinity.h"
+#include "mptcpinfo.h"
+#include "empiricaldistribution.h"
+#include "udpreceiveworker.h"
+#include "receiveworker.h"
 
 
 using namespace std;
 
 
+// Maximum number of connections accepted per listening socket and main loop pass
+#define NETPERFMETER_ACCEPT_BATCH 64
+
 #define MAX_LOCAL_ADDRESSES 16
 static unsigned int   gLocalDataAddresses = 0;
 static sockaddr_union gLocalDataAddressArray[MAX_LOCAL_ADDRESSES];
@@ -61,18 +78,88 @@ static int            gMPTCPSocket      = -1;
 static int            gUDPSocket        = -1;
 static int            gSCTPSocket       = -1;
 static int            gDCCPSocket       = -1;
+static const char*    gUnixDirectory       = "/tmp";
+static int            gUnixStreamSocket    = -1;
+static int            gUnixSeqPacketSocket = -1;
+static int            gShmSocket           = -1;
+static std::map<int, unsigned long long> gPendingShmSockets;   // SD -> attach deadline
 static double         gRuntime          = -1.0;
+static unsigned int   gRampUpMode       = FLOWSCHEDULE_LINEAR;
+static double         gRampUp           = 0.0;
+static unsigned int   gRampDownMode     = FLOWSCHEDULE_LINEAR;
+static double         gRampDown         = 0.0;
+static double         gWarmUp           = 0.0;
+static double         gCoolDown         = 0.0;
+static double         gStartTime        = 0.0;
+static const char*    gCPUPolicy        = NULL;
+static int            gSchedPolicy      = SCHED_OTHER;
+static int            gSchedPriority    = 0;
+static bool           gMemoryLock       = false;
+static bool           gPrefault         = false;
+static bool           gUDPGRO           = false;
+static unsigned int   gUDPWorkers       = 0;
+static bool           gUDPWorkerCPUSteering = false;
+static std::vector<UDPReceiveWorker*> gUDPWorkerSet;
+static unsigned int   gReceiveWorkers   = 0;
+static int            gReceiveWorkerPolicy = RECEIVEWORKER_POLICY_LEASTLOADED;
+static std::vector<ReceiveWorker*> gReceiveWorkerSet;
 static bool           gStopTimeReached  = false;
 MessageReader         gMessageReader;
 
 
 
+// ###### Read ramp-up or ramp-down setting #################################
+static void parseRamp(const char* parameter, unsigned int& mode, double& window)
+{
+   const char* value = strchr(parameter, '=') + 1;
+   mode = FLOWSCHEDULE_LINEAR;
+   if(strncmp(value, "linear:", 7) == 0) {
+      value = (const char*)&value[7];
+   }
+   else if(strncmp(value, "random:", 7) == 0) {
+      mode  = FLOWSCHEDULE_RANDOM;
+      value = (const char*)&value[7];
+   }
+   else if(strncmp(value, "fixed:", 6) == 0) {
+      mode  = FLOWSCHEDULE_FIXED;
+      value = (const char*)&value[6];
+   }
+   char* end;
+   window = strtod(value, &end);
+   if( (end == value) || (*end != 0x00) || (window < 0.0) ) {
+      cerr << "ERROR: Invalid setting " << parameter
+           << "! Use [linear:|random:|fixed:]<seconds>." << endl;
+      exit(1);
+   }
+}
+
+
 // ###### Handle global command-line parameter ##############################
 bool handleGlobalParameter(char* parameter)
 {
    if(strncmp(parameter, "-runtime=", 9) == 0) {
       gRuntime = atof((const char*)&parameter[9]);
    }
+   else if(strncmp(parameter, "-rampup=", 8) == 0) {
+      parseRamp(parameter, gRampUpMode, gRampUp);
+   }
+   else if(strncmp(parameter, "-rampdown=", 10) == 0) {
+      parseRamp(parameter, gRampDownMode, gRampDown);
+   }
+   else if(strncmp(parameter, "-warmup=", 8) == 0) {
+      gWarmUp = std::max(0.0, atof((const char*)&parameter[8]));
+   }
+   else if(strncmp(parameter, "-cooldown=", 10) == 0) {
+      gCoolDown = std::max(0.0, atof((const char*)&parameter[10]));
+   }
+   else if(strncmp(parameter, "-starttime=", 11) == 0) {
+      gStartTime = atof((const char*)&parameter[11]);
+      if(gStartTime <= 0.0) {
+         cerr << "ERROR: Invalid setting " << parameter
+              << "! Use the start time in seconds since the epoch." << endl;
+         exit(1);
+      }
+   }
    else if(strcmp(parameter, "-control-over-tcp") == 0) {
       gControlOverTCP = true;
    }
@@ -97,6 +184,98 @@ bool handleGlobalParameter(char* parameter)
    else if(strcmp(parameter, "-v6only") == 0) {
       gBindV6Only = true;
    }
+   else if(strncmp(parameter, "-unixdir=", 9) == 0) {
+      gUnixDirectory = (const char*)&parameter[9];
+   }
+   else if(strncmp(parameter, "-cpus=", 6) == 0) {
+      gCPUPolicy = (const char*)&parameter[6];
+   }
+   else if(strncmp(parameter, "-sched=", 7) == 0) {
+      const char* policy = (const char*)&parameter[7];
+      int         n      = 0;
+      if(strncmp(policy, "fifo", 4) == 0) {
+         gSchedPolicy = SCHED_FIFO;
+         n = 4;
+      }
+      else if(strncmp(policy, "rr", 2) == 0) {
+         gSchedPolicy = SCHED_RR;
+         n = 2;
+      }
+      else if(strncmp(policy, "other", 5) == 0) {
+         gSchedPolicy = SCHED_OTHER;
+         n = 5;
+      }
+      else {
+         cerr << "ERROR: Invalid scheduling class " << policy
+              << "! Use fifo, rr or other." << endl;
+         exit(1);
+      }
+      gSchedPriority = (gSchedPolicy != SCHED_OTHER) ? 50 : 0;
+      if(policy[n] == ':') {
+         gSchedPriority = atoi((const char*)&policy[n + 1]);
+      }
+      else if(policy[n] != 0x00) {
+         cerr << "ERROR: Invalid scheduling class " << policy << "!" << endl;
+         exit(1);
+      }
+      if( (gSchedPolicy != SCHED_OTHER) &&
+          ( (gSchedPriority < sched_get_priority_min(gSchedPolicy)) ||
+            (gSchedPriority > sched_get_priority_max(gSchedPolicy)) ) ) {
+         cerr << "ERROR: Invalid scheduling priority " << gSchedPriority
+              << "! Use " << sched_get_priority_min(gSchedPolicy) << "-"
+              << sched_get_priority_max(gSchedPolicy) << "." << endl;
+         exit(1);
+      }
+   }
+   else if(strcmp(parameter, "-mlockall") == 0) {
+      gMemoryLock = true;
+   }
+   else if(strcmp(parameter, "-prefault") == 0) {
+      gPrefault = true;
+   }
+   else if(strcmp(parameter, "-udpgro") == 0) {
+      gUDPGRO = true;
+   }
+   else if(strncmp(parameter, "-udp-workers=", 13) == 0) {
+      char* steering = NULL;
+      gUDPWorkers = (unsigned int)strtoul((const char*)&parameter[13], &steering, 10);
+      gUDPWorkerCPUSteering = false;
+      if(strcmp(steering, ":cpu") == 0) {
+         gUDPWorkerCPUSteering = true;
+      }
+      else if( (steering[0] != 0x00) && (strcmp(steering, ":hash") != 0) ) {
+         cerr << "ERROR: Invalid UDP worker steering " << steering
+              << "! Use hash or cpu." << endl;
+         exit(1);
+      }
+      if( (gUDPWorkers < 1) || (gUDPWorkers > 256) ) {
+         cerr << "ERROR: Invalid number of UDP workers " << &parameter[13]
+              << "! Use 1-256." << endl;
+         exit(1);
+      }
+#ifndef SO_REUSEPORT
+      cerr << "ERROR: UDP workers need SO_REUSEPORT, which is not supported on this platform!" << endl;
+      exit(1);
+#endif
+   }
+   else if(strncmp(parameter, "-recv-workers=", 14) == 0) {
+      char* policy = NULL;
+      gReceiveWorkers = (unsigned int)strtoul((const char*)&parameter[14], &policy, 10);
+      gReceiveWorkerPolicy = RECEIVEWORKER_POLICY_LEASTLOADED;
+      if(strcmp(policy, ":rr") == 0) {
+         gReceiveWorkerPolicy = RECEIVEWORKER_POLICY_ROUNDROBIN;
+      }
+      else if( (policy[0] != 0x00) && (strcmp(policy, ":least") != 0) ) {
+         cerr << "ERROR: Invalid receive worker policy " << policy
+              << "! Use least or rr." << endl;
+         exit(1);
+      }
+      if( (gReceiveWorkers < 1) || (gReceiveWorkers > 256) ) {
+         cerr << "ERROR: Invalid number of receive workers " << &parameter[14]
+              << "! Use 1-256." << endl;
+         exit(1);
+      }
+   }
    else if(strcmp(parameter, "-quiet") == 0) {
       // Already handled before!
    }
@@ -165,6 +344,20 @@ void printGlobalParameters()
       else {
          std::cout << "until manual stop" << std::endl;
       }
+      if( (gRampUp > 0.0) || (gRampDown > 0.0) ) {
+         static const char* modeNames[] = { "fixed", "linear", "random" };
+         std::cout << "   - Ramp-Up/Ramp-Down         = "
+                   << modeNames[gRampUpMode] << " " << gRampUp << "s / "
+                   << modeNames[gRampDownMode] << " " << gRampDown << "s" << std::endl;
+      }
+      if(gStartTime > 0.0) {
+         std::cout << "   - Start Time                = "
+                   << format("%1.6f", gStartTime) << std::endl;
+      }
+      if( (gWarmUp > 0.0) || (gCoolDown > 0.0) ) {
+         std::cout << "   - Warm-Up/Cool-Down         = "
+                   << gWarmUp << "s / " << gCoolDown << "s" << std::endl;
+      }
       std::cout << "   - Active Node Name          = " << gActiveNodeName  << std::endl
                 << "   - Passive Node Name         = " << gPassiveNodeName << std::endl;
       std::cout << "   - Local Data Address(es)    = ";
@@ -193,22 +386,106 @@ void printGlobalParameters()
          std::cout << "(any)";
       }
       std::cout << std::endl;
+      std::cout << "   - UNIX Socket Directory     = " << gUnixDirectory << std::endl;
+      std::cout << "   - CPU Affinity              = ";
+      printCPUList(std::cout, FlowManager::getFlowManager()->getCPUSet());
+      std::cout << std::endl;
+      std::cout << "   - Scheduling                = "
+                << ((gSchedPolicy == SCHED_FIFO) ? "FIFO" :
+                      ((gSchedPolicy == SCHED_RR) ? "RR" : "default"));
+      if(gSchedPolicy != SCHED_OTHER) {
+         std::cout << " (priority " << gSchedPriority << ")";
+      }
+      std::cout << std::endl
+                << "   - Memory Locking            = " << ((gMemoryLock == true) ? "yes" : "no") << std::endl
+                << "   - Prefault Buffers          = " << ((gPrefault == true)   ? "yes" : "no") << std::endl
+                << "   - UDP GRO                   = " << ((gUDPGRO == true)     ? "yes" : "no") << std::endl
+                << "   - UDP Receive Workers       = ";
+      if(gUDPWorkers > 0) {
+         std::cout << gUDPWorkers
+                   << ((gUDPWorkerCPUSteering == true) ? " (steered by CPU)" : " (steered by hash)");
+      }
+      else {
+         std::cout << "none";
+      }
+      std::cout << std::endl
+                << "   - Receive Workers           = ";
+      if(gReceiveWorkers > 0) {
+         std::cout << gReceiveWorkers
+                   << ((gReceiveWorkerPolicy == RECEIVEWORKER_POLICY_ROUNDROBIN) ?
+                         " (round-robin)" : " (least loaded)");
+      }
+      else {
+         std::cout << "none";
+      }
+      std::cout << std::endl;
       std::cout << "   - Logging Verbosity         = " << gOutputVerbosity << std::endl
                 << std::endl;
    }
 }
 
 
+// ###### Apply thread and memory settings ##################################
+static void applyThreadSettings(const sockaddr* destination)
+{
+   // ====== CPU affinity ===================================================
+   if(gCPUPolicy != NULL) {
+      std::vector<unsigned int> cpus;
+      if(!getCPUsForPolicy(gCPUPolicy, destination, cpus)) {
+         cerr << "ERROR: Invalid CPU set " << gCPUPolicy
+              << "! Use a list like 0-3,8 or auto[:interface]." << endl;
+         exit(1);
+      }
+      FlowManager::getFlowManager()->setCPUSet(cpus);
+
+      // The main loop shares its CPU with the FlowManager thread.
+      const std::vector<unsigned int> mainLoopCPUs(1, cpus[0]);
+      Thread::setCPUAffinityOfCaller(mainLoopCPUs);
+   }
+
+   // ====== Real-time scheduling ===========================================
+   if(gSchedPolicy != SCHED_OTHER) {
+      FlowManager::getFlowManager()->setFlowScheduling(gSchedPolicy, gSchedPriority);
+   }
+
+   // ====== Memory locking and prefaulting =================================
+   if(gMemoryLock) {
+      if(mlockall(MCL_CURRENT|MCL_FUTURE) < 0) {
+         cerr << "WARNING: Unable to lock memory (needs CAP_IPC_LOCK or a sufficient RLIMIT_MEMLOCK) - "
+              << strerror(errno) << "! Continuing without memory locking." << endl;
+         gMemoryLock = false;
+      }
+   }
+   if(gPrefault) {
+      FlowManager::getFlowManager()->setPrefault(true);
+   }
+}
+
+
 // ###### Read random number parameter ######################################
 static const char* parseNextEntry(const char* parameters,
                                   double*     valueArray,
                                   uint8_t*    rng)
 {
-   int n = 0;
+   char fileName[256];
+   int  n = 0;
    for(size_t i = 0;i < NETPERFMETER_RNG_INPUT_PARAMETERS;i++) {
       valueArray[i] = 0.0;
    }
-   if(sscanf(parameters, "exp%lf%n", &valueArray[0], &n) == 1) {
+   if( (sscanf(parameters, "histogram=%255[^:,]%n", (char*)&fileName, &n) == 1) ||
+       (sscanf(parameters, "cdf=%255[^:,]%n", (char*)&fileName, &n) == 1) ) {
+      EmpiricalDistribution* distribution = new EmpiricalDistribution;
+      if(!distribution->load(fileName, (parameters[0] == 'c'))) {
+         exit(1);
+      }
+      valueArray[0] = distribution->getMean();
+      valueArray[1] = EmpiricalDistribution::registerDistribution(distribution);
+      if(valueArray[1] == 0) {
+         exit(1);
+      }
+      *rng = RANDOM_EMPIRICAL;
+   }
+   else if(sscanf(parameters, "exp%lf%n", &valueArray[0], &n) == 1) {
       *rng = RANDOM_EXPONENTIAL;
    }
    else if(sscanf(parameters, "const%lf%n", &valueArray[0], &n) == 1) {
@@ -241,6 +518,7 @@ static const char* parseTrafficSpecOption(const char*      parameters,
                                           uint32_t&        flowID)
 {
    char   description[256];
+   char   traceFile[256];
    int    n        = 0;
    double dblValue = 0.0;
    int    intValue = 0;
@@ -302,6 +580,9 @@ static const char* parseTrafficSpecOption(const char*      parameters,
    else if(sscanf(parameters, "sndbuf=%u%n", &intValue, &n) == 1) {
       trafficSpec.SndBufferSize = (uint32_t)intValue;
    }
+   else if(sscanf(parameters, "cpu=%u%n", &intValue, &n) == 1) {
+      trafficSpec.CPU = intValue;
+   }
    else if(strncmp(parameters, "cmt=", 4) == 0) {
       unsigned int cmt;
       int          pos;
@@ -393,6 +674,198 @@ static const char* parseTrafficSpecOption(const char*      parameters,
       trafficSpec.BindV6Only = true;
       n = 6;
    }
+   else if(strncmp(parameters, "churn", 5) == 0) {
+      trafficSpec.Churn = true;
+      n = 5;
+   }
+   else if(strncmp(parameters, "tfo", 3) == 0) {
+      trafficSpec.FastOpen = true;
+      n = 3;
+   }
+   else if(strncmp(parameters, "reuseaddr", 9) == 0) {
+      trafficSpec.ReuseAddress = true;
+      n = 9;
+   }
+   else if(strncmp(parameters, "portrange=", 10) == 0) {
+      unsigned int low;
+      unsigned int high;
+      int          pos;
+      if( (sscanf((const char*)&parameters[10], "%u-%u%n", &low, &high, &pos) != 2) ||
+          (low < 1) || (high > 65535) || (low > high) ) {
+         cerr << "ERROR: Invalid \"portrange\" setting: " << (const char*)&parameters[10]
+              << "! Use portrange=<first>-<last>." << std::endl;
+         exit(1);
+      }
+      trafficSpec.PortRangeLow  = (uint16_t)low;
+      trafficSpec.PortRangeHigh = (uint16_t)high;
+      n = 10 + pos;
+   }
+   else if(sscanf(parameters, "connecttimeout=%u%n", &intValue, &n) == 1) {
+      trafficSpec.ConnectTimeout = (unsigned int)intValue;
+   }
+   else if(strncmp(parameters, "rpc", 3) == 0) {
+      trafficSpec.RPC = true;
+      n = 3;
+   }
+   else if(sscanf(parameters, "outstanding=%u%n", &intValue, &n) == 1) {
+      if(intValue < 1) {
+         cerr << "ERROR: Invalid \"outstanding\" setting: " << (const char*)&parameters[12]
+              << "! At least one outstanding request is required." << std::endl;
+         exit(1);
+      }
+      trafficSpec.Outstanding = (unsigned int)intValue;
+   }
+   else if(strncmp(parameters, "abr=", 4) == 0) {
+      // Bitrate ladder in Kbit/s, e.g. abr=300,750,1500,3000
+      n = 4;
+      trafficSpec.ABRLadder.clear();
+      int m = 0;
+      while(sscanf((const char*)&parameters[n], "%u%n", &intValue, &m) == 1) {
+         if( (intValue < 1) ||
+             (trafficSpec.ABRLadder.size() >= NETPERFMETER_ABR_LADDER_MAX) ) {
+            cerr << "ERROR: Invalid \"abr\" setting: " << (const char*)&parameters[4]
+                 << "! Use up to " << NETPERFMETER_ABR_LADDER_MAX
+                 << " positive bitrates in Kbit/s." << std::endl;
+            exit(1);
+         }
+         trafficSpec.ABRLadder.push_back((unsigned int)intValue);
+         n += m;
+         if(parameters[n] != ',') {
+            break;
+         }
+         n++;
+      }
+      if(trafficSpec.ABRLadder.size() == 0) {
+         cerr << "ERROR: Invalid \"abr\" setting: " << (const char*)&parameters[4]
+              << "! Use abr=<bitrate>,<bitrate>,... in Kbit/s." << std::endl;
+         exit(1);
+      }
+      std::sort(trafficSpec.ABRLadder.begin(), trafficSpec.ABRLadder.end());
+      trafficSpec.RPC = true;
+   }
+   else if(sscanf(parameters, "segment=%lf%n", &dblValue, &n) == 1) {
+      if( (dblValue < 0.1) || (dblValue > 60.0) ) {
+         cerr << "ERROR: Invalid \"segment\" setting: " << (const char*)&parameters[8]
+              << "! The segment duration must be between 0.1s and 60s." << std::endl;
+         exit(1);
+      }
+      trafficSpec.SegmentDuration = dblValue;
+   }
+   else if(strncmp(parameters, "abrpolicy=buffer", 16) == 0) {
+      trafficSpec.ABRPolicy = ABR_POLICY_BUFFER;
+      n = 16;
+   }
+   else if(strncmp(parameters, "abrpolicy=throughput", 20) == 0) {
+      trafficSpec.ABRPolicy = ABR_POLICY_THROUGHPUT;
+      n = 20;
+   }
+   else if(sscanf(parameters, "abrbuffer=%lf%n", &dblValue, &n) == 1) {
+      if(dblValue <= 0.0) {
+         cerr << "ERROR: Invalid \"abrbuffer\" setting: " << (const char*)&parameters[10]
+              << "! The playout buffer size must be positive." << std::endl;
+         exit(1);
+      }
+      trafficSpec.ABRBufferSize = dblValue;
+   }
+   else if(sscanf(parameters, "start=random:%lf%n", &dblValue, &n) == 1) {
+      if(dblValue < 0.0) {
+         cerr << "ERROR: Invalid \"start\" setting: " << (const char*)&parameters[6]
+              << "! The start window must not be negative." << std::endl;
+         exit(1);
+      }
+      trafficSpec.StartOffset = dblValue;
+      trafficSpec.StartRandom = true;
+   }
+   else if(sscanf(parameters, "start=%lf%n", &dblValue, &n) == 1) {
+      if(dblValue < 0.0) {
+         cerr << "ERROR: Invalid \"start\" setting: " << (const char*)&parameters[6]
+              << "! The start offset must not be negative." << std::endl;
+         exit(1);
+      }
+      trafficSpec.StartOffset = dblValue;
+      trafficSpec.StartRandom = false;
+   }
+   else if(sscanf(parameters, "train=%u%n", &intValue, &n) == 1) {
+      if( (intValue < 2) || (intValue > TRAIN_MAX_LENGTH) ) {
+         cerr << "ERROR: Invalid \"train\" setting: " << (const char*)&parameters[6]
+              << "! A packet train needs 2 to " << TRAIN_MAX_LENGTH << " packets." << std::endl;
+         exit(1);
+      }
+      trafficSpec.Probe       = true;
+      trafficSpec.TrainLength = (unsigned int)intValue;
+   }
+   else if(strncmp(parameters, "loss=ge:", 8) == 0) {
+      // Gilbert-Elliott: p, r[, loss in bad state[, loss in good state]]
+      ImpairmentSpec& impairment = trafficSpec.Impairment;
+      impairment.LossInBad  = 1.0;
+      impairment.LossInGood = 0.0;
+      if( (sscanf(parameters, "loss=ge:%lf,%lf,%lf,%lf%n",
+                  &impairment.GoodToBad, &impairment.BadToGood,
+                  &impairment.LossInBad, &impairment.LossInGood, &n) != 4) &&
+          (sscanf(parameters, "loss=ge:%lf,%lf,%lf%n",
+                  &impairment.GoodToBad, &impairment.BadToGood,
+                  &impairment.LossInBad, &n) != 3) &&
+          (sscanf(parameters, "loss=ge:%lf,%lf%n",
+                  &impairment.GoodToBad, &impairment.BadToGood, &n) != 2) ) {
+         cerr << "ERROR: Invalid \"loss\" setting: " << (const char*)&parameters[5]
+              << "! Use ge:<p>,<r>[,<loss in bad state>[,<loss in good state>]]." << std::endl;
+         exit(1);
+      }
+      if( (impairment.GoodToBad <= 0.0)  || (impairment.GoodToBad > 1.0) ||
+          (impairment.BadToGood <= 0.0)  || (impairment.BadToGood > 1.0) ||
+          (impairment.LossInBad < 0.0)   || (impairment.LossInBad > 1.0) ||
+          (impairment.LossInGood < 0.0)  || (impairment.LossInGood > 1.0) ) {
+         cerr << "ERROR: Bad probability for \"loss\" option in " << parameters << "!" << endl;
+         exit(1);
+      }
+   }
+   else if(sscanf(parameters, "loss=%lf%n", &dblValue, &n) == 1) {
+      if((dblValue < 0.0) || (dblValue > 1.0)) {
+         cerr << "ERROR: Bad probability for \"loss\" option in " << parameters << "!" << endl;
+         exit(1);
+      }
+      trafficSpec.Impairment.GoodToBad  = 0.0;
+      trafficSpec.Impairment.LossInGood = dblValue;
+   }
+   else if(sscanf(parameters, "duplicate=%lf%n", &dblValue, &n) == 1) {
+      if((dblValue < 0.0) || (dblValue > 1.0)) {
+         cerr << "ERROR: Bad probability for \"duplicate\" option in " << parameters << "!" << endl;
+         exit(1);
+      }
+      trafficSpec.Impairment.DuplicateRate = dblValue;
+   }
+   else if(sscanf(parameters, "reorder=%lf%n", &dblValue, &n) == 1) {
+      if((dblValue < 0.0) || (dblValue > 1.0)) {
+         cerr << "ERROR: Bad probability for \"reorder\" option in " << parameters << "!" << endl;
+         exit(1);
+      }
+      trafficSpec.Impairment.ReorderRate = dblValue;
+   }
+   else if(strncmp(parameters, "delay=", 6) == 0) {
+      // Delay in ms, given like a frame rate or size (e.g. const20, exp20).
+      const char* p = parseNextEntry((const char*)&parameters[6],
+                                     (double*)&trafficSpec.Impairment.Delay,
+                                     &trafficSpec.Impairment.DelayRng);
+      n = (p != NULL) ? (int)((long)p - (long)parameters - 1) : (int)strlen(parameters);
+   }
+   else if(sscanf(parameters, "tracescale=%lf%n", &dblValue, &n) == 1) {
+      if(dblValue <= 0.0) {
+         cerr << "ERROR: Invalid \"tracescale\" setting: " << (const char*)&parameters[11]
+              << "! The time scaling factor must be positive." << std::endl;
+         exit(1);
+      }
+      trafficSpec.TraceScale = dblValue;
+   }
+   else if(strncmp(parameters, "traceloop", 9) == 0) {
+      trafficSpec.TraceLoop = true;
+      n = 9;
+   }
+   else if(sscanf(parameters, "trace=%255[^:]%n", (char*)&traceFile, &n) == 1) {
+      trafficSpec.OutboundTrace = std::string(traceFile);
+   }
+   else if(sscanf(parameters, "inboundtrace=%255[^:]%n", (char*)&traceFile, &n) == 1) {
+      trafficSpec.InboundTrace = std::string(traceFile);
+   }
    else if(sscanf(parameters, "description=%255[^:]s%n", (char*)&description, &n) == 1) {
       trafficSpec.Description = std::string(description);
       n = 12 + strlen(description);
@@ -611,6 +1084,54 @@ static Flow* createFlow(Flow*                  previousFlow,
    if(trafficSpec.Description == "") {
       trafficSpec.Description = format("Flow %u", flowID);
    }
+   if( (trafficSpec.Churn) &&
+       (trafficSpec.Protocol != IPPROTO_TCP) &&
+       (trafficSpec.Protocol != IPPROTO_MPTCP) &&
+       (trafficSpec.Protocol != IPPROTO_SCTP) ) {
+      cerr << "ERROR: Connection churn is only supported for TCP, MPTCP and SCTP flows!" << endl;
+      exit(1);
+   }
+   if( (trafficSpec.RPC) && (trafficSpec.Churn) ) {
+      cerr << "ERROR: Request/response mode cannot be combined with connection churn!" << endl;
+      exit(1);
+   }
+   if(trafficSpec.ABRLadder.size() > 0) {
+      if( (trafficSpec.Protocol != IPPROTO_TCP) &&
+          (trafficSpec.Protocol != IPPROTO_MPTCP) ) {
+         cerr << "ERROR: Adaptive-bitrate streaming is only supported for TCP and MPTCP flows!" << endl;
+         exit(1);
+      }
+      if(trafficSpec.SegmentDuration * trafficSpec.ABRLadder.back() * 1000.0 / 8.0 > 4294967295.0) {
+         cerr << "ERROR: ABR segments of more than 4 GiB are not supported!" << endl;
+         exit(1);
+      }
+      // Segments are fetched one by one.
+      trafficSpec.Outstanding = 1;
+   }
+   if( (trafficSpec.Probe) &&
+       ((trafficSpec.Protocol != IPPROTO_UDP) || (trafficSpec.RPC) || (trafficSpec.Churn)) ) {
+      cerr << "ERROR: Packet trains are only supported for plain UDP flows!" << endl;
+      exit(1);
+   }
+   if(trafficSpec.Impairment.isEnabled()) {
+      bool datagramFlow = (trafficSpec.Protocol == IPPROTO_UDP);
+#ifdef HAVE_DCCP
+      datagramFlow = datagramFlow || (trafficSpec.Protocol == IPPROTO_DCCP);
+#endif
+      if( (!datagramFlow) || (trafficSpec.RPC) || (trafficSpec.Probe) ) {
+         cerr << "ERROR: Impairments are only supported for plain UDP and DCCP flows!" << endl;
+         exit(1);
+      }
+   }
+   if( ((trafficSpec.OutboundTrace != "") || (trafficSpec.InboundTrace != "")) &&
+       ((trafficSpec.RPC) || (trafficSpec.Churn) || (trafficSpec.Probe)) ) {
+      cerr << "ERROR: Traces cannot be combined with request/response, churn or packet train flows!" << endl;
+      exit(1);
+   }
+   if( (trafficSpec.FastOpen) && (trafficSpec.Protocol == IPPROTO_SCTP) ) {
+      cerr << "WARNING: TCP Fast Open is not applicable to SCTP flows!" << endl;
+      trafficSpec.FastOpen = false;
+   }
 
    // ====== Create new flow ================================================
    if(FlowManager::getFlowManager()->findFlow(measurementID, flowID, streamID) != NULL) {
@@ -619,6 +1140,10 @@ static Flow* createFlow(Flow*                  previousFlow,
    }
    Flow* flow = new Flow(measurementID, flowID, streamID, trafficSpec);
    assert(flow != NULL);
+   trafficSpec.releaseDistributions();   // The flow holds its own references
+   if(!flow->loadTrace()) {
+      exit(1);
+   }
 
    // ====== Initialize vector file =========================================
    const std::string vectorName = flow->getNodeOutputName(vectorNamePattern,
@@ -635,11 +1160,23 @@ static Flow* createFlow(Flow*                  previousFlow,
       setPort(&destinationAddress.sa, getPort(&destinationAddress.sa) - 1);
    }
 
+   // ====== Local transports: use AF_UNIX socket path =====================
+   std::string unixPath;
+   if(isLocalProtocol(trafficSpec.Protocol)) {
+      unixPath = getUnixSocketPath(gUnixDirectory, getPort(&remoteAddress.sa),
+                                   trafficSpec.Protocol);
+   }
+
    // ====== Print information ==============================================
    if(gOutputVerbosity >= NPFOV_STATUS) {
       cout << "Flow #" << flow->getFlowID() << ": connecting "
          << getProtocolName(trafficSpec.Protocol) << " socket to ";
-      printAddress(cout, &destinationAddress.sa, true);
+      if(isLocalProtocol(trafficSpec.Protocol)) {
+         cout << unixPath;
+      }
+      else {
+         printAddress(cout, &destinationAddress.sa, true);
+      }
       cout << " from ";
       if(gLocalDataAddresses > 0) {
          for(unsigned int i = 0;i < gLocalDataAddresses;i++) {
@@ -701,6 +1238,12 @@ static Flow* createFlow(Flow*                  previousFlow,
                                                    trafficSpec.BindV6Only);
            break;
 #endif
+         case IPPROTO_UNIX_STREAM:
+         case IPPROTO_UNIX_SEQPACKET:
+         case IPPROTO_SHM:
+            // NOTE: The socket is already connected here!
+            socketDescriptor = createUnixSocket(trafficSpec.Protocol, unixPath.c_str(), false);
+           break;
          default:
             abort();
 
@@ -738,7 +1281,8 @@ static Flow* createFlow(Flow*                  previousFlow,
       if(flow->configureSocket(socketDescriptor) == false) {
          exit(1);
       }
-      if(ext_connect(socketDescriptor, &destinationAddress.sa, getSocklen(&destinationAddress.sa)) < 0) {
+      if( (!isLocalProtocol(trafficSpec.Protocol)) &&
+          (ext_connect(socketDescriptor, &destinationAddress.sa, getSocklen(&destinationAddress.sa)) < 0) ) {
          cerr << "ERROR: Unable to connect " << getProtocolName(trafficSpec.Protocol)
               << " socket - " << strerror(errno) << "!" << endl;
          exit(1);
@@ -753,6 +1297,27 @@ static Flow* createFlow(Flow*                  previousFlow,
    // ====== Update flow with socket descriptor =============================
    flow->setSocketDescriptor(socketDescriptor, originalSocketDescriptor);
 
+   // ====== SHM: create rings and pass them to the remote side =============
+   if( (trafficSpec.Protocol == IPPROTO_SHM) && (originalSocketDescriptor) ) {
+      ShmRing* ring = ShmRing::create(socketDescriptor);
+      if(ring == NULL) {
+         exit(1);
+      }
+      flow->setShmRing(ring);
+   }
+
+   // ====== Upstream MPTCP: initialize subflow vector file =================
+   if( (trafficSpec.Protocol == IPPROTO_MPTCP) && (originalSocketDescriptor) &&
+       (vectorFileFormat != OFF_None) && (isUpstreamMPTCPSocket(socketDescriptor)) ) {
+      const std::string subflowVectorName =
+         flow->getNodeOutputName(vectorNamePattern, "active",
+                                 format("-%08x-%04x-mptcp", flowID, streamID));
+      if(!flow->initializeSubflowVectorFile(subflowVectorName.c_str(), vectorFileFormat)) {
+         std::cerr << "ERROR: Unable to create subflow vector file <" << subflowVectorName << ">!" << std::endl;
+         exit(1);
+      }
+   }
+
    flowID++;
    return(flow);
 }
@@ -773,21 +1338,67 @@ static void addToPollFDs(pollfd* pollFDs, const int fd, int& n, int* index = NUL
 }
 
 
+// ###### Accept pending incoming connections ###############################
+// The listening data sockets are non-blocking, so that a burst of incoming
+// connections (e.g. connection churn) is accepted in one pass of the main
+// loop instead of one connection per poll().
+static void acceptConnections(const int listenSocket, const int protocol)
+{
+   for(unsigned int i = 0;i < NETPERFMETER_ACCEPT_BATCH;i++) {
+      const int newSD = ext_accept(listenSocket, NULL, 0);
+      if(newSD < 0) {
+         break;
+      }
+#ifndef __linux__
+      // Other systems let the new socket inherit O_NONBLOCK.
+      const int flags = ext_fcntl(newSD, F_GETFL, 0);
+      ext_fcntl(newSD, F_SETFL, flags & ~O_NONBLOCK);
+#endif
+      FlowManager::getFlowManager()->addSocket(protocol, newSD);
+   }
+}
+
+
+// ###### Prepare listening data socket #####################################
+static void prepareListenSocket(const int listenSocket, const int protocol)
+{
+   ext_fcntl(listenSocket, F_SETFL, ext_fcntl(listenSocket, F_GETFL, 0) | O_NONBLOCK);
+#ifdef TCP_FASTOPEN
+   if( (protocol == IPPROTO_TCP) || (protocol == IPPROTO_MPTCP) ) {
+      // Accept TCP Fast Open requests (e.g. from connection churn flows).
+      const int queueLength = NETPERFMETER_ACCEPT_BATCH * 16;
+      if(ext_setsockopt(listenSocket, IPPROTO_TCP, TCP_FASTOPEN,
+                        &queueLength, sizeof(queueLength)) < 0) {
+         if(gOutputVerbosity >= NPFOV_STATUS) {
+            cerr << "NOTE: Unable to enable TCP Fast Open on "
+                 << getProtocolName(protocol) << " socket - "
+                 << strerror(errno) << "!" << endl;
+         }
+      }
+   }
+#endif
+}
+
+
 // ###### Main loop #########################################################
 bool mainLoop(const bool               isActiveMode,
               const unsigned long long stopAt,
               const uint64_t           measurementID)
 {
-   pollfd                 fds[5 + gMessageReader.size()];
+   pollfd                 fds[8 + gMessageReader.size() + gPendingShmSockets.size()];
    int                    n       = 0;
    int                    tcpID   = -1;
    int                    mptcpID = -1;
    int                    udpID   = -1;
    int                    sctpID  = -1;
    int                    dccpID  = -1;
+   int                    unixStreamID    = -1;
+   int                    unixSeqPacketID = -1;
+   int                    shmID           = -1;
    unsigned long long     now     = getMicroTime();
    std::map<int, pollfd*> pollFDIndex;
 
+   FlowManager::getFlowManager()->updateMainLoopStatus();
 
    // ====== Get parameters for poll() ======================================
    addToPollFDs((pollfd*)&fds, gTCPSocket,     n, &tcpID);
@@ -795,6 +1406,9 @@ bool mainLoop(const bool               isActiveMode,
    addToPollFDs((pollfd*)&fds, gUDPSocket,     n, &udpID);
    addToPollFDs((pollfd*)&fds, gSCTPSocket,    n, &sctpID);
    addToPollFDs((pollfd*)&fds, gDCCPSocket,    n, &dccpID);
+   addToPollFDs((pollfd*)&fds, gUnixStreamSocket,    n, &unixStreamID);
+   addToPollFDs((pollfd*)&fds, gUnixSeqPacketSocket, n, &unixSeqPacketID);
+   addToPollFDs((pollfd*)&fds, gShmSocket,           n, &shmID);
    int    controlFDSet[gMessageReader.size()];
    size_t controlFDs = gMessageReader.getAllSDs((int*)&controlFDSet, sizeof(controlFDSet) / sizeof(int));
    const int controlIDMin = n;
@@ -802,6 +1416,12 @@ bool mainLoop(const bool               isActiveMode,
       addToPollFDs((pollfd*)&fds, controlFDSet[i], n, NULL);
    }
    const int controlIDMax = n - 1;
+   const int shmPendingIDMin = n;
+   for(std::map<int, unsigned long long>::const_iterator iterator = gPendingShmSockets.begin();
+       iterator != gPendingShmSockets.end(); iterator++) {
+      addToPollFDs((pollfd*)&fds, iterator->first, n, NULL);
+   }
+   const int shmPendingIDMax = n - 1;
 
 
    // ====== Use poll() to wait for events ==================================
@@ -852,16 +1472,10 @@ bool mainLoop(const bool               isActiveMode,
 
       // ====== Incoming data message =======================================
       if( (tcpID >= 0) && (fds[tcpID].revents & POLLIN) ) {
-         const int newSD = ext_accept(gTCPSocket, NULL, 0);
-         if(newSD >= 0) {
-            FlowManager::getFlowManager()->addSocket(IPPROTO_TCP, newSD);
-         }
+         acceptConnections(gTCPSocket, IPPROTO_TCP);
       }
       if( (mptcpID >= 0) && (fds[mptcpID].revents & POLLIN) ) {
-         const int newSD = ext_accept(gMPTCPSocket, NULL, 0);
-         if(newSD >= 0) {
-            FlowManager::getFlowManager()->addSocket(IPPROTO_MPTCP, newSD);
-         }
+         acceptConnections(gMPTCPSocket, IPPROTO_MPTCP);
       }
       if( (udpID >= 0) && (fds[udpID].revents & POLLIN) ) {
          FlowManager::getFlowManager()->lock();
@@ -869,22 +1483,62 @@ bool mainLoop(const bool               isActiveMode,
          FlowManager::getFlowManager()->unlock();
       }
       if( (sctpID >= 0) && (fds[sctpID].revents & POLLIN) ) {
-         const int newSD = ext_accept(gSCTPSocket, NULL, 0);
-         if(newSD >= 0) {
-            FlowManager::getFlowManager()->addSocket(IPPROTO_SCTP, newSD);
-         }
+         acceptConnections(gSCTPSocket, IPPROTO_SCTP);
       }
 #ifdef HAVE_DCCP
       if( (dccpID >= 0) && (fds[dccpID].revents & POLLIN) ) {
-         const int newSD = ext_accept(gDCCPSocket, NULL, 0);
+         acceptConnections(gDCCPSocket, IPPROTO_DCCP);
+      }
+#endif
+      if( (unixStreamID >= 0) && (fds[unixStreamID].revents & POLLIN) ) {
+         const int newSD = ext_accept(gUnixStreamSocket, NULL, 0);
          if(newSD >= 0) {
-            FlowManager::getFlowManager()->addSocket(IPPROTO_DCCP, newSD);
+            FlowManager::getFlowManager()->addSocket(IPPROTO_UNIX_STREAM, newSD);
+         }
+      }
+      if( (unixSeqPacketID >= 0) && (fds[unixSeqPacketID].revents & POLLIN) ) {
+         const int newSD = ext_accept(gUnixSeqPacketSocket, NULL, 0);
+         if(newSD >= 0) {
+            FlowManager::getFlowManager()->addSocket(IPPROTO_UNIX_SEQPACKET, newSD);
+         }
+      }
+      if( (shmID >= 0) && (fds[shmID].revents & POLLIN) ) {
+         const int newSD = ext_accept(gShmSocket, NULL, 0);
+         if(newSD >= 0) {
+            // The active side passes the shared memory right after connecting.
+            gPendingShmSockets.insert(std::pair<int, unsigned long long>(
+                                         newSD, now + SHMRING_ATTACH_TIMEOUT));
+         }
+      }
+      for(int shmPendingID = shmPendingIDMin; shmPendingID <= shmPendingIDMax; shmPendingID++) {
+         if(fds[shmPendingID].revents & (POLLIN|POLLERR|POLLHUP)) {
+            const int sd = fds[shmPendingID].fd;
+            gPendingShmSockets.erase(sd);
+            ShmRing* ring = ShmRing::attach(sd);
+            if(ring != NULL) {
+               FlowManager::getFlowManager()->addSocket(IPPROTO_SHM, sd, ring);
+            }
+            else {
+               ext_close(sd);
+            }
          }
       }
-#endif
 
    }
 
+   // ====== Give up on SHM connections without shared memory ===============
+   std::map<int, unsigned long long>::iterator iterator = gPendingShmSockets.begin();
+   while(iterator != gPendingShmSockets.end()) {
+      if(iterator->second <= now) {
+         cerr << "ERROR: Shared memory has not been passed by peer!" << endl;
+         ext_close(iterator->first);
+         gPendingShmSockets.erase(iterator++);
+      }
+      else {
+         iterator++;
+      }
+   }
+
    // ====== Stop-time reached ==============================================
    if(now >= stopAt) {
       gStopTimeReached = true;
@@ -894,6 +1548,66 @@ bool mainLoop(const bool               isActiveMode,
 
 
 
+// ###### Create and configure passive-side UDP socket #####################
+static int createUDPSocket(const uint16_t localPort, const bool reusePort)
+{
+   const int sd = createAndBindSocket(AF_UNSPEC, SOCK_DGRAM, IPPROTO_UDP, localPort,
+                                      gLocalDataAddresses, (const sockaddr_union*)&gLocalDataAddressArray,
+                                      true, gBindV6Only, reusePort);
+   if(sd < 0) {
+      cerr << "ERROR: Failed to create and bind UDP socket - "
+           << strerror(errno) << "!" << endl;
+      exit(1);
+   }
+   // Kernel reception time stamps for packet train dispersion measurements.
+   const int on = 1;
+   if(ext_setsockopt(sd, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) < 0) {
+      cerr << "WARNING: Unable to enable SO_TIMESTAMP on UDP socket - "
+           << strerror(errno) << "!" << endl;
+   }
+   // Coalesced datagrams are split into their segments upon reception.
+   if(gUDPGRO) {
+#ifdef UDP_GRO
+      if(ext_setsockopt(sd, SOL_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+         cerr << "WARNING: Unable to enable UDP_GRO on UDP socket - "
+              << strerror(errno) << "! Continuing without GRO." << endl;
+         gUDPGRO = false;
+      }
+#else
+      cerr << "WARNING: UDP_GRO is not supported on this platform! Continuing without GRO." << endl;
+      gUDPGRO = false;
+#endif
+   }
+   return(sd);
+}
+
+
+// ###### Steer datagrams to the SO_REUSEPORT socket of the receiving CPU ##
+// The classic BPF program selects socket (CPU mod workers) of the group,
+// i.e. a flow stays on the socket of the CPU handling its interrupts.
+static void attachReusePortCPUSteering(const int sd, const unsigned int workers)
+{
+#if defined(SO_ATTACH_REUSEPORT_CBPF) && defined(SKF_AD_CPU)
+   sock_filter code[] = {
+      { BPF_LD  | BPF_W   | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+      { BPF_ALU | BPF_MOD | BPF_K,   0, 0, workers },
+      { BPF_RET | BPF_A,             0, 0, 0 }
+   };
+   sock_fprog program;
+   program.len    = sizeof(code) / sizeof(code[0]);
+   program.filter = code;
+   if(ext_setsockopt(sd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0) {
+      cerr << "WARNING: Unable to attach CPU steering program to UDP sockets - "
+           << strerror(errno) << "! Continuing with hash steering." << endl;
+      gUDPWorkerCPUSteering = false;
+   }
+#else
+   cerr << "WARNING: CPU steering of UDP sockets is not supported on this platform! Continuing with hash steering." << endl;
+   gUDPWorkerCPUSteering = false;
+#endif
+}
+
+
 // ###### Passive Mode ######################################################
 void passiveMode(int argc, char** argv, const uint16_t localPort)
 {
@@ -904,6 +1618,7 @@ void passiveMode(int argc, char** argv, const uint16_t localPort)
          exit(1);
       }
    }
+   applyThreadSettings((gLocalDataAddresses > 0) ? &gLocalDataAddressArray[0].sa : NULL);
    printGlobalParameters();
 
    // ====== Initialize control socket ======================================
@@ -949,6 +1664,7 @@ void passiveMode(int argc, char** argv, const uint16_t localPort)
    if(setBufferSizes(gTCPSocket, gSndBufSize, gRcvBufSize) == false) {
       exit(1);
    }
+   prepareListenSocket(gTCPSocket, IPPROTO_TCP);
 
 #ifdef HAVE_MPTCP
    gMPTCPSocket = createAndBindSocket(AF_UNSPEC, SOCK_STREAM, IPPROTO_MPTCP, localPort - 1,
@@ -960,38 +1676,57 @@ void passiveMode(int argc, char** argv, const uint16_t localPort)
       }
    }
    else {
-      if (ext_setsockopt(gMPTCPSocket, IPPROTO_TCP, MPTCP_PATH_MANAGER_LEGACY, gPathMgr, strlen(gPathMgr)) < 0) {
-         if (ext_setsockopt(gMPTCPSocket, IPPROTO_TCP, MPTCP_PATH_MANAGER, gPathMgr, strlen(gPathMgr)) < 0) {
-            if(strcmp(gPathMgr, "default") != 0) {
-               std::cerr << "WARNING: Failed to set MPTCP_PATH_MANAGER on socket - "
-                           << strerror(errno) << "!" << std::endl;
+      // Upstream Linux MPTCP uses the system-wide path manager and scheduler
+      if(!isUpstreamMPTCPSocket(gMPTCPSocket)) {
+         if (ext_setsockopt(gMPTCPSocket, IPPROTO_TCP, MPTCP_PATH_MANAGER_LEGACY, gPathMgr, strlen(gPathMgr)) < 0) {
+            if (ext_setsockopt(gMPTCPSocket, IPPROTO_TCP, MPTCP_PATH_MANAGER, gPathMgr, strlen(gPathMgr)) < 0) {
+               if(strcmp(gPathMgr, "default") != 0) {
+                  std::cerr << "WARNING: Failed to set MPTCP_PATH_MANAGER on socket - "
+                              << strerror(errno) << "!" << std::endl;
+               }
             }
          }
-      }
-      if (ext_setsockopt(gMPTCPSocket, IPPROTO_TCP, MPTCP_SCHEDULER_LEGACY, gScheduler, strlen(gScheduler)) < 0) {
-         if (ext_setsockopt(gMPTCPSocket, IPPROTO_TCP, MPTCP_SCHEDULER, gScheduler, strlen(gScheduler)) < 0) {
-            if(strcmp(gScheduler, "default") != 0) {
-               std::cerr << "WARNING: Failed to set MPTCP_SCHEDULER on socket - "
-                           << strerror(errno) << "!" << std::endl;
+         if (ext_setsockopt(gMPTCPSocket, IPPROTO_TCP, MPTCP_SCHEDULER_LEGACY, gScheduler, strlen(gScheduler)) < 0) {
+            if (ext_setsockopt(gMPTCPSocket, IPPROTO_TCP, MPTCP_SCHEDULER, gScheduler, strlen(gScheduler)) < 0) {
+               if(strcmp(gScheduler, "default") != 0) {
+                  std::cerr << "WARNING: Failed to set MPTCP_SCHEDULER on socket - "
+                              << strerror(errno) << "!" << std::endl;
+               }
             }
          }
       }
       if(setBufferSizes(gMPTCPSocket, gSndBufSize, gRcvBufSize) == false) {
          exit(1);
       }
-      ext_listen(gMPTCPSocket, 10);
+      ext_listen(gMPTCPSocket, SOMAXCONN);
+      prepareListenSocket(gMPTCPSocket, IPPROTO_MPTCP);
    }
 #endif
 
-   gUDPSocket = createAndBindSocket(AF_UNSPEC, SOCK_DGRAM, IPPROTO_UDP, localPort,
-                                    gLocalDataAddresses, (const sockaddr_union*)&gLocalDataAddressArray, true, gBindV6Only);
-   if(gUDPSocket < 0) {
-      cerr << "ERROR: Failed to create and bind UDP socket - "
-           << strerror(errno) << "!" << endl;
-      exit(1);
+   if(gUDPWorkers == 0) {
+      gUDPSocket = createUDPSocket(localPort, false);
+      // NOTE: For connection-less UDP, the FlowManager takes care of the socket!
+      FlowManager::getFlowManager()->addSocket(IPPROTO_UDP, gUDPSocket);
+   }
+   else {
+      // Each worker has its own socket; the kernel distributes the datagrams.
+      for(unsigned int i = 0; i < gUDPWorkers; i++) {
+         const int sd = createUDPSocket(localPort, true);
+         if( (i == gUDPWorkers - 1) && (gUDPWorkerCPUSteering) ) {
+            attachReusePortCPUSteering(sd, gUDPWorkers);
+         }
+         UDPReceiveWorker* worker = new UDPReceiveWorker(i, sd);
+         FlowManager::getFlowManager()->addUDPWorker(worker);
+         gUDPWorkerSet.push_back(worker);
+      }
+      for(std::vector<UDPReceiveWorker*>::iterator iterator = gUDPWorkerSet.begin();
+          iterator != gUDPWorkerSet.end(); iterator++) {
+         if(!(*iterator)->start()) {
+            cerr << "ERROR: Unable to start UDP receive worker!" << endl;
+            exit(1);
+         }
+      }
    }
-   // NOTE: For connection-less UDP, the FlowManager takes care of the socket!
-   FlowManager::getFlowManager()->addSocket(IPPROTO_UDP, gUDPSocket);
 
 #ifdef HAVE_DCCP
    gDCCPSocket = createAndBindSocket(AF_UNSPEC, SOCK_DCCP, IPPROTO_DCCP, localPort,
@@ -1009,6 +1744,7 @@ void passiveMode(int argc, char** argv, const uint16_t localPort)
       if(setBufferSizes(gDCCPSocket, gSndBufSize, gRcvBufSize) == false) {
          exit(1);
       }
+      prepareListenSocket(gDCCPSocket, IPPROTO_DCCP);
    }
 #endif
 
@@ -1039,6 +1775,34 @@ void passiveMode(int argc, char** argv, const uint16_t localPort)
    if(setBufferSizes(gSCTPSocket, gSndBufSize, gRcvBufSize) == false) {
       exit(1);
    }
+   prepareListenSocket(gSCTPSocket, IPPROTO_SCTP);
+
+   // ====== Start receive workers ==========================================
+   // Identified TCP/MPTCP/SCTP/DCCP sockets are spread over the workers.
+   if(gReceiveWorkers > 0) {
+      FlowManager::getFlowManager()->setReceiveWorkerPolicy(gReceiveWorkerPolicy);
+      for(unsigned int i = 0; i < gReceiveWorkers; i++) {
+         ReceiveWorker* worker = new ReceiveWorker(i);
+         FlowManager::getFlowManager()->addReceiveWorker(worker);
+         gReceiveWorkerSet.push_back(worker);
+         if(!worker->start()) {
+            cerr << "ERROR: Unable to start receive worker!" << endl;
+            exit(1);
+         }
+      }
+   }
+
+   // ====== Initialize local baseline transports ===========================
+   const std::string unixStreamPath    = getUnixSocketPath(gUnixDirectory, localPort, IPPROTO_UNIX_STREAM);
+   const std::string unixSeqPacketPath = getUnixSocketPath(gUnixDirectory, localPort, IPPROTO_UNIX_SEQPACKET);
+   const std::string shmPath           = getUnixSocketPath(gUnixDirectory, localPort, IPPROTO_SHM);
+   gUnixStreamSocket    = createUnixSocket(IPPROTO_UNIX_STREAM,    unixStreamPath.c_str(),    true);
+   gUnixSeqPacketSocket = createUnixSocket(IPPROTO_UNIX_SEQPACKET, unixSeqPacketPath.c_str(), true);
+   gShmSocket           = createUnixSocket(IPPROTO_SHM,            shmPath.c_str(),           true);
+   if( (gUnixStreamSocket < 0) || (gUnixSeqPacketSocket < 0) || (gShmSocket < 0) ) {
+      cerr << "NOTE: Unable to create UNIX sockets in " << gUnixDirectory << " - "
+           << strerror(errno) << "!" << endl;
+   }
 
 
    // ====== Print status ===================================================
@@ -1046,7 +1810,12 @@ void passiveMode(int argc, char** argv, const uint16_t localPort)
       cout << "Passive Mode: Accepting TCP"
            << ((gMPTCPSocket > 0) ? "+MPTCP" : "")
            << "/UDP/SCTP" << ((gDCCPSocket > 0) ? "/DCCP" : "")
-           << " connections on port " << localPort << endl << endl;
+           << " connections on port " << localPort << endl;
+      if( (gUnixStreamSocket >= 0) || (gUnixSeqPacketSocket >= 0) || (gShmSocket >= 0) ) {
+         cout << "              Accepting UNIX-Stream/UNIX-SeqPacket/SHM connections in "
+              << gUnixDirectory << endl;
+      }
+      cout << endl;
    }
 
 
@@ -1073,12 +1842,50 @@ void passiveMode(int argc, char** argv, const uint16_t localPort)
    if(gMPTCPSocket >= 0) {
       ext_close(gMPTCPSocket);
    }
-   FlowManager::getFlowManager()->removeSocket(gUDPSocket, false);
-   ext_close(gUDPSocket);
+   if(gUDPSocket >= 0) {
+      FlowManager::getFlowManager()->removeSocket(gUDPSocket, false);
+      ext_close(gUDPSocket);
+   }
+   for(std::vector<UDPReceiveWorker*>::iterator iterator = gUDPWorkerSet.begin();
+       iterator != gUDPWorkerSet.end(); iterator++) {
+      UDPReceiveWorker* worker = *iterator;
+      worker->stop();
+      worker->waitForFinish();
+      FlowManager::getFlowManager()->removeUDPWorker(worker);
+      ext_close(worker->getSocketDescriptor());
+      delete worker;
+   }
+   gUDPWorkerSet.clear();
+   for(std::vector<ReceiveWorker*>::iterator iterator = gReceiveWorkerSet.begin();
+       iterator != gReceiveWorkerSet.end(); iterator++) {
+      ReceiveWorker* worker = *iterator;
+      worker->stop();
+      worker->waitForFinish();
+      FlowManager::getFlowManager()->removeReceiveWorker(worker);
+      delete worker;
+   }
+   gReceiveWorkerSet.clear();
    ext_close(gSCTPSocket);
    if(gDCCPSocket >= 0) {
       ext_close(gDCCPSocket);
    }
+   if(gUnixStreamSocket >= 0) {
+      ext_close(gUnixStreamSocket);
+      unlink(unixStreamPath.c_str());
+   }
+   if(gUnixSeqPacketSocket >= 0) {
+      ext_close(gUnixSeqPacketSocket);
+      unlink(unixSeqPacketPath.c_str());
+   }
+   if(gShmSocket >= 0) {
+      ext_close(gShmSocket);
+      unlink(shmPath.c_str());
+   }
+   for(std::map<int, unsigned long long>::const_iterator iterator = gPendingShmSockets.begin();
+       iterator != gPendingShmSockets.end(); iterator++) {
+      ext_close(iterator->first);
+   }
+   gPendingShmSockets.clear();
 }
 
 
@@ -1167,6 +1974,15 @@ void activeMode(int argc, char** argv)
          else if(strcmp(argv[i], "-sctp") == 0) {
             protocol = IPPROTO_SCTP;
          }
+         else if(strcmp(argv[i], "-unix") == 0) {
+            protocol = IPPROTO_UNIX_STREAM;
+         }
+         else if(strcmp(argv[i], "-seqpacket") == 0) {
+            protocol = IPPROTO_UNIX_SEQPACKET;
+         }
+         else if(strcmp(argv[i], "-shm") == 0) {
+            protocol = IPPROTO_SHM;
+         }
          else if(strcmp(argv[i], "-dccp") == 0) {
 #ifdef HAVE_DCCP
             protocol = IPPROTO_DCCP;
@@ -1243,23 +2059,58 @@ void activeMode(int argc, char** argv)
       cout << endl;
    }
 
+   applyThreadSettings(&remoteAddress.sa);
    printGlobalParameters();
 
 
    // ====== Start measurement ==============================================
+   if( (gRampDown > 0.0) && ((gRuntime <= 0.0) || (gRampDown >= gRuntime)) ) {
+      cerr << "ERROR: Ramp-down needs a runtime longer than the ramp-down window!" << endl;
+      exit(1);
+   }
+   if( (gCoolDown > 0.0) && ((gRuntime <= 0.0) || (gWarmUp + gCoolDown >= gRuntime)) ) {
+      cerr << "ERROR: Cool-down needs a runtime longer than warm-up and cool-down!" << endl;
+      exit(1);
+   }
+   if( (gRuntime > 0.0) && (gWarmUp >= gRuntime) ) {
+      cerr << "ERROR: Warm-up needs to be shorter than the runtime!" << endl;
+      exit(1);
+   }
+   const unsigned long long startTime = (unsigned long long)rint(gStartTime * 1000000.0);
+   if( (startTime > 0) && (startTime <= getMicroTime()) ) {
+      cerr << "ERROR: Start time " << format("%1.6f", gStartTime)
+           << " has already passed!" << endl;
+      exit(1);
+   }
+   FlowManager::getFlowManager()->scheduleFlows(
+      measurementID,
+      gRampUpMode,   (unsigned long long)rint(gRampUp * 1000000.0),
+      gRampDownMode, (unsigned long long)rint(gRampDown * 1000000.0),
+      (gRuntime > 0.0) ? (unsigned long long)rint(gRuntime * 1000000.0) : 0);
    if(!performNetPerfMeterStart(&gMessageReader, gControlSocket, measurementID,
                                 gActiveNodeName, gPassiveNodeName,
                                 configName,
                                 vectorNamePattern, vectorFileFormat,
-                                scalarNamePattern, scalarFileFormat)) {
+                                scalarNamePattern, scalarFileFormat,
+                                (unsigned long long)rint(gWarmUp * 1000000.0),
+                                (gCoolDown > 0.0) ?
+                                   (unsigned long long)rint((gRuntime - gCoolDown) * 1000000.0) : 0,
+                                startTime)) {
       std::cerr << "ERROR: Failed to start measurement!" << std::endl;
       exit(1);
    }
 
 
+   if( (startTime > 0) && (gOutputVerbosity >= NPFOV_STATUS) ) {
+      cout << "Flows start in " << format("%1.3f", ((double)startTime - (double)getMicroTime()) / 1000000.0)
+           << "s" << endl;
+   }
+
+
    // ====== Main loop ======================================================
+   // The runtime counts from the scheduled start time.
    const unsigned long long stopAt  = (gRuntime > 0) ?
-      (getMicroTime() + (unsigned long long)rint(gRuntime * 1000000.0)) : ~0ULL;
+      (std::max(getMicroTime(), startTime) + (unsigned long long)rint(gRuntime * 1000000.0)) : ~0ULL;
    signal(SIGPIPE, SIG_IGN);
    installBreakDetector();
    if(gOutputVerbosity >= NPFOV_BANDWIDTH_INFO) {
@@ -1298,7 +2149,7 @@ int main(int argc, char** argv)
 {
    if(argc < 2) {
       cerr << "Usage: " << argv[0]
-           << " [Local Port|Remote Endpoint] {-control-over-tcp} {-tcp|-udp|-sctp|-dccp} {flow spec} ..."
+           << " [Local Port|Remote Endpoint] {-control-over-tcp} {-tcp|-udp|-sctp|-dccp|-unix|-seqpacket|-shm} {flow spec} ..."
            << endl;
       exit(1);
    }
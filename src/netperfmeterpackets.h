@@ -124,6 +124,54 @@ struct NetPerfMeterAddFlowMessage
 #define NPMAFF_DEBUG         (1 << 0)
 #define NPMAFF_NODELAY       (1 << 1)
 #define NPMAFF_REPEATONOFF   (1 << 2)
+#define NPMAFF_RPC           (1 << 3)
+#define NPMAFF_PROBE         (1 << 4)
+
+// Optional extensions may follow the on/off events. Each one begins with a
+// NetPerfMeterHeader (Type = NPMAFE_*, Length including the header).
+struct NetPerfMeterTraceExtension
+{
+   NetPerfMeterHeader Header;
+   uint32_t           TimeScale;   // Time scaling factor * 1000000
+   char               Data[];      // Binary trace or trace file name
+} __attribute__((packed));
+
+#define NPMAFE_TRACE_DATA  0x01   // Data: complete binary trace
+#define NPMAFE_TRACE_FILE  0x02   // Data: trace file name on the passive node
+
+#define NPMAFEF_TRACE_LOOP (1 << 0)
+
+// Larger traces are sent by reference (file name) only
+#define NETPERFMETER_TRACE_INLINE_MAX 32768
+
+struct NetPerfMeterDistributionEntry
+{
+   network_double_t Value;
+   network_double_t Weight;
+} __attribute__((packed));
+
+// Empirical distribution referenced by RANDOM_EMPIRICAL values of the flow
+struct NetPerfMeterDistributionExtension
+{
+   NetPerfMeterHeader            Header;
+   uint32_t                      Identifier;   // Sender's identifier
+   NetPerfMeterDistributionEntry Entry[];
+} __attribute__((packed));
+
+#define NPMAFE_DISTRIBUTION 0x03
+
+// Adaptive-bitrate streaming: segment bitrate ladder of the flow. Each
+// request carries the index of the requested representation.
+struct NetPerfMeterABRExtension
+{
+   NetPerfMeterHeader Header;
+   uint32_t           SegmentDuration;   // in us
+   uint32_t           Bitrate[];         // in Kbit/s, ascending
+} __attribute__((packed));
+
+#define NPMAFE_ABR_LADDER 0x04
+
+#define NETPERFMETER_ABR_LADDER_MAX 64
 
 // RetransmissionTrials in milliseconds (highest bit of 32-bit value set)
 #define NPMAF_RTX_TRIALS_IN_MILLISECONDS (1 << 31)
@@ -167,7 +215,7 @@ struct NetPerfMeterDataMessage
    uint32_t           FlowID;
    uint64_t           MeasurementID;
    uint16_t           StreamID;
-   uint16_t           Padding;
+   uint16_t           Parameter;   // ABR request: representation index
 
    uint32_t           FrameID;
    uint64_t           SeqNumber;
@@ -177,8 +225,10 @@ struct NetPerfMeterDataMessage
    unsigned char      Payload[];
 } __attribute__((packed));
 
-#define NPMDF_FRAME_BEGIN (1 << 0)
-#define NPMDF_FRAME_END   (1 << 1)
+#define NPMDF_FRAME_BEGIN  (1 << 0)
+#define NPMDF_FRAME_END    (1 << 1)
+#define NPMDF_RPC_REQUEST  (1 << 2)   // FrameID is the transaction ID
+#define NPMDF_RPC_RESPONSE (1 << 3)   // FrameID echoes the request's FrameID
 
 
 struct NetPerfMeterStartMessage
@@ -193,6 +243,47 @@ struct NetPerfMeterStartMessage
 #define NPMSF_COMPRESS_SCALARS (1 << 1)
 #define NPMSF_NO_VECTORS       (1 << 2)
 #define NPMSF_NO_SCALARS       (1 << 3)
+#define NPMSF_CONTINUED        (1 << 4)   // Schedule continues, do not start yet
+
+// Optional extensions may follow, formatted like the NETPERFMETER_ADD_FLOW
+// extensions.
+struct NetPerfMeterFlowSchedule
+{
+   uint32_t           FlowID;
+   uint16_t           StreamID;
+   uint16_t           Padding;
+   uint64_t           StartOffset;   // in us after the measurement start
+   uint64_t           StopOffset;    // in us after the measurement start (0: none)
+} __attribute__((packed));
+
+struct NetPerfMeterScheduleExtension
+{
+   NetPerfMeterHeader       Header;
+   NetPerfMeterFlowSchedule Schedule[];
+} __attribute__((packed));
+
+// Larger schedules are split over several NETPERFMETER_START messages; all
+// but the last one have the NPMSF_CONTINUED flag set.
+#define NETPERFMETER_SCHEDULE_MAX_ENTRIES 2048
+
+struct NetPerfMeterStatisticsWindowExtension
+{
+   NetPerfMeterHeader Header;
+   uint32_t           Padding;
+   uint64_t           WarmUp;           // in us after the measurement start
+   uint64_t           CoolDownOffset;   // in us after the measurement start (0: none)
+} __attribute__((packed));
+
+struct NetPerfMeterStartTimeExtension
+{
+   NetPerfMeterHeader Header;
+   uint32_t           Padding;
+   uint64_t           StartTime;        // Absolute time in us since the epoch
+} __attribute__((packed));
+
+#define NPMSE_SCHEDULE          0x01
+#define NPMSE_STATISTICS_WINDOW 0x02
+#define NPMSE_START_TIME        0x03
 
 
 struct NetPerfMeterStopMessage
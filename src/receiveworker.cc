@@ -0,0 +1,285 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "receiveworker.h"
+#include "transfer.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+
+// ###### Constructor #######################################################
+ReceiveWorker::ReceiveWorker(const unsigned int workerID)
+   : WorkerID(workerID),
+     StartTime(getMicroTime())
+{
+   memset(&Statistics, 0, sizeof(Statistics));
+   ShardSockets = 0;
+   if(ext_pipe((int*)&WakeUpPipe) == 0) {
+      ext_fcntl(WakeUpPipe[0], F_SETFL, O_NONBLOCK);
+      ext_fcntl(WakeUpPipe[1], F_SETFL, O_NONBLOCK);
+   }
+   else {
+      WakeUpPipe[0] = WakeUpPipe[1] = -1;
+   }
+#ifdef __linux__
+   EpollFD = epoll_create1(EPOLL_CLOEXEC);
+   if(EpollFD < 0) {
+      std::cerr << "ERROR: Unable to create epoll instance - "
+                << strerror(errno) << "!" << std::endl;
+      exit(1);
+   }
+   if(WakeUpPipe[0] >= 0) {
+      epoll_event event;
+      memset(&event, 0, sizeof(event));
+      event.events  = EPOLLIN;
+      event.data.fd = WakeUpPipe[0];
+      epoll_ctl(EpollFD, EPOLL_CTL_ADD, WakeUpPipe[0], &event);
+   }
+#else
+   UpdatedPollSet = true;
+#endif
+}
+
+
+// ###### Destructor ########################################################
+ReceiveWorker::~ReceiveWorker()
+{
+   stop();
+   waitForFinish();
+   if(WakeUpPipe[0] >= 0) {
+      ext_close(WakeUpPipe[0]);
+      ext_close(WakeUpPipe[1]);
+   }
+#ifdef __linux__
+   close(EpollFD);
+#endif
+}
+
+
+// ###### Stop the worker thread ############################################
+void ReceiveWorker::stop()
+{
+   Thread::stop();
+   wakeUp();
+}
+
+
+// ###### Interrupt the worker thread's poll() ##############################
+void ReceiveWorker::wakeUp()
+{
+   if(WakeUpPipe[1] >= 0) {
+      const char wakeUpSignal = 'W';
+      ext_write(WakeUpPipe[1], &wakeUpSignal, 1);
+   }
+}
+
+
+// ###### Get copy of the receive statistics ################################
+void ReceiveWorker::getReceiveStatistics(ReceiveWorkerStatistics& statistics,
+                                         double&                  utilization)
+{
+   lock();
+   statistics = Statistics;
+   unlock();
+   const unsigned long long duration = getMicroTime() - StartTime;
+   utilization = (duration > 0) ? (double)statistics.BusyTime / (double)duration : 0.0;
+}
+
+
+// ###### Add socket to the worker's poll set ###############################
+// Called by the FlowManager, with the FlowManager locked.
+void ReceiveWorker::watchSocket(const int socketDescriptor, const int protocol)
+{
+   lock();
+   if(SocketSet.insert(std::pair<int, int>(socketDescriptor, protocol)).second) {
+      Statistics.AssignedSockets++;
+#ifdef __linux__
+      epoll_event event;
+      memset(&event, 0, sizeof(event));
+      event.events  = EPOLLIN;
+      event.data.fd = socketDescriptor;
+      if(epoll_ctl(EpollFD, EPOLL_CTL_ADD, socketDescriptor, &event) < 0) {
+         std::cerr << "WARNING: Unable to add socket " << socketDescriptor
+                   << " to epoll set of receive worker " << WorkerID << " - "
+                   << strerror(errno) << "!" << std::endl;
+      }
+#else
+      UpdatedPollSet = true;
+      wakeUp();
+#endif
+   }
+   unlock();
+}
+
+
+// ###### Remove socket from the worker's poll set ##########################
+// Called by the FlowManager, with the FlowManager locked. Afterwards, the
+// worker does not read from the socket any more.
+void ReceiveWorker::unwatchSocket(const int socketDescriptor)
+{
+   lock();
+   if(SocketSet.erase(socketDescriptor) > 0) {
+#ifdef __linux__
+      // A closed socket has already left the epoll set.
+      epoll_ctl(EpollFD, EPOLL_CTL_DEL, socketDescriptor, NULL);
+#else
+      UpdatedPollSet = true;
+#endif
+   }
+   unlock();
+}
+
+
+// ###### Check whether socket belongs to the worker ########################
+bool ReceiveWorker::hasSocket(const int socketDescriptor)
+{
+   return(SocketSet.find(socketDescriptor) != SocketSet.end());
+}
+
+
+// ###### Find flow by socket descriptor and stream ID ######################
+Flow* ReceiveWorker::findFlow(const int socketDescriptor, const uint16_t streamID)
+{
+   const FlowManager::SocketKey key = { socketDescriptor, streamID };
+
+   // ====== Look up the worker's cache =====================================
+   std::unordered_map<FlowManager::SocketKey, Flow*,
+                      FlowManager::SocketKeyHash>::const_iterator found =
+      FlowCache.find(key);
+   if(found != FlowCache.end()) {
+      return(found->second);
+   }
+
+   // ====== Cache miss: ask the FlowManager ================================
+   // The FlowManager has to be locked before the worker. The FlowManager
+   // lock is kept until the flow is in the cache, so that a concurrent
+   // FlowManager::removeFlow() cannot leave a stale entry. The socket may
+   // have been taken away meanwhile.
+   unlock();
+   FlowManager::getFlowManager()->lock();
+   lock();
+   Flow* flow = NULL;
+   if(hasSocket(socketDescriptor)) {
+      flow = FlowManager::getFlowManager()->findFlow(socketDescriptor, streamID);
+      if(flow != NULL) {
+         FlowCache.insert(std::pair<FlowManager::SocketKey, Flow*>(key, flow));
+      }
+   }
+   FlowManager::getFlowManager()->unlock();
+   return(flow);
+}
+
+
+// ###### Remove flow from the cache ########################################
+// Called by the FlowManager, with the FlowManager locked.
+void ReceiveWorker::forgetFlow(const FlowManager::SocketKey& key, Flow* flow)
+{
+   lock();
+   std::unordered_map<FlowManager::SocketKey, Flow*,
+                      FlowManager::SocketKeyHash>::iterator found =
+      FlowCache.find(key);
+   if( (found != FlowCache.end()) && (found->second == flow) ) {
+      FlowCache.erase(found);
+   }
+   unlock();
+}
+
+
+// ###### Receive thread ####################################################
+void ReceiveWorker::run()
+{
+   signal(SIGPIPE, SIG_IGN);
+
+#ifdef __linux__
+   epoll_event         events[RECEIVEWORKER_MAX_EVENTS];
+#else
+   std::vector<pollfd> pollFDs;
+#endif
+   do {
+      // ====== Wait for events =============================================
+      // The timeout ensures that a stop request is noticed.
+#ifdef __linux__
+      const int result = epoll_wait(EpollFD, (epoll_event*)&events,
+                                    RECEIVEWORKER_MAX_EVENTS, 250);
+#else
+      lock();
+      if(UpdatedPollSet) {
+         UpdatedPollSet = false;
+         pollFDs.clear();
+         pollfd entry;
+         entry.events  = POLLIN;
+         entry.revents = 0;
+         if(WakeUpPipe[0] >= 0) {
+            entry.fd = WakeUpPipe[0];
+            pollFDs.push_back(entry);
+         }
+         for(std::map<int, int>::const_iterator iterator = SocketSet.begin();
+             iterator != SocketSet.end(); iterator++) {
+            entry.fd = iterator->first;
+            pollFDs.push_back(entry);
+         }
+      }
+      unlock();
+      const int result = ext_poll_wrapper(pollFDs.data(), pollFDs.size(), 250);
+#endif
+
+      // ====== Handle events ===============================================
+      lock();
+      const unsigned long long now = getMicroTime();
+      updateCurrentCPU();
+      prefaultStack();   // Only does something when prefaulting is requested
+      if(result > 0) {
+         Statistics.Wakeups++;
+#ifdef __linux__
+         for(int j = 0;j < result;j++) {
+            const int sd = events[j].data.fd;
+#else
+         for(size_t j = 0;j < pollFDs.size();j++) {
+            if(!(pollFDs[j].revents & (POLLIN|POLLERR|POLLHUP))) {
+               continue;
+            }
+            const int sd = pollFDs[j].fd;
+#endif
+            if(sd == WakeUpPipe[0]) {
+               char buffer[64];
+               while(ext_read(WakeUpPipe[0], (char*)&buffer, sizeof(buffer)) > 0) { }
+               continue;
+            }
+
+            // NOTE: The socket may have been removed by the FlowManager
+            //       after the poll() call.
+            std::map<int, int>::const_iterator found = SocketSet.find(sd);
+            if(found != SocketSet.end()) {
+               handleNetPerfMeterData(true, now, found->second, sd, this);
+            }
+         }
+         Statistics.BusyTime += getMicroTime() - now;
+      }
+      unlock();
+   } while(!isStopping());
+}
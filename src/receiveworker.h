@@ -0,0 +1,110 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#ifndef RECEIVEWORKER_H
+#define RECEIVEWORKER_H
+
+#include "thread.h"
+#include "flow.h"
+
+#include <map>
+#include <unordered_map>
+
+
+// Policies for assigning identified sockets to the receive workers
+#define RECEIVEWORKER_POLICY_LEASTLOADED 0   // Worker with fewest sockets
+#define RECEIVEWORKER_POLICY_ROUNDROBIN  1
+
+// Maximum number of ready sockets handled per epoll_wait() call
+#define RECEIVEWORKER_MAX_EVENTS 64
+
+
+struct ReceiveWorkerStatistics {
+   unsigned long long AssignedSockets;    // Sockets assigned so far
+   unsigned long long Wakeups;            // Returns from poll()
+   unsigned long long ReceivedMessages;
+   unsigned long long ReceivedBytes;
+   unsigned long long BusyTime;           // Time spent on reception in us
+};
+
+
+// A receive thread for a shard of the identified TCP, MPTCP, SCTP and DCCP
+// sockets of the passive side. The FlowManager assigns a socket upon flow
+// identification; from then on, only the worker reads from it, using its
+// own poll set. Flows are looked up in the worker's own cache, which is
+// filled from the FlowManager upon a miss.
+// Lock order: FlowManager -> ReceiveWorker -> Flow.
+class ReceiveWorker : public Thread
+{
+   // ====== Methods ========================================================
+   public:
+   ReceiveWorker(const unsigned int workerID);
+   virtual ~ReceiveWorker();
+
+   virtual void stop();
+
+   inline unsigned int getWorkerID() const {
+      return(WorkerID);
+   }
+   inline ReceiveWorkerStatistics& getReceiveStatistics() {   // Worker must be locked!
+      return(Statistics);
+   }
+   void getReceiveStatistics(ReceiveWorkerStatistics& statistics,
+                             double&                  utilization);
+
+   void watchSocket(const int socketDescriptor, const int protocol);
+   void unwatchSocket(const int socketDescriptor);
+   bool hasSocket(const int socketDescriptor);   // Worker must be locked!
+
+   Flow* findFlow(const int socketDescriptor, const uint16_t streamID);   // Worker must be locked!
+   void forgetFlow(const FlowManager::SocketKey& key, Flow* flow);
+
+   // ====== Protected Methods ==============================================
+   protected:
+   void run();
+
+   // ====== Private Methods ================================================
+   private:
+   void wakeUp();
+
+   // ====== Private Data ===================================================
+   private:
+   const unsigned int       WorkerID;
+   const unsigned long long StartTime;
+   ReceiveWorkerStatistics  Statistics;
+   std::map<int, int>       SocketSet;       // Socket descriptor -> protocol
+   std::unordered_map<FlowManager::SocketKey, Flow*,
+                      FlowManager::SocketKeyHash> FlowCache;
+   int                      WakeUpPipe[2];   // Interrupts poll() on new sockets
+#ifdef __linux__
+   int                      EpollFD;
+#else
+   bool                     UpdatedPollSet;
+#endif
+
+   // ------ Shard size, maintained by the FlowManager ----------------------
+   friend class FlowManager;
+   size_t                   ShardSockets;    // FlowManager must be locked!
+};
+
+#endif
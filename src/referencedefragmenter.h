@@ -0,0 +1,104 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#ifndef REFERENCEDEFRAGMENTER_H
+#define REFERENCEDEFRAGMENTER_H
+
+#include <map>
+
+#include "netperfmeterpackets.h"
+#include "bufferarena.h"
+
+
+// The map-based defragmenter, which has been replaced by the sliding window
+// of Defragmenter. It is only kept as reference for defragmentertest.
+class ReferenceDefragmenter
+{
+   // ====== Public Methods =================================================
+   public:
+   ReferenceDefragmenter();
+   ~ReferenceDefragmenter();
+
+   void print(std::ostream& os);
+
+   void addFragment(const unsigned long long       now,
+                    const NetPerfMeterDataMessage* dataMsg);
+   void purge(const unsigned long long now,
+              const unsigned long long defragmentTimeout,
+              size_t&                  receivedFrames,
+              size_t&                  lostFrames,
+              size_t&                  lostPackets,
+              size_t&                  lostBytes);
+
+
+   // ====== Private Data ===================================================
+   private:
+   // Fragments and frames are allocated from the buffer arena, in order to
+   // avoid a heap allocation per received packet.
+   struct ArenaObject
+   {
+      inline static void* operator new(size_t size) {
+         void* object = BufferArena::getBufferArena()->allocate(size);
+         if(object == NULL) {
+            throw std::bad_alloc();
+         }
+         return(object);
+      }
+      inline static void operator delete(void* object) {
+         BufferArena::getBufferArena()->release(object);
+      }
+   };
+   struct Fragment : public ArenaObject
+   {
+      uint64_t PacketSeqNumber;
+      uint64_t ByteSeqNumber;
+      uint16_t Length;
+      uint8_t  Flags;
+   };
+   typedef std::map<uint64_t, Fragment*, std::less<uint64_t>,
+                    ArenaAllocator<std::pair<const uint64_t, Fragment*> > > FragmentMap;
+   struct Frame : public ArenaObject
+   {
+      uint32_t                      FrameID;
+      unsigned long long            LastUpdate;
+      FragmentMap                   FragmentSet;
+      bool                          Completed;
+   };
+   typedef std::map<uint32_t, Frame*, std::less<uint32_t>,
+                    ArenaAllocator<std::pair<const uint32_t, Frame*> > >    FrameMap;
+
+   bool getFirstFragment(Frame*&    frame,
+                         Fragment*& fragment);
+   bool getNextFragment(Frame*&    frame,
+                        Fragment*& fragment,
+                        const bool eraseCurrentFrame);
+
+   FrameMap                                FrameSet;
+   FrameMap::iterator                      FrameIterator;
+   FragmentMap::iterator                   FragmentIterator;
+   uint64_t                                NextPacketSeqNumber;
+   uint64_t                                NextByteSeqNumber;
+   uint32_t                                NextFrameID;
+};
+
+#endif
@@ -0,0 +1,355 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "shmring.h"
+#include "tools.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include <iostream>
+#include <algorithm>
+
+
+#define SHMRING_MAGIC       0x4e504d53484d5247ULL   // "NPMSHMRG"
+#define SHMRING_SPIN_TRIALS 1000                    // before sleeping
+
+
+// ###### Constructor #######################################################
+ShmRing::ShmRing()
+{
+   Mapping     = NULL;
+   MappingSize = 0;
+   RingSize    = 0;
+   TxControl   = NULL;
+   TxData      = NULL;
+   RxControl   = NULL;
+   RxData      = NULL;
+}
+
+
+// ###### Destructor ########################################################
+ShmRing::~ShmRing()
+{
+   if(Mapping != NULL) {
+      munmap(Mapping, MappingSize);
+      Mapping = NULL;
+   }
+}
+
+
+// ###### Map shared memory #################################################
+bool ShmRing::map(const int fd, const size_t size, const bool isActiveSide)
+{
+   Mapping = (Header*)mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+   if(Mapping == (Header*)MAP_FAILED) {
+      Mapping = NULL;
+      return(false);
+   }
+   MappingSize = size;
+
+   char* ring0 = (char*)Mapping + sysconf(_SC_PAGESIZE);
+   if(isActiveSide) {
+      RingSize          = (size - sysconf(_SC_PAGESIZE)) / 2;
+      Mapping->Magic    = SHMRING_MAGIC;
+      Mapping->RingSize = RingSize;
+      for(unsigned int i = 0;i < 2;i++) {
+         Mapping->Ring[i].Head            = 0;
+         Mapping->Ring[i].Tail            = 0;
+         Mapping->Ring[i].ConsumerWaiting = 1;
+      }
+   }
+   else {
+      // The peer's settings are only trusted after validation: the ring
+      // size is used as mask, and Head/Tail must describe a valid fill level.
+      const uint64_t ringSize = Mapping->RingSize;
+      if( (Mapping->Magic != SHMRING_MAGIC) ||
+          (ringSize == 0) || ((ringSize & (ringSize - 1)) != 0) ||
+          (ringSize > (size - sysconf(_SC_PAGESIZE)) / 2) ) {
+         return(false);
+      }
+      for(unsigned int i = 0;i < 2;i++) {
+         if(Mapping->Ring[i].Head - Mapping->Ring[i].Tail > ringSize) {
+            return(false);
+         }
+      }
+      RingSize = ringSize;
+   }
+
+   TxControl = &Mapping->Ring[(isActiveSide == true) ? 0 : 1];
+   TxData    = ring0 + ((isActiveSide == true) ? 0 : RingSize);
+   RxControl = &Mapping->Ring[(isActiveSide == true) ? 1 : 0];
+   RxData    = ring0 + ((isActiveSide == true) ? RingSize : 0);
+   return(true);
+}
+
+
+// ###### Create shared memory and pass it to the peer #####################
+ShmRing* ShmRing::create(const int sd, const size_t ringSize)
+{
+   assert((ringSize & (ringSize - 1)) == 0);
+
+   // ====== Create anonymous shared memory object ==========================
+   static unsigned int counter = 0;
+   const std::string   name    = format("/netperfmeter-%u-%u", (unsigned int)getpid(), counter++);
+   const int fd = shm_open(name.c_str(), O_RDWR|O_CREAT|O_EXCL, 0600);
+   if(fd < 0) {
+      std::cerr << "ERROR: Unable to create shared memory - " << strerror(errno) << "!" << std::endl;
+      return(NULL);
+   }
+   shm_unlink(name.c_str());   // The descriptors keep the object alive.
+
+   const size_t size = sysconf(_SC_PAGESIZE) + 2 * ringSize;
+   ShmRing*     ring = NULL;
+   if(ftruncate(fd, size) == 0) {
+      ring = new ShmRing;
+      if(ring->map(fd, size, true) == false) {
+         delete ring;
+         ring = NULL;
+      }
+   }
+   if(ring == NULL) {
+      std::cerr << "ERROR: Unable to map shared memory - " << strerror(errno) << "!" << std::endl;
+      close(fd);
+      return(NULL);
+   }
+
+   // ====== Pass descriptor to peer ========================================
+   char     dummy = 0x00;
+   iovec    iov;
+   msghdr   msg;
+   char     control[CMSG_SPACE(sizeof(int))];
+   memset(&msg, 0, sizeof(msg));
+   memset(&control, 0, sizeof(control));
+   iov.iov_base       = &dummy;
+   iov.iov_len        = sizeof(dummy);
+   msg.msg_iov        = &iov;
+   msg.msg_iovlen     = 1;
+   msg.msg_control    = control;
+   msg.msg_controllen = sizeof(control);
+   cmsghdr* cmsg      = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level   = SOL_SOCKET;
+   cmsg->cmsg_type    = SCM_RIGHTS;
+   cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
+   memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+   const ssize_t sent = ext_sendmsg(sd, &msg, 0);
+   close(fd);
+   if(sent != sizeof(dummy)) {
+      std::cerr << "ERROR: Unable to pass shared memory to peer - " << strerror(errno) << "!" << std::endl;
+      delete ring;
+      return(NULL);
+   }
+   return(ring);
+}
+
+
+// ###### Attach to shared memory passed by the peer ########################
+// The socket has to be readable, i.e. the call does not block. Waiting for
+// the peer is up to the caller (see SHMRING_ATTACH_TIMEOUT).
+ShmRing* ShmRing::attach(const int sd)
+{
+   char     dummy;
+   iovec    iov;
+   msghdr   msg;
+   char     control[CMSG_SPACE(sizeof(int))];
+   memset(&msg, 0, sizeof(msg));
+   iov.iov_base       = &dummy;
+   iov.iov_len        = sizeof(dummy);
+   msg.msg_iov        = &iov;
+   msg.msg_iovlen     = 1;
+   msg.msg_control    = control;
+   msg.msg_controllen = sizeof(control);
+   if(ext_recvmsg(sd, &msg, MSG_DONTWAIT) != sizeof(dummy)) {
+      std::cerr << "ERROR: Unable to receive shared memory from peer - " << strerror(errno) << "!" << std::endl;
+      return(NULL);
+   }
+   const cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+   if( (cmsg == NULL) ||
+       (cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS) ) {
+      std::cerr << "ERROR: Peer did not pass shared memory!" << std::endl;
+      return(NULL);
+   }
+   int fd;
+   memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+   // ====== Map shared memory ==============================================
+   ShmRing*    ring = new ShmRing;
+   struct stat status;
+   if( (fstat(fd, &status) != 0) ||
+       (ring->map(fd, status.st_size, false) == false) ) {
+      std::cerr << "ERROR: Unable to map shared memory passed by peer!" << std::endl;
+      delete ring;
+      ring = NULL;
+   }
+   close(fd);
+   return(ring);
+}
+
+
+// ###### Copy data into transmit ring ######################################
+void ShmRing::copyIn(const uint64_t position, const void* data, const size_t length)
+{
+   const size_t offset = position & (RingSize - 1);
+   const size_t first  = std::min(length, RingSize - offset);
+   memcpy(&TxData[offset], data, first);
+   if(first < length) {
+      memcpy(&TxData[0], (const char*)data + first, length - first);
+   }
+}
+
+
+// ###### Copy data out of receive ring #####################################
+void ShmRing::copyOut(const uint64_t position, void* data, const size_t length)
+{
+   const size_t offset = position & (RingSize - 1);
+   const size_t first  = std::min(length, RingSize - offset);
+   memcpy(data, &RxData[offset], first);
+   if(first < length) {
+      memcpy((char*)data + first, &RxData[0], length - first);
+   }
+}
+
+
+// ###### Send message ######################################################
+ssize_t ShmRing::send(const int sd, const void* data, const size_t length)
+{
+   const uint32_t recordLength = length;
+   const uint64_t head         = TxControl->Head;
+   if(sizeof(recordLength) + length > RingSize) {
+      errno = EMSGSIZE;
+      return(-1);
+   }
+
+   // ====== Wait for space, like a blocking socket with send timeout =======
+   unsigned int       trials   = 0;
+   unsigned long long deadline = 0;
+   while(RingSize - (head - TxControl->Tail) < sizeof(recordLength) + length) {
+      if(++trials < SHMRING_SPIN_TRIALS) {
+         sched_yield();
+      }
+      else {
+         // A stalled receiver must not block the flow's thread forever.
+         const unsigned long long now = getMicroTime();
+         if(deadline == 0) {
+            deadline = now + (1000ULL * SHMRING_SEND_TIMEOUT);
+         }
+         else if(now >= deadline) {
+            errno = EAGAIN;
+            return(-1);
+         }
+
+         // Check for a closed peer, which would never consume anything.
+         pollfd pfd;
+         pfd.fd      = sd;
+         pfd.events  = 0;
+         pfd.revents = 0;
+         if( (ext_poll_wrapper(&pfd, 1, 1) > 0) &&
+             (pfd.revents & (POLLHUP|POLLERR|POLLNVAL)) ) {
+            errno = EPIPE;
+            return(-1);
+         }
+      }
+   }
+   __sync_synchronize();
+
+   // ====== Write record ===================================================
+   copyIn(head, &recordLength, sizeof(recordLength));
+   copyIn(head + sizeof(recordLength), data, length);
+   __sync_synchronize();
+   TxControl->Head = head + sizeof(recordLength) + length;
+   __sync_synchronize();
+
+   // ====== Ring doorbell, if consumer is waiting ==========================
+   if(__sync_lock_test_and_set(&TxControl->ConsumerWaiting, 0) != 0) {
+      const char doorbell = 0x00;
+      if( (ext_send(sd, &doorbell, sizeof(doorbell), MSG_DONTWAIT) < 0) &&
+          (errno != EAGAIN) ) {
+         return(-1);
+      }
+   }
+   return(length);
+}
+
+
+// ###### Receive message ###################################################
+ssize_t ShmRing::receive(const int sd, void* buffer, const size_t bufferSize)
+{
+   uint64_t tail = RxControl->Tail;
+   uint64_t head = RxControl->Head;
+
+   // ====== Ring is empty: wait for doorbell ===============================
+   if(head == tail) {
+      // The doorbell is only consumed when the ring is empty. Otherwise,
+      // remaining messages would not trigger poll() anymore.
+      RxControl->ConsumerWaiting = 1;
+      __sync_synchronize();
+      bool    closed = false;
+      char    doorbells[256];
+      ssize_t result;
+      while( (result = ext_recv(sd, &doorbells, sizeof(doorbells), MSG_DONTWAIT)) > 0 ) { }
+      if(result == 0) {
+         closed = true;
+      }
+      else if(errno != EAGAIN) {
+         return(-1);
+      }
+      head = RxControl->Head;
+      if(head == tail) {
+         if(closed) {
+            return(0);
+         }
+         errno = EAGAIN;
+         return(-1);
+      }
+   }
+   __sync_synchronize();
+
+   // ====== Read record ====================================================
+   // The producer is not trusted: the record has to be within the ring's
+   // filled part, which has to be within the ring.
+   const uint64_t filled = head - tail;
+   uint32_t       recordLength;
+   if( (filled > RingSize) || (filled < sizeof(recordLength)) ) {
+      errno = EPROTO;
+      return(-1);
+   }
+   copyOut(tail, &recordLength, sizeof(recordLength));
+   if( (recordLength == 0) || (recordLength > filled - sizeof(recordLength)) ) {
+      errno = EPROTO;
+      return(-1);
+   }
+   if(recordLength > bufferSize) {
+      errno = EMSGSIZE;
+      return(-1);
+   }
+   copyOut(tail + sizeof(recordLength), buffer, recordLength);
+   __sync_synchronize();
+   RxControl->Tail = tail + sizeof(recordLength) + recordLength;
+   return(recordLength);
+}
@@ -0,0 +1,94 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <sys/types.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Size of each direction's ring (must be a power of 2)
+#define SHMRING_DEFAULT_SIZE   (4 * 1024 * 1024)
+
+// Time for the active side to pass the shared memory (in us)
+#define SHMRING_ATTACH_TIMEOUT 5000000ULL
+
+// Time a sender waits for space in a full ring before giving up (in ms)
+#define SHMRING_SEND_TIMEOUT   1000
+
+
+// A shared-memory ring pair between active and passive side of a flow on
+// the same host. Messages are copied into a single-producer/single-consumer
+// byte ring; the flow's AF_UNIX stream socket is only used as doorbell, i.e.
+// a byte is written when the consumer is waiting for new data. The active
+// side creates the shared memory and passes it to the passive side via
+// SCM_RIGHTS.
+class ShmRing
+{
+   // ====== Public Methods =================================================
+   public:
+   ~ShmRing();
+
+   static ShmRing* create(const int sd, const size_t ringSize = SHMRING_DEFAULT_SIZE);
+   static ShmRing* attach(const int sd);
+
+   ssize_t send(const int sd, const void* data, const size_t length);
+   ssize_t receive(const int sd, void* buffer, const size_t bufferSize);
+
+
+   // ====== Private Methods ================================================
+   private:
+   struct Control {
+      volatile uint64_t Head;                 // Written by producer only
+      char              Pad1[64 - sizeof(uint64_t)];
+      volatile uint64_t Tail;                 // Written by consumer only
+      char              Pad2[64 - sizeof(uint64_t)];
+      volatile uint32_t ConsumerWaiting;      // Consumer needs a doorbell
+      char              Pad3[64 - sizeof(uint32_t)];
+   };
+   struct Header {
+      uint64_t Magic;
+      uint64_t RingSize;
+      char     Pad[64 - 2 * sizeof(uint64_t)];
+      Control  Ring[2];                       // 0: active->passive, 1: passive->active
+   };
+
+   ShmRing();
+   bool map(const int fd, const size_t size, const bool isActiveSide);
+   void copyIn(const uint64_t position, const void* data, const size_t length);
+   void copyOut(const uint64_t position, void* data, const size_t length);
+
+
+   // ====== Private Data ===================================================
+   Header*  Mapping;
+   size_t   MappingSize;
+   size_t   RingSize;
+   Control* TxControl;
+   char*    TxData;
+   Control* RxControl;
+   char*    RxData;
+};
+
+#endif
@@ -22,9 +22,17 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <alloca.h>
 #include <iostream>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include "thread.h"
 
@@ -34,7 +42,15 @@ Thread::Thread()
 {
    MyThread = 0;
    lock();
-   Stopping = false;
+   Stopping                   = false;
+   CurrentCPU                 = -1;
+   SchedulingPolicy           = SCHED_OTHER;
+   SchedulingPriority         = 0;
+   StackPrefault              = 0;
+   PrefaultPending            = false;
+   ThreadID                   = 0;
+   VoluntaryContextSwitches   = 0;
+   InvoluntaryContextSwitches = 0;
    unlock();
 }
 
@@ -52,11 +68,65 @@ Thread::~Thread()
 void* Thread::startRoutine(void* object)
 {
    Thread* thread = (Thread*)object;
+   thread->lock();
+#ifdef __linux__
+   thread->ThreadID = (pid_t)syscall(SYS_gettid);
+#endif
+   thread->PrefaultPending = true;
+   thread->unlock();
+   thread->updateCurrentCPU();
+   thread->prefaultStack();
+
    thread->run();
+
+   // ====== Keep the thread's statistics ===================================
+   thread->updateCurrentCPU();
+   unsigned long long voluntary;
+   unsigned long long involuntary;
+   thread->lock();
+   if(readContextSwitches(thread->ThreadID, voluntary, involuntary)) {
+      thread->VoluntaryContextSwitches   += voluntary;
+      thread->InvoluntaryContextSwitches += involuntary;
+   }
+   thread->ThreadID = 0;
+   thread->unlock();
    return(NULL);
 }
 
 
+// ###### Initialize thread attributes #####################################
+bool Thread::initializeAttributes(pthread_attr_t* attr,
+                                  const bool      withScheduling)
+{
+   if(pthread_attr_init(attr) != 0) {
+      return(false);
+   }
+#ifdef __linux__
+   if(CPUAffinity.size() > 0) {
+      cpu_set_t cpuSet;
+      CPU_ZERO(&cpuSet);
+      for(size_t i = 0;i < CPUAffinity.size();i++) {
+         CPU_SET(CPUAffinity[i], &cpuSet);
+      }
+      if(pthread_attr_setaffinity_np(attr, sizeof(cpuSet), &cpuSet) != 0) {
+         std::cerr << "WARNING: Unable to set CPU affinity for new thread!" << std::endl;
+      }
+   }
+#endif
+   if( (withScheduling) && (SchedulingPolicy != SCHED_OTHER) ) {
+      sched_param param;
+      memset(&param, 0, sizeof(param));
+      param.sched_priority = SchedulingPriority;
+      if( (pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED) != 0) ||
+          (pthread_attr_setschedpolicy(attr, SchedulingPolicy) != 0) ||
+          (pthread_attr_setschedparam(attr, &param) != 0) ) {
+         std::cerr << "WARNING: Unable to set scheduling parameters for new thread!" << std::endl;
+      }
+   }
+   return(true);
+}
+
+
 // ###### Start thread ######################################################
 bool Thread::start()
 {
@@ -64,7 +134,28 @@ bool Thread::start()
       lock();
       Stopping = false;
       unlock();
-      if(pthread_create(&MyThread, NULL, startRoutine, (void*)this) == 0) {
+
+      pthread_attr_t attr;
+      int            result = EINVAL;
+      if(initializeAttributes(&attr, true)) {
+         result = pthread_create(&MyThread, &attr, startRoutine, (void*)this);
+         pthread_attr_destroy(&attr);
+         if( (result == EPERM) && (SchedulingPolicy != SCHED_OTHER) ) {
+            // Not permitted to use the real-time scheduling class
+            // => fall back to the default scheduling class.
+            static bool warned = false;
+            if(!warned) {
+               std::cerr << "WARNING: Not permitted to use real-time scheduling (needs CAP_SYS_NICE or RLIMIT_RTPRIO)! "
+                            "Using default scheduling instead." << std::endl;
+               warned = true;
+            }
+            if(initializeAttributes(&attr, false)) {
+               result = pthread_create(&MyThread, &attr, startRoutine, (void*)this);
+               pthread_attr_destroy(&attr);
+            }
+         }
+      }
+      if(result == 0) {
          return(true);
       }
       MyThread = 0;
@@ -96,6 +187,204 @@ void Thread::waitForFinish()
 }
 
 
+// ###### Apply CPU affinity to given thread ################################
+bool Thread::applyCPUAffinity(pthread_t                        thread,
+                              const std::vector<unsigned int>& cpus)
+{
+#ifdef __linux__
+   cpu_set_t cpuSet;
+   CPU_ZERO(&cpuSet);
+   if(cpus.size() > 0) {
+      for(size_t i = 0;i < cpus.size();i++) {
+         CPU_SET(cpus[i], &cpuSet);
+      }
+   }
+   else {
+      // Empty set: allow all CPUs again
+      for(unsigned int i = 0;i < CPU_SETSIZE;i++) {
+         CPU_SET(i, &cpuSet);
+      }
+   }
+   const int result = pthread_setaffinity_np(thread, sizeof(cpuSet), &cpuSet);
+   if(result != 0) {
+      std::cerr << "WARNING: Unable to set CPU affinity - "
+                << strerror(result) << "!" << std::endl;
+      return(false);
+   }
+   return(true);
+#else
+   if(cpus.size() > 0) {
+      std::cerr << "WARNING: CPU affinity is not supported on this platform!" << std::endl;
+   }
+   return(cpus.size() == 0);
+#endif
+}
+
+
+// ###### Set CPU affinity ##################################################
+bool Thread::setCPUAffinity(const std::vector<unsigned int>& cpus)
+{
+   bool success = true;
+   lock();
+   CPUAffinity = cpus;
+   if(MyThread != 0) {
+      // The thread is already running -> change its affinity immediately
+      success = applyCPUAffinity(MyThread, CPUAffinity);
+   }
+   unlock();
+   return(success);
+}
+
+
+// ###### Set CPU affinity of calling thread ################################
+bool Thread::setCPUAffinityOfCaller(const std::vector<unsigned int>& cpus)
+{
+   return(applyCPUAffinity(pthread_self(), cpus));
+}
+
+
+// ###### Get CPU the calling thread is running on ##########################
+int Thread::getCPUOfCaller()
+{
+#ifdef __linux__
+   return(sched_getcpu());
+#else
+   return(-1);
+#endif
+}
+
+
+// ###### Get kernel thread ID of calling thread ############################
+pid_t Thread::getThreadIDOfCaller()
+{
+#ifdef __linux__
+   return((pid_t)syscall(SYS_gettid));
+#else
+   return(0);
+#endif
+}
+
+
+// ###### Remember the CPU the thread is currently running on ###############
+void Thread::updateCurrentCPU()
+{
+   const int currentCPU = getCPUOfCaller();
+   lock();
+   CurrentCPU = currentCPU;
+   unlock();
+}
+
+
+// ###### Set scheduling class and priority #################################
+bool Thread::setScheduling(const int policy, const int priority)
+{
+   bool success = true;
+   lock();
+   SchedulingPolicy   = policy;
+   SchedulingPriority = priority;
+   if(MyThread != 0) {
+      // The thread is already running -> change its scheduling immediately
+      sched_param param;
+      memset(&param, 0, sizeof(param));
+      param.sched_priority = priority;
+      const int result = pthread_setschedparam(MyThread, policy, &param);
+      if(result != 0) {
+         std::cerr << "WARNING: Unable to set scheduling parameters - "
+                   << strerror(result) << "! Using default scheduling instead." << std::endl;
+         success = false;
+      }
+   }
+   unlock();
+   return(success);
+}
+
+
+// ###### Set amount of stack to prefault at thread start ###################
+void Thread::setStackPrefault(const size_t bytes)
+{
+   lock();
+   StackPrefault   = bytes;
+   PrefaultPending = (bytes > 0);
+   unlock();
+}
+
+
+// ###### Touch the stack pages the thread is going to use ##################
+void Thread::prefaultStack()
+{
+   lock();
+   const size_t bytes = (PrefaultPending) ? StackPrefault : 0;
+   PrefaultPending = false;
+   unlock();
+
+   if(bytes > 0) {
+      // NOTE: The region is located below the caller's stack frame, i.e.
+      //       where the frames of the subsequently called functions will be.
+      const size_t   pageSize = (size_t)sysconf(_SC_PAGESIZE);
+      volatile char* stack    = (volatile char*)alloca(bytes);
+      for(size_t i = 0;i < bytes;i += pageSize) {
+         stack[i] = 0;
+      }
+   }
+}
+
+
+// ###### Read context switch counters of a thread ##########################
+bool Thread::readContextSwitches(const pid_t         threadID,
+                                 unsigned long long& voluntary,
+                                 unsigned long long& involuntary)
+{
+   bool success = false;
+   voluntary    = 0;
+   involuntary  = 0;
+#ifdef __linux__
+   if(threadID != 0) {
+      char fileName[64];
+      snprintf((char*)&fileName, sizeof(fileName), "/proc/self/task/%d/status", (int)threadID);
+      FILE* fh = fopen(fileName, "r");
+      if(fh != NULL) {
+         char line[256];
+         unsigned int found = 0;
+         while(fgets((char*)&line, sizeof(line), fh) != NULL) {
+            if(sscanf(line, "voluntary_ctxt_switches: %llu", &voluntary) == 1) {
+               found++;
+            }
+            else if(sscanf(line, "nonvoluntary_ctxt_switches: %llu", &involuntary) == 1) {
+               found++;
+            }
+         }
+         fclose(fh);
+         success = (found == 2);
+      }
+   }
+#endif
+   return(success);
+}
+
+
+// ###### Get context switch counters of the thread #########################
+void Thread::getContextSwitches(unsigned long long& voluntary,
+                                unsigned long long& involuntary)
+{
+   lock();
+   if(!readContextSwitches(ThreadID, voluntary, involuntary)) {
+      voluntary   = 0;
+      involuntary = 0;
+   }
+   voluntary   += VoluntaryContextSwitches;
+   involuntary += InvoluntaryContextSwitches;
+   unlock();
+}
+
+
+// ###### Get context switch counters of the calling thread #################
+bool Thread::getContextSwitchesOfCaller(unsigned long long& voluntary,
+                                        unsigned long long& involuntary)
+{
+   return(readContextSwitches(getThreadIDOfCaller(), voluntary, involuntary));
+}
+
+
 // ###### Wait a given amount of microseconds ###############################
 void Thread::delay(const unsigned int us)
 {
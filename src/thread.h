@@ -26,6 +26,11 @@
 
 #include "mutex.h"
 
+#include <sys/types.h>
+#include <sched.h>
+
+#include <vector>
+
 
 class Thread : public Mutex
 {
@@ -47,18 +52,57 @@ class Thread : public Mutex
    virtual void stop();
    void waitForFinish();
 
+   bool setCPUAffinity(const std::vector<unsigned int>& cpus);
+   inline const std::vector<unsigned int>& getCPUAffinity() const {
+      return(CPUAffinity);
+   }
+   inline int getCurrentCPU() {
+      lock();
+      const int currentCPU = CurrentCPU;
+      unlock();
+      return(currentCPU);
+   }
+
+   bool setScheduling(const int policy, const int priority);
+   void setStackPrefault(const size_t bytes);
+   void getContextSwitches(unsigned long long& voluntary,
+                           unsigned long long& involuntary);
+
    static void delay(const unsigned int us);
+   static bool setCPUAffinityOfCaller(const std::vector<unsigned int>& cpus);
+   static int getCPUOfCaller();
+   static pid_t getThreadIDOfCaller();
+   static bool getContextSwitchesOfCaller(unsigned long long& voluntary,
+                                          unsigned long long& involuntary);
+   static bool readContextSwitches(const pid_t         threadID,
+                                   unsigned long long& voluntary,
+                                   unsigned long long& involuntary);
 
    protected:
    virtual void run() = 0;
+   void updateCurrentCPU();
+   void prefaultStack();
 
    protected:
    pthread_t MyThread;
 
    private:
    static void* startRoutine(void* object);
+   static bool applyCPUAffinity(pthread_t                        thread,
+                                const std::vector<unsigned int>& cpus);
+   bool initializeAttributes(pthread_attr_t* attr,
+                             const bool      withScheduling);
 
-   bool         Stopping;
+   bool                      Stopping;
+   std::vector<unsigned int> CPUAffinity;        // Empty set: no affinity
+   int                       CurrentCPU;         // CPU last seen by the thread
+   int                       SchedulingPolicy;   // SCHED_OTHER/FIFO/RR
+   int                       SchedulingPriority;
+   size_t                    StackPrefault;      // Stack bytes to prefault
+   bool                      PrefaultPending;
+   pid_t                     ThreadID;           // Kernel thread ID (Linux)
+   unsigned long long        VoluntaryContextSwitches;     // Of finished runs
+   unsigned long long        InvoluntaryContextSwitches;   // Of finished runs
 };
 
 #endif
@@ -22,6 +22,8 @@
  */
 
 #include "tools.h"
+#include "mptcpinfo.h"
+#include "empiricaldistribution.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,6 +41,7 @@
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <sys/uio.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <net/if.h>
@@ -518,11 +521,29 @@ const char* getProtocolName(const uint8_t protocol)
          protocolName = "DCCP";
          break;
 #endif
+      case IPPROTO_UNIX_STREAM:
+         protocolName = "UNIX-Stream";
+         break;
+      case IPPROTO_UNIX_SEQPACKET:
+         protocolName = "UNIX-SeqPacket";
+         break;
+      case IPPROTO_SHM:
+         protocolName = "SHM";
+         break;
    }
    return(protocolName);
 }
 
 
+/* ###### Is protocol a local (AF_UNIX-based) pseudo-protocol? ########### */
+bool isLocalProtocol(const uint8_t protocol)
+{
+   return( (protocol == IPPROTO_UNIX_STREAM)    ||
+           (protocol == IPPROTO_UNIX_SEQPACKET) ||
+           (protocol == IPPROTO_SHM) );
+}
+
+
 /* ###### Get port ####################################################### */
 uint16_t getPort(const struct sockaddr* address)
 {
@@ -579,6 +600,13 @@ int createSocket(const int             family,
    int socketProtocol = protocol;
 #ifdef HAVE_MPTCP
    if(socketProtocol == IPPROTO_MPTCP) {
+      // ====== Upstream Linux MPTCP ========================================
+      const int sd = createUpstreamMPTCPSocket(socketFamily, type);
+      if(sd >= 0) {
+         return(sd);
+      }
+
+      // ====== Out-of-tree MPTCP: TCP socket with MPTCP_ENABLED ============
       socketProtocol = IPPROTO_TCP;
       if(localAddresses > 1) {
          printf("WARNING: Currently, MPTCP does not support TCP_MULTIPATH_ADD. Binding to ANY address instead ...\n");
@@ -659,7 +687,8 @@ int bindSocket(const int             sd,
 #ifndef __linux__
 #warning MPTCP is currently only available on Linux!
 #else
-   if((protocol == IPPROTO_MPTCP) || (protocol == IPPROTO_TCP)) {
+   if( ((protocol == IPPROTO_MPTCP) && (!isUpstreamMPTCPSocket(sd))) ||
+       (protocol == IPPROTO_TCP) ) {
       const int cmtOnOff = (protocol == IPPROTO_MPTCP);
       if(ext_setsockopt(sd, IPPROTO_TCP, MPTCP_ENABLED_LEGACY, &cmtOnOff, sizeof(cmtOnOff)) < 0) {
          if(ext_setsockopt(sd, IPPROTO_TCP, MPTCP_ENABLED, &cmtOnOff, sizeof(cmtOnOff)) < 0) {
@@ -725,7 +754,7 @@ int bindSocket(const int             sd,
 
    // ====== Put socket into listening mode =================================
    if(listenMode) {
-      ext_listen(sd, 10);
+      ext_listen(sd, SOMAXCONN);
    }
    return(sd);
 }
@@ -739,11 +768,23 @@ int createAndBindSocket(const int             family,
                         const unsigned int    localAddresses,
                         const sockaddr_union* localAddressArray,
                         const bool            listenMode,
-                        const bool            bindV6Only)
+                        const bool            bindV6Only,
+                        const bool            reusePort)
 {
    int sd = createSocket(family, type, protocol,
                          localAddresses, localAddressArray);
    if(sd >= 0) {
+#ifdef SO_REUSEPORT
+      /* Several sockets may share the port, the kernel distributes the
+         incoming packets among them. */
+      if(reusePort) {
+         const int on = 1;
+         if(ext_setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+            ext_close(sd);
+            return(-1);
+         }
+      }
+#endif
       const int success = bindSocket(sd, family, type, protocol,
                                      localPort, localAddresses, localAddressArray,
                                      listenMode, bindV6Only);
@@ -756,6 +797,59 @@ int createAndBindSocket(const int             family,
 }
 
 
+/* ###### Get AF_UNIX socket path for a local pseudo-protocol ########### */
+std::string getUnixSocketPath(const char*    directory,
+                              const uint16_t port,
+                              const uint8_t  protocol)
+{
+   const char* suffix = "stream";
+   if(protocol == IPPROTO_UNIX_SEQPACKET) {
+      suffix = "seqpacket";
+   }
+   else if(protocol == IPPROTO_SHM) {
+      suffix = "shm";
+   }
+   return(format("%s/netperfmeter-%u.%s", directory, port, suffix));
+}
+
+
+/* ###### Create AF_UNIX socket and bind or connect it ################### */
+int createUnixSocket(const uint8_t protocol,
+                     const char*   path,
+                     const bool    listenMode)
+{
+   sockaddr_un address;
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   if(strlen(path) >= sizeof(address.sun_path)) {
+      errno = ENAMETOOLONG;
+      return(-1);
+   }
+   safestrcpy((char*)&address.sun_path, path, sizeof(address.sun_path));
+
+   // SHM flows use a stream socket as doorbell.
+   const int type = (protocol == IPPROTO_UNIX_SEQPACKET) ? SOCK_SEQPACKET : SOCK_STREAM;
+   const int sd   = ext_socket(AF_UNIX, type, 0);
+   if(sd >= 0) {
+      if(listenMode) {
+         unlink(path);
+         if( (ext_bind(sd, (sockaddr*)&address, sizeof(address)) < 0) ||
+             (ext_listen(sd, 10) < 0) ) {
+            ext_close(sd);
+            return(-1);
+         }
+      }
+      else {
+         if(ext_connect(sd, (sockaddr*)&address, sizeof(address)) < 0) {
+            ext_close(sd);
+            return(-1);
+         }
+      }
+   }
+   return(sd);
+}
+
+
 /* ###### Send SCTP ABORT ################################################ */
 bool sendAbort(int sd, sctp_assoc_t assocID)
 {
@@ -1062,6 +1156,9 @@ double getRandomValue(const double* valueArray, const uint8_t rng)
       case RANDOM_PARETO:
          value = randomParetoDouble(valueArray[0], valueArray[1]);
        break;
+      case RANDOM_EMPIRICAL:
+         value = EmpiricalDistribution::sample((unsigned int)valueArray[1]);
+       break;
       default:
          value = 0.0;   // Avoids warning of uninitialized variable.
          assert(false);
@@ -1083,6 +1180,8 @@ const char* getRandomGeneratorName(const uint8_t rng)
          return("uniform");
       case RANDOM_PARETO:
          return("pareto");
+      case RANDOM_EMPIRICAL:
+         return("empirical");
    }
    return("(invalid!)");
 }
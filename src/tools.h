@@ -45,8 +45,22 @@
 #include <iostream>
 
 
-/* MPTCP as "pseudo-protocol". Just for internal representation. */
-#define IPPROTO_MPTCP IPPROTO_EGP
+/* MPTCP as "pseudo-protocol". Just for internal representation.
+   NOTE: Newer C libraries define IPPROTO_MPTCP as the upstream Linux
+         protocol number, which does not fit into the 8-bit protocol field
+         of the control protocol. */
+#ifdef IPPROTO_MPTCP
+#undef IPPROTO_MPTCP
+#endif
+#define IPPROTO_MPTCP        IPPROTO_EGP
+#define IPPROTO_MPTCP_KERNEL 262   /* Upstream Linux MPTCP socket protocol */
+
+/* Local baseline transports as "pseudo-protocols". Values are from the
+   range for experimentation and testing (RFC 3692), plus one unassigned
+   value. They are only used for internal representation. */
+#define IPPROTO_UNIX_STREAM    253
+#define IPPROTO_UNIX_SEQPACKET 254
+#define IPPROTO_SHM            252
 
 /* FIXME: This is ugly, but currently the only way to easily get the #defines for Linux MPTCP! */
 #define MPTCP_ENABLED               42
@@ -114,6 +128,13 @@ void printAddress(std::ostream&          os,
                   const bool             hideScope = false);
 
 const char* getProtocolName(const uint8_t protocol);
+bool isLocalProtocol(const uint8_t protocol);
+std::string getUnixSocketPath(const char*    directory,
+                              const uint16_t port,
+                              const uint8_t  protocol);
+int createUnixSocket(const uint8_t protocol,
+                     const char*   path,
+                     const bool    listenMode);
 uint16_t getPort(const struct sockaddr* address);
 bool setPort(struct sockaddr* address, uint16_t port);
 bool sendAbort(int sd, sctp_assoc_t assocID = 0);
@@ -138,7 +159,8 @@ int createAndBindSocket(const int             family,
                         const unsigned int    localAddresses,
                         const sockaddr_union* localAddressArray,
                         const bool            listenMode,
-                        const bool            bindV6Only);
+                        const bool            bindV6Only,
+                        const bool            reusePort = false);
 uint64_t hton64(const uint64_t value);
 uint64_t ntoh64(const uint64_t value);
 
@@ -159,6 +181,7 @@ void sendBreak(const bool quiet);
 #define RANDOM_UNIFORM     1
 #define RANDOM_EXPONENTIAL 2
 #define RANDOM_PARETO      3
+#define RANDOM_EMPIRICAL   4   // ValueArray: mean, distribution identifier
 
 const char* getRandomGeneratorName(const uint8_t rng);
 double getRandomValue(const double* valueArray, const uint8_t rng);
@@ -25,10 +25,19 @@
 #include "control.h"
 #include "tools.h"
 #include "netperfmeterpackets.h"
+#include "bufferarena.h"
+#include "udpreceiveworker.h"
+#include "receiveworker.h"
 
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/sockios.h>
+#include <netinet/udp.h>
+#endif
 #include <iostream>
 
 
@@ -39,9 +48,49 @@ static void updateStatistics(Flow*                          flowSpec,
 
 extern unsigned int gOutputVerbosity;
 
-#define MAXIMUM_MESSAGE_SIZE (size_t)65536
+#define MAXIMUM_MESSAGE_SIZE (size_t)FLOW_SEND_BUFFER_SIZE
 #define MAXIMUM_PAYLOAD_SIZE (MAXIMUM_MESSAGE_SIZE - sizeof(NetPerfMeterDataMessage))
 
+#define TRAIN_SEND_BATCH_SIZE 64   // Packets per sendmmsg() call of a train
+
+#ifdef __linux__
+#define UDP_RECEIVE_BATCH_SIZE 32
+
+struct UDPReceiveBatch {
+   mmsghdr        Messages[UDP_RECEIVE_BATCH_SIZE];
+   iovec          IOVecs[UDP_RECEIVE_BATCH_SIZE];
+   sockaddr_union Addresses[UDP_RECEIVE_BATCH_SIZE];
+   char           Control[UDP_RECEIVE_BATCH_SIZE][CMSG_SPACE(sizeof(timeval)) +
+                                                  CMSG_SPACE(sizeof(int))];
+   char*          Buffer;
+};
+static __thread UDPReceiveBatch* MyUDPReceiveBatch = NULL;
+static pthread_once_t            UDPReceiveBatchKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t             UDPReceiveBatchKey;
+
+
+// ###### Free a terminating thread's UDP receive batch ######################
+static void destroyUDPReceiveBatch(void* data)
+{
+   UDPReceiveBatch* batch = (UDPReceiveBatch*)data;
+   delete [] batch->Buffer;
+   delete batch;
+   MyUDPReceiveBatch = NULL;
+}
+
+
+// ###### Create key for the UDP receive batches ############################
+static void createUDPReceiveBatchKey()
+{
+   const int result = pthread_key_create(&UDPReceiveBatchKey, destroyUDPReceiveBatch);
+   assert(result == 0);
+}
+#endif
+
+// This is only updated with the FlowManager locked. UDP receive workers
+// have their own counters.
+static UDPReceiveStatistics gUDPReceiveStatistics = { 0, 0, 0, 0 };
+
 
 // ###### Generate payload pattern ##########################################
 static void fillPayload(unsigned char* payload, const size_t length)
@@ -56,25 +105,21 @@ static void fillPayload(unsigned char* payload, const size_t length)
 }
 
 
-// ###### Send NETPERFMETER_DATA message ####################################
-ssize_t sendNetPerfMeterData(Flow*                    flow,
-                             const uint32_t           frameID,
-                             const bool               isFrameBegin,
-                             const bool               isFrameEnd,
-                             const unsigned long long now,
-                             size_t                   bytesToSend)
+// ###### Prepare NETPERFMETER_DATA message #################################
+static void prepareNetPerfMeterData(Flow*                    flow,
+                                    NetPerfMeterDataMessage* dataMsg,
+                                    const uint32_t           frameID,
+                                    const bool               isFrameBegin,
+                                    const bool               isFrameEnd,
+                                    const unsigned long long now,
+                                    const size_t             bytesToSend,
+                                    const uint64_t           byteSeqNumber,
+                                    const uint8_t            rpcFlags,
+                                    const uint16_t           parameter)
 {
-   char                     outputBuffer[MAXIMUM_MESSAGE_SIZE];
-   NetPerfMeterDataMessage* dataMsg = (NetPerfMeterDataMessage*)&outputBuffer;
-
-   if(bytesToSend < sizeof(NetPerfMeterDataMessage)) {
-      bytesToSend = sizeof(NetPerfMeterDataMessage);
-   }
-
-   // ====== Prepare NETPERFMETER_DATA message ==============================
    // ------ Create header --------------------------------
    dataMsg->Header.Type   = NETPERFMETER_DATA;
-   dataMsg->Header.Flags  = 0x00;
+   dataMsg->Header.Flags  = rpcFlags;
    if(isFrameBegin) {
       dataMsg->Header.Flags |= NPMDF_FRAME_BEGIN;
    }
@@ -85,15 +130,117 @@ ssize_t sendNetPerfMeterData(Flow*                    flow,
    dataMsg->MeasurementID = hton64(flow->getMeasurementID());
    dataMsg->FlowID        = htonl(flow->getFlowID());
    dataMsg->StreamID      = htons(flow->getStreamID());
-   dataMsg->Padding       = 0x0000;
+   dataMsg->Parameter     = htons(parameter);
    dataMsg->FrameID       = htonl(frameID);
    dataMsg->SeqNumber     = hton64(flow->nextOutboundSeqNumber());
-   dataMsg->ByteSeqNumber = hton64(flow->getCurrentBandwidthStats().TransmittedBytes);
+   dataMsg->ByteSeqNumber = hton64(byteSeqNumber);
    dataMsg->TimeStamp     = hton64(now);
 
    // ------ Create payload data pattern ------------------
    fillPayload((unsigned char*)&dataMsg->Payload,
                bytesToSend - sizeof(NetPerfMeterDataMessage));
+}
+
+
+// ###### Send datagram over the flow's socket (UDP or DCCP) ###############
+static ssize_t sendDatagram(Flow* flow, const char* data, const size_t length)
+{
+   if( (flow->getTrafficSpec().Protocol == IPPROTO_UDP) && (flow->isRemoteAddressValid()) ) {
+      return(ext_sendto(flow->getSocketDescriptor(),
+                        data, length, 0,
+                        flow->getRemoteAddress(),
+                        getSocklen(flow->getRemoteAddress())));
+   }
+   return(ext_send(flow->getSocketDescriptor(), data, length, 0));
+}
+
+
+// ###### Send datagram through the flow's impairment stage #################
+// Dropped datagrams count as sent, so that the receiver's loss statistics
+// can be compared with the impairment counters.
+static ssize_t sendImpairedDatagram(Flow*                    flow,
+                                    const char*              data,
+                                    const size_t             length,
+                                    const unsigned long long now)
+{
+   Impairment* impairment = flow->getImpairment();
+   if(impairment->dropPacket()) {
+      return(length);
+   }
+
+   // A held packet is released after the next packet, i.e. not after its
+   // own duplicate. Only one copy of a packet is held back.
+   ssize_t      sent    = length;
+   const bool   holding = impairment->hasHeldPacket();
+   const size_t copies  = (impairment->duplicatePacket()) ? 2 : 1;
+   for(size_t i = 0;i < copies;i++) {
+      // ====== Hold back for reordering ====================================
+      if( (i == 0) && (impairment->reorderPacket()) ) {
+         impairment->hold(now, data, length);
+         continue;
+      }
+
+      // ====== Send now or through the timer queue =========================
+      const unsigned long long delay = impairment->getDelay();
+      if(delay > 0) {
+         impairment->enqueue(now + delay, data, length);
+      }
+      else {
+         sent = sendDatagram(flow, data, length);
+      }
+
+      // ====== A held packet follows its successor =========================
+      std::string packet;
+      if( (holding) && (impairment->unhold(packet)) ) {
+         if(delay > 0) {
+            impairment->enqueue(now + delay, packet.data(), packet.size());
+         }
+         else {
+            sendDatagram(flow, packet.data(), packet.size());
+         }
+      }
+   }
+   return(sent);
+}
+
+
+// ###### Send datagrams released by the impairment's timer queue ###########
+void releaseImpairedDatagrams(Flow* flow, const unsigned long long now)
+{
+   Impairment* impairment = flow->getImpairment();
+   std::string packet;
+   while(impairment->dequeue(now, packet)) {
+      sendDatagram(flow, packet.data(), packet.size());
+   }
+}
+
+
+// ###### Send NETPERFMETER_DATA message ####################################
+ssize_t sendNetPerfMeterData(Flow*                    flow,
+                             const uint32_t           frameID,
+                             const bool               isFrameBegin,
+                             const bool               isFrameEnd,
+                             const unsigned long long now,
+                             size_t                   bytesToSend,
+                             const int                sd,
+                             const uint8_t            rpcFlags,
+                             const uint16_t           parameter)
+{
+   // A churn connection (sd >= 0) is used instead of the flow's socket.
+   const int socketDescriptor = (sd >= 0) ? sd : flow->getSocketDescriptor();
+
+   char*                    outputBuffer = flow->getSendBuffer();
+   NetPerfMeterDataMessage* dataMsg      = (NetPerfMeterDataMessage*)outputBuffer;
+
+   if(bytesToSend < sizeof(NetPerfMeterDataMessage)) {
+      bytesToSend = sizeof(NetPerfMeterDataMessage);
+   }
+
+   // ====== Prepare NETPERFMETER_DATA message ==============================
+   prepareNetPerfMeterData(flow, dataMsg, frameID, isFrameBegin, isFrameEnd,
+                           now, bytesToSend,
+                           flow->getCurrentBandwidthStats().TransmittedBytes,
+                           rpcFlags, parameter);
 
    // ====== Send NETPERFMETER_DATA message =================================
    ssize_t sent;
@@ -128,29 +275,37 @@ ssize_t sendNetPerfMeterData(Flow*                    flow,
             sinfo.sinfo_flags |= SCTP_UNORDERED;
          }
       }
-      sent = sctp_send(flow->getSocketDescriptor(),
-                       (char*)&outputBuffer, bytesToSend,
+      sent = sctp_send(socketDescriptor,
+                       outputBuffer, bytesToSend,
                        &sinfo, 0);
    }
+   else if( (flow->getImpairment() != NULL) && (sd < 0) ) {
+      sent = sendImpairedDatagram(flow, outputBuffer, bytesToSend, now);
+   }
    else if(flow->getTrafficSpec().Protocol == IPPROTO_UDP) {
       if(flow->isRemoteAddressValid()) {
          sent = ext_sendto(flow->getSocketDescriptor(),
-                           (char*)&outputBuffer, bytesToSend, 0,
+                           outputBuffer, bytesToSend, 0,
                            flow->getRemoteAddress(),
                            getSocklen(flow->getRemoteAddress()));
       }
       else {
          sent = ext_send(flow->getSocketDescriptor(),
-                         (char*)&outputBuffer, bytesToSend, 0);
+                         outputBuffer, bytesToSend, 0);
       }
    }
+   else if(flow->getTrafficSpec().Protocol == IPPROTO_SHM) {
+      sent = flow->getShmRing()->send(flow->getSocketDescriptor(),
+                                      outputBuffer, bytesToSend);
+   }
    else {
-      sent = ext_send(flow->getSocketDescriptor(), (char*)&outputBuffer, bytesToSend, 0);
+      sent = ext_send(socketDescriptor, outputBuffer, bytesToSend, 0);
    }
 
    // ====== Check, whether flow has been aborted unintentionally ===========
    if((sent < 0) &&
       (errno != EAGAIN) &&
+      (sd < 0) &&
       (!flow->isAcceptedIncomingFlow()) &&
       (flow->getTrafficSpec().ErrorOnAbort) &&
       (flow->getOutputStatus() == Flow::On)) {
@@ -163,23 +318,18 @@ ssize_t sendNetPerfMeterData(Flow*                    flow,
 }
 
 
-// ###### Transmit data frame ###############################################
-ssize_t transmitFrame(Flow*                    flow,
-                      const unsigned long long now)
+// ###### Send data frame as sequence of messages ##########################
+static ssize_t sendFrame(Flow*                    flow,
+                         const unsigned long long now,
+                         const uint32_t           frameID,
+                         const size_t             bytesToSend,
+                         const int                sd,
+                         const uint8_t            rpcFlags,
+                         const uint16_t           parameter = 0)
 {
-   // ====== Obtain length of data to send ==================================
-   size_t bytesToSend =
-      (size_t)rint(getRandomValue((const double*)&flow->getTrafficSpec().OutboundFrameSize,
-                                  flow->getTrafficSpec().OutboundFrameSizeRng));
-   if(bytesToSend == 0) {
-      // On POLLOUT, we generate a maximum-sized message. If there is still space
-      // in the buffer, POLLOUT will be set again ...
-      bytesToSend = std::min((size_t)flow->getTrafficSpec().MaxMsgSize, MAXIMUM_MESSAGE_SIZE);
-   }
    ssize_t bytesSent   = 0;
    size_t  packetsSent = 0;
 
-   const uint32_t frameID = flow->nextOutboundFrameID();
    while(bytesSent < (ssize_t)bytesToSend) {
       // ====== Send message ================================================
       size_t chunkSize = std::min(bytesToSend, std::min((size_t)flow->getTrafficSpec().MaxMsgSize,
@@ -188,7 +338,7 @@ ssize_t transmitFrame(Flow*                    flow,
          sendNetPerfMeterData(flow, frameID,
                               (bytesSent == 0),                       // Is frame begin?
                               (bytesSent + chunkSize >= bytesToSend), // Is frame end?
-                              now, chunkSize);
+                              now, chunkSize, sd, rpcFlags, parameter);
 
       // ====== Update statistics ===========================================
       if(sent > 0) {
@@ -206,69 +356,570 @@ ssize_t transmitFrame(Flow*                    flow,
 }
 
 
+// ###### Transmit packet train (UDP probing flow) #########################
+// All packets of the train form one frame. They are prepared in the flow's
+// send buffer and handed to the kernel in batches of sendmmsg() calls, so
+// that they leave back-to-back.
+static ssize_t transmitTrain(Flow* flow, const unsigned long long now)
+{
+   const size_t packets    = flow->getTrafficSpec().TrainLength;
+   size_t       packetSize =
+      (size_t)rint(getRandomValue((const double*)&flow->getTrafficSpec().OutboundFrameSize,
+                                  flow->getTrafficSpec().OutboundFrameSizeRng));
+   packetSize = std::max(packetSize, sizeof(NetPerfMeterDataMessage));
+   packetSize = std::min(packetSize, std::min((size_t)flow->getTrafficSpec().MaxMsgSize,
+                                              MAXIMUM_MESSAGE_SIZE));
+   const size_t batchSize = std::min((size_t)TRAIN_SEND_BATCH_SIZE,
+                                     MAXIMUM_MESSAGE_SIZE / packetSize);
+
+   char*          outputBuffer  = flow->getSendBuffer();
+   const uint32_t frameID       = flow->nextOutboundFrameID();
+   const uint64_t byteSeqNumber = flow->getCurrentBandwidthStats().TransmittedBytes;
+   sockaddr*      remoteAddress = (flow->isRemoteAddressValid()) ?
+                                     (sockaddr*)flow->getRemoteAddress() : NULL;
+   size_t         packetsSent   = 0;
+#ifdef __linux__
+   mmsghdr        msgs[TRAIN_SEND_BATCH_SIZE];
+   iovec          iovs[TRAIN_SEND_BATCH_SIZE];
+#endif
+   while(packetsSent < packets) {
+      // ====== Prepare next batch of the train =============================
+      const size_t first = packetsSent;
+      const size_t count = std::min(batchSize, packets - first);
+      for(size_t i = 0;i < count;i++) {
+         prepareNetPerfMeterData(flow, (NetPerfMeterDataMessage*)&outputBuffer[i * packetSize],
+                                 frameID, (first + i == 0), (first + i + 1 == packets),
+                                 now, packetSize, byteSeqNumber + ((first + i) * packetSize),
+                                 0x00, 0);
+      }
+
+      // ====== Send the batch ==============================================
+#ifdef __linux__
+      for(size_t i = 0;i < count;i++) {
+         iovs[i].iov_base = &outputBuffer[i * packetSize];
+         iovs[i].iov_len  = packetSize;
+         memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+         msgs[i].msg_hdr.msg_iov     = &iovs[i];
+         msgs[i].msg_hdr.msg_iovlen  = 1;
+         msgs[i].msg_hdr.msg_name    = remoteAddress;
+         msgs[i].msg_hdr.msg_namelen = (remoteAddress != NULL) ? getSocklen(remoteAddress) : 0;
+      }
+      size_t batchSent = 0;
+      while(batchSent < count) {
+         const int sent = sendmmsg(flow->getSocketDescriptor(),
+                                   &msgs[batchSent], count - batchSent, 0);
+         if(sent <= 0) {
+            break;
+         }
+         batchSent += sent;
+      }
+#else
+      size_t batchSent = 0;
+      while(batchSent < count) {
+         const ssize_t sent = (remoteAddress != NULL) ?
+            ext_sendto(flow->getSocketDescriptor(),
+                       &outputBuffer[batchSent * packetSize], packetSize, 0,
+                       remoteAddress, getSocklen(remoteAddress)) :
+            ext_send(flow->getSocketDescriptor(),
+                     &outputBuffer[batchSent * packetSize], packetSize, 0);
+         if(sent <= 0) {
+            break;
+         }
+         batchSent++;
+      }
+#endif
+      packetsSent += batchSent;
+      if(batchSent < count) {
+         break;
+      }
+   }
+
+   flow->updateTransmissionStatistics(now, 1, packetsSent, packetsSent * packetSize);
+   return(packetsSent * packetSize);
+}
+
+
+// ###### Transmit data frame ###############################################
+ssize_t transmitFrame(Flow*                    flow,
+                      const unsigned long long now,
+                      const int                sd)
+{
+   // ====== Probing flow: a frame is a packet train ========================
+   if(flow->getTrafficSpec().TrainLength > 1) {
+      return(transmitTrain(flow, now));
+   }
+
+   // ====== Obtain length of data to send ==================================
+   size_t bytesToSend =
+      (size_t)rint(getRandomValue((const double*)&flow->getTrafficSpec().OutboundFrameSize,
+                                  flow->getTrafficSpec().OutboundFrameSizeRng));
+   if(bytesToSend == 0) {
+      // On POLLOUT, we generate a maximum-sized message. If there is still space
+      // in the buffer, POLLOUT will be set again ...
+      bytesToSend = std::min((size_t)flow->getTrafficSpec().MaxMsgSize, MAXIMUM_MESSAGE_SIZE);
+   }
+   return(sendFrame(flow, now, flow->nextOutboundFrameID(), bytesToSend, sd, 0x00));
+}
+
+
+// ###### Transmit frame of given size (trace-driven flow) ##################
+ssize_t transmitTraceFrame(Flow*                    flow,
+                           const unsigned long long now,
+                           const size_t             frameSize)
+{
+   // A frame size of 0 results in a header-only message (minimum size).
+   return(sendFrame(flow, now, flow->nextOutboundFrameID(),
+                    std::max(frameSize, sizeof(NetPerfMeterDataMessage)),
+                    -1, 0x00));
+}
+
+
+// ###### Transmit request or response frame ################################
+// For ABR flows, the request carries the representation index as parameter,
+// and the response is the segment of this representation.
+ssize_t transmitRPCFrame(Flow*                    flow,
+                         const unsigned long long now,
+                         const uint32_t           transactionID,
+                         const uint8_t            rpcFlags,
+                         const uint16_t           parameter)
+{
+   // A frame size of 0 results in a header-only message (minimum size).
+   size_t bytesToSend;
+   if( (rpcFlags & NPMDF_RPC_RESPONSE) && (flow->getTrafficSpec().ABRLadder.size() > 0) ) {
+      bytesToSend = flow->getSegmentSize(parameter);
+   }
+   else {
+      bytesToSend =
+         (size_t)rint(getRandomValue((const double*)&flow->getTrafficSpec().OutboundFrameSize,
+                                     flow->getTrafficSpec().OutboundFrameSizeRng));
+   }
+   return(sendFrame(flow, now, transactionID,
+                    std::max(bytesToSend, sizeof(NetPerfMeterDataMessage)),
+                    -1, rpcFlags, parameter));
+}
+
+
+// ###### Get kernel reception time of the last received datagram ##########
+static unsigned long long getReceptionTime(const int                sd,
+                                           const unsigned long long now)
+{
+#ifdef SIOCGSTAMP
+   timeval tv;
+   if(ioctl(sd, SIOCGSTAMP, &tv) == 0) {
+      return(((unsigned long long)tv.tv_sec * 1000000ULL) + tv.tv_usec);
+   }
+#endif
+   return(now);
+}
+
+
+// ###### Handle a received NETPERFMETER_DATA message of a flow ############
+// A reception time of 0 means that the kernel time stamp has to be queried
+// from the socket, if needed.
+static void handleFlowData(Flow*                          flow,
+                           const unsigned long long       now,
+                           const unsigned long long       receptionTime,
+                           const int                      sd,
+                           const NetPerfMeterDataMessage* dataMsg,
+                           const ssize_t                  received)
+{
+   // Update flow statistics by received NETPERFMETER_DATA message.
+   updateStatistics(flow, now, dataMsg, received);
+
+   // ====== Packet train probing ===========================================
+   if(flow->getTrafficSpec().Probe) {
+      flow->updateTrainStatistics((receptionTime != 0) ? receptionTime :
+                                                         getReceptionTime(sd, now),
+                                  dataMsg, received);
+   }
+
+   // ====== Request/response transactions ==================================
+   if(dataMsg->Header.Flags & NPMDF_FRAME_END) {
+      if(dataMsg->Header.Flags & NPMDF_RPC_REQUEST) {
+         flow->queueRPCResponse(ntohl(dataMsg->FrameID), ntohs(dataMsg->Parameter));
+      }
+      else if(dataMsg->Header.Flags & NPMDF_RPC_RESPONSE) {
+         flow->completeRPCTransaction(ntohl(dataMsg->FrameID), now);
+      }
+   }
+}
+
+
+// ###### Handle a received NetPerfMeter message ###########################
+// A reception time of 0 means that the kernel time stamp has to be queried
+// from the socket, if needed.
+static void processNetPerfMeterMessage(const bool               isActiveMode,
+                                       const unsigned long long now,
+                                       const unsigned long long receptionTime,
+                                       const int                protocol,
+                                       const int                sd,
+                                       const char*              inputBuffer,
+                                       const ssize_t            received,
+                                       const sockaddr_union*    from,
+                                       const sctp_sndrcvinfo*   sinfo)
+{
+   const NetPerfMeterDataMessage*     dataMsg     =
+      (const NetPerfMeterDataMessage*)inputBuffer;
+   const NetPerfMeterIdentifyMessage* identifyMsg =
+      (const NetPerfMeterIdentifyMessage*)inputBuffer;
+
+   // ====== Handle NETPERFMETER_IDENTIFY_FLOW message ======================
+   if( (received >= (ssize_t)sizeof(NetPerfMeterIdentifyMessage)) &&
+       (identifyMsg->Header.Type == NETPERFMETER_IDENTIFY_FLOW) &&
+       (ntoh64(identifyMsg->MagicNumber) == NETPERFMETER_IDENTIFY_FLOW_MAGIC_NUMBER) ) {
+       handleNetPerfMeterIdentify(identifyMsg, sd, from);
+   }
+
+   // ====== Handle NETPERFMETER_DATA message ===============================
+   else if( (received >= (ssize_t)sizeof(NetPerfMeterDataMessage)) &&
+            (dataMsg->Header.Type == NETPERFMETER_DATA) ) {
+      // ====== Identify flow ===============================================
+      Flow* flow;
+      if(( protocol == IPPROTO_UDP) && (!isActiveMode) ) {
+         flow = FlowManager::getFlowManager()->findFlow(&from->sa);
+      }
+      else {
+         flow = FlowManager::getFlowManager()->findFlow(sd, sinfo->sinfo_stream);
+         if( (flow == NULL) && (protocol != IPPROTO_UDP) ) {
+            // Connection churn: the request on a short-lived connection
+            // belongs to the flow given in the message.
+            flow = FlowManager::getFlowManager()->findFlow(ntoh64(dataMsg->MeasurementID),
+                                                           ntohl(dataMsg->FlowID),
+                                                           ntohs(dataMsg->StreamID));
+         }
+      }
+      if(flow) {
+         handleFlowData(flow, now, receptionTime, sd, dataMsg, received);
+      }
+      else {
+         std::cout << "WARNING: Received data for unknown flow!" << std::endl;
+      }
+   }
+   else {
+      std::cout << "WARNING: Received garbage!" << std::endl;
+   }
+}
+
+
+// ###### Handle a NetPerfMeter message received by a UDP worker ###########
+// The worker is locked by the caller. Instead of the FlowManager lock, the
+// flow's own lock protects its statistics and defragmenter; the flow
+// lookup uses the worker's cache.
+static void processWorkerMessage(UDPReceiveWorker*        worker,
+                                 const unsigned long long now,
+                                 const unsigned long long receptionTime,
+                                 const int                sd,
+                                 const char*              inputBuffer,
+                                 const ssize_t            received,
+                                 const sockaddr_union*    from)
+{
+   const NetPerfMeterDataMessage*     dataMsg     =
+      (const NetPerfMeterDataMessage*)inputBuffer;
+   const NetPerfMeterIdentifyMessage* identifyMsg =
+      (const NetPerfMeterIdentifyMessage*)inputBuffer;
+
+   // ====== Handle NETPERFMETER_IDENTIFY_FLOW message ======================
+   if( (received >= (ssize_t)sizeof(NetPerfMeterIdentifyMessage)) &&
+       (identifyMsg->Header.Type == NETPERFMETER_IDENTIFY_FLOW) &&
+       (ntoh64(identifyMsg->MagicNumber) == NETPERFMETER_IDENTIFY_FLOW_MAGIC_NUMBER) ) {
+      // The FlowManager has to be locked before the worker.
+      worker->unlock();
+      FlowManager::getFlowManager()->lock();
+      handleNetPerfMeterIdentify(identifyMsg, sd, from);
+      FlowManager::getFlowManager()->unlock();
+      worker->lock();
+   }
+
+   // ====== Handle NETPERFMETER_DATA message ===============================
+   else if( (received >= (ssize_t)sizeof(NetPerfMeterDataMessage)) &&
+            (dataMsg->Header.Type == NETPERFMETER_DATA) ) {
+      Flow* flow = worker->findFlow(&from->sa);
+      if(flow) {
+         flow->lock();
+         handleFlowData(flow, now, receptionTime, sd, dataMsg, received);
+         flow->unlock();
+      }
+      else {
+         std::cout << "WARNING: Received data for unknown flow!" << std::endl;
+      }
+   }
+   else {
+      std::cout << "WARNING: Received garbage!" << std::endl;
+   }
+}
+
+
+// ###### Handle a NetPerfMeter message received by a receive worker #######
+// Like processWorkerMessage(), but for a socket of the worker's shard.
+static void processShardMessage(ReceiveWorker*           worker,
+                                const unsigned long long now,
+                                const int                sd,
+                                const char*              inputBuffer,
+                                const ssize_t            received,
+                                const sockaddr_union*    from,
+                                const sctp_sndrcvinfo*   sinfo)
+{
+   const NetPerfMeterDataMessage*     dataMsg     =
+      (const NetPerfMeterDataMessage*)inputBuffer;
+   const NetPerfMeterIdentifyMessage* identifyMsg =
+      (const NetPerfMeterIdentifyMessage*)inputBuffer;
+
+   worker->getReceiveStatistics().ReceivedMessages++;
+   worker->getReceiveStatistics().ReceivedBytes += (unsigned long long)received;
+
+   // ====== Handle NETPERFMETER_IDENTIFY_FLOW message ======================
+   // Further streams of an SCTP association are identified here.
+   if( (received >= (ssize_t)sizeof(NetPerfMeterIdentifyMessage)) &&
+       (identifyMsg->Header.Type == NETPERFMETER_IDENTIFY_FLOW) &&
+       (ntoh64(identifyMsg->MagicNumber) == NETPERFMETER_IDENTIFY_FLOW_MAGIC_NUMBER) ) {
+      // The FlowManager has to be locked before the worker.
+      worker->unlock();
+      FlowManager::getFlowManager()->lock();
+      handleNetPerfMeterIdentify(identifyMsg, sd, from);
+      FlowManager::getFlowManager()->unlock();
+      worker->lock();
+   }
+
+   // ====== Handle NETPERFMETER_DATA message ===============================
+   else if( (received >= (ssize_t)sizeof(NetPerfMeterDataMessage)) &&
+            (dataMsg->Header.Type == NETPERFMETER_DATA) ) {
+      Flow* flow = worker->findFlow(sd, sinfo->sinfo_stream);
+      if(flow) {
+         flow->lock();
+         handleFlowData(flow, now, 0, sd, dataMsg, received);
+         flow->unlock();
+      }
+      else if(worker->hasSocket(sd)) {
+         std::cout << "WARNING: Received data for unknown flow!" << std::endl;
+      }
+   }
+   else {
+      std::cout << "WARNING: Received garbage!" << std::endl;
+   }
+}
+
+
+#ifdef __linux__
+// ###### Receive a batch of UDP datagrams ##################################
+// All datagrams queued on the socket (up to UDP_RECEIVE_BATCH_SIZE) are
+// fetched by a single recvmmsg() call and handled with the same time "now".
+// The per-datagram kernel time stamps (SO_TIMESTAMP) are used for the
+// packet train probing. The buffers are kept for the thread's lifetime, and
+// freed when the thread terminates.
+// With UDP_GRO enabled on the socket, a datagram may consist of several
+// coalesced segments of the size given in the UDP_GRO control message
+// (only the last one may be shorter). Each segment is a separate message.
+// For a UDP receive worker, the batch is handled with the worker locked.
+static ssize_t handleNetPerfMeterDataBatch(const bool               isActiveMode,
+                                           const unsigned long long now,
+                                           const int                sd,
+                                           UDPReceiveWorker*        worker = NULL)
+{
+   UDPReceiveBatch* batch = MyUDPReceiveBatch;
+   if(batch == NULL) {
+      batch = new UDPReceiveBatch;
+      batch->Buffer = new char[UDP_RECEIVE_BATCH_SIZE * MAXIMUM_MESSAGE_SIZE];
+      MyUDPReceiveBatch = batch;
+      pthread_once(&UDPReceiveBatchKeyOnce, createUDPReceiveBatchKey);
+      pthread_setspecific(UDPReceiveBatchKey, batch);
+   }
+   for(size_t i = 0;i < UDP_RECEIVE_BATCH_SIZE;i++) {
+      batch->IOVecs[i].iov_base = &batch->Buffer[i * MAXIMUM_MESSAGE_SIZE];
+      batch->IOVecs[i].iov_len  = MAXIMUM_MESSAGE_SIZE;
+      memset(&batch->Messages[i].msg_hdr, 0, sizeof(batch->Messages[i].msg_hdr));
+      batch->Messages[i].msg_hdr.msg_iov        = &batch->IOVecs[i];
+      batch->Messages[i].msg_hdr.msg_iovlen     = 1;
+      batch->Messages[i].msg_hdr.msg_name       = &batch->Addresses[i];
+      batch->Messages[i].msg_hdr.msg_namelen    = sizeof(batch->Addresses[i]);
+      batch->Messages[i].msg_hdr.msg_control    = batch->Control[i];
+      batch->Messages[i].msg_hdr.msg_controllen = sizeof(batch->Control[i]);
+   }
+
+   const int messages = recvmmsg(sd, batch->Messages, UDP_RECEIVE_BATCH_SIZE,
+                                 MSG_DONTWAIT, NULL);
+   if(messages <= 0) {
+      return((messages < 0) ? -1 : 0);
+   }
+   if(worker) {
+      worker->lock();
+   }
+   UDPReceiveStatistics& statistics = (worker != NULL) ? worker->getReceiveStatistics() :
+                                                         gUDPReceiveStatistics;
+   statistics.ReceiveCalls++;
+   statistics.ReceivedDatagrams += (unsigned long long)messages;
+
+   sctp_sndrcvinfo sinfo;
+   sinfo.sinfo_stream = 0;
+   ssize_t totalReceived = 0;
+   for(int i = 0;i < messages;i++) {
+      const msghdr* msg      = &batch->Messages[i].msg_hdr;
+      const ssize_t received = (ssize_t)batch->Messages[i].msg_len;
+      const char*   buffer   = (const char*)batch->IOVecs[i].iov_base;
+      totalReceived += received;
+
+      // ====== Get kernel reception time and GRO segment size ==============
+      unsigned long long receptionTime = now;
+      ssize_t            segmentSize   = received;
+      for(const cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+          cmsg = CMSG_NXTHDR((msghdr*)msg, (cmsghdr*)cmsg)) {
+         if( (cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMP) ) {
+            timeval tv;
+            memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+            receptionTime = ((unsigned long long)tv.tv_sec * 1000000ULL) + tv.tv_usec;
+         }
+#ifdef UDP_GRO
+         else if( (cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO) ) {
+            int gsoSize;
+            memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+            if( (gsoSize > 0) && (gsoSize < received) ) {
+               segmentSize = gsoSize;
+               statistics.CoalescedDatagrams++;
+            }
+         }
+#endif
+      }
+      if(msg->msg_flags & MSG_TRUNC) {
+         std::cout << "WARNING: Received garbage!" << std::endl;
+         continue;
+      }
+
+      // ====== Handle message segments =====================================
+      for(ssize_t offset = 0;offset < received;offset += segmentSize) {
+         const char*   segment = &buffer[offset];
+         const ssize_t length  = std::min(segmentSize, received - offset);
+         const NetPerfMeterHeader* header = (const NetPerfMeterHeader*)segment;
+         statistics.ReceivedSegments++;
+         if( (length < (ssize_t)sizeof(NetPerfMeterHeader)) ||
+             (ntohs(header->Length) != length) ) {
+            std::cout << "WARNING: Received garbage!" << std::endl;
+            continue;
+         }
+         if(worker) {
+            processWorkerMessage(worker, now, receptionTime, sd,
+                                 segment, length, &batch->Addresses[i]);
+         }
+         else {
+            processNetPerfMeterMessage(isActiveMode, now, receptionTime, IPPROTO_UDP, sd,
+                                       segment, length, &batch->Addresses[i], &sinfo);
+         }
+      }
+   }
+   if(worker) {
+      worker->unlock();
+   }
+   return(totalReceived);
+}
+#endif
+
+
+// ###### Get UDP receive statistics ########################################
+void getUDPReceiveStatistics(UDPReceiveStatistics& statistics)
+{
+   statistics = gUDPReceiveStatistics;
+}
+
+
+// ###### Handle data message of a UDP receive worker #######################
+ssize_t handleNetPerfMeterWorkerData(UDPReceiveWorker*        worker,
+                                     const unsigned long long now)
+{
+   const int sd = worker->getSocketDescriptor();
+#ifdef __linux__
+   return(handleNetPerfMeterDataBatch(false, now, sd, worker));
+#else
+   char           inputBuffer[MAXIMUM_MESSAGE_SIZE];
+   sockaddr_union from;
+   socklen_t      fromlen  = sizeof(from);
+   const ssize_t  received = ext_recvfrom(sd, (char*)&inputBuffer, sizeof(inputBuffer),
+                                          MSG_DONTWAIT, &from.sa, &fromlen);
+   if(received > 0) {
+      worker->lock();
+      UDPReceiveStatistics& statistics = worker->getReceiveStatistics();
+      statistics.ReceiveCalls++;
+      statistics.ReceivedDatagrams++;
+      statistics.ReceivedSegments++;
+      processWorkerMessage(worker, now, 0, sd, (const char*)&inputBuffer, received, &from);
+      worker->unlock();
+   }
+   return(received);
+#endif
+}
+
+
 // ###### Handle data message ###############################################
+// A receive worker calls this function for the sockets of its shard, with
+// the worker locked.
 ssize_t handleNetPerfMeterData(const bool               isActiveMode,
                                const unsigned long long now,
                                const int                protocol,
-                               const int                sd)
+                               const int                sd,
+                               ReceiveWorker*           worker)
 {
-   char            inputBuffer[65536];
+#ifdef __linux__
+   if( (protocol == IPPROTO_UDP) && (worker == NULL) &&
+       (FlowManager::getFlowManager()->getMessageReader()->getShmRing(sd) == NULL) ) {
+      return(handleNetPerfMeterDataBatch(isActiveMode, now, sd));
+   }
+#endif
+
+   MessageReader*  messageReader = FlowManager::getFlowManager()->getMessageReader();
+   const char*     inputBuffer;
    sockaddr_union  from;
-   socklen_t       fromlen = sizeof(from);
-   int             flags   = 0;
+   socklen_t       fromlen;
+   int             flags;
    sctp_sndrcvinfo sinfo;
-
-   sinfo.sinfo_stream = 0;
-   const ssize_t received =
-      FlowManager::getFlowManager()->getMessageReader()->receiveMessage(
-         sd, &inputBuffer, sizeof(inputBuffer), &from.sa, &fromlen, &sinfo, &flags);
-
-   if( (received > 0) && (!(flags & MSG_NOTIFICATION)) ) {
-      const NetPerfMeterDataMessage*     dataMsg     =
-         (const NetPerfMeterDataMessage*)&inputBuffer;
-      const NetPerfMeterIdentifyMessage* identifyMsg =
-         (const NetPerfMeterIdentifyMessage*)&inputBuffer;
-
-      // ====== Handle NETPERFMETER_IDENTIFY_FLOW message ===================
-      if( (received >= (ssize_t)sizeof(NetPerfMeterIdentifyMessage)) &&
-          (identifyMsg->Header.Type == NETPERFMETER_IDENTIFY_FLOW) &&
-          (ntoh64(identifyMsg->MagicNumber) == NETPERFMETER_IDENTIFY_FLOW_MAGIC_NUMBER) ) {
-          handleNetPerfMeterIdentify(identifyMsg, sd, &from);
-      }
-
-      // ====== Handle NETPERFMETER_DATA message ============================
-      else if( (received >= (ssize_t)sizeof(NetPerfMeterDataMessage)) &&
-               (dataMsg->Header.Type == NETPERFMETER_DATA) ) {
-         // ====== Identify flow ============================================
-         Flow* flow;
-         if(( protocol == IPPROTO_UDP) && (!isActiveMode) ) {
-            flow = FlowManager::getFlowManager()->findFlow(&from.sa);
+   ssize_t         received;
+
+   // A bulk read of a stream socket may return several messages, which are
+   // all handled here. Each message is a view into the MessageReader's
+   // buffer of the socket.
+   do {
+      fromlen            = sizeof(from);
+      flags              = 0;
+      sinfo.sinfo_stream = 0;
+      received = messageReader->receiveMessageView(sd, &inputBuffer, &from.sa, &fromlen,
+                                                   &sinfo, &flags);
+
+      if( (received > 0) && (!(flags & MSG_NOTIFICATION)) ) {
+         if(protocol == IPPROTO_UDP) {
+            gUDPReceiveStatistics.ReceiveCalls++;
+            gUDPReceiveStatistics.ReceivedDatagrams++;
+            gUDPReceiveStatistics.ReceivedSegments++;
+         }
+         if(worker) {
+            processShardMessage(worker, now, sd, inputBuffer, received, &from, &sinfo);
          }
          else {
-            flow = FlowManager::getFlowManager()->findFlow(sd, sinfo.sinfo_stream);
+            processNetPerfMeterMessage(isActiveMode, now, 0, protocol, sd,
+                                       inputBuffer, received, &from, &sinfo);
+         }
+      }
+
+      else if( (received <= 0) && (received != MRRM_PARTIAL_READ) ) {
+         if(worker) {
+            // The FlowManager has to be locked before the worker.
+            worker->unlock();
+            FlowManager::getFlowManager()->lock();
          }
+         Flow* flow = FlowManager::getFlowManager()->findFlow(sd, sinfo.sinfo_stream);
          if(flow) {
-            // Update flow statistics by received NETPERFMETER_DATA message.
-            updateStatistics(flow, now, dataMsg, received);
+            if(gOutputVerbosity >= NPFOV_CONNECTIONS) {
+               std::cout << "End of input for flow " <<  flow->getFlowID() << std::endl;
+            }
+            flow->endOfInput();
          }
-         else {
-            std::cout << "WARNING: Received data for unknown flow!" << std::endl;
+         if(worker) {
+            FlowManager::getFlowManager()->unlock();
+            worker->lock();
          }
       }
-      else {
-         std::cout << "WARNING: Received garbage!" << std::endl;
-      }
-   }
 
-   else if( (received <= 0) && (received != MRRM_PARTIAL_READ) ) {
-      Flow* flow = FlowManager::getFlowManager()->findFlow(sd, sinfo.sinfo_stream);
-      if(flow) {
-         if(gOutputVerbosity >= NPFOV_CONNECTIONS) {
-            std::cout << "End of input for flow " <<  flow->getFlowID() << std::endl;
-         }
-         flow->endOfInput();
+      // A worker's socket may have been taken away while the worker was
+      // unlocked. Then, its MessageReader entry must not be used any more.
+      if( (worker != NULL) && (!worker->hasSocket(sd)) ) {
+         break;
       }
-   }
+   } while( (received > 0) && (messageReader->hasBufferedMessage(sd)) );
 
    return(received);
 }
@@ -29,12 +29,39 @@
 #include <sys/types.h>
 
 
+class UDPReceiveWorker;
+class ReceiveWorker;
+
+// Counters of the UDP reception path
+struct UDPReceiveStatistics {
+   unsigned long long ReceiveCalls;
+   unsigned long long ReceivedDatagrams;
+   unsigned long long ReceivedSegments;
+   unsigned long long CoalescedDatagrams;
+};
+
+
 ssize_t transmitFrame(Flow*                    flow,
-                      const unsigned long long now);
+                      const unsigned long long now,
+                      const int                sd = -1);
+ssize_t transmitTraceFrame(Flow*                    flow,
+                           const unsigned long long now,
+                           const size_t             frameSize);
+ssize_t transmitRPCFrame(Flow*                    flow,
+                         const unsigned long long now,
+                         const uint32_t           transactionID,
+                         const uint8_t            rpcFlags,
+                         const uint16_t           parameter = 0);
+void releaseImpairedDatagrams(Flow*                    flow,
+                              const unsigned long long now);
 
 ssize_t handleNetPerfMeterData(const bool               isActiveMode,
                                const unsigned long long now,
                                const int                protocol,
-                               const int                sd);
+                               const int                sd,
+                               ReceiveWorker*           worker = NULL);
+ssize_t handleNetPerfMeterWorkerData(UDPReceiveWorker*        worker,
+                                     const unsigned long long now);
+void getUDPReceiveStatistics(UDPReceiveStatistics& statistics);
 
 #endif
@@ -0,0 +1,217 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "flow.h"
+#include "transfer.h"
+#include "tools.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <netinet/udp.h>
+#include <iostream>
+#include <vector>
+
+
+// Compares the passive node's UDP receive path with and without UDP_GRO.
+// A local sender transmits NETPERFMETER_DATA messages as UDP_SEGMENT
+// (GSO) datagrams over the loopback interface. Without UDP_GRO, the kernel
+// delivers each segment as a separate datagram; with UDP_GRO, the receiver
+// gets the coalesced datagrams and handleNetPerfMeterData() splits them.
+// Only the reception is timed: each round's datagrams are queued on the
+// socket before they are received, like a backlog after a traffic burst.
+
+#define SEGMENT_SIZE           1000
+#define SEGMENTS_PER_SEND      32
+#define SENDS_PER_ROUND        32
+#define ROUNDS                 200
+#define RECEIVE_BUFFER_SIZE    (16 * 1024 * 1024)
+#define BENCHMARK_MEASUREMENT  0x1234567890abcdefULL
+
+MessageReader gMessageReader;
+
+
+// ###### Create UDP socket bound to the loopback address ###################
+static int createLoopbackSocket(sockaddr_union& address)
+{
+   const int sd = ext_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+   if(sd < 0) {
+      std::cerr << "ERROR: Unable to create UDP socket - "
+                << strerror(errno) << "!" << std::endl;
+      exit(1);
+   }
+   memset(&address, 0, sizeof(address));
+   address.in.sin_family      = AF_INET;
+   address.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   socklen_t addressLength = sizeof(address.in);
+   if( (ext_bind(sd, &address.sa, addressLength) < 0) ||
+       (ext_getsockname(sd, &address.sa, &addressLength) < 0) ) {
+      std::cerr << "ERROR: Unable to bind UDP socket - "
+                << strerror(errno) << "!" << std::endl;
+      exit(1);
+   }
+   return(sd);
+}
+
+
+// ###### Send a round of GSO datagrams #####################################
+static void sendRound(const int       sd,
+                      const uint64_t  firstSeqNumber,
+                      char*           buffer)
+{
+   for(unsigned int s = 0;s < SENDS_PER_ROUND;s++) {
+      // ====== Build the segments ==========================================
+      for(unsigned int i = 0;i < SEGMENTS_PER_SEND;i++) {
+         const uint64_t seqNumber = firstSeqNumber + (s * SEGMENTS_PER_SEND) + i;
+         NetPerfMeterDataMessage* dataMsg =
+            (NetPerfMeterDataMessage*)&buffer[i * SEGMENT_SIZE];
+         memset(dataMsg, 0, sizeof(NetPerfMeterDataMessage));
+         dataMsg->Header.Type   = NETPERFMETER_DATA;
+         dataMsg->Header.Flags  = NPMDF_FRAME_BEGIN|NPMDF_FRAME_END;
+         dataMsg->Header.Length = htons(SEGMENT_SIZE);
+         dataMsg->MeasurementID = hton64(BENCHMARK_MEASUREMENT);
+         dataMsg->FrameID       = htonl((uint32_t)seqNumber);
+         dataMsg->SeqNumber     = hton64(seqNumber);
+         dataMsg->ByteSeqNumber = hton64(seqNumber * SEGMENT_SIZE);
+         dataMsg->TimeStamp     = hton64(getMicroTime());
+      }
+
+      // ====== Send them as one GSO datagram ===============================
+      iovec  iov;
+      iov.iov_base = buffer;
+      iov.iov_len  = SEGMENTS_PER_SEND * SEGMENT_SIZE;
+      char   control[CMSG_SPACE(sizeof(uint16_t))];
+      msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      memset(&control, 0, sizeof(control));
+      msg.msg_iov        = &iov;
+      msg.msg_iovlen     = 1;
+      msg.msg_control    = control;
+      msg.msg_controllen = sizeof(control);
+      cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type  = UDP_SEGMENT;
+      cmsg->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+      const uint16_t segmentSize = SEGMENT_SIZE;
+      memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+      if(sendmsg(sd, &msg, 0) < 0) {
+         std::cerr << "ERROR: Unable to send GSO datagram - "
+                   << strerror(errno) << "!" << std::endl;
+         exit(1);
+      }
+   }
+}
+
+
+// ###### Measure the receive path ##########################################
+static void runBenchmark(const bool gro)
+{
+   FlowManager* flowManager = FlowManager::getFlowManager();
+
+   // ====== Create sockets =================================================
+   sockaddr_union receiverAddress;
+   sockaddr_union senderAddress;
+   const int receiverSD = createLoopbackSocket(receiverAddress);
+   const int senderSD   = createLoopbackSocket(senderAddress);
+   if(ext_connect(senderSD, &receiverAddress.sa, sizeof(receiverAddress.in)) < 0) {
+      std::cerr << "ERROR: Unable to connect UDP socket - "
+                << strerror(errno) << "!" << std::endl;
+      exit(1);
+   }
+   const int on         = 1;
+   const int bufferSize = RECEIVE_BUFFER_SIZE;
+   if( (ext_setsockopt(receiverSD, SOL_SOCKET, SO_RCVBUFFORCE, &bufferSize, sizeof(bufferSize)) < 0) &&
+       (ext_setsockopt(receiverSD, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize)) < 0) ) {
+      std::cerr << "WARNING: Unable to set receive buffer size - "
+                << strerror(errno) << "!" << std::endl;
+   }
+   ext_setsockopt(receiverSD, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on));
+   if( (gro) &&
+       (ext_setsockopt(receiverSD, SOL_UDP, UDP_GRO, &on, sizeof(on)) < 0) ) {
+      std::cerr << "ERROR: Unable to enable UDP_GRO - "
+                << strerror(errno) << "!" << std::endl;
+      exit(1);
+   }
+
+   // ====== Create flow ====================================================
+   // Like on the passive node, the flow is found by its source address.
+   FlowTrafficSpec trafficSpec;
+   trafficSpec.Protocol = IPPROTO_UDP;
+   Flow* flow = new Flow(BENCHMARK_MEASUREMENT, 0, 0, trafficSpec, STDIN_FILENO);
+   int controlSocketDescriptor;
+   if(flowManager->identifySocket(BENCHMARK_MEASUREMENT, 0, 0,
+                                  receiverSD, &senderAddress, OFF_None,
+                                  controlSocketDescriptor) != flow) {
+      std::cerr << "ERROR: Unable to identify flow!" << std::endl;
+      exit(1);
+   }
+
+   // ====== Send and receive ===============================================
+   UDPReceiveStatistics before;
+   UDPReceiveStatistics after;
+   getUDPReceiveStatistics(before);
+   std::vector<char>  buffer(SEGMENTS_PER_SEND * SEGMENT_SIZE);
+   unsigned long long receiveTime = 0;
+   for(unsigned int round = 0;round < ROUNDS;round++) {
+      sendRound(senderSD, (uint64_t)round * SENDS_PER_ROUND * SEGMENTS_PER_SEND,
+                buffer.data());
+
+      const unsigned long long t1 = getMicroTime();
+      flowManager->lock();
+      while(handleNetPerfMeterData(false, t1, IPPROTO_UDP, receiverSD) > 0) {
+      }
+      flowManager->unlock();
+      receiveTime += getMicroTime() - t1;
+   }
+   getUDPReceiveStatistics(after);
+
+   // ====== Print results ==================================================
+   const unsigned long long sent       = (unsigned long long)ROUNDS * SENDS_PER_ROUND * SEGMENTS_PER_SEND;
+   const unsigned long long segments   = after.ReceivedSegments - before.ReceivedSegments;
+   const unsigned long long datagrams  = after.ReceivedDatagrams - before.ReceivedDatagrams;
+   const unsigned long long calls      = after.ReceiveCalls - before.ReceiveCalls;
+   const unsigned long long coalesced  = after.CoalescedDatagrams - before.CoalescedDatagrams;
+   std::cout << format("%-6s %6.1f ns/segment, %8llu segments (%llu lost), "
+                       "%7llu datagrams (%llu coalesced), %6llu recvmmsg() calls",
+                       (gro == true) ? "GRO:" : "Plain:",
+                       (segments > 0) ? 1000.0 * receiveTime / segments : 0.0,
+                       segments, sent - segments,
+                       datagrams, coalesced, calls)
+             << std::endl;
+
+   // ====== Clean up =======================================================
+   delete flow;
+   ext_close(senderSD);
+   ext_close(receiverSD);
+}
+
+
+// ###### Main program ######################################################
+int main(int argc, char** argv)
+{
+   std::cout << "UDP receive path, " << ROUNDS << " rounds of "
+             << SENDS_PER_ROUND << " GSO datagrams with " << SEGMENTS_PER_SEND
+             << " segments of " << SEGMENT_SIZE << " bytes:" << std::endl;
+   runBenchmark(false);
+   runBenchmark(true);
+   return(0);
+}
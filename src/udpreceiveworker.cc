@@ -0,0 +1,120 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#include "udpreceiveworker.h"
+
+#include <poll.h>
+#include <signal.h>
+
+
+// ###### Constructor #######################################################
+UDPReceiveWorker::UDPReceiveWorker(const unsigned int workerID,
+                                   const int          socketDescriptor)
+   : WorkerID(workerID),
+     SocketDescriptor(socketDescriptor)
+{
+   memset(&Statistics, 0, sizeof(Statistics));
+}
+
+
+// ###### Destructor ########################################################
+UDPReceiveWorker::~UDPReceiveWorker()
+{
+}
+
+
+// ###### Get copy of the receive statistics ################################
+void UDPReceiveWorker::getReceiveStatistics(UDPReceiveStatistics& statistics)
+{
+   lock();
+   statistics = Statistics;
+   unlock();
+}
+
+
+// ###### Find flow by source address #######################################
+Flow* UDPReceiveWorker::findFlow(const sockaddr* from)
+{
+   FlowManager::AddressKey key;
+   if(!FlowManager::getAddressKey(from, key)) {
+      return(NULL);
+   }
+
+   // ====== Look up the worker's cache =====================================
+   std::unordered_map<FlowManager::AddressKey, Flow*,
+                      FlowManager::AddressKeyHash>::const_iterator found =
+      FlowCache.find(key);
+   if(found != FlowCache.end()) {
+      return(found->second);
+   }
+
+   // ====== Cache miss: ask the FlowManager ================================
+   // The FlowManager has to be locked before the worker. The FlowManager
+   // lock is kept until the flow is in the cache, so that a concurrent
+   // FlowManager::removeFlow() cannot leave a stale entry.
+   unlock();
+   FlowManager::getFlowManager()->lock();
+   lock();
+   Flow* flow = FlowManager::getFlowManager()->findFlow(from);
+   if(flow != NULL) {
+      FlowCache.insert(std::pair<FlowManager::AddressKey, Flow*>(key, flow));
+   }
+   FlowManager::getFlowManager()->unlock();
+   return(flow);
+}
+
+
+// ###### Remove flow from the cache ########################################
+// Called by the FlowManager, with the FlowManager locked.
+void UDPReceiveWorker::forgetFlow(const FlowManager::AddressKey& key, Flow* flow)
+{
+   lock();
+   std::unordered_map<FlowManager::AddressKey, Flow*,
+                      FlowManager::AddressKeyHash>::iterator found =
+      FlowCache.find(key);
+   if( (found != FlowCache.end()) && (found->second == flow) ) {
+      FlowCache.erase(found);
+   }
+   unlock();
+}
+
+
+// ###### Receive thread ####################################################
+void UDPReceiveWorker::run()
+{
+   signal(SIGPIPE, SIG_IGN);
+
+   pollfd pfd;
+   pfd.fd     = SocketDescriptor;
+   pfd.events = POLLIN;
+   do {
+      // The timeout ensures that a stop request is noticed.
+      pfd.revents = 0;
+      const int result = ext_poll_wrapper(&pfd, 1, 250);
+      updateCurrentCPU();
+      prefaultStack();   // Only does something when prefaulting is requested
+      if( (result > 0) && (pfd.revents & POLLIN) ) {
+         handleNetPerfMeterWorkerData(this, getMicroTime());
+      }
+   } while(!isStopping());
+}
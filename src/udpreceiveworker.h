@@ -0,0 +1,74 @@
+/*
+ * ==========================================================================
+ *                  NetPerfMeter -- Network Performance Meter                 
+ *                 Copyright (C) 2009-2018 by Thomas Dreibholz
+ * ==========================================================================
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Contact:  dreibh@iem.uni-due.de
+ * Homepage: https://www.uni-due.de/~be0001/netperfmeter/
+ */
+
+#ifndef UDPRECEIVEWORKER_H
+#define UDPRECEIVEWORKER_H
+
+#include "thread.h"
+#include "flow.h"
+#include "transfer.h"
+
+#include <unordered_map>
+
+
+// A receive thread for one of the SO_REUSEPORT UDP sockets of the passive
+// side. The kernel distributes the incoming datagrams among the sockets,
+// so each worker only sees a subset of the flows. Flows are looked up in
+// the worker's own cache, which is filled from the FlowManager upon a miss.
+// Lock order: FlowManager -> UDPReceiveWorker -> Flow.
+class UDPReceiveWorker : public Thread
+{
+   // ====== Methods ========================================================
+   public:
+   UDPReceiveWorker(const unsigned int workerID,
+                    const int          socketDescriptor);
+   virtual ~UDPReceiveWorker();
+
+   inline unsigned int getWorkerID() const {
+      return(WorkerID);
+   }
+   inline int getSocketDescriptor() const {
+      return(SocketDescriptor);
+   }
+   inline UDPReceiveStatistics& getReceiveStatistics() {   // Worker must be locked!
+      return(Statistics);
+   }
+   void getReceiveStatistics(UDPReceiveStatistics& statistics);
+
+   Flow* findFlow(const sockaddr* from);   // Worker must be locked!
+   void forgetFlow(const FlowManager::AddressKey& key, Flow* flow);
+
+   // ====== Protected Methods ==============================================
+   protected:
+   void run();
+
+   // ====== Private Data ===================================================
+   private:
+   const unsigned int   WorkerID;
+   const int            SocketDescriptor;
+   UDPReceiveStatistics Statistics;
+   std::unordered_map<FlowManager::AddressKey, Flow*,
+                      FlowManager::AddressKeyHash> FlowCache;
+};
+
+#endif